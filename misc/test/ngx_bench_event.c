@@ -0,0 +1,250 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * The event loop over many idle connections: batches of read events of
+ * randomly chosen connections are marked ready and posted the way
+ * ngx_epoll_process_events() does with NGX_POST_EVENTS, and then run by
+ * ngx_event_process_posted(); the handler touches the connection fields
+ * used on every request.  The connection and event arrays are allocated
+ * as in ngx_event_process_init(), up to 1M connections.
+ *
+ * The epoll_wait() call itself is not included: it needs a descriptor
+ * per connection.  Where perf_event_open() is permitted, the cache
+ * misses per event are reported too.
+ *
+ *     ngx_bench_event [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_test.h>
+
+#if (NGX_LINUX)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+
+#define NGX_BENCH_EVENT_CONNECTIONS  (1024 * 1024)
+#define NGX_BENCH_EVENT_BATCH        512
+
+
+static void ngx_bench_event_run(ngx_uint_t n);
+static void ngx_bench_event_handler(ngx_event_t *ev);
+static int ngx_bench_event_perf_open(void);
+static uint64_t ngx_bench_event_perf_read(int fd);
+
+
+static ngx_cycle_t   ngx_bench_event_cycle;
+static uint32_t     *ngx_bench_event_order;
+static uint64_t      ngx_bench_event_handled;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    ngx_uint_t  n;
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 10000000;
+    }
+
+    ngx_bench_event_cycle.log = ngx_test_log;
+
+    ngx_queue_init(&ngx_posted_events);
+
+    ngx_bench_event_order = ngx_alloc(NGX_BENCH_EVENT_CONNECTIONS
+                                      * sizeof(uint32_t), ngx_test_log);
+    if (ngx_bench_event_order == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    printf("    connection %lu, event %lu bytes, batch %d\n",
+           (unsigned long) sizeof(ngx_connection_t),
+           (unsigned long) sizeof(ngx_event_t), NGX_BENCH_EVENT_BATCH);
+
+    for (n = 4096; n <= NGX_BENCH_EVENT_CONNECTIONS; n *= 16) {
+        ngx_bench_event_run(n);
+    }
+
+    ngx_free(ngx_bench_event_order);
+
+    return 0;
+}
+
+
+static void
+ngx_bench_event_run(ngx_uint_t n)
+{
+    int                fd;
+    char               name[64];
+    uint32_t           t;
+    uint64_t           i, start, nsec, misses;
+    ngx_uint_t         k, j, b;
+    ngx_event_t       *rev, *wev;
+    ngx_connection_t  *c;
+
+    /* the same as ngx_event_process_init() */
+
+    c = ngx_memalign(NGX_CPU_CACHE_LINE, sizeof(ngx_connection_t) * n,
+                     ngx_test_log);
+    rev = ngx_memalign(NGX_CPU_CACHE_LINE, sizeof(ngx_event_t) * n,
+                       ngx_test_log);
+    wev = ngx_memalign(NGX_CPU_CACHE_LINE, sizeof(ngx_event_t) * n,
+                       ngx_test_log);
+
+    if (c == NULL || rev == NULL || wev == NULL) {
+        ngx_test_fail("ngx_memalign() failed");
+    }
+
+    ngx_memzero(c, sizeof(ngx_connection_t) * n);
+    ngx_memzero(rev, sizeof(ngx_event_t) * n);
+    ngx_memzero(wev, sizeof(ngx_event_t) * n);
+
+    for (k = 0; k < n; k++) {
+        c[k].read = &rev[k];
+        c[k].write = &wev[k];
+        c[k].fd = (ngx_socket_t) k;
+        c[k].log = ngx_test_log;
+
+        rev[k].data = &c[k];
+        rev[k].log = ngx_test_log;
+        rev[k].index = NGX_INVALID_INDEX;
+        rev[k].handler = ngx_bench_event_handler;
+        rev[k].active = 1;
+
+        wev[k].data = &c[k];
+        wev[k].log = ngx_test_log;
+        wev[k].index = NGX_INVALID_INDEX;
+        wev[k].write = 1;
+
+        ngx_bench_event_order[k] = k;
+    }
+
+    for (k = n - 1; k > 0; k--) {
+        j = ngx_test_random() % (k + 1);
+        t = ngx_bench_event_order[k];
+        ngx_bench_event_order[k] = ngx_bench_event_order[j];
+        ngx_bench_event_order[j] = t;
+    }
+
+    ngx_bench_event_handled = 0;
+
+    fd = ngx_bench_event_perf_open();
+    misses = ngx_bench_event_perf_read(fd);
+
+    start = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; /* void */) {
+
+        /* the part of ngx_epoll_process_events() that touches events */
+
+        for (b = 0; b < NGX_BENCH_EVENT_BATCH; b++, i++) {
+            k = ngx_bench_event_order[i % n];
+
+            if (c[k].fd == (ngx_socket_t) -1 || c[k].read->instance) {
+                continue;
+            }
+
+            if (c[k].read->active) {
+                c[k].read->ready = 1;
+                c[k].read->available = -1;
+
+                ngx_post_event(c[k].read, &ngx_posted_events);
+            }
+        }
+
+        ngx_event_process_posted(&ngx_bench_event_cycle, &ngx_posted_events);
+    }
+
+    nsec = ngx_test_nsec() - start;
+    misses = ngx_bench_event_perf_read(fd) - misses;
+
+    if (ngx_bench_event_handled != i) {
+        ngx_test_fail("%uL handlers called", ngx_bench_event_handled);
+    }
+
+    ngx_sprintf((u_char *) name, "%ui connections%Z", n);
+    ngx_test_report(name, i, nsec);
+
+    if (fd != -1) {
+        printf("    %-40s %12.2f cache misses/op\n", "",
+               (double) misses / i);
+        (void) close(fd);
+    }
+
+    ngx_free(c);
+    ngx_free(rev);
+    ngx_free(wev);
+}
+
+
+static void
+ngx_bench_event_handler(ngx_event_t *ev)
+{
+    ngx_connection_t  *c;
+
+    c = ev->data;
+
+    /* the fields used by ngx_http_wait_request_handler() and alike */
+
+    if (c->destroyed || c->close || ev->timedout || c->buffer) {
+        ngx_test_fail("unexpected connection state");
+    }
+
+    c->requests++;
+    c->idle = 0;
+    c->log->action = NULL;
+
+    if (ev->timer_set) {
+        ngx_test_fail("unexpected timer");
+    }
+
+    ev->ready = 0;
+
+    ngx_bench_event_handled++;
+}
+
+
+static int
+ngx_bench_event_perf_open(void)
+{
+#if (NGX_LINUX)
+    struct perf_event_attr  attr;
+
+    ngx_memzero(&attr, sizeof(struct perf_event_attr));
+
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(struct perf_event_attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+
+static uint64_t
+ngx_bench_event_perf_read(int fd)
+{
+    uint64_t  n;
+
+    if (fd == -1 || read(fd, &n, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        return 0;
+    }
+
+    return n;
+}
@@ -0,0 +1,155 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Lookups of typical request header names, some of them unknown,
+ * in the known request headers with ngx_hash_find() and with
+ * ngx_hash_find_perfect().
+ *
+ *     ngx_bench_hash_perfect [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+static ngx_str_t  ngx_bench_hash_perfect_names[] = {
+    ngx_string("host"),
+    ngx_string("user-agent"),
+    ngx_string("accept"),
+    ngx_string("accept-language"),
+    ngx_string("accept-encoding"),
+    ngx_string("referer"),
+    ngx_string("cookie"),
+    ngx_string("connection"),
+    ngx_string("content-type"),
+    ngx_string("content-length"),
+    ngx_string("if-modified-since"),
+    ngx_string("x-forwarded-for"),
+    ngx_string("upgrade-insecure-requests"),
+    ngx_string("sec-fetch-mode"),
+    ngx_string("cache-control"),
+    ngx_string("x-request-id")
+};
+
+#define NGX_BENCH_HASH_PERFECT_NAMES                                          \
+    (sizeof(ngx_bench_hash_perfect_names) / sizeof(ngx_str_t))
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    uint64_t             i, start, hash, perfect;
+    ngx_str_t           *name;
+    ngx_uint_t           n, k, found;
+    ngx_pool_t          *pool;
+    ngx_array_t          headers_in;
+    ngx_hash_t           headers_in_hash;
+    ngx_hash_key_t      *hk;
+    ngx_hash_init_t      hinit;
+    ngx_http_header_t   *header;
+    ngx_hash_perfect_t   headers_in_perfect_hash;
+    ngx_uint_t           keys[NGX_BENCH_HASH_PERFECT_NAMES];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 50000000;
+    }
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+    if (pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    /* the same as ngx_http_init_headers_in_hash() */
+
+    if (ngx_array_init(&headers_in, pool, 32, sizeof(ngx_hash_key_t))
+        != NGX_OK)
+    {
+        ngx_test_fail("ngx_array_init() failed");
+    }
+
+    for (header = ngx_http_headers_in; header->name.len; header++) {
+        hk = ngx_array_push(&headers_in);
+        if (hk == NULL) {
+            ngx_test_fail("ngx_array_push() failed");
+        }
+
+        hk->key = header->name;
+        hk->key_hash = ngx_hash_key_lc(header->name.data, header->name.len);
+        hk->value = header;
+    }
+
+    hinit.hash = &headers_in_hash;
+    hinit.key = ngx_hash_key_lc;
+    hinit.max_size = 512;
+    hinit.bucket_size = ngx_align(64, ngx_cacheline_size);
+    hinit.name = "headers_in_hash";
+    hinit.pool = pool;
+    hinit.temp_pool = NULL;
+
+    if (ngx_hash_init(&hinit, headers_in.elts, headers_in.nelts) != NGX_OK) {
+        ngx_test_fail("ngx_hash_init() failed");
+    }
+
+    if (ngx_hash_perfect_init(&headers_in_perfect_hash, &headers_in_hash,
+                              headers_in.elts, headers_in.nelts, 1024, pool)
+        != NGX_OK)
+    {
+        ngx_test_fail("ngx_hash_perfect_init() failed");
+    }
+
+    for (n = 0; n < NGX_BENCH_HASH_PERFECT_NAMES; n++) {
+        name = &ngx_bench_hash_perfect_names[n];
+        keys[n] = ngx_hash_key(name->data, name->len);
+    }
+
+    found = 0;
+    start = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        k = i % NGX_BENCH_HASH_PERFECT_NAMES;
+        name = &ngx_bench_hash_perfect_names[k];
+
+        if (ngx_hash_find(&headers_in_hash, keys[k], name->data, name->len)) {
+            found++;
+        }
+    }
+
+    hash = ngx_test_nsec() - start;
+
+    start = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        k = i % NGX_BENCH_HASH_PERFECT_NAMES;
+        name = &ngx_bench_hash_perfect_names[k];
+
+        if (ngx_hash_find_perfect(&headers_in_perfect_hash, keys[k],
+                                  name->data, name->len))
+        {
+            found--;
+        }
+    }
+
+    perfect = ngx_test_nsec() - start;
+
+    if (found != 0) {
+        ngx_test_fail("results differ");
+    }
+
+    ngx_test_report("ngx_hash_find()", ngx_test_iterations, hash);
+    ngx_test_report("ngx_hash_find_perfect()", ngx_test_iterations, perfect);
+
+    ngx_destroy_pool(pool);
+
+    return 0;
+}
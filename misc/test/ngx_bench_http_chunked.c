@@ -0,0 +1,164 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * 1 MB chunked bodies with different chunk sizes and extension lengths
+ * are parsed by ngx_http_parse_chunked() with the SSE2 line scanner and
+ * by the scalar one; an operation is a whole body.
+ *
+ *     ngx_bench_http_chunked [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+#include <ngx_http_parse_scalar.h>
+
+
+#define NGX_BENCH_HTTP_CHUNKED_BODY  (1024 * 1024)
+
+
+typedef ngx_int_t (*ngx_bench_http_chunked_pt)(ngx_http_request_t *r,
+    ngx_buf_t *b, ngx_http_chunked_t *ctx);
+
+
+static void ngx_bench_http_chunked_run(size_t size, size_t ext);
+static uint64_t ngx_bench_http_chunked_parse(ngx_bench_http_chunked_pt parse,
+    u_char *start, u_char *end);
+
+
+static ngx_connection_t    ngx_bench_http_chunked_connection;
+static ngx_http_request_t  ngx_bench_http_chunked_request;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 100;
+    }
+
+    ngx_bench_http_chunked_connection.log = ngx_test_log;
+    ngx_bench_http_chunked_request.connection =
+                                         &ngx_bench_http_chunked_connection;
+
+    ngx_bench_http_chunked_run(16, 0);
+    ngx_bench_http_chunked_run(100, 0);
+    ngx_bench_http_chunked_run(8192, 0);
+    ngx_bench_http_chunked_run(8192, 80);
+
+    return 0;
+}
+
+
+static void
+ngx_bench_http_chunked_run(size_t size, size_t ext)
+{
+    char      name[64];
+    u_char   *start, *p, *last;
+    size_t    len;
+    uint64_t  sse2, scalar;
+
+    len = NGX_BENCH_HTTP_CHUNKED_BODY / size * (size + ext + 32) + 64;
+
+    start = ngx_alloc(len, ngx_test_log);
+    if (start == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    p = start;
+
+    for (len = 0; len < NGX_BENCH_HTTP_CHUNKED_BODY; len += size) {
+        p = ngx_sprintf(p, "%xz", size);
+
+        if (ext) {
+            *p++ = ';';
+            p = ngx_cpymem(p, "sig=", 4);
+            ngx_memset(p, 'a', ext - 4);
+            p += ext - 4;
+        }
+
+        *p++ = CR; *p++ = LF;
+
+        ngx_memset(p, 'x', size);
+        p += size;
+
+        *p++ = CR; *p++ = LF;
+    }
+
+    last = ngx_cpymem(p, "0" CRLF CRLF, 5);
+
+    sse2 = ngx_bench_http_chunked_parse(ngx_http_parse_chunked, start, last);
+    scalar = ngx_bench_http_chunked_parse(ngx_http_parse_chunked_scalar,
+                                          start, last);
+
+    ngx_sprintf((u_char *) name, "%uz byte chunks, %uz byte ext, sse2%Z",
+                size, ext);
+    ngx_test_report(name, ngx_test_iterations, sse2);
+
+    ngx_sprintf((u_char *) name, "%uz byte chunks, %uz byte ext, scalar%Z",
+                size, ext);
+    ngx_test_report(name, ngx_test_iterations, scalar);
+
+    ngx_free(start);
+}
+
+
+static uint64_t
+ngx_bench_http_chunked_parse(ngx_bench_http_chunked_pt parse, u_char *start,
+    u_char *end)
+{
+    size_t               size;
+    uint64_t             i, begin;
+    ngx_int_t            rc;
+    ngx_buf_t            b;
+    ngx_http_chunked_t   ctx;
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    begin = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+
+        b.pos = start;
+        b.last = end;
+
+        ngx_memzero(&ctx, sizeof(ngx_http_chunked_t));
+
+        for ( ;; ) {
+            rc = parse(&ngx_bench_http_chunked_request, &b, &ctx);
+
+            if (rc != NGX_OK) {
+                break;
+            }
+
+            /* the same as ngx_http_request_body_chunked_filter() */
+
+            size = b.last - b.pos;
+
+            if ((off_t) size > ctx.size) {
+                b.pos += (size_t) ctx.size;
+                ctx.size = 0;
+
+            } else {
+                ctx.size -= size;
+                b.pos = b.last;
+            }
+        }
+
+        if (rc != NGX_DONE || b.pos != end) {
+            ngx_test_fail("body not parsed: %i", rc);
+        }
+    }
+
+    return ngx_test_nsec() - begin;
+}
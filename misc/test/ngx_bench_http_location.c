@@ -0,0 +1,324 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Static location lookups with the radix trie and with the previous
+ * binary tree.  The locations are paths of common words, a fifth of them
+ * exact, a third with the trailing slash and half of those with
+ * auto_redirect; the URIs are the names, the names with a file name or
+ * an extension, without the last character or with a character of the
+ * other case, and misses.  An operation is a lookup.
+ *
+ *     ngx_bench_http_location [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+#include <ngx_http_location_tree.h>
+
+
+#define NGX_BENCH_HTTP_LOCATION_NAME  128
+
+
+typedef struct {
+    ngx_http_location_trie_t        *trie;
+    ngx_http_location_tree_node_t   *tree;
+    ngx_str_t                       *names;
+    ngx_uint_t                       nelts;
+    ngx_str_t                       *uris;
+    ngx_uint_t                       nuris;
+} ngx_bench_http_location_t;
+
+
+static void ngx_bench_http_location_run(ngx_uint_t locations,
+    ngx_uint_t uris);
+static void ngx_bench_http_location_conf(ngx_bench_http_location_t *l,
+    ngx_pool_t *pool);
+static void ngx_bench_http_location_uris(ngx_bench_http_location_t *l,
+    ngx_pool_t *pool);
+
+
+static char  *ngx_bench_http_location_words[] = {
+    "api", "v1", "v2", "users", "orders", "static", "images", "img", "css",
+    "js", "assets", "media", "download", "uploads", "admin", "login",
+    "account", "search", "cart", "products", "catalog", "blog", "news",
+    "docs", "help", "status", "health", "metrics", "internal", "files"
+};
+
+#define NGX_BENCH_HTTP_LOCATION_WORDS                                         \
+    (sizeof(ngx_bench_http_location_words) / sizeof(char *))
+
+
+static ngx_connection_t    ngx_bench_http_location_connection;
+static ngx_http_request_t  ngx_bench_http_location_request;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 10000000;
+    }
+
+    ngx_bench_http_location_connection.log = ngx_test_log;
+    ngx_bench_http_location_request.connection =
+                                          &ngx_bench_http_location_connection;
+
+    ngx_bench_http_location_run(3000, 100000);
+    ngx_bench_http_location_run(3000, 2000);
+    ngx_bench_http_location_run(300, 2000);
+
+    return 0;
+}
+
+
+static void
+ngx_bench_http_location_run(ngx_uint_t locations, ngx_uint_t uris)
+{
+    char                        name[64];
+    uint64_t                    i, start, trie, tree;
+    ngx_int_t                   rc;
+    ngx_str_t                  *uri;
+    ngx_pool_t                 *pool;
+    ngx_http_request_t         *r;
+    ngx_bench_http_location_t   l;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+    if (pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    l.nelts = locations;
+    l.nuris = uris;
+
+    ngx_bench_http_location_conf(&l, pool);
+    ngx_bench_http_location_uris(&l, pool);
+
+    r = &ngx_bench_http_location_request;
+
+    rc = 0;
+    start = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        uri = &l.uris[i % l.nuris];
+
+        r->uri = *uri;
+        rc += ngx_test_http_find_static_location(r, l.trie);
+    }
+
+    trie = ngx_test_nsec() - start;
+
+    start = ngx_test_nsec();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        uri = &l.uris[i % l.nuris];
+
+        r->uri = *uri;
+        rc -= ngx_http_location_tree_find(r, l.tree);
+    }
+
+    tree = ngx_test_nsec() - start;
+
+    if (rc != 0) {
+        ngx_test_fail("results differ");
+    }
+
+    ngx_sprintf((u_char *) name, "%ui locations, %ui uris, trie%Z",
+                locations, uris);
+    ngx_test_report(name, ngx_test_iterations, trie);
+
+    ngx_sprintf((u_char *) name, "%ui locations, %ui uris, tree%Z",
+                locations, uris);
+    ngx_test_report(name, ngx_test_iterations, tree);
+
+    ngx_destroy_pool(pool);
+}
+
+
+static void
+ngx_bench_http_location_conf(ngx_bench_http_location_t *l, ngx_pool_t *pool)
+{
+    u_char                    *p, name[NGX_BENCH_HTTP_LOCATION_NAME];
+    char                      *word;
+    ngx_uint_t                 i, k, n, exact;
+    ngx_conf_t                 cf;
+    ngx_conf_file_t            conf_file;
+    ngx_http_core_srv_conf_t  *cscf;
+    ngx_http_core_loc_conf_t  *clcf, *pclcf, **clcfs;
+
+    ngx_memzero(&cf, sizeof(ngx_conf_t));
+    ngx_memzero(&conf_file, sizeof(ngx_conf_file_t));
+
+    ngx_str_set(&conf_file.file.name, "bench");
+
+    cf.pool = pool;
+    cf.temp_pool = pool;
+    cf.log = ngx_test_log;
+    cf.conf_file = &conf_file;
+
+    cscf = ngx_pcalloc(pool, sizeof(ngx_http_core_srv_conf_t));
+    pclcf = ngx_pcalloc(pool, sizeof(ngx_http_core_loc_conf_t));
+    clcfs = ngx_palloc(pool, l->nelts * sizeof(ngx_http_core_loc_conf_t *));
+    l->names = ngx_palloc(pool, l->nelts * sizeof(ngx_str_t));
+
+    if (cscf == NULL || pclcf == NULL || clcfs == NULL || l->names == NULL) {
+        ngx_test_fail("ngx_palloc() failed");
+    }
+
+    n = 0;
+
+    while (n < l->nelts) {
+
+        /* one to four words, the last one numbered to make names unique */
+
+        p = name;
+
+        for (k = ngx_test_random() % 4; k; k--) {
+            word = ngx_bench_http_location_words[ngx_test_random()
+                                             % NGX_BENCH_HTTP_LOCATION_WORDS];
+            p = ngx_sprintf(p, "/%s", word);
+        }
+
+        word = ngx_bench_http_location_words[ngx_test_random()
+                                             % NGX_BENCH_HTTP_LOCATION_WORDS];
+        p = ngx_sprintf(p, "/%s%ui", word,
+                        (ngx_uint_t) ngx_test_random() % 100);
+
+        if (ngx_test_random() % 3 == 0) {
+            *p++ = '/';
+        }
+
+        exact = (ngx_test_random() % 5 == 0);
+
+        for (i = 0; i < n; i++) {
+            if (clcfs[i]->exact_match == exact
+                && clcfs[i]->name.len == (size_t) (p - name)
+                && ngx_memcmp(clcfs[i]->name.data, name, p - name) == 0)
+            {
+                break;
+            }
+        }
+
+        if (i < n) {
+            continue;
+        }
+
+        clcf = ngx_pcalloc(pool, sizeof(ngx_http_core_loc_conf_t));
+        if (clcf == NULL) {
+            ngx_test_fail("ngx_pcalloc() failed");
+        }
+
+        clcf->name.len = p - name;
+        clcf->name.data = ngx_pnalloc(pool, clcf->name.len + 1);
+        if (clcf->name.data == NULL) {
+            ngx_test_fail("ngx_pnalloc() failed");
+        }
+
+        ngx_cpystrn(clcf->name.data, name, clcf->name.len + 1);
+
+        clcf->exact_match = exact;
+
+        if (p[-1] == '/' && ngx_test_random() % 2) {
+            clcf->auto_redirect = 1;
+        }
+
+        clcf->loc_conf = (void **) clcf;
+
+        if (ngx_http_add_location(&cf, &pclcf->locations, clcf) != NGX_OK) {
+            ngx_test_fail("ngx_http_add_location() failed");
+        }
+
+        clcfs[n] = clcf;
+        l->names[n] = clcf->name;
+        n++;
+    }
+
+    if (ngx_test_http_init_locations(&cf, cscf, pclcf) != NGX_OK) {
+        ngx_test_fail("ngx_test_http_init_locations() failed");
+    }
+
+    l->trie = pclcf->static_locations;
+
+    l->tree = ngx_http_location_tree_create(&cf, pclcf->locations);
+    if (l->tree == NULL) {
+        ngx_test_fail("ngx_http_location_tree_create() failed");
+    }
+}
+
+
+static void
+ngx_bench_http_location_uris(ngx_bench_http_location_t *l, ngx_pool_t *pool)
+{
+    u_char      *p;
+    size_t       len;
+    ngx_str_t   *name, *uri;
+    ngx_uint_t   i, n;
+
+    l->uris = ngx_palloc(pool, l->nuris * sizeof(ngx_str_t));
+    if (l->uris == NULL) {
+        ngx_test_fail("ngx_palloc() failed");
+    }
+
+    for (i = 0; i < l->nuris; i++) {
+        name = &l->names[ngx_test_random() % l->nelts];
+        uri = &l->uris[i];
+
+        p = ngx_pnalloc(pool, name->len + 32);
+        if (p == NULL) {
+            ngx_test_fail("ngx_pnalloc() failed");
+        }
+
+        uri->data = p;
+        len = name->len;
+
+        p = ngx_cpymem(p, name->data, len);
+
+        switch (ngx_test_random() % 6) {
+
+        case 0:
+            break;
+
+        case 1:
+            p = ngx_sprintf(p, "/index%ui.html",
+                            (ngx_uint_t) ngx_test_random() % 1000);
+            break;
+
+        case 2:
+            p = ngx_cpymem(p, ".json", 5);
+            break;
+
+        case 3:
+            p--;
+            break;
+
+        case 4:
+            n = 1 + ngx_test_random() % (len - 1);
+
+            if ((uri->data[n] | 0x20) >= 'a' && (uri->data[n] | 0x20) <= 'z')
+            {
+                uri->data[n] ^= 0x20;
+            }
+
+            break;
+
+        default:
+            p = uri->data;
+            p = ngx_sprintf(p, "/%s/%ui",
+                            ngx_bench_http_location_words[ngx_test_random()
+                                             % NGX_BENCH_HTTP_LOCATION_WORDS],
+                            (ngx_uint_t) ngx_test_random());
+        }
+
+        uri->len = p - uri->data;
+    }
+}
@@ -0,0 +1,156 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * About 3 KB of typical request header values, Huffman encoded, are
+ * decoded by ngx_http_huff_decode() at once, as HTTP/2 does with a whole
+ * field in the buffer, and in 7 byte pieces, which never enter the fast
+ * path and thus measure the previous nibble state machine together with
+ * the overhead of a call per piece; an operation is a header value.
+ *
+ *     ngx_bench_huff_decode [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+static ngx_str_t  ngx_bench_huff_decode_values[] = {
+    ngx_string("www.example.com"),
+    ngx_string("Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+               "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36"),
+    ngx_string("text/html,application/xhtml+xml,application/xml;q=0.9,"
+               "image/avif,image/webp,*/*;q=0.8"),
+    ngx_string("gzip, deflate, br"),
+    ngx_string("en-US,en;q=0.9"),
+    ngx_string("https://www.example.com/search?q=nginx+huffman"),
+    ngx_string("session=9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822c;"
+               " _ga=GA1.2.1234567890.1700000000; theme=dark; "
+               "consent=analytics%2Cmarketing"),
+    ngx_string("no-cache"),
+    ngx_string("Sat, 14 Oct 2023 08:12:31 GMT"),
+    ngx_string("\"33a64df551425fcc55e4d42a148795d9f25f89d4\""),
+    ngx_string("Bearer eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM"
+               "0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ"),
+    ngx_string("/api/v1/users/42/orders?limit=50&offset=100&sort=-created"),
+    ngx_string("192.0.2.43, 198.51.100.17"),
+    ngx_string("3f2c7a1e-8b4d-4f6a-9c0e-2d5b7e9a1c3f"),
+    ngx_string("max-age=31536000; includeSubDomains; preload"),
+    ngx_string("application/json; charset=utf-8")
+};
+
+#define NGX_BENCH_HUFF_DECODE_VALUES                                          \
+    (sizeof(ngx_bench_huff_decode_values) / sizeof(ngx_str_t))
+
+
+static uint64_t ngx_bench_huff_decode_run(ngx_str_t *in, ngx_uint_t n,
+    size_t piece, u_char *out);
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char      *p, *out;
+    size_t       len, size;
+    uint64_t     whole, pieces;
+    ngx_str_t    in[NGX_BENCH_HUFF_DECODE_VALUES * 8];
+    ngx_uint_t   i, n;
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 5000000;
+    }
+
+    /* the values repeated to about 3 KB of encoded input */
+
+    size = 0;
+
+    for (i = 0; i < NGX_BENCH_HUFF_DECODE_VALUES; i++) {
+        size += ngx_bench_huff_decode_values[i].len;
+    }
+
+    n = 0;
+    len = 0;
+
+    p = ngx_alloc(size * 8, ngx_test_log);
+    out = ngx_alloc(size * 8 * 8 / 5, ngx_test_log);
+
+    if (p == NULL || out == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    while (len < 3072 && n < NGX_BENCH_HUFF_DECODE_VALUES * 8) {
+        in[n].data = p;
+        in[n].len = ngx_http_huff_encode(
+                              ngx_bench_huff_decode_values[n
+                                  % NGX_BENCH_HUFF_DECODE_VALUES].data,
+                              ngx_bench_huff_decode_values[n
+                                  % NGX_BENCH_HUFF_DECODE_VALUES].len,
+                              p, 0);
+
+        if (in[n].len == 0) {
+            ngx_test_fail("value %ui is not encoded",
+                          n % NGX_BENCH_HUFF_DECODE_VALUES);
+        }
+
+        p += in[n].len;
+        len += in[n].len;
+        n++;
+    }
+
+    whole = ngx_bench_huff_decode_run(in, n, (size_t) -1, out);
+    pieces = ngx_bench_huff_decode_run(in, n, 7, out);
+
+    printf("    %lu values, %lu bytes encoded\n",
+           (unsigned long) n, (unsigned long) len);
+
+    ngx_test_report("whole value", ngx_test_iterations, whole);
+    ngx_test_report("7 byte pieces", ngx_test_iterations, pieces);
+
+    ngx_free(in[0].data);
+    ngx_free(out);
+
+    return 0;
+}
+
+
+static uint64_t
+ngx_bench_huff_decode_run(ngx_str_t *in, ngx_uint_t n, size_t piece,
+    u_char *out)
+{
+    u_char      *dst, state;
+    size_t       i, size;
+    uint64_t     k, start;
+    ngx_str_t   *v;
+
+    start = ngx_test_nsec();
+
+    for (k = 0; k < ngx_test_iterations; k++) {
+        v = &in[k % n];
+
+        dst = out;
+        state = 0;
+
+        for (i = 0; i < v->len; i += size) {
+            size = ngx_min(piece, v->len - i);
+
+            if (ngx_http_huff_decode(&state, v->data + i, size, &dst,
+                                     i + size == v->len, ngx_test_log)
+                != NGX_OK)
+            {
+                ngx_test_fail("value %uL is not decoded", k % n);
+            }
+        }
+    }
+
+    return ngx_test_nsec() - start;
+}
@@ -0,0 +1,205 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Several processes allocate and free chunks of 16..143 bytes in one zone,
+ * with and without the worker magazines; all chunks must be returned
+ * to the zone afterwards.
+ *
+ *     ngx_bench_slab [iterations per process] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_test.h>
+
+
+#define NGX_BENCH_SLAB_ZONE       (64 * 1024 * 1024)
+#define NGX_BENCH_SLAB_PROCESSES  8
+#define NGX_BENCH_SLAB_WORKING    256
+
+
+static void ngx_bench_slab_run(ngx_uint_t magazine);
+static void ngx_bench_slab_process(ngx_cycle_t *cycle, ngx_slab_pool_t *sp,
+    ngx_uint_t n);
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 1000000;
+    }
+
+    ngx_slab_sizes_init();
+
+    printf("    %d processes, %llu alloc/free pairs each\n",
+           NGX_BENCH_SLAB_PROCESSES, (unsigned long long) ngx_test_iterations);
+
+    ngx_bench_slab_run(0);
+    ngx_bench_slab_run(64);
+
+    return 0;
+}
+
+
+static void
+ngx_bench_slab_run(ngx_uint_t magazine)
+{
+    int               status;
+    char              name[64];
+    uint64_t          start;
+    ngx_uint_t        i, pfree, reqs;
+    ngx_pid_t         pid;
+    ngx_cycle_t       cycle;
+    ngx_shm_zone_t   *zone;
+    ngx_slab_pool_t  *sp;
+
+    ngx_memzero(&cycle, sizeof(ngx_cycle_t));
+
+    cycle.log = ngx_test_log;
+    cycle.pool = ngx_create_pool(NGX_CYCLE_POOL_SIZE, ngx_test_log);
+    if (cycle.pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    if (ngx_list_init(&cycle.shared_memory, cycle.pool, 1,
+                      sizeof(ngx_shm_zone_t))
+        != NGX_OK)
+    {
+        ngx_test_fail("ngx_list_init() failed");
+    }
+
+    zone = ngx_list_push(&cycle.shared_memory);
+    if (zone == NULL) {
+        ngx_test_fail("ngx_list_push() failed");
+    }
+
+    ngx_memzero(zone, sizeof(ngx_shm_zone_t));
+
+    zone->magazine = magazine;
+    zone->shm.size = NGX_BENCH_SLAB_ZONE;
+    zone->shm.log = ngx_test_log;
+    ngx_str_set(&zone->shm.name, "bench");
+
+    if (ngx_shm_alloc(&zone->shm) != NGX_OK) {
+        ngx_test_fail("ngx_shm_alloc() failed");
+    }
+
+    /* the same as ngx_init_zone_pool() */
+
+    sp = (ngx_slab_pool_t *) zone->shm.addr;
+
+    sp->end = zone->shm.addr + zone->shm.size;
+    sp->min_shift = 3;
+    sp->addr = zone->shm.addr;
+
+    if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+        ngx_test_fail("ngx_shmtx_create() failed");
+    }
+
+    ngx_slab_init(sp);
+
+    pfree = sp->pfree;
+
+    (void) fflush(stdout);
+
+    start = ngx_test_nsec();
+
+    for (i = 0; i < NGX_BENCH_SLAB_PROCESSES; i++) {
+
+        pid = fork();
+
+        if (pid == -1) {
+            ngx_test_fail("fork() failed");
+        }
+
+        if (pid == 0) {
+            ngx_bench_slab_process(&cycle, sp, i);
+            exit(0);
+        }
+    }
+
+    for (i = 0; i < NGX_BENCH_SLAB_PROCESSES; i++) {
+        if (wait(&status) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            ngx_test_fail("process failed");
+        }
+    }
+
+    ngx_sprintf((u_char *) name, "magazine=%ui%Z", magazine);
+
+    ngx_test_report(name, NGX_BENCH_SLAB_PROCESSES * ngx_test_iterations,
+                    ngx_test_nsec() - start);
+
+    reqs = 0;
+
+    for (i = 0; i < ngx_slab_nslots(sp); i++) {
+        reqs += sp->stats[i].reqs;
+
+        if (sp->stats[i].used != 0) {
+            ngx_test_fail("slot %ui: %ui chunks are not returned",
+                          i, sp->stats[i].used);
+        }
+    }
+
+    if (sp->pfree != pfree) {
+        ngx_test_fail("%ui pages are not returned", pfree - sp->pfree);
+    }
+
+    printf("    %-40s %12lu requests under the mutex\n", "",
+           (unsigned long) reqs);
+
+    ngx_shm_free(&zone->shm);
+    ngx_destroy_pool(cycle.pool);
+}
+
+
+static void
+ngx_bench_slab_process(ngx_cycle_t *cycle, ngx_slab_pool_t *sp, ngx_uint_t n)
+{
+    void        *p[NGX_BENCH_SLAB_WORKING];
+    uint64_t     i;
+    ngx_uint_t   k;
+
+    ngx_test_srandom(ngx_test_seed + n);
+
+    /* magazines are created in the worker processes only */
+
+    if (ngx_slab_cache_init(cycle) != NGX_OK) {
+        ngx_test_fail("ngx_slab_cache_init() failed");
+    }
+
+    ngx_memzero(p, sizeof(p));
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        k = ngx_test_random() % NGX_BENCH_SLAB_WORKING;
+
+        if (p[k]) {
+            ngx_slab_free(sp, p[k]);
+        }
+
+        p[k] = ngx_slab_alloc(sp, 16 + ngx_test_random() % 128);
+
+        if (p[k] == NULL) {
+            ngx_test_fail("ngx_slab_alloc() failed");
+        }
+    }
+
+    for (k = 0; k < NGX_BENCH_SLAB_WORKING; k++) {
+        if (p[k]) {
+            ngx_slab_free(sp, p[k]);
+        }
+    }
+
+    ngx_slab_cache_flush();
+}
@@ -0,0 +1,2029 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * grpc_pass over shared upstream HTTP/2 sessions, end to end.  nginx is
+ * started from the objects of the tree in a child process, with
+ * "multiplex 2; multiplex_streams 16; multiplex_window 64k;", and the
+ * program is both its HTTP/1.0 clients and the HTTP/2 backend behind it.
+ * Every round has three phases:
+ *
+ *     concurrent: 32 requests are held by the backend until all of them
+ *         are open at once, they must come over the two sessions;
+ *
+ *     window: request bodies against backend stream windows of 16k which
+ *         are restored only once exhausted, and responses up to 1m, some
+ *         to clients which do not read until the others are done, so that
+ *         their stream windows are exhausted while the session goes on;
+ *
+ *     goaway: 16 requests are held, then each session is sent GOAWAY with
+ *         its middle stream as the last one, the streams above it must be
+ *         retried on another session, and the session must be closed.
+ *
+ * Every other request goes through "proxy_pass" with "proxy_http_version 2"
+ * to the same upstream instead, its URI prefix is replaced.
+ *
+ * Bodies are checked byte by byte, flow control and framing errors fail
+ * the check, as do alerts in the error log and nginx not exiting cleanly.
+ * The prefix directory is kept on failure.
+ *
+ *     ngx_check_grpc [rounds] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+#define NGX_CHECK_GRPC_SESSIONS     2
+#define NGX_CHECK_GRPC_STREAMS      16
+#define NGX_CHECK_GRPC_CLIENTS                                                \
+    (NGX_CHECK_GRPC_SESSIONS * NGX_CHECK_GRPC_STREAMS)
+
+/* the backend's stream window for request bodies */
+#define NGX_CHECK_GRPC_WINDOW       16384
+
+#define NGX_CHECK_GRPC_RESPONSE     (1024 * 1024)
+#define NGX_CHECK_GRPC_BODY         (256 * 1024)
+
+#define NGX_CHECK_GRPC_CONNS        64
+#define NGX_CHECK_GRPC_SLOTS        64
+
+#define NGX_CHECK_GRPC_FRAME                                                  \
+    (NGX_HTTP_V2_FRAME_HEADER_SIZE + NGX_HTTP_V2_DEFAULT_FRAME_SIZE)
+#define NGX_CHECK_GRPC_INPUT        (2 * NGX_CHECK_GRPC_FRAME)
+
+/* responses are queued while the output is below the limit */
+#define NGX_CHECK_GRPC_OUTPUT       65536
+#define NGX_CHECK_GRPC_OUTPUT_SIZE                                            \
+    (NGX_CHECK_GRPC_OUTPUT + 4 * NGX_CHECK_GRPC_FRAME)
+
+/* windows are restored when nothing arrived for the time, in ms */
+#define NGX_CHECK_GRPC_IDLE         50
+#define NGX_CHECK_GRPC_TIMEOUT      30000
+
+#define ngx_check_grpc_byte(id, n)                                            \
+    ((u_char) ((id) * 7 + (n) + ((n) >> 8) * 13))
+
+#define ngx_check_grpc_body_byte(id, n)  ngx_check_grpc_byte((id) + 128, n)
+
+
+typedef struct {
+    int                        fd;
+    ngx_uint_t                 id;
+    ngx_uint_t                 slow;
+
+    u_char                    *request;
+    size_t                     size;
+    size_t                     written;
+
+    size_t                     len;
+    size_t                     received;
+
+    u_char                     header[1024];
+    size_t                     header_len;
+    ngx_uint_t                 body;
+
+    ngx_uint_t                 done;
+} ngx_check_grpc_client_t;
+
+
+typedef struct {
+    ngx_uint_t                 sid;
+    ngx_uint_t                 id;
+
+    size_t                     len;
+    size_t                     sent;
+    size_t                     body;
+    size_t                     received;
+
+    ssize_t                    send_window;
+    size_t                     recv_window;
+
+    unsigned                   in_closed:1;
+    unsigned                   headers_sent:1;
+    unsigned                   held:1;
+    unsigned                   stalled:1;
+} ngx_check_grpc_stream_t;
+
+
+typedef struct {
+    int                        fd;
+
+    u_char                    *in;
+    size_t                     in_len;
+    ngx_uint_t                 preface;
+
+    u_char                    *out;
+    size_t                     out_pos;
+    size_t                     out_len;
+
+    ssize_t                    send_window;
+    size_t                     recv_window;
+    ssize_t                    init_window;
+
+    /* a header block continued in CONTINUATION frames */
+    u_char                     headers[4096];
+    size_t                     headers_len;
+    ngx_uint_t                 headers_sid;
+    ngx_uint_t                 headers_flags;
+
+    ngx_uint_t                 last_sid;
+    ngx_uint_t                 goaway;
+    ngx_uint_t                 nstreams;
+    ngx_uint_t                 total;
+
+    ngx_check_grpc_stream_t    streams[NGX_CHECK_GRPC_SLOTS];
+} ngx_check_grpc_conn_t;
+
+
+typedef struct {
+    ngx_uint_t                 phase;
+    ngx_uint_t                 base;
+    ngx_uint_t                 n;
+    ngx_uint_t                 fast;
+    ngx_uint_t                 held;
+    ngx_uint_t                 released;
+    ngx_uint_t                 refused;
+    u_char                     seen[NGX_CHECK_GRPC_CLIENTS];
+    u_char                     refusals[NGX_CHECK_GRPC_CLIENTS];
+} ngx_check_grpc_phase_t;
+
+
+static void ngx_check_grpc_start(void);
+static void ngx_check_grpc_wait(void);
+static void ngx_check_grpc_stop(void);
+static void ngx_check_grpc_exit(void);
+static ngx_int_t ngx_check_grpc_delete_file(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static ngx_int_t ngx_check_grpc_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path);
+static ngx_int_t ngx_check_grpc_delete_dir(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static void ngx_check_grpc_run(ngx_uint_t phase, ngx_uint_t n);
+static void ngx_check_grpc_client_init(ngx_check_grpc_client_t *c,
+    ngx_uint_t i);
+static void ngx_check_grpc_client_write(ngx_check_grpc_client_t *c);
+static void ngx_check_grpc_client_read(ngx_check_grpc_client_t *c);
+static int ngx_check_grpc_connect(char *name);
+static void ngx_check_grpc_accept(void);
+static ngx_int_t ngx_check_grpc_read(ngx_check_grpc_conn_t *hc);
+static void ngx_check_grpc_frame(ngx_check_grpc_conn_t *hc, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, u_char *p, size_t size);
+static void ngx_check_grpc_settings(ngx_check_grpc_conn_t *hc, u_char *p,
+    size_t size);
+static void ngx_check_grpc_headers(ngx_check_grpc_conn_t *hc);
+static void ngx_check_grpc_data(ngx_check_grpc_conn_t *hc, ngx_uint_t flags,
+    ngx_uint_t sid, u_char *p, size_t size);
+static void ngx_check_grpc_complete(ngx_check_grpc_stream_t *st);
+static ngx_check_grpc_stream_t *ngx_check_grpc_stream(
+    ngx_check_grpc_conn_t *hc, ngx_uint_t sid);
+static ngx_int_t ngx_check_grpc_path(u_char *p, size_t size, ngx_str_t *path,
+    u_char *buf);
+static ngx_int_t ngx_check_grpc_string(u_char **pos, u_char *end,
+    ngx_str_t *s, u_char *buf, size_t size);
+static ngx_int_t ngx_check_grpc_integer(u_char **pos, u_char *end,
+    ngx_uint_t prefix);
+static void ngx_check_grpc_release(void);
+static void ngx_check_grpc_restore(ngx_check_grpc_conn_t *hc,
+    ngx_uint_t idle);
+static void ngx_check_grpc_output(ngx_check_grpc_conn_t *hc);
+static u_char *ngx_check_grpc_frame_out(ngx_check_grpc_conn_t *hc,
+    ngx_uint_t type, ngx_uint_t flags, ngx_uint_t sid, size_t size);
+static void ngx_check_grpc_window_update(ngx_check_grpc_conn_t *hc,
+    ngx_uint_t sid, size_t window);
+static void ngx_check_grpc_write(ngx_check_grpc_conn_t *hc);
+static void ngx_check_grpc_close(ngx_uint_t i);
+
+
+static char  ngx_check_grpc_conf[] =
+    "daemon off;" CRLF
+    "master_process off;" CRLF
+    "pid %s/nginx.pid;" CRLF
+    "error_log %s/error.log info;" CRLF
+    CRLF
+    "events {" CRLF
+    "    worker_connections 1024;" CRLF
+    "}" CRLF
+    CRLF
+    "http {" CRLF
+    "    access_log off;" CRLF
+    CRLF
+    "    upstream backend {" CRLF
+    "        server unix:%s/backend.sock;" CRLF
+    "        multiplex %d;" CRLF
+    "        multiplex_streams %d;" CRLF
+    "        multiplex_window 64k;" CRLF
+    "    }" CRLF
+    CRLF
+    "    server {" CRLF
+    "        listen unix:%s/nginx.sock;" CRLF
+    CRLF
+    "        location / {" CRLF
+    "            grpc_pass grpc://backend;" CRLF
+    "        }" CRLF
+    CRLF
+    "        location /proxy/ {" CRLF
+    "            proxy_pass http://backend/;" CRLF
+    "            proxy_http_version 2;" CRLF
+    "        }" CRLF
+    "    }" CRLF
+    "}" CRLF;
+
+
+static char                     ngx_check_grpc_prefix[] =
+                                                "/tmp/ngx_check_grpc.XXXXXX";
+static ngx_uint_t               ngx_check_grpc_kept;
+static ngx_pid_t                ngx_check_grpc_pid;
+static int                      ngx_check_grpc_listen;
+
+static ngx_check_grpc_phase_t   ngx_check_grpc_phase;
+static ngx_check_grpc_client_t  ngx_check_grpc_clients[NGX_CHECK_GRPC_CLIENTS];
+static ngx_check_grpc_conn_t   *ngx_check_grpc_conns[NGX_CHECK_GRPC_CONNS];
+
+static uint64_t                 ngx_check_grpc_requests;
+static uint64_t                 ngx_check_grpc_connections;
+static uint64_t                 ngx_check_grpc_sessions;
+static uint64_t                 ngx_check_grpc_refused;
+static uint64_t                 ngx_check_grpc_stalls;
+static uint64_t                 ngx_check_grpc_body_stalls;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    ngx_uint_t  i, grpc, multiplex;
+
+    grpc = 0;
+    multiplex = 0;
+
+    for (i = 0; ngx_module_names[i]; i++) {
+        if (ngx_strcmp(ngx_module_names[i], "ngx_http_grpc_module") == 0) {
+            grpc = 1;
+        }
+
+        if (ngx_strcmp(ngx_module_names[i],
+                       "ngx_http_upstream_multiplex_module")
+            == 0)
+        {
+            multiplex = 1;
+        }
+    }
+
+    if (!grpc || !multiplex) {
+        printf("    no grpc or upstream multiplex module\n");
+        return 0;
+    }
+
+    /* nginx is started first, so that its main() sees a fresh process */
+
+    ngx_check_grpc_start();
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 3;
+    }
+
+    ngx_check_grpc_wait();
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        ngx_check_grpc_run('c', NGX_CHECK_GRPC_CLIENTS);
+        ngx_check_grpc_run('w', NGX_CHECK_GRPC_STREAMS);
+        ngx_check_grpc_run('g', NGX_CHECK_GRPC_STREAMS);
+    }
+
+    if (ngx_check_grpc_stalls == 0) {
+        ngx_test_fail("no response stream window was exhausted");
+    }
+
+    if (ngx_check_grpc_body_stalls == 0) {
+        ngx_test_fail("no request body stream window was exhausted");
+    }
+
+    ngx_check_grpc_stop();
+
+    printf("    %llu rounds, %llu requests, "
+           "%llu backend connections, %llu shared\n"
+           "    %llu streams refused and retried, "
+           "%llu response and %llu request body windows exhausted\n",
+           (unsigned long long) ngx_test_iterations,
+           (unsigned long long) ngx_check_grpc_requests,
+           (unsigned long long) ngx_check_grpc_connections,
+           (unsigned long long) ngx_check_grpc_sessions,
+           (unsigned long long) ngx_check_grpc_refused,
+           (unsigned long long) ngx_check_grpc_stalls,
+           (unsigned long long) ngx_check_grpc_body_stalls);
+
+    return 0;
+}
+
+
+static void
+ngx_check_grpc_start(void)
+{
+    int                  fd;
+    u_char              *last;
+    char                *prefix, *argv[8];
+    ngx_fd_t             file;
+    struct sockaddr_un   sun;
+    u_char               conf[2048], name[NGX_MAX_PATH], error[NGX_MAX_PATH];
+
+    prefix = mkdtemp(ngx_check_grpc_prefix);
+    if (prefix == NULL) {
+        ngx_test_fail("mkdtemp() failed");
+    }
+
+    ngx_check_grpc_kept = 1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        ngx_test_fail("socket() failed");
+    }
+
+    ngx_memzero(&sun, sizeof(struct sockaddr_un));
+    sun.sun_family = AF_UNIX;
+    ngx_sprintf((u_char *) sun.sun_path, "%s/backend.sock%Z", prefix);
+
+    if (bind(fd, (struct sockaddr *) &sun, sizeof(struct sockaddr_un)) == -1
+        || listen(fd, NGX_LISTEN_BACKLOG) == -1
+        || ngx_nonblocking(fd) == -1)
+    {
+        ngx_test_fail("backend socket failed");
+    }
+
+    ngx_check_grpc_listen = fd;
+
+    last = ngx_snprintf(conf, sizeof(conf), ngx_check_grpc_conf,
+                        prefix, prefix, prefix, NGX_CHECK_GRPC_SESSIONS,
+                        NGX_CHECK_GRPC_STREAMS, prefix);
+
+    ngx_sprintf(name, "%s/nginx.conf%Z", prefix);
+
+    file = ngx_open_file(name, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                         NGX_FILE_DEFAULT_ACCESS);
+
+    if (file == NGX_INVALID_FILE
+        || ngx_write_fd(file, conf, last - conf) != last - conf
+        || ngx_close_file(file) == NGX_FILE_ERROR)
+    {
+        ngx_test_fail("writing \"%s\" failed", name);
+    }
+
+    ngx_sprintf(error, "%s/error.log%Z", prefix);
+
+    argv[0] = "nginx";
+    argv[1] = "-p";
+    argv[2] = prefix;
+    argv[3] = "-c";
+    argv[4] = (char *) name;
+    argv[5] = "-e";
+    argv[6] = (char *) error;
+    argv[7] = NULL;
+
+    ngx_check_grpc_pid = fork();
+
+    if (ngx_check_grpc_pid == -1) {
+        ngx_test_fail("fork() failed");
+    }
+
+    if (ngx_check_grpc_pid == 0) {
+        close(fd);
+        exit(ngx_test_nginx_main(7, argv));
+    }
+
+    atexit(ngx_check_grpc_exit);
+
+    signal(SIGPIPE, SIG_IGN);
+}
+
+
+static void
+ngx_check_grpc_wait(void)
+{
+    int         fd, status;
+    ngx_uint_t  i;
+    u_char      name[NGX_MAX_PATH];
+
+    ngx_sprintf(name, "%s/nginx.sock%Z", ngx_check_grpc_prefix);
+
+    for (i = 0; i < 500; i++) {
+
+        if (waitpid(ngx_check_grpc_pid, &status, WNOHANG)
+            == ngx_check_grpc_pid)
+        {
+            ngx_check_grpc_pid = 0;
+            ngx_test_fail("nginx exited, see %s/error.log",
+                          ngx_check_grpc_prefix);
+        }
+
+        fd = ngx_check_grpc_connect((char *) name);
+
+        if (fd != -1) {
+            close(fd);
+            return;
+        }
+
+        ngx_msleep(10);
+    }
+
+    ngx_test_fail("nginx did not start, see %s/error.log",
+                  ngx_check_grpc_prefix);
+}
+
+
+static void
+ngx_check_grpc_stop(void)
+{
+    u_char          *p, *last, *line;
+    ssize_t          n;
+    ngx_fd_t         fd;
+    ngx_str_t        tree;
+    ngx_uint_t       i;
+    ngx_file_info_t  fi;
+    ngx_tree_ctx_t   ctx;
+    int              status;
+    u_char           name[NGX_MAX_PATH];
+
+    static char  *errors[] = { "[emerg]", "[alert]", "[crit]", NULL };
+
+    kill(ngx_check_grpc_pid, SIGQUIT);
+
+    for (i = 0; i < 1000; i++) {
+        if (waitpid(ngx_check_grpc_pid, &status, WNOHANG)
+            == ngx_check_grpc_pid)
+        {
+            break;
+        }
+
+        ngx_msleep(10);
+    }
+
+    if (i == 1000) {
+        ngx_test_fail("nginx did not exit");
+    }
+
+    ngx_check_grpc_pid = 0;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ngx_test_fail("nginx exited with status %d", status);
+    }
+
+    for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+        if (ngx_check_grpc_conns[i]) {
+            ngx_check_grpc_conns[i]->nstreams = 0;
+            ngx_check_grpc_close(i);
+        }
+    }
+
+    close(ngx_check_grpc_listen);
+
+    /* the error log */
+
+    ngx_sprintf(name, "%s/error.log%Z", ngx_check_grpc_prefix);
+
+    fd = ngx_open_file(name, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE || ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_test_fail("opening \"%s\" failed", name);
+    }
+
+    p = ngx_alloc(ngx_file_size(&fi) + 1, ngx_test_log);
+    if (p == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    n = ngx_read_fd(fd, p, ngx_file_size(&fi));
+
+    if (n != ngx_file_size(&fi)) {
+        ngx_test_fail("reading \"%s\" failed", name);
+    }
+
+    ngx_close_file(fd);
+
+    last = p + n;
+    *last = '\0';
+
+    for (i = 0; errors[i]; i++) {
+        line = ngx_strnstr(p, errors[i], n);
+
+        if (line) {
+            while (line > p && line[-1] != LF) {
+                line--;
+            }
+
+            ngx_test_fail("nginx logged \"%*s\"",
+                          ngx_strlchr(line, last, LF) - line, line);
+        }
+    }
+
+    if (ngx_strnstr(p, "sent goaway", n) == NULL) {
+        ngx_test_fail("no GOAWAY was handled by a session");
+    }
+
+    ngx_free(p);
+
+    /* the prefix */
+
+    ngx_memzero(&ctx, sizeof(ngx_tree_ctx_t));
+
+    ctx.file_handler = ngx_check_grpc_delete_file;
+    ctx.pre_tree_handler = ngx_check_grpc_noop;
+    ctx.post_tree_handler = ngx_check_grpc_delete_dir;
+    ctx.spec_handler = ngx_check_grpc_delete_file;
+    ctx.log = ngx_test_log;
+
+    tree.data = (u_char *) ngx_check_grpc_prefix;
+    tree.len = ngx_strlen(ngx_check_grpc_prefix);
+
+    if (ngx_walk_tree(&ctx, &tree) != NGX_OK
+        || ngx_delete_dir(ngx_check_grpc_prefix) == NGX_FILE_ERROR)
+    {
+        ngx_test_fail("removing %s failed", ngx_check_grpc_prefix);
+    }
+
+    ngx_check_grpc_kept = 0;
+}
+
+
+static void
+ngx_check_grpc_exit(void)
+{
+    int  status;
+
+    if (ngx_check_grpc_pid) {
+        kill(ngx_check_grpc_pid, SIGKILL);
+        (void) waitpid(ngx_check_grpc_pid, &status, 0);
+    }
+
+    if (ngx_check_grpc_kept) {
+        fprintf(stderr, "the prefix %s is kept\n", ngx_check_grpc_prefix);
+    }
+}
+
+
+static ngx_int_t
+ngx_check_grpc_delete_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    if (ngx_delete_file(path->data) == NGX_FILE_ERROR) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_check_grpc_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_check_grpc_delete_dir(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    if (ngx_delete_dir(path->data) == NGX_FILE_ERROR) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_check_grpc_run(ngx_uint_t phase, ngx_uint_t n)
+{
+    int                       events, status;
+    uint64_t                  deadline;
+    ngx_uint_t                i, k, done, goaway;
+    ngx_check_grpc_conn_t    *hc;
+    ngx_check_grpc_phase_t   *ph;
+    ngx_check_grpc_client_t  *c;
+    struct pollfd             pfd[1 + NGX_CHECK_GRPC_CONNS
+                                  + NGX_CHECK_GRPC_CLIENTS];
+
+    ph = &ngx_check_grpc_phase;
+
+    ngx_memzero(ph, sizeof(ngx_check_grpc_phase_t));
+
+    ph->phase = phase;
+    ph->base = ngx_check_grpc_requests;
+    ph->n = n;
+
+    for (i = 0; i < n; i++) {
+        ngx_check_grpc_client_init(&ngx_check_grpc_clients[i], i);
+    }
+
+    ngx_check_grpc_requests += n;
+
+    deadline = ngx_test_nsec() + (uint64_t) NGX_CHECK_GRPC_TIMEOUT * 1000000;
+
+    for ( ;; ) {
+
+        pfd[0].fd = ngx_check_grpc_listen;
+        pfd[0].events = POLLIN;
+
+        for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+            hc = ngx_check_grpc_conns[i];
+
+            pfd[1 + i].fd = hc ? hc->fd : -1;
+            pfd[1 + i].events = POLLIN
+                                | ((hc && hc->out_len) ? POLLOUT : 0);
+        }
+
+        for (i = 0; i < NGX_CHECK_GRPC_CLIENTS; i++) {
+            c = &ngx_check_grpc_clients[i];
+            k = 1 + NGX_CHECK_GRPC_CONNS + i;
+
+            pfd[k].fd = -1;
+            pfd[k].events = 0;
+
+            if (i >= n || c->done) {
+                continue;
+            }
+
+            pfd[k].fd = c->fd;
+
+            if (c->written < c->size) {
+                pfd[k].events = POLLOUT;
+
+            } else if (!c->slow || ph->fast == 0) {
+                pfd[k].events = POLLIN;
+            }
+        }
+
+        events = poll(pfd, 1 + NGX_CHECK_GRPC_CONNS + NGX_CHECK_GRPC_CLIENTS,
+                      NGX_CHECK_GRPC_IDLE);
+
+        if (events == -1) {
+            if (ngx_errno == NGX_EINTR) {
+                continue;
+            }
+
+            ngx_test_fail("poll() failed");
+        }
+
+        if (pfd[0].revents) {
+            ngx_check_grpc_accept();
+        }
+
+        for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+            hc = ngx_check_grpc_conns[i];
+
+            if (hc && pfd[1 + i].revents
+                && ngx_check_grpc_read(hc) == NGX_DONE)
+            {
+                ngx_check_grpc_close(i);
+            }
+        }
+
+        ngx_check_grpc_release();
+
+        for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+            hc = ngx_check_grpc_conns[i];
+
+            if (hc) {
+                ngx_check_grpc_restore(hc, events == 0);
+                ngx_check_grpc_output(hc);
+                ngx_check_grpc_write(hc);
+            }
+        }
+
+        done = 0;
+
+        for (i = 0; i < n; i++) {
+            c = &ngx_check_grpc_clients[i];
+            k = 1 + NGX_CHECK_GRPC_CONNS + i;
+
+            if (!c->done && c->written < c->size) {
+                ngx_check_grpc_client_write(c);
+            }
+
+            if (!c->done && (pfd[k].revents & (POLLIN|POLLHUP|POLLERR))) {
+                ngx_check_grpc_client_read(c);
+            }
+
+            done += c->done;
+        }
+
+        /* a session sent GOAWAY is closed once its streams are done */
+
+        goaway = 0;
+
+        for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+            hc = ngx_check_grpc_conns[i];
+
+            if (hc && hc->goaway) {
+                goaway++;
+            }
+        }
+
+        if (done == n && goaway == 0) {
+            break;
+        }
+
+        if (ngx_test_nsec() > deadline) {
+            ngx_test_fail("phase %c timed out: %ui of %ui requests done, "
+                          "%ui held, %ui sessions after GOAWAY open",
+                          (int) phase, done, n, ph->held, goaway);
+        }
+
+        if (waitpid(ngx_check_grpc_pid, &status, WNOHANG)
+            == ngx_check_grpc_pid)
+        {
+            ngx_check_grpc_pid = 0;
+            ngx_test_fail("nginx exited with status %d", status);
+        }
+    }
+
+    if (phase != 'g') {
+        return;
+    }
+
+    if (ph->refused == 0) {
+        ngx_test_fail("no streams refused");
+    }
+
+    for (i = 0; i < n; i++) {
+        if (ph->refusals[i] && ph->seen[i] < 2) {
+            ngx_test_fail("request %ui was not retried", ph->base + i);
+        }
+    }
+
+    ngx_check_grpc_refused += ph->refused;
+}
+
+
+static void
+ngx_check_grpc_client_init(ngx_check_grpc_client_t *c, ngx_uint_t i)
+{
+    u_char                  *p;
+    size_t                   len, body, n;
+    ngx_uint_t               id, slow;
+    ngx_check_grpc_phase_t  *ph;
+    u_char                   name[NGX_MAX_PATH];
+
+    ph = &ngx_check_grpc_phase;
+
+    id = ph->base + i;
+    body = 0;
+    slow = 0;
+
+    switch (ph->phase) {
+
+    case 'c':
+        len = ngx_test_random() % 8192;
+        break;
+
+    case 'w':
+
+        switch (i % 4) {
+
+        case 0:
+            slow = 1;
+            len = NGX_CHECK_GRPC_RESPONSE;
+            break;
+
+        case 1:
+            len = NGX_CHECK_GRPC_RESPONSE / 4
+                  + ngx_test_random() % (NGX_CHECK_GRPC_RESPONSE * 3 / 4);
+            break;
+
+        default:
+            len = ngx_test_random() % 4096;
+            body = NGX_CHECK_GRPC_WINDOW
+                   + ngx_test_random()
+                     % (NGX_CHECK_GRPC_BODY - NGX_CHECK_GRPC_WINDOW);
+        }
+
+        break;
+
+    default: /* 'g' */
+        len = ngx_test_random() % 65536;
+    }
+
+    ngx_memzero(c, sizeof(ngx_check_grpc_client_t));
+
+    c->id = id;
+    c->slow = slow;
+    c->len = len;
+
+    if (!slow) {
+        ph->fast++;
+    }
+
+    c->request = ngx_alloc(256 + body, ngx_test_log);
+    if (c->request == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    p = ngx_sprintf(c->request, "%s %s/%c/%ui/%uz/%uz HTTP/1.0" CRLF
+                    "Host: check" CRLF,
+                    body ? "POST" : "GET", (id & 1) ? "/proxy" : "",
+                    (int) ph->phase, id, len, body);
+
+    if (body) {
+        p = ngx_sprintf(p, "Content-Length: %uz" CRLF, body);
+    }
+
+    *p++ = CR; *p++ = LF;
+
+    for (n = 0; n < body; n++) {
+        *p++ = ngx_check_grpc_body_byte(id, n);
+    }
+
+    c->size = p - c->request;
+
+    ngx_sprintf(name, "%s/nginx.sock%Z", ngx_check_grpc_prefix);
+
+    c->fd = ngx_check_grpc_connect((char *) name);
+
+    if (c->fd == -1) {
+        ngx_test_fail("connect() to nginx failed");
+    }
+}
+
+
+static void
+ngx_check_grpc_client_write(ngx_check_grpc_client_t *c)
+{
+    ssize_t  n;
+
+    n = send(c->fd, c->request + c->written, c->size - c->written, 0);
+
+    if (n == -1) {
+        if (ngx_socket_errno == NGX_EAGAIN) {
+            return;
+        }
+
+        ngx_test_fail("request %ui: send() failed", c->id);
+    }
+
+    c->written += n;
+
+    if (c->written == c->size) {
+        ngx_free(c->request);
+        c->request = NULL;
+    }
+}
+
+
+static void
+ngx_check_grpc_client_read(ngx_check_grpc_client_t *c)
+{
+    u_char   *p, *last;
+    ssize_t   n;
+    u_char    buf[NGX_CHECK_GRPC_FRAME];
+
+    for ( ;; ) {
+        n = recv(c->fd, buf, sizeof(buf), 0);
+
+        if (n == -1) {
+            if (ngx_socket_errno == NGX_EAGAIN) {
+                return;
+            }
+
+            ngx_test_fail("request %ui: recv() failed", c->id);
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        p = buf;
+        last = buf + n;
+
+        while (p < last && !c->body) {
+
+            if (c->header_len == sizeof(c->header)) {
+                ngx_test_fail("request %ui: too long response header", c->id);
+            }
+
+            c->header[c->header_len++] = *p++;
+
+            if (c->header_len >= 4
+                && ngx_strncmp(&c->header[c->header_len - 4], CRLF CRLF, 4)
+                   == 0)
+            {
+                if (ngx_strncmp(c->header, "HTTP/1.1 200 ", 13) != 0) {
+                    ngx_test_fail("request %ui: \"%*s\"", c->id,
+                                  ngx_strlchr(c->header,
+                                              c->header + c->header_len, CR)
+                                  - c->header,
+                                  c->header);
+                }
+
+                c->body = 1;
+            }
+        }
+
+        for ( /* void */ ; p < last; p++) {
+            if (c->received == c->len
+                || *p != ngx_check_grpc_byte(c->id, c->received))
+            {
+                ngx_test_fail("request %ui: invalid response byte at %uz",
+                              c->id, c->received);
+            }
+
+            c->received++;
+        }
+    }
+
+    if (!c->body || c->received != c->len) {
+        ngx_test_fail("request %ui: %uz of %uz response bytes", c->id,
+                      c->received, c->len);
+    }
+
+    close(c->fd);
+
+    c->done = 1;
+
+    if (!c->slow) {
+        ngx_check_grpc_phase.fast--;
+    }
+}
+
+
+static int
+ngx_check_grpc_connect(char *name)
+{
+    int                  fd;
+    struct sockaddr_un   sun;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        ngx_test_fail("socket() failed");
+    }
+
+    ngx_memzero(&sun, sizeof(struct sockaddr_un));
+    sun.sun_family = AF_UNIX;
+    ngx_cpystrn((u_char *) sun.sun_path, (u_char *) name,
+                sizeof(sun.sun_path));
+
+    if (connect(fd, (struct sockaddr *) &sun, sizeof(struct sockaddr_un))
+        == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (ngx_nonblocking(fd) == -1) {
+        ngx_test_fail("ngx_nonblocking() failed");
+    }
+
+    return fd;
+}
+
+
+static void
+ngx_check_grpc_accept(void)
+{
+    int                     fd;
+    u_char                 *p;
+    ngx_uint_t              i;
+    ngx_check_grpc_conn_t  *hc;
+
+    for ( ;; ) {
+        fd = accept(ngx_check_grpc_listen, NULL, NULL);
+
+        if (fd == -1) {
+            if (ngx_socket_errno == NGX_EAGAIN) {
+                return;
+            }
+
+            ngx_test_fail("accept() failed");
+        }
+
+        if (ngx_nonblocking(fd) == -1) {
+            ngx_test_fail("ngx_nonblocking() failed");
+        }
+
+        for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+            if (ngx_check_grpc_conns[i] == NULL) {
+                break;
+            }
+        }
+
+        if (i == NGX_CHECK_GRPC_CONNS) {
+            ngx_test_fail("too many backend connections");
+        }
+
+        hc = ngx_calloc(sizeof(ngx_check_grpc_conn_t), ngx_test_log);
+        if (hc == NULL) {
+            ngx_test_fail("ngx_calloc() failed");
+        }
+
+        hc->in = ngx_alloc(NGX_CHECK_GRPC_INPUT, ngx_test_log);
+        hc->out = ngx_alloc(NGX_CHECK_GRPC_OUTPUT_SIZE, ngx_test_log);
+
+        if (hc->in == NULL || hc->out == NULL) {
+            ngx_test_fail("ngx_alloc() failed");
+        }
+
+        hc->fd = fd;
+        hc->send_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+        hc->recv_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+        hc->init_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+
+        /* SETTINGS_INITIAL_WINDOW_SIZE */
+
+        p = ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_SETTINGS_FRAME, 0, 0, 6);
+        p = ngx_http_v2_write_uint16(p, 0x4);
+        (void) ngx_http_v2_write_uint32(p, NGX_CHECK_GRPC_WINDOW);
+
+        ngx_check_grpc_conns[i] = hc;
+        ngx_check_grpc_connections++;
+    }
+}
+
+
+static ngx_int_t
+ngx_check_grpc_read(ngx_check_grpc_conn_t *hc)
+{
+    u_char   *p, *last;
+    size_t    size;
+    ssize_t   n;
+
+    static u_char  preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    for ( ;; ) {
+        n = recv(hc->fd, hc->in + hc->in_len, NGX_CHECK_GRPC_INPUT - hc->in_len,
+                 0);
+
+        if (n == -1) {
+            if (ngx_socket_errno == NGX_EAGAIN) {
+                return NGX_OK;
+            }
+
+            if (ngx_socket_errno == NGX_ECONNRESET) {
+                return NGX_DONE;
+            }
+
+            ngx_test_fail("backend recv() failed");
+        }
+
+        if (n == 0) {
+            return NGX_DONE;
+        }
+
+        hc->in_len += n;
+
+        p = hc->in;
+        last = hc->in + hc->in_len;
+
+        if (!hc->preface) {
+            if (last - p < (ssize_t) sizeof(preface) - 1) {
+                continue;
+            }
+
+            if (ngx_memcmp(p, preface, sizeof(preface) - 1) != 0) {
+                ngx_test_fail("invalid connection preface");
+            }
+
+            p += sizeof(preface) - 1;
+            hc->preface = 1;
+        }
+
+        while (last - p >= NGX_HTTP_V2_FRAME_HEADER_SIZE) {
+            size = (p[0] << 16) + (p[1] << 8) + p[2];
+
+            if (size > NGX_HTTP_V2_DEFAULT_FRAME_SIZE) {
+                ngx_test_fail("too large frame: %uz", size);
+            }
+
+            if ((size_t) (last - p) < NGX_HTTP_V2_FRAME_HEADER_SIZE + size) {
+                break;
+            }
+
+            ngx_check_grpc_frame(hc, p[3], p[4], ngx_http_v2_parse_sid(&p[5]),
+                                 p + NGX_HTTP_V2_FRAME_HEADER_SIZE, size);
+
+            p += NGX_HTTP_V2_FRAME_HEADER_SIZE + size;
+        }
+
+        hc->in_len = last - p;
+        ngx_memmove(hc->in, p, hc->in_len);
+    }
+}
+
+
+static void
+ngx_check_grpc_frame(ngx_check_grpc_conn_t *hc, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, u_char *p, size_t size)
+{
+    size_t                    window, padding;
+    ngx_check_grpc_stream_t  *st;
+
+    if (hc->headers_sid && type != NGX_HTTP_V2_CONTINUATION_FRAME) {
+        ngx_test_fail("frame type %ui within the header block of stream %ui",
+                      type, hc->headers_sid);
+    }
+
+    switch (type) {
+
+    case NGX_HTTP_V2_DATA_FRAME:
+        ngx_check_grpc_data(hc, flags, sid, p, size);
+        break;
+
+    case NGX_HTTP_V2_HEADERS_FRAME:
+
+        if (sid == 0 || (sid & 1) == 0 || sid <= hc->last_sid) {
+            ngx_test_fail("HEADERS of invalid stream %ui after %ui",
+                          sid, hc->last_sid);
+        }
+
+        hc->last_sid = sid;
+
+        if (flags & NGX_HTTP_V2_PADDED_FLAG) {
+            if (size == 0 || p[0] >= size) {
+                ngx_test_fail("invalid padding of stream %ui", sid);
+            }
+
+            padding = p[0];
+            p++;
+            size -= 1 + padding;
+        }
+
+        if (flags & NGX_HTTP_V2_PRIORITY_FLAG) {
+            if (size < 5) {
+                ngx_test_fail("invalid priority of stream %ui", sid);
+            }
+
+            p += 5;
+            size -= 5;
+        }
+
+        if (size > sizeof(hc->headers)) {
+            ngx_test_fail("too long header block of stream %ui", sid);
+        }
+
+        ngx_memcpy(hc->headers, p, size);
+
+        hc->headers_len = size;
+        hc->headers_sid = sid;
+        hc->headers_flags = flags;
+
+        if (flags & NGX_HTTP_V2_END_HEADERS_FLAG) {
+            ngx_check_grpc_headers(hc);
+        }
+
+        break;
+
+    case NGX_HTTP_V2_CONTINUATION_FRAME:
+
+        if (sid == 0 || sid != hc->headers_sid) {
+            ngx_test_fail("unexpected CONTINUATION of stream %ui", sid);
+        }
+
+        if (size > sizeof(hc->headers) - hc->headers_len) {
+            ngx_test_fail("too long header block of stream %ui", sid);
+        }
+
+        ngx_memcpy(hc->headers + hc->headers_len, p, size);
+        hc->headers_len += size;
+
+        if (flags & NGX_HTTP_V2_END_HEADERS_FLAG) {
+            ngx_check_grpc_headers(hc);
+        }
+
+        break;
+
+    case NGX_HTTP_V2_RST_STREAM_FRAME:
+
+        st = ngx_check_grpc_stream(hc, sid);
+
+        if (st) {
+            ngx_test_fail("stream %ui of request %ui reset with %ui",
+                          sid, st->id, size == 4 ? ngx_http_v2_parse_uint32(p)
+                                                 : (uint32_t) -1);
+        }
+
+        break;
+
+    case NGX_HTTP_V2_SETTINGS_FRAME:
+
+        if (sid != 0) {
+            ngx_test_fail("SETTINGS of stream %ui", sid);
+        }
+
+        if (!(flags & NGX_HTTP_V2_ACK_FLAG)) {
+            ngx_check_grpc_settings(hc, p, size);
+        }
+
+        break;
+
+    case NGX_HTTP_V2_PING_FRAME:
+
+        if (sid != 0 || size != 8) {
+            ngx_test_fail("invalid PING");
+        }
+
+        if (!(flags & NGX_HTTP_V2_ACK_FLAG)) {
+            ngx_memcpy(ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_PING_FRAME,
+                                                NGX_HTTP_V2_ACK_FLAG, 0, 8),
+                       p, 8);
+        }
+
+        break;
+
+    case NGX_HTTP_V2_WINDOW_UPDATE_FRAME:
+
+        if (size != 4) {
+            ngx_test_fail("invalid WINDOW_UPDATE of stream %ui", sid);
+        }
+
+        window = ngx_http_v2_parse_window(p);
+
+        if (window == 0) {
+            ngx_test_fail("zero WINDOW_UPDATE of stream %ui", sid);
+        }
+
+        if (sid == 0) {
+            hc->send_window += window;
+
+            if (hc->send_window > NGX_HTTP_V2_MAX_WINDOW) {
+                ngx_test_fail("connection window overflow");
+            }
+
+            break;
+        }
+
+        st = ngx_check_grpc_stream(hc, sid);
+
+        if (st) {
+            st->send_window += window;
+            st->stalled = 0;
+
+            if (st->send_window > NGX_HTTP_V2_MAX_WINDOW) {
+                ngx_test_fail("stream %ui window overflow", sid);
+            }
+        }
+
+        break;
+
+    case NGX_HTTP_V2_PUSH_PROMISE_FRAME:
+        ngx_test_fail("PUSH_PROMISE from a client");
+
+    default:
+        /* PRIORITY, GOAWAY and unknown frames */
+        break;
+    }
+}
+
+
+static void
+ngx_check_grpc_settings(ngx_check_grpc_conn_t *hc, u_char *p, size_t size)
+{
+    ssize_t      delta;
+    ngx_uint_t   i, id, value;
+
+    if (size % 6) {
+        ngx_test_fail("SETTINGS of invalid length %uz", size);
+    }
+
+    for ( /* void */ ; size; size -= 6, p += 6) {
+        id = ngx_http_v2_parse_uint16(p);
+        value = ngx_http_v2_parse_uint32(&p[2]);
+
+        if (id != 0x4) {
+            continue;
+        }
+
+        if (value > NGX_HTTP_V2_MAX_WINDOW) {
+            ngx_test_fail("too large initial window %ui", value);
+        }
+
+        delta = (ssize_t) value - hc->init_window;
+        hc->init_window = value;
+
+        for (i = 0; i < NGX_CHECK_GRPC_SLOTS; i++) {
+            if (hc->streams[i].sid) {
+                hc->streams[i].send_window += delta;
+            }
+        }
+    }
+
+    (void) ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_SETTINGS_FRAME,
+                                    NGX_HTTP_V2_ACK_FLAG, 0, 0);
+}
+
+
+/* the path is "/<phase>/<request>/<response length>/<body length>" */
+
+static void
+ngx_check_grpc_headers(ngx_check_grpc_conn_t *hc)
+{
+    u_char                   *p, *last;
+    ngx_int_t                 value[3];
+    ngx_str_t                 path;
+    ngx_uint_t                sid, flags, i, k;
+    ngx_check_grpc_phase_t   *ph;
+    ngx_check_grpc_stream_t  *st;
+    u_char                    buf[1024];
+
+    ph = &ngx_check_grpc_phase;
+
+    sid = hc->headers_sid;
+    flags = hc->headers_flags;
+
+    hc->headers_sid = 0;
+
+    if (ngx_check_grpc_path(hc->headers, hc->headers_len, &path, buf)
+        != NGX_OK)
+    {
+        ngx_test_fail("invalid header block of stream %ui", sid);
+    }
+
+    if (hc->goaway && sid > hc->goaway) {
+        /* opened before GOAWAY reached nginx, it is refused there */
+        return;
+    }
+
+    p = path.data;
+    last = path.data + path.len;
+
+    if (path.len < 3 || p[0] != '/' || p[1] != ph->phase || p[2] != '/') {
+        ngx_test_fail("unexpected path \"%V\" in phase %c",
+                      &path, (int) ph->phase);
+    }
+
+    p += 3;
+
+    for (i = 0; i < 3; i++) {
+        k = 0;
+
+        while (p + k < last && p[k] != '/') {
+            k++;
+        }
+
+        value[i] = ngx_atoi(p, k);
+
+        if (value[i] == NGX_ERROR) {
+            ngx_test_fail("invalid path \"%V\"", &path);
+        }
+
+        p += k + 1;
+    }
+
+    if ((ngx_uint_t) value[0] < ph->base
+        || (ngx_uint_t) value[0] >= ph->base + ph->n)
+    {
+        ngx_test_fail("request %i is not of the phase", value[0]);
+    }
+
+    k = value[0] - ph->base;
+
+    if (ph->seen[k] && !ph->refusals[k]) {
+        ngx_test_fail("request %i was passed again", value[0]);
+    }
+
+    ph->seen[k]++;
+
+    for (i = 0; i < NGX_CHECK_GRPC_SLOTS; i++) {
+        if (hc->streams[i].sid == 0) {
+            break;
+        }
+    }
+
+    if (i == NGX_CHECK_GRPC_SLOTS) {
+        ngx_test_fail("too many streams on a connection");
+    }
+
+    st = &hc->streams[i];
+
+    ngx_memzero(st, sizeof(ngx_check_grpc_stream_t));
+
+    st->sid = sid;
+    st->id = value[0];
+    st->len = value[1];
+    st->body = value[2];
+    st->send_window = hc->init_window;
+    st->recv_window = NGX_CHECK_GRPC_WINDOW;
+
+    hc->nstreams++;
+
+    if (++hc->total == 2) {
+        ngx_check_grpc_sessions++;
+    }
+
+    if (flags & NGX_HTTP_V2_END_STREAM_FLAG) {
+
+        if (st->body) {
+            ngx_test_fail("request %ui without body", st->id);
+        }
+
+        ngx_check_grpc_complete(st);
+    }
+}
+
+
+static void
+ngx_check_grpc_data(ngx_check_grpc_conn_t *hc, ngx_uint_t flags,
+    ngx_uint_t sid, u_char *p, size_t size)
+{
+    size_t                    i, padding;
+    ngx_check_grpc_stream_t  *st;
+
+    if (size > hc->recv_window) {
+        ngx_test_fail("connection flow control violated: "
+                      "%uz bytes with window %uz", size, hc->recv_window);
+    }
+
+    hc->recv_window -= size;
+
+    st = ngx_check_grpc_stream(hc, sid);
+
+    if (st == NULL) {
+
+        if (hc->goaway && sid > hc->goaway) {
+            return;
+        }
+
+        ngx_test_fail("DATA of closed stream %ui", sid);
+    }
+
+    if (st->in_closed) {
+        ngx_test_fail("DATA after the end of stream %ui", sid);
+    }
+
+    if (size > st->recv_window) {
+        ngx_test_fail("stream %ui flow control violated: "
+                      "%uz bytes with window %uz", sid, size, st->recv_window);
+    }
+
+    st->recv_window -= size;
+
+    if (flags & NGX_HTTP_V2_PADDED_FLAG) {
+        if (size == 0 || p[0] >= size) {
+            ngx_test_fail("invalid padding of stream %ui", sid);
+        }
+
+        padding = p[0];
+        p++;
+        size -= 1 + padding;
+    }
+
+    for (i = 0; i < size; i++) {
+        if (st->received == st->body
+            || p[i] != ngx_check_grpc_body_byte(st->id, st->received))
+        {
+            ngx_test_fail("request %ui: invalid body byte at %uz",
+                          st->id, st->received);
+        }
+
+        st->received++;
+    }
+
+    if (flags & NGX_HTTP_V2_END_STREAM_FLAG) {
+
+        if (st->received != st->body) {
+            ngx_test_fail("request %ui: %uz of %uz body bytes",
+                          st->id, st->received, st->body);
+        }
+
+        ngx_check_grpc_complete(st);
+    }
+}
+
+
+static void
+ngx_check_grpc_complete(ngx_check_grpc_stream_t *st)
+{
+    ngx_check_grpc_phase_t  *ph;
+
+    ph = &ngx_check_grpc_phase;
+
+    st->in_closed = 1;
+
+    if (ph->phase != 'w' && !ph->released) {
+        st->held = 1;
+        ph->held++;
+    }
+}
+
+
+static ngx_check_grpc_stream_t *
+ngx_check_grpc_stream(ngx_check_grpc_conn_t *hc, ngx_uint_t sid)
+{
+    ngx_uint_t  i;
+
+    for (i = 0; i < NGX_CHECK_GRPC_SLOTS; i++) {
+        if (hc->streams[i].sid == sid && sid) {
+            return &hc->streams[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * nginx never refers to the dynamic table, so only the static entries
+ * of ":path" are known
+ */
+
+static ngx_int_t
+ngx_check_grpc_path(u_char *p, size_t size, ngx_str_t *path, u_char *buf)
+{
+    u_char      *end;
+    ngx_int_t    index;
+    ngx_str_t    name, value;
+    ngx_uint_t   prefix;
+    u_char       tmp[1024];
+
+    end = p + size;
+
+    ngx_str_null(path);
+
+    while (p < end) {
+
+        if (*p & 0x80) {
+            index = ngx_check_grpc_integer(&p, end, 7);
+
+            if (index <= 0 || index > 61) {
+                return NGX_ERROR;
+            }
+
+            if (index == 4) {
+                ngx_str_set(path, "/");
+
+            } else if (index == 5) {
+                ngx_str_set(path, "/index.html");
+            }
+
+            continue;
+        }
+
+        if ((*p & 0xe0) == 0x20) {
+
+            /* dynamic table size update */
+
+            if (ngx_check_grpc_integer(&p, end, 5) < 0) {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+
+        prefix = (*p & 0x40) ? 6 : 4;
+
+        index = ngx_check_grpc_integer(&p, end, prefix);
+
+        if (index < 0 || index > 61) {
+            return NGX_ERROR;
+        }
+
+        if (index == 0) {
+            if (ngx_check_grpc_string(&p, end, &name, tmp, sizeof(tmp))
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+        } else if (index == 4 || index == 5) {
+            ngx_str_set(&name, ":path");
+
+        } else {
+            ngx_str_null(&name);
+        }
+
+        if (name.len == 5 && ngx_strncmp(name.data, ":path", 5) == 0) {
+            if (ngx_check_grpc_string(&p, end, path, buf, 1024) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_check_grpc_string(&p, end, &value, tmp, sizeof(tmp))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return path->len ? NGX_OK : NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_check_grpc_string(u_char **pos, u_char *end, ngx_str_t *s, u_char *buf,
+    size_t size)
+{
+    u_char     *dst, state;
+    ngx_int_t   len;
+    ngx_uint_t  huff;
+
+    if (*pos == end) {
+        return NGX_ERROR;
+    }
+
+    huff = **pos & 0x80;
+
+    len = ngx_check_grpc_integer(pos, end, 7);
+
+    if (len < 0 || len > end - *pos) {
+        return NGX_ERROR;
+    }
+
+    if (huff) {
+        if ((size_t) len * 8 / 5 > size) {
+            return NGX_ERROR;
+        }
+
+        state = 0;
+        dst = buf;
+
+        if (ngx_http_huff_decode(&state, *pos, len, &dst, 1, ngx_test_log)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        s->len = dst - buf;
+
+    } else {
+        if ((size_t) len > size) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(buf, *pos, len);
+        s->len = len;
+    }
+
+    s->data = buf;
+    *pos += len;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_check_grpc_integer(u_char **pos, u_char *end, ngx_uint_t prefix)
+{
+    u_char      *p;
+    ngx_uint_t   mask, value, shift;
+
+    p = *pos;
+
+    if (p == end) {
+        return NGX_ERROR;
+    }
+
+    mask = (1 << prefix) - 1;
+    value = *p++ & mask;
+
+    if (value == mask) {
+        shift = 0;
+
+        do {
+            if (p == end || shift > 21) {
+                return NGX_ERROR;
+            }
+
+            value += (ngx_uint_t) (*p & 0x7f) << shift;
+            shift += 7;
+
+        } while (*p++ & 0x80);
+    }
+
+    *pos = p;
+
+    return value;
+}
+
+
+/*
+ * all requests of the phase are open: in the concurrent phase they must
+ * have come over the sessions, in the goaway phase every connection is
+ * sent GOAWAY and the streams above the middle one are left unanswered
+ */
+
+static void
+ngx_check_grpc_release(void)
+{
+    ngx_uint_t                i, k, n, sid, last, conns;
+    ngx_check_grpc_conn_t    *hc;
+    ngx_check_grpc_phase_t   *ph;
+    ngx_check_grpc_stream_t  *st;
+    ngx_uint_t                sids[NGX_CHECK_GRPC_SLOTS];
+    u_char                    *p;
+
+    ph = &ngx_check_grpc_phase;
+
+    if (ph->phase == 'w' || ph->released || ph->held < ph->n) {
+        return;
+    }
+
+    ph->released = 1;
+
+    conns = 0;
+
+    for (i = 0; i < NGX_CHECK_GRPC_CONNS; i++) {
+        hc = ngx_check_grpc_conns[i];
+
+        if (hc == NULL) {
+            continue;
+        }
+
+        /* the held stream ids, sorted */
+
+        n = 0;
+
+        for (k = 0; k < NGX_CHECK_GRPC_SLOTS; k++) {
+            if (!hc->streams[k].held) {
+                continue;
+            }
+
+            sid = hc->streams[k].sid;
+
+            for (last = n; last && sids[last - 1] > sid; last--) {
+                sids[last] = sids[last - 1];
+            }
+
+            sids[last] = sid;
+            n++;
+        }
+
+        if (n == 0) {
+            continue;
+        }
+
+        conns++;
+
+        last = sids[(n - 1) / 2];
+
+        if (ph->phase == 'g') {
+            p = ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_GOAWAY_FRAME, 0, 0, 8);
+            p = ngx_http_v2_write_sid(p, last);
+            (void) ngx_http_v2_write_uint32(p, 0);
+
+            hc->goaway = last;
+        }
+
+        for (k = 0; k < NGX_CHECK_GRPC_SLOTS; k++) {
+            st = &hc->streams[k];
+
+            if (!st->held) {
+                continue;
+            }
+
+            st->held = 0;
+
+            if (ph->phase == 'g' && st->sid > last) {
+                ph->refusals[st->id - ph->base] = 1;
+                ph->refused++;
+
+                st->sid = 0;
+                hc->nstreams--;
+            }
+        }
+    }
+
+    if (ph->phase == 'c' && conns != NGX_CHECK_GRPC_SESSIONS) {
+        ngx_test_fail("%ui concurrent requests over %ui connections "
+                      "instead of %d sessions",
+                      ph->n, conns, NGX_CHECK_GRPC_SESSIONS);
+    }
+}
+
+
+/*
+ * the request body windows are restored once exhausted, or when nothing
+ * arrived for a while
+ */
+
+static void
+ngx_check_grpc_restore(ngx_check_grpc_conn_t *hc, ngx_uint_t idle)
+{
+    ngx_uint_t                i;
+    ngx_check_grpc_stream_t  *st;
+
+    for (i = 0; i < NGX_CHECK_GRPC_SLOTS; i++) {
+        st = &hc->streams[i];
+
+        if (st->sid == 0 || st->in_closed) {
+            continue;
+        }
+
+        if (st->recv_window == 0) {
+            ngx_check_grpc_body_stalls++;
+
+        } else if (!idle || st->recv_window == NGX_CHECK_GRPC_WINDOW) {
+            continue;
+        }
+
+        ngx_check_grpc_window_update(hc, st->sid,
+                                     NGX_CHECK_GRPC_WINDOW - st->recv_window);
+
+        st->recv_window = NGX_CHECK_GRPC_WINDOW;
+    }
+
+    if (hc->recv_window == 0
+        || (idle && hc->recv_window < NGX_HTTP_V2_DEFAULT_WINDOW))
+    {
+        ngx_check_grpc_window_update(hc, 0,
+                               NGX_HTTP_V2_DEFAULT_WINDOW - hc->recv_window);
+
+        hc->recv_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+    }
+}
+
+
+/* responses are sent a frame per stream in turn, as the windows allow */
+
+static void
+ngx_check_grpc_output(ngx_check_grpc_conn_t *hc)
+{
+    u_char                   *p;
+    size_t                    n, k;
+    ngx_uint_t                i, sent, flags;
+    ngx_check_grpc_stream_t  *st;
+
+    do {
+        sent = 0;
+
+        for (i = 0; i < NGX_CHECK_GRPC_SLOTS; i++) {
+            st = &hc->streams[i];
+
+            if (hc->out_len >= NGX_CHECK_GRPC_OUTPUT) {
+                return;
+            }
+
+            if (st->sid == 0 || !st->in_closed || st->held) {
+                continue;
+            }
+
+            if (!st->headers_sent) {
+                st->headers_sent = 1;
+
+                flags = NGX_HTTP_V2_END_HEADERS_FLAG;
+
+                if (st->len == 0) {
+                    flags |= NGX_HTTP_V2_END_STREAM_FLAG;
+                }
+
+                /* ":status: 200" */
+
+                p = ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_HEADERS_FRAME,
+                                             flags, st->sid, 1);
+                *p = ngx_http_v2_indexed(NGX_HTTP_V2_STATUS_200_INDEX);
+
+                sent = 1;
+
+                if (st->len == 0) {
+                    st->sid = 0;
+                    hc->nstreams--;
+                    continue;
+                }
+            }
+
+            n = ngx_min(st->len - st->sent, NGX_HTTP_V2_DEFAULT_FRAME_SIZE);
+
+            if (st->send_window < (ssize_t) n) {
+                n = (st->send_window > 0) ? st->send_window : 0;
+            }
+
+            if (hc->send_window < (ssize_t) n) {
+                n = (hc->send_window > 0) ? hc->send_window : 0;
+            }
+
+            if (n == 0) {
+                if (st->send_window <= 0 && !st->stalled) {
+                    st->stalled = 1;
+                    ngx_check_grpc_stalls++;
+                }
+
+                continue;
+            }
+
+            flags = (st->sent + n == st->len) ? NGX_HTTP_V2_END_STREAM_FLAG
+                                              : 0;
+
+            p = ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_DATA_FRAME, flags,
+                                         st->sid, n);
+
+            for (k = 0; k < n; k++) {
+                p[k] = ngx_check_grpc_byte(st->id, st->sent + k);
+            }
+
+            st->sent += n;
+            st->send_window -= n;
+            hc->send_window -= n;
+
+            sent = 1;
+
+            if (flags) {
+                st->sid = 0;
+                hc->nstreams--;
+            }
+        }
+
+    } while (sent);
+}
+
+
+static u_char *
+ngx_check_grpc_frame_out(ngx_check_grpc_conn_t *hc, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, size_t size)
+{
+    u_char  *p;
+
+    if (hc->out_len + NGX_HTTP_V2_FRAME_HEADER_SIZE + size
+        > NGX_CHECK_GRPC_OUTPUT_SIZE)
+    {
+        ngx_test_fail("backend output overflow");
+    }
+
+    p = hc->out + hc->out_len;
+
+    *p++ = (u_char) (size >> 16);
+    *p++ = (u_char) (size >> 8);
+    *p++ = (u_char) size;
+    *p++ = (u_char) type;
+    *p++ = (u_char) flags;
+
+    p = ngx_http_v2_write_sid(p, sid);
+
+    hc->out_len += NGX_HTTP_V2_FRAME_HEADER_SIZE + size;
+
+    return p;
+}
+
+
+static void
+ngx_check_grpc_window_update(ngx_check_grpc_conn_t *hc, ngx_uint_t sid,
+    size_t window)
+{
+    u_char  *p;
+
+    p = ngx_check_grpc_frame_out(hc, NGX_HTTP_V2_WINDOW_UPDATE_FRAME, 0, sid,
+                                 4);
+    (void) ngx_http_v2_write_uint32(p, window);
+}
+
+
+static void
+ngx_check_grpc_write(ngx_check_grpc_conn_t *hc)
+{
+    ssize_t  n;
+
+    while (hc->out_pos < hc->out_len) {
+        n = send(hc->fd, hc->out + hc->out_pos, hc->out_len - hc->out_pos, 0);
+
+        if (n == -1) {
+            if (ngx_socket_errno == NGX_EAGAIN) {
+                break;
+            }
+
+            if (ngx_socket_errno == NGX_EPIPE
+                || ngx_socket_errno == NGX_ECONNRESET)
+            {
+                /* closed by nginx, the read handler will see it */
+                hc->out_pos = hc->out_len;
+                break;
+            }
+
+            ngx_test_fail("backend send() failed");
+        }
+
+        hc->out_pos += n;
+    }
+
+    if (hc->out_pos == 0) {
+        return;
+    }
+
+    hc->out_len -= hc->out_pos;
+    ngx_memmove(hc->out, hc->out + hc->out_pos, hc->out_len);
+    hc->out_pos = 0;
+}
+
+
+static void
+ngx_check_grpc_close(ngx_uint_t i)
+{
+    ngx_check_grpc_conn_t  *hc;
+
+    hc = ngx_check_grpc_conns[i];
+
+    if (hc->nstreams) {
+        ngx_test_fail("backend connection closed by nginx "
+                      "with %ui open streams", hc->nstreams);
+    }
+
+    close(hc->fd);
+
+    ngx_free(hc->in);
+    ngx_free(hc->out);
+    ngx_free(hc);
+
+    ngx_check_grpc_conns[i] = NULL;
+}
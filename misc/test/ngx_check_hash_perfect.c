@@ -0,0 +1,320 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * ngx_hash_find_perfect() must return the same as ngx_hash_find() over
+ * the same keys: for the known request headers as configured by
+ * ngx_http_init_headers_in_hash() and for random key sets, including
+ * the ones for which no perfect layout is found, both for the keys and
+ * for the names around them.
+ *
+ *     ngx_check_hash_perfect [lookups] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+#define NGX_CHECK_HASH_PERFECT_KEYS   255
+#define NGX_CHECK_HASH_PERFECT_NAME   40
+
+
+typedef struct {
+    ngx_hash_t           hash;
+    ngx_hash_perfect_t   perfect;
+    ngx_uint_t           nelts;
+    ngx_hash_key_t       keys[NGX_CHECK_HASH_PERFECT_KEYS];
+    u_char               names[NGX_CHECK_HASH_PERFECT_KEYS]
+                              [NGX_CHECK_HASH_PERFECT_NAME];
+} ngx_check_hash_perfect_t;
+
+
+static ngx_int_t ngx_check_hash_perfect_build(ngx_check_hash_perfect_t *h,
+    ngx_uint_t max_size, ngx_pool_t *pool);
+static void ngx_check_hash_perfect_random(ngx_check_hash_perfect_t *h);
+static size_t ngx_check_hash_perfect_name(ngx_check_hash_perfect_t *h,
+    u_char *name);
+static void ngx_check_hash_perfect_lookup(ngx_check_hash_perfect_t *h,
+    u_char *name, size_t len);
+
+
+static char  ngx_check_hash_perfect_chars[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+
+
+static ngx_check_hash_perfect_t  ngx_check_hash_perfect_set;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                     len;
+    uint64_t                   n, sets, declined;
+    ngx_int_t                  rc;
+    ngx_pool_t                *pool;
+    ngx_http_header_t         *header;
+    ngx_check_hash_perfect_t  *h;
+    u_char                     name[NGX_CHECK_HASH_PERFECT_NAME * 2];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 10000000;
+    }
+
+    h = &ngx_check_hash_perfect_set;
+
+    /* the known request headers */
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+    if (pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    for (header = ngx_http_headers_in; header->name.len; header++) {
+        h->keys[h->nelts].key = header->name;
+        h->keys[h->nelts].value = header;
+        h->nelts++;
+    }
+
+    if (ngx_check_hash_perfect_build(h, 1024, pool) != NGX_OK) {
+        ngx_test_fail("no perfect hash for %ui request headers", h->nelts);
+    }
+
+    for (n = 0; n < ngx_test_iterations / 2; n++) {
+        len = ngx_check_hash_perfect_name(h, name);
+        ngx_check_hash_perfect_lookup(h, name, len);
+    }
+
+    ngx_destroy_pool(pool);
+
+    /* random key sets, some of them too large for max_size */
+
+    sets = 0;
+    declined = 0;
+
+    for (n = 0; n < ngx_test_iterations / 2; n++) {
+
+        if (n % 1000 == 0) {
+            if (sets) {
+                ngx_destroy_pool(pool);
+            }
+
+            pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+            if (pool == NULL) {
+                ngx_test_fail("ngx_create_pool() failed");
+            }
+
+            ngx_check_hash_perfect_random(h);
+
+            rc = ngx_check_hash_perfect_build(h,
+                                              16 << ngx_test_random() % 7,
+                                              pool);
+            if (rc == NGX_DECLINED) {
+                declined++;
+            }
+
+            sets++;
+        }
+
+        len = ngx_check_hash_perfect_name(h, name);
+        ngx_check_hash_perfect_lookup(h, name, len);
+    }
+
+    if (sets) {
+        ngx_destroy_pool(pool);
+    }
+
+    printf("    %llu lookups, %llu random sets, %llu without a layout\n",
+           (unsigned long long) ngx_test_iterations,
+           (unsigned long long) sets, (unsigned long long) declined);
+
+    return 0;
+}
+
+
+/*
+ * the same as ngx_http_init_headers_in_hash(), the regular hash is larger
+ * to fit the random sets
+ */
+
+static ngx_int_t
+ngx_check_hash_perfect_build(ngx_check_hash_perfect_t *h,
+    ngx_uint_t max_size, ngx_pool_t *pool)
+{
+    ngx_int_t        rc;
+    ngx_uint_t       i;
+    ngx_hash_init_t  hash;
+
+    for (i = 0; i < h->nelts; i++) {
+        h->keys[i].key_hash = ngx_hash_key_lc(h->keys[i].key.data,
+                                              h->keys[i].key.len);
+    }
+
+    hash.hash = &h->hash;
+    hash.key = ngx_hash_key_lc;
+    hash.max_size = 4096;
+    hash.bucket_size = ngx_align(128, ngx_cacheline_size);
+    hash.name = "check_hash";
+    hash.pool = pool;
+    hash.temp_pool = NULL;
+
+    if (ngx_hash_init(&hash, h->keys, h->nelts) != NGX_OK) {
+        ngx_test_fail("ngx_hash_init() failed");
+    }
+
+    rc = ngx_hash_perfect_init(&h->perfect, &h->hash, h->keys, h->nelts,
+                               max_size, pool);
+
+    if (rc == NGX_ERROR) {
+        ngx_test_fail("ngx_hash_perfect_init() failed");
+    }
+
+    if (rc == NGX_DECLINED && h->perfect.index != NULL) {
+        ngx_test_fail("declined layout is used");
+    }
+
+    return rc;
+}
+
+
+static void
+ngx_check_hash_perfect_random(ngx_check_hash_perfect_t *h)
+{
+    u_char      *name;
+    size_t       len;
+    ngx_uint_t   i, k, nelts;
+
+    nelts = 1 + ngx_test_random() % NGX_CHECK_HASH_PERFECT_KEYS;
+
+    h->nelts = 0;
+
+    while (h->nelts < nelts) {
+        name = h->names[h->nelts];
+        len = 1 + ngx_test_random() % (NGX_CHECK_HASH_PERFECT_NAME - 1);
+
+        for (i = 0; i < len; i++) {
+            name[i] = ngx_check_hash_perfect_chars[ngx_test_random()
+                                % (sizeof(ngx_check_hash_perfect_chars) - 1)];
+        }
+
+        /* the keys are unique regardless of case */
+
+        for (k = 0; k < h->nelts; k++) {
+            if (h->keys[k].key.len == len
+                && ngx_strncasecmp(h->keys[k].key.data, name, len) == 0)
+            {
+                break;
+            }
+        }
+
+        if (k < h->nelts) {
+            continue;
+        }
+
+        h->keys[h->nelts].key.data = name;
+        h->keys[h->nelts].key.len = len;
+        h->keys[h->nelts].value = name;
+        h->nelts++;
+    }
+}
+
+
+/*
+ * a lowercased key, the key with one character changed, inserted
+ * or removed, a random name, or a different name with the same hash
+ */
+
+static size_t
+ngx_check_hash_perfect_name(ngx_check_hash_perfect_t *h, u_char *name)
+{
+    size_t       len;
+    ngx_str_t   *key;
+    ngx_uint_t   i, n;
+
+    key = &h->keys[ngx_test_random() % h->nelts].key;
+
+    len = key->len;
+    ngx_strlow(name, key->data, len);
+
+    switch (ngx_test_random() % 8) {
+
+    case 0:
+        name[ngx_test_random() % len] =
+            ngx_tolower(ngx_check_hash_perfect_chars[ngx_test_random()
+                            % (sizeof(ngx_check_hash_perfect_chars) - 1)]);
+        break;
+
+    case 1:
+        n = ngx_test_random() % (len + 1);
+        ngx_memmove(name + n + 1, name + n, len - n);
+        name[n] = ngx_tolower(ngx_check_hash_perfect_chars[ngx_test_random()
+                            % (sizeof(ngx_check_hash_perfect_chars) - 1)]);
+        len++;
+        break;
+
+    case 2:
+        if (len > 1) {
+            n = ngx_test_random() % len;
+            ngx_memmove(name + n, name + n + 1, len - n - 1);
+            len--;
+        }
+        break;
+
+    case 3:
+        len = 1 + ngx_test_random() % (NGX_CHECK_HASH_PERFECT_NAME - 1);
+
+        for (i = 0; i < len; i++) {
+            name[i] = ngx_tolower(ngx_check_hash_perfect_chars[
+                                      ngx_test_random()
+                                % (sizeof(ngx_check_hash_perfect_chars) - 1)]);
+        }
+        break;
+
+    /* the same key as the original name */
+
+    case 4:
+        ngx_memmove(name + 1, name, len);
+        name[0] = '\0';
+        len++;
+        break;
+
+    case 5:
+        if (len > 1) {
+            n = ngx_test_random() % (len - 1);
+            name[n] += 1;
+            name[n + 1] -= 31;
+        }
+        break;
+    }
+
+    return len;
+}
+
+
+static void
+ngx_check_hash_perfect_lookup(ngx_check_hash_perfect_t *h, u_char *name,
+    size_t len)
+{
+    void        *v, *p;
+    ngx_uint_t   key;
+
+    /* the same as r->header_hash and h->lowcase_key */
+
+    key = ngx_hash_key(name, len);
+
+    v = ngx_hash_find(&h->hash, key, name, len);
+    p = ngx_hash_find_perfect(&h->perfect, key, name, len);
+
+    if (v != p) {
+        ngx_test_fail("\"%*s\": %p instead of %p", len, name, p, v);
+    }
+}
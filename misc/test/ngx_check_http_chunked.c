@@ -0,0 +1,255 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Random chunked bodies with extensions and trailers, valid and broken,
+ * are fed to ngx_http_parse_chunked() with the SSE2 line scanner and to
+ * the scalar one, split at the same random buffer boundaries; the results,
+ * the buffer position and the parser context must be the same after
+ * every call.
+ *
+ *     ngx_check_http_chunked [bodies] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+#include <ngx_http_parse_scalar.h>
+
+
+#define NGX_CHECK_HTTP_CHUNKED_LEN  65536
+
+
+typedef struct {
+    ngx_buf_t            b;
+    ngx_http_chunked_t   ctx;
+} ngx_check_http_chunked_t;
+
+
+static u_char *ngx_check_http_chunked_body(u_char *p, u_char *end);
+static u_char *ngx_check_http_chunked_line(u_char *p, ngx_uint_t n);
+static void ngx_check_http_chunked_run(u_char *start, u_char *end);
+static void ngx_check_http_chunked_data(ngx_check_http_chunked_t *c);
+
+
+static ngx_connection_t    ngx_check_http_chunked_connection;
+static ngx_http_request_t  ngx_check_http_chunked_request;
+
+static u_char  ngx_check_http_chunked_buf[NGX_CHECK_HTTP_CHUNKED_LEN];
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char      *p, *last;
+    uint64_t     n;
+    ngx_uint_t   i;
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 100000;
+    }
+
+    ngx_check_http_chunked_connection.log = ngx_test_log;
+    ngx_check_http_chunked_request.connection =
+                                            &ngx_check_http_chunked_connection;
+
+    for (n = 0; n < ngx_test_iterations; n++) {
+
+        p = ngx_check_http_chunked_buf;
+
+        last = ngx_check_http_chunked_body(p, p + NGX_CHECK_HTTP_CHUNKED_LEN);
+
+        if (ngx_test_random() % 4 == 0) {
+            for (i = ngx_test_random() % 4; i < 4; i++) {
+                p[ngx_test_random() % (last - p)] = (u_char) ngx_test_random();
+            }
+        }
+
+        ngx_check_http_chunked_run(p, last);
+    }
+
+    printf("    %llu bodies\n", (unsigned long long) ngx_test_iterations);
+
+    return 0;
+}
+
+
+static u_char *
+ngx_check_http_chunked_body(u_char *p, u_char *end)
+{
+    ngx_uint_t  i, n, size, chunks;
+
+    chunks = ngx_test_random() % 8;
+
+    for (i = 0; i <= chunks; i++) {
+
+        size = (i == chunks) ? 0 : ngx_test_random() % 300;
+
+        for (n = ngx_test_random() % 4; n; n--) {
+            *p++ = '0';
+        }
+
+        p = ngx_sprintf(p, (ngx_test_random() % 2) ? "%xi" : "%Xi", size);
+
+        /* extensions, some of them longer than a vector */
+
+        n = ngx_test_random() % 4;
+
+        while (n--) {
+            *p++ = ';';
+            p = ngx_check_http_chunked_line(p, ngx_test_random() % 8
+                                               ? ngx_test_random() % 24
+                                               : ngx_test_random() % 200);
+        }
+
+        p = ngx_cpymem(p, CRLF, ngx_test_random() % 8 ? 2 : 1);
+
+        if (size) {
+            while (size--) {
+                *p++ = (u_char) ngx_test_random();
+            }
+
+            p = ngx_cpymem(p, CRLF, ngx_test_random() % 8 ? 2 : 1);
+        }
+    }
+
+    /* trailers */
+
+    n = ngx_test_random() % 4;
+
+    while (n--) {
+        p = ngx_check_http_chunked_line(p, ngx_test_random() % 8
+                                           ? ngx_test_random() % 40
+                                           : ngx_test_random() % 400);
+
+        p = ngx_cpymem(p, CRLF, ngx_test_random() % 8 ? 2 : 1);
+    }
+
+    p = ngx_cpymem(p, CRLF, ngx_test_random() % 8 ? 2 : 1);
+
+    if (p > end) {
+        ngx_test_fail("buffer overflow");
+    }
+
+    return p;
+}
+
+
+static u_char *
+ngx_check_http_chunked_line(u_char *p, ngx_uint_t n)
+{
+    static char  usual[] = "abcdefghijklmnopqrstuvwxyz0123456789=\":; \t";
+
+    while (n--) {
+        if (ngx_test_random() % 64 == 0) {
+            *p++ = (u_char) ngx_test_random();
+
+        } else {
+            *p++ = usual[ngx_test_random() % (sizeof(usual) - 1)];
+        }
+    }
+
+    return p;
+}
+
+
+static void
+ngx_check_http_chunked_run(u_char *start, u_char *end)
+{
+    ngx_int_t                  rcv, rcs;
+    ngx_http_request_t        *r;
+    ngx_check_http_chunked_t   v, s;
+
+    r = &ngx_check_http_chunked_request;
+
+    ngx_memzero(&v, sizeof(ngx_check_http_chunked_t));
+
+    v.b.start = start;
+    v.b.pos = start;
+    v.b.last = start;
+    v.b.end = end;
+
+    s = v;
+
+    for ( ;; ) {
+
+        if (v.b.last == end) {
+            return;
+        }
+
+        if (ngx_test_random() % 2) {
+            v.b.last = end;
+
+        } else {
+            v.b.last += ngx_min(1 + ngx_test_random() % 64,
+                                (ngx_uint_t) (end - v.b.last));
+        }
+
+        s.b.last = v.b.last;
+
+        for ( ;; ) {
+
+            rcv = ngx_http_parse_chunked(r, &v.b, &v.ctx);
+            rcs = ngx_http_parse_chunked_scalar(r, &s.b, &s.ctx);
+
+            if (rcv != rcs) {
+                ngx_test_fail("%i instead of %i at offset %uz",
+                              rcv, rcs, s.b.pos - start);
+            }
+
+            if (v.b.pos != s.b.pos) {
+                ngx_test_fail("stopped at offset %uz instead of %uz",
+                              v.b.pos - start, s.b.pos - start);
+            }
+
+            if (v.ctx.state != s.ctx.state
+                || v.ctx.size != s.ctx.size
+                || v.ctx.length != s.ctx.length)
+            {
+                ngx_test_fail("context %ui:%O:%O instead of %ui:%O:%O",
+                              v.ctx.state, v.ctx.size, v.ctx.length,
+                              s.ctx.state, s.ctx.size, s.ctx.length);
+            }
+
+            if (rcv != NGX_OK) {
+                break;
+            }
+
+            ngx_check_http_chunked_data(&v);
+            ngx_check_http_chunked_data(&s);
+        }
+
+        if (rcv != NGX_AGAIN) {
+            return;
+        }
+    }
+}
+
+
+/* the same as ngx_http_request_body_chunked_filter() */
+
+static void
+ngx_check_http_chunked_data(ngx_check_http_chunked_t *c)
+{
+    size_t  size;
+
+    size = c->b.last - c->b.pos;
+
+    if ((off_t) size > c->ctx.size) {
+        c->b.pos += (size_t) c->ctx.size;
+        c->ctx.size = 0;
+
+    } else {
+        c->ctx.size -= size;
+        c->b.pos = c->b.last;
+    }
+}
@@ -0,0 +1,379 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Random sets of static locations, exact and prefix ones, some of them
+ * with auto_redirect, are compiled by ngx_http_init_locations() into the
+ * radix trie and into the previous binary tree; for URIs around the
+ * location names ngx_http_core_find_static_location() must return the
+ * same result and configuration as the previous walk.  Every tenth set
+ * has 3000 locations.
+ *
+ *     ngx_check_http_location [uris] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+#include <ngx_http_location_tree.h>
+
+
+#define NGX_CHECK_HTTP_LOCATION_MAX   3000
+#define NGX_CHECK_HTTP_LOCATION_URIS  1000
+#define NGX_CHECK_HTTP_LOCATION_NAME  64
+
+
+typedef struct {
+    ngx_pool_t                      *pool;
+    ngx_http_location_trie_t        *trie;
+    ngx_http_location_tree_node_t   *tree;
+    ngx_uint_t                       nelts;
+    ngx_http_core_loc_conf_t        *locations[NGX_CHECK_HTTP_LOCATION_MAX];
+} ngx_check_http_location_t;
+
+
+static void ngx_check_http_location_conf(ngx_check_http_location_t *l,
+    ngx_uint_t n);
+static size_t ngx_check_http_location_name(ngx_check_http_location_t *l,
+    u_char *name);
+static size_t ngx_check_http_location_uri(ngx_check_http_location_t *l,
+    u_char *uri);
+static ngx_int_t ngx_check_http_location_find(ngx_check_http_location_t *l,
+    u_char *uri, size_t len);
+
+
+static char  ngx_check_http_location_chars[] = "/////abcxyzAB.-_09";
+
+
+static ngx_connection_t           ngx_check_http_location_connection;
+static ngx_http_request_t         ngx_check_http_location_request;
+static ngx_check_http_location_t  ngx_check_http_location_set;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                      len;
+    uint64_t                    n, sets, rcs[4];
+    ngx_int_t                   rc;
+    ngx_check_http_location_t  *l;
+    u_char                      uri[NGX_CHECK_HTTP_LOCATION_NAME * 2];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 1000000;
+    }
+
+    ngx_check_http_location_connection.log = ngx_test_log;
+    ngx_check_http_location_request.connection =
+                                          &ngx_check_http_location_connection;
+
+    l = &ngx_check_http_location_set;
+
+    sets = 0;
+    ngx_memzero(rcs, sizeof(rcs));
+
+    for (n = 0; n < ngx_test_iterations; n++) {
+
+        if (n % NGX_CHECK_HTTP_LOCATION_URIS == 0) {
+            if (sets) {
+                ngx_destroy_pool(l->pool);
+            }
+
+            ngx_check_http_location_conf(l, (sets % 10 == 0)
+                                  ? NGX_CHECK_HTTP_LOCATION_MAX
+                                  : 1 + ngx_test_random() % 300);
+            sets++;
+        }
+
+        len = ngx_check_http_location_uri(l, uri);
+
+        rc = ngx_check_http_location_find(l, uri, len);
+
+        switch (rc) {
+
+        case NGX_OK:
+            rcs[0]++;
+            break;
+
+        case NGX_AGAIN:
+            rcs[1]++;
+            break;
+
+        case NGX_DONE:
+            rcs[2]++;
+            break;
+
+        default:
+            rcs[3]++;
+        }
+    }
+
+    if (sets) {
+        ngx_destroy_pool(l->pool);
+    }
+
+    printf("    %llu uris, %llu location sets\n"
+           "    %llu exact, %llu prefix, %llu redirects, %llu unmatched\n",
+           (unsigned long long) ngx_test_iterations,
+           (unsigned long long) sets,
+           (unsigned long long) rcs[0], (unsigned long long) rcs[1],
+           (unsigned long long) rcs[2], (unsigned long long) rcs[3]);
+
+    return 0;
+}
+
+
+/* the same as ngx_http_core_location() with unique names */
+
+static void
+ngx_check_http_location_conf(ngx_check_http_location_t *l, ngx_uint_t n)
+{
+    u_char                     name[NGX_CHECK_HTTP_LOCATION_NAME];
+    size_t                     len;
+    ngx_uint_t                 i, exact;
+    ngx_conf_t                 cf;
+    ngx_conf_file_t            conf_file;
+    ngx_http_core_srv_conf_t  *cscf;
+    ngx_http_core_loc_conf_t  *clcf, *pclcf;
+
+    l->pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+    if (l->pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    ngx_memzero(&cf, sizeof(ngx_conf_t));
+    ngx_memzero(&conf_file, sizeof(ngx_conf_file_t));
+
+    ngx_str_set(&conf_file.file.name, "check");
+
+    cf.pool = l->pool;
+    cf.temp_pool = l->pool;
+    cf.log = ngx_test_log;
+    cf.conf_file = &conf_file;
+
+    cscf = ngx_pcalloc(l->pool, sizeof(ngx_http_core_srv_conf_t));
+    pclcf = ngx_pcalloc(l->pool, sizeof(ngx_http_core_loc_conf_t));
+
+    if (cscf == NULL || pclcf == NULL) {
+        ngx_test_fail("ngx_pcalloc() failed");
+    }
+
+    l->nelts = 0;
+
+    while (l->nelts < n) {
+
+        len = ngx_check_http_location_name(l, name);
+        exact = (ngx_test_random() % 5 == 0);
+
+        for (i = 0; i < l->nelts; i++) {
+            clcf = l->locations[i];
+
+            if (clcf->exact_match == exact
+                && clcf->name.len == len
+                && ngx_memcmp(clcf->name.data, name, len) == 0)
+            {
+                break;
+            }
+        }
+
+        if (i < l->nelts) {
+            continue;
+        }
+
+        clcf = ngx_pcalloc(l->pool, sizeof(ngx_http_core_loc_conf_t));
+        if (clcf == NULL) {
+            ngx_test_fail("ngx_pcalloc() failed");
+        }
+
+        /* null-terminated as the configuration arguments */
+
+        clcf->name.data = ngx_pnalloc(l->pool, len + 1);
+        if (clcf->name.data == NULL) {
+            ngx_test_fail("ngx_pnalloc() failed");
+        }
+
+        ngx_cpystrn(clcf->name.data, name, len + 1);
+        clcf->name.len = len;
+        clcf->exact_match = exact;
+
+        /* as set by proxy_pass and others */
+
+        if (name[len - 1] == '/' && ngx_test_random() % 2) {
+            clcf->auto_redirect = 1;
+        }
+
+        /* only compared */
+
+        clcf->loc_conf = (void **) clcf;
+
+        conf_file.line = l->nelts;
+
+        if (ngx_http_add_location(&cf, &pclcf->locations, clcf) != NGX_OK) {
+            ngx_test_fail("ngx_http_add_location() failed");
+        }
+
+        l->locations[l->nelts++] = clcf;
+    }
+
+    if (ngx_test_http_init_locations(&cf, cscf, pclcf) != NGX_OK) {
+        ngx_test_fail("ngx_test_http_init_locations() failed");
+    }
+
+    l->trie = pclcf->static_locations;
+
+    l->tree = ngx_http_location_tree_create(&cf, pclcf->locations);
+    if (l->tree == NULL) {
+        ngx_test_fail("ngx_http_location_tree_create() failed");
+    }
+}
+
+
+/* a slash, or an existing name, mostly, with a few more characters */
+
+static size_t
+ngx_check_http_location_name(ngx_check_http_location_t *l, u_char *name)
+{
+    size_t                     len, n;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (l->nelts == 0 || ngx_test_random() % 8 == 0) {
+        name[0] = '/';
+        len = 1;
+
+    } else {
+        clcf = l->locations[ngx_test_random() % l->nelts];
+
+        len = 1 + ngx_test_random() % (NGX_CHECK_HTTP_LOCATION_NAME / 2);
+        len = ngx_min(len, clcf->name.len);
+
+        ngx_memcpy(name, clcf->name.data, len);
+    }
+
+    n = 1 + ngx_test_random() % 8;
+    n = ngx_min(n, NGX_CHECK_HTTP_LOCATION_NAME - len);
+
+    while (n--) {
+        name[len++] = (ngx_test_random() % 64)
+                      ? ngx_check_http_location_chars[ngx_test_random()
+                                % (sizeof(ngx_check_http_location_chars) - 1)]
+                      : (u_char) (0x80 + ngx_test_random() % 0x80);
+    }
+
+    return len;
+}
+
+
+/*
+ * a location name as is, longer, shorter by one or more characters,
+ * with a character changed or of the other case, or a random URI
+ */
+
+static size_t
+ngx_check_http_location_uri(ngx_check_http_location_t *l, u_char *uri)
+{
+    size_t                     len, n;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = l->locations[ngx_test_random() % l->nelts];
+
+    len = clcf->name.len;
+    ngx_memcpy(uri, clcf->name.data, len);
+
+    switch (ngx_test_random() % 8) {
+
+    case 0:
+        break;
+
+    case 1:
+    case 2:
+        n = 1 + ngx_test_random() % 16;
+
+        while (n--) {
+            uri[len++] = (ngx_test_random() % 32)
+                         ? ngx_check_http_location_chars[ngx_test_random()
+                                  % (sizeof(ngx_check_http_location_chars) - 1)]
+                         : (u_char) ngx_test_random();
+        }
+
+        break;
+
+    case 3:
+        len--;
+        break;
+
+    case 4:
+        len = ngx_test_random() % len;
+        break;
+
+    case 5:
+        uri[ngx_test_random() % len] = ngx_check_http_location_chars[
+                                           ngx_test_random()
+                                 % (sizeof(ngx_check_http_location_chars) - 1)];
+        break;
+
+    case 6:
+        n = ngx_test_random() % len;
+
+        if ((uri[n] | 0x20) >= 'a' && (uri[n] | 0x20) <= 'z') {
+            uri[n] ^= 0x20;
+        }
+
+        break;
+
+    default:
+        len = ngx_test_random() % NGX_CHECK_HTTP_LOCATION_NAME;
+
+        for (n = 0; n < len; n++) {
+            uri[n] = ngx_check_http_location_chars[ngx_test_random()
+                                 % (sizeof(ngx_check_http_location_chars) - 1)];
+        }
+    }
+
+    return len;
+}
+
+
+static ngx_int_t
+ngx_check_http_location_find(ngx_check_http_location_t *l, u_char *uri,
+    size_t len)
+{
+    void                **conf;
+    ngx_int_t             rc, rv;
+    ngx_str_t            *trie, *tree;
+    ngx_http_request_t   *r;
+
+    static ngx_str_t  none = ngx_string("none");
+
+    r = &ngx_check_http_location_request;
+
+    r->uri.data = uri;
+    r->uri.len = len;
+
+    r->loc_conf = NULL;
+    rc = ngx_test_http_find_static_location(r, l->trie);
+    conf = r->loc_conf;
+
+    r->loc_conf = NULL;
+    rv = ngx_http_location_tree_find(r, l->tree);
+
+    if (rc != rv || conf != r->loc_conf) {
+        /* loc_conf points to the location itself, its name comes first */
+
+        trie = conf ? (ngx_str_t *) conf : &none;
+        tree = r->loc_conf ? (ngx_str_t *) r->loc_conf : &none;
+
+        ngx_test_fail("\"%*s\": %i \"%V\" instead of %i \"%V\"",
+                      len, uri, rc, trie, rv, tree);
+    }
+
+    return rc;
+}
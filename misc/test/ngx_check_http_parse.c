@@ -0,0 +1,351 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Random request lines and header blocks, valid and broken, are fed
+ * to the parser with the SSE2 fast paths and to the scalar one, split
+ * at the same random buffer boundaries; the results and all the request
+ * fields set by the parsers must be the same after every call.
+ *
+ *     ngx_check_http_parse [messages] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+#include <ngx_http_parse_scalar.h>
+
+
+#define NGX_CHECK_HTTP_PARSE_LEN  16384
+
+#define ngx_check_http_parse_nelts(a)                                         \
+    (sizeof(ngx_check_http_parse_##a) / sizeof(char *))
+
+
+typedef struct {
+    ngx_http_request_t   r;
+    ngx_buf_t            b;
+} ngx_check_http_parse_t;
+
+
+static u_char *ngx_check_http_parse_request(u_char *p);
+static u_char *ngx_check_http_parse_string(u_char *p, ngx_uint_t n,
+    const char *usual);
+static void ngx_check_http_parse_run(u_char *start, u_char *end);
+static void ngx_check_http_parse_compare(ngx_check_http_parse_t *v,
+    ngx_check_http_parse_t *s, u_char *start);
+
+
+static ngx_connection_t  ngx_check_http_parse_connection;
+
+static char  *ngx_check_http_parse_methods[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "MKCOL", "COPY", "MOVE",
+    "OPTIONS", "PROPFIND", "PROPPATCH", "LOCK", "UNLOCK", "PATCH", "TRACE",
+    "CONNECT", "get", "G", "GETS", "PROPFINDX", ""
+};
+
+static char  *ngx_check_http_parse_versions[] = {
+    " HTTP/1.1", " HTTP/1.0", " HTTP/2.0", " HTTP/1.10", " HTTP/10.1",
+    " HTTP/1", " HTTP/1.", " http/1.1", " HTTP/1.1 ", "  HTTP/1.1", ""
+};
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char      *p, *last;
+    uint64_t     n;
+    ngx_uint_t   i;
+    u_char       buf[NGX_CHECK_HTTP_PARSE_LEN];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 200000;
+    }
+
+    ngx_check_http_parse_connection.log = ngx_test_log;
+
+    for (n = 0; n < ngx_test_iterations; n++) {
+
+        last = ngx_check_http_parse_request(buf);
+
+        /* corrupt some of the messages */
+
+        if (ngx_test_random() % 4 == 0) {
+            for (i = ngx_test_random() % 4; i < 4; i++) {
+                p = buf + ngx_test_random() % (last - buf);
+                *p = (u_char) ngx_test_random();
+            }
+        }
+
+        ngx_check_http_parse_run(buf, last);
+    }
+
+    printf("    %llu messages\n", (unsigned long long) ngx_test_iterations);
+
+    return 0;
+}
+
+
+static u_char *
+ngx_check_http_parse_request(u_char *p)
+{
+    char        *s;
+    ngx_uint_t   i, n, headers;
+
+    s = ngx_check_http_parse_methods[ngx_test_random()
+                                     % ngx_check_http_parse_nelts(methods)];
+    p = ngx_cpymem(p, s, ngx_strlen(s));
+
+    *p++ = ' ';
+
+    switch (ngx_test_random() % 8) {
+
+    case 0:
+        p = ngx_cpymem(p, "http://", 7);
+        p = ngx_check_http_parse_string(p, ngx_test_random() % 24,
+                                        "abcxyz019.-[]:");
+        if (ngx_test_random() % 2) {
+            p = ngx_sprintf(p, ":%uD", ngx_test_random() % 70000);
+        }
+        break;
+
+    case 1:
+        *p++ = '*';
+        break;
+
+    case 2:
+        *p++ = ' ';
+        break;
+    }
+
+    n = ngx_test_random() % 8 ? ngx_test_random() % 48
+                              : ngx_test_random() % 400;
+
+    if (n) {
+        *p++ = '/';
+        p = ngx_check_http_parse_string(p, n - 1,
+                                        "abcdefghijklmnopqrstuvwxyz0123456789"
+                                        "abcdefghijklmnopqrstuvwxyz0123456789"
+                                        "ABCXYZ/////...%%%???##++&&==;~-_"
+                                        "\x7f\x80\xc3\xff");
+    }
+
+    s = ngx_check_http_parse_versions[ngx_test_random()
+                                      % ngx_check_http_parse_nelts(versions)];
+    p = ngx_cpymem(p, s, ngx_strlen(s));
+
+    p = ngx_cpymem(p, CRLF, ngx_test_random() % 8 ? 2 : 1);
+
+    headers = ngx_test_random() % 12;
+
+    for (i = 0; i < headers; i++) {
+
+        n = ngx_test_random() % 8 ? ngx_test_random() % 40
+                                  : ngx_test_random() % 100;
+
+        p = ngx_check_http_parse_string(p, n,
+                                        "abcdefghijklmnopqrstuvwxyz0123456789"
+                                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ----"
+                                        "_. \x80\xff");
+
+        if (ngx_test_random() % 16) {
+            *p++ = ':';
+        }
+
+        if (ngx_test_random() % 2) {
+            p = ngx_cpymem(p, "   ", 1 + ngx_test_random() % 3);
+        }
+
+        n = ngx_test_random() % 8 ? ngx_test_random() % 64
+                                  : ngx_test_random() % 600;
+
+        p = ngx_check_http_parse_string(p, n,
+                                        "abcdefghijklmnopqrstuvwxyz0123456789"
+                                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ,;=\"/()"
+                                        "   \t\x80\xc3\xff");
+
+        switch (ngx_test_random() % 16) {
+        case 0:
+            *p++ = CR;
+            break;
+        case 1:
+            *p++ = LF;
+            break;
+        default:
+            *p++ = CR; *p++ = LF;
+        }
+    }
+
+    *p++ = CR; *p++ = LF;
+
+    return p;
+}
+
+
+/*
+ * the characters are taken from "usual", with a small chance of
+ * any byte at all, including CR, LF and NUL
+ */
+
+static u_char *
+ngx_check_http_parse_string(u_char *p, ngx_uint_t n, const char *usual)
+{
+    size_t  len;
+
+    len = ngx_strlen(usual);
+
+    while (n--) {
+        if (ngx_test_random() % 64 == 0) {
+            *p++ = (u_char) ngx_test_random();
+
+        } else {
+            *p++ = usual[ngx_test_random() % len];
+        }
+    }
+
+    return p;
+}
+
+
+static void
+ngx_check_http_parse_run(u_char *start, u_char *end)
+{
+    ngx_int_t                rcv, rcs;
+    ngx_uint_t               headers, underscores;
+    ngx_check_http_parse_t   v, s;
+
+    ngx_memzero(&v, sizeof(ngx_check_http_parse_t));
+    ngx_memzero(&s, sizeof(ngx_check_http_parse_t));
+
+    v.r.connection = &ngx_check_http_parse_connection;
+    s.r.connection = &ngx_check_http_parse_connection;
+
+    v.b.start = start;
+    v.b.pos = start;
+    v.b.last = start;
+    v.b.end = end;
+
+    s.b = v.b;
+
+    underscores = ngx_test_random() % 2;
+    headers = 0;
+
+    for ( ;; ) {
+
+        /* the next part of the message arrives */
+
+        if (v.b.last == end) {
+            return;
+        }
+
+        if (ngx_test_random() % 2) {
+            v.b.last = end;
+
+        } else {
+            v.b.last += ngx_min(1 + ngx_test_random() % 40,
+                                (ngx_uint_t) (end - v.b.last));
+        }
+
+        s.b.last = v.b.last;
+
+        for ( ;; ) {
+
+            if (headers) {
+                rcv = ngx_http_parse_header_line(&v.r, &v.b, underscores);
+                rcs = ngx_http_parse_header_line_scalar(&s.r, &s.b,
+                                                        underscores);
+
+            } else {
+                rcv = ngx_http_parse_request_line(&v.r, &v.b);
+                rcs = ngx_http_parse_request_line_scalar(&s.r, &s.b);
+            }
+
+            if (rcv != rcs) {
+                ngx_test_fail("%s: %i instead of %i at offset %uz",
+                              headers ? "header" : "request line",
+                              rcv, rcs, s.b.pos - start);
+            }
+
+            ngx_check_http_parse_compare(&v, &s, start);
+
+            if (rcv == NGX_AGAIN) {
+                break;
+            }
+
+            if (rcv != NGX_OK) {
+                return;
+            }
+
+            /* the same as ngx_http_process_request_line() */
+
+            headers = 1;
+        }
+    }
+}
+
+
+#define ngx_check_http_parse_field(field)                                     \
+    if (v->field != s->field) {                                               \
+        ngx_test_fail("\"%s\" differs", #field);                              \
+    }
+
+
+static void
+ngx_check_http_parse_compare(ngx_check_http_parse_t *v,
+    ngx_check_http_parse_t *s, u_char *start)
+{
+    if (v->b.pos != s->b.pos) {
+        ngx_test_fail("stopped at offset %uz instead of %uz",
+                      v->b.pos - start, s->b.pos - start);
+    }
+
+    ngx_check_http_parse_field(r.state);
+    ngx_check_http_parse_field(r.method);
+    ngx_check_http_parse_field(r.http_version);
+    ngx_check_http_parse_field(r.http_major);
+    ngx_check_http_parse_field(r.http_minor);
+    ngx_check_http_parse_field(r.http_protocol.data);
+
+    ngx_check_http_parse_field(r.request_start);
+    ngx_check_http_parse_field(r.request_end);
+    ngx_check_http_parse_field(r.method_end);
+    ngx_check_http_parse_field(r.uri_start);
+    ngx_check_http_parse_field(r.uri_end);
+    ngx_check_http_parse_field(r.uri_ext);
+    ngx_check_http_parse_field(r.args_start);
+    ngx_check_http_parse_field(r.schema_start);
+    ngx_check_http_parse_field(r.schema_end);
+    ngx_check_http_parse_field(r.host_start);
+    ngx_check_http_parse_field(r.host_end);
+    ngx_check_http_parse_field(r.port_start);
+    ngx_check_http_parse_field(r.port_end);
+
+    ngx_check_http_parse_field(r.complex_uri);
+    ngx_check_http_parse_field(r.quoted_uri);
+    ngx_check_http_parse_field(r.plus_in_uri);
+    ngx_check_http_parse_field(r.empty_path_in_uri);
+
+    ngx_check_http_parse_field(r.header_name_start);
+    ngx_check_http_parse_field(r.header_name_end);
+    ngx_check_http_parse_field(r.header_start);
+    ngx_check_http_parse_field(r.header_end);
+    ngx_check_http_parse_field(r.header_hash);
+    ngx_check_http_parse_field(r.lowcase_index);
+    ngx_check_http_parse_field(r.invalid_header);
+
+    if (ngx_memcmp(v->r.lowcase_header, s->r.lowcase_header,
+                   NGX_HTTP_LC_HEADER_LEN)
+        != 0)
+    {
+        ngx_test_fail("\"r.lowcase_header\" differs");
+    }
+}
@@ -0,0 +1,618 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Thousands of short HTTP/2 streams on one connection, the way
+ * "nghttp -m" sends them: rounds of concurrent requests, each round
+ * answered in full before the next one, so that the connection goes
+ * idle in between.  nginx is started from the objects of the tree in
+ * a child process; the stream pools and fake connections cached by the
+ * connection must be reused across the rounds, as reported by
+ * $http2_pool_hits and $http2_conn_hits.  A last round follows an idle
+ * second, after which the cached memory is released.
+ *
+ *     ngx_check_http_v2_pool [rounds] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+#define NGX_CHECK_H2_STREAMS      100
+#define NGX_CHECK_H2_TIMEOUT      10
+
+#define NGX_CHECK_H2_BUFFER                                                   \
+    (NGX_HTTP_V2_FRAME_HEADER_SIZE + NGX_HTTP_V2_DEFAULT_FRAME_SIZE)
+
+
+static void ngx_check_h2_start(void);
+static void ngx_check_h2_wait(void);
+static void ngx_check_h2_stop(void);
+static void ngx_check_h2_exit(void);
+static ngx_int_t ngx_check_h2_delete_file(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static ngx_int_t ngx_check_h2_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path);
+static ngx_int_t ngx_check_h2_delete_dir(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static int ngx_check_h2_connect(void);
+static void ngx_check_h2_round(int fd, ngx_uint_t n, u_char *path,
+    u_char *body, size_t *len);
+static u_char *ngx_check_h2_frame(u_char *p, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, size_t size);
+static void ngx_check_h2_read(int fd, u_char *buf, size_t size);
+static void ngx_check_h2_write(int fd, u_char *buf, size_t size);
+
+
+static char  ngx_check_h2_conf[] =
+    "daemon off;" CRLF
+    "master_process off;" CRLF
+    "pid %s/nginx.pid;" CRLF
+    "error_log %s/error.log info;" CRLF
+    CRLF
+    "events {" CRLF
+    "    worker_connections 64;" CRLF
+    "}" CRLF
+    CRLF
+    "http {" CRLF
+    "    access_log off;" CRLF
+    "    keepalive_requests 100000;" CRLF
+    CRLF
+    "    server {" CRLF
+    "        listen unix:%s/nginx.sock http2;" CRLF
+    CRLF
+    "        location / {" CRLF
+    "            return 200 \"ok\";" CRLF
+    "        }" CRLF
+    CRLF
+    "        location = /stats {" CRLF
+    "            return 200 \"$http2_pool_hits $http2_pool_misses "
+                            "$http2_pool_drops $http2_conn_hits "
+                            "$http2_conn_misses\";" CRLF
+    "        }" CRLF
+    "    }" CRLF
+    "}" CRLF;
+
+
+static char        ngx_check_h2_prefix[] = "/tmp/ngx_check_h2.XXXXXX";
+static ngx_uint_t  ngx_check_h2_kept;
+static ngx_pid_t   ngx_check_h2_pid;
+static ngx_uint_t  ngx_check_h2_sid = 1;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    int         fd;
+    size_t      len;
+    u_char     *p;
+    ngx_uint_t  i, v2, stats[5];
+    u_char      body[256], preface[64];
+
+    v2 = 0;
+
+    for (i = 0; ngx_module_names[i]; i++) {
+        if (ngx_strcmp(ngx_module_names[i], "ngx_http_v2_module") == 0) {
+            v2 = 1;
+        }
+    }
+
+    if (!v2) {
+        printf("    no http2 module\n");
+        return 0;
+    }
+
+    /* nginx is started first, so that its main() sees a fresh process */
+
+    ngx_check_h2_start();
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 20;
+    }
+
+    ngx_check_h2_wait();
+
+    fd = ngx_check_h2_connect();
+
+    if (fd == -1) {
+        ngx_test_fail("connect() failed");
+    }
+
+    p = ngx_cpymem(preface, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+    p = ngx_check_h2_frame(p, NGX_HTTP_V2_SETTINGS_FRAME, 0, 0, 0);
+
+    ngx_check_h2_write(fd, preface, p - preface);
+
+    for (i = 0; i < ngx_test_iterations; i++) {
+        ngx_check_h2_round(fd, NGX_CHECK_H2_STREAMS, (u_char *) "/", NULL,
+                           NULL);
+
+        /* the connection is idle for a moment */
+
+        ngx_msleep(10);
+    }
+
+    /* the cached memory is released after an idle second */
+
+    ngx_msleep(1200);
+
+    ngx_check_h2_round(fd, NGX_CHECK_H2_STREAMS, (u_char *) "/", NULL, NULL);
+
+    len = sizeof(body) - 1;
+
+    ngx_check_h2_round(fd, 1, (u_char *) "/stats", body, &len);
+
+    body[len] = '\0';
+
+    p = body;
+
+    for (i = 0; i < 5; i++) {
+        stats[i] = strtoul((char *) p, (char **) &p, 10);
+    }
+
+    close(fd);
+
+    ngx_check_h2_stop();
+
+    printf("    %llu streams, pools: %lu hits, %lu misses, %lu drops, "
+           "fake connections: %lu hits, %lu misses\n",
+           (unsigned long long) (ngx_test_iterations + 1)
+                                * NGX_CHECK_H2_STREAMS,
+           (unsigned long) stats[0], (unsigned long) stats[1],
+           (unsigned long) stats[2], (unsigned long) stats[3],
+           (unsigned long) stats[4]);
+
+    if (stats[0] == 0) {
+        ngx_test_fail("no stream pool was reused");
+    }
+
+    if (stats[3] == 0) {
+        ngx_test_fail("no fake connection was reused");
+    }
+
+    return 0;
+}
+
+
+static void
+ngx_check_h2_start(void)
+{
+    u_char    *last;
+    char      *prefix, *argv[8];
+    ngx_fd_t   file;
+    u_char     conf[2048], name[NGX_MAX_PATH], error[NGX_MAX_PATH];
+
+    prefix = mkdtemp(ngx_check_h2_prefix);
+    if (prefix == NULL) {
+        ngx_test_fail("mkdtemp() failed");
+    }
+
+    ngx_check_h2_kept = 1;
+
+    last = ngx_snprintf(conf, sizeof(conf), ngx_check_h2_conf,
+                        prefix, prefix, prefix);
+
+    ngx_sprintf(name, "%s/nginx.conf%Z", prefix);
+
+    file = ngx_open_file(name, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                         NGX_FILE_DEFAULT_ACCESS);
+
+    if (file == NGX_INVALID_FILE
+        || ngx_write_fd(file, conf, last - conf) != last - conf
+        || ngx_close_file(file) == NGX_FILE_ERROR)
+    {
+        ngx_test_fail("writing \"%s\" failed", name);
+    }
+
+    ngx_sprintf(error, "%s/error.log%Z", prefix);
+
+    argv[0] = "nginx";
+    argv[1] = "-p";
+    argv[2] = prefix;
+    argv[3] = "-c";
+    argv[4] = (char *) name;
+    argv[5] = "-e";
+    argv[6] = (char *) error;
+    argv[7] = NULL;
+
+    ngx_check_h2_pid = fork();
+
+    if (ngx_check_h2_pid == -1) {
+        ngx_test_fail("fork() failed");
+    }
+
+    if (ngx_check_h2_pid == 0) {
+        exit(ngx_test_nginx_main(7, argv));
+    }
+
+    atexit(ngx_check_h2_exit);
+
+    signal(SIGPIPE, SIG_IGN);
+}
+
+
+static void
+ngx_check_h2_wait(void)
+{
+    int         fd, status;
+    ngx_uint_t  i;
+
+    for (i = 0; i < 500; i++) {
+
+        if (waitpid(ngx_check_h2_pid, &status, WNOHANG) == ngx_check_h2_pid) {
+            ngx_check_h2_pid = 0;
+            ngx_test_fail("nginx exited, see %s/error.log",
+                          ngx_check_h2_prefix);
+        }
+
+        fd = ngx_check_h2_connect();
+
+        if (fd != -1) {
+            close(fd);
+            return;
+        }
+
+        ngx_msleep(10);
+    }
+
+    ngx_test_fail("nginx did not start, see %s/error.log",
+                  ngx_check_h2_prefix);
+}
+
+
+static void
+ngx_check_h2_stop(void)
+{
+    u_char          *p, *last, *line;
+    ssize_t          n;
+    ngx_fd_t         fd;
+    ngx_str_t        tree;
+    ngx_uint_t       i;
+    ngx_file_info_t  fi;
+    ngx_tree_ctx_t   ctx;
+    int              status;
+    u_char           name[NGX_MAX_PATH];
+
+    static char  *errors[] = { "[emerg]", "[alert]", "[crit]", NULL };
+
+    kill(ngx_check_h2_pid, SIGQUIT);
+
+    for (i = 0; i < 1000; i++) {
+        if (waitpid(ngx_check_h2_pid, &status, WNOHANG) == ngx_check_h2_pid) {
+            break;
+        }
+
+        ngx_msleep(10);
+    }
+
+    if (i == 1000) {
+        ngx_test_fail("nginx did not exit");
+    }
+
+    ngx_check_h2_pid = 0;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ngx_test_fail("nginx exited with status %d", status);
+    }
+
+    /* the error log */
+
+    ngx_sprintf(name, "%s/error.log%Z", ngx_check_h2_prefix);
+
+    fd = ngx_open_file(name, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE || ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_test_fail("opening \"%s\" failed", name);
+    }
+
+    p = ngx_alloc(ngx_file_size(&fi) + 1, ngx_test_log);
+    if (p == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    n = ngx_read_fd(fd, p, ngx_file_size(&fi));
+
+    if (n != ngx_file_size(&fi)) {
+        ngx_test_fail("reading \"%s\" failed", name);
+    }
+
+    ngx_close_file(fd);
+
+    last = p + n;
+    *last = '\0';
+
+    for (i = 0; errors[i]; i++) {
+        line = ngx_strnstr(p, errors[i], n);
+
+        if (line) {
+            while (line > p && line[-1] != LF) {
+                line--;
+            }
+
+            ngx_test_fail("nginx logged \"%*s\"",
+                          ngx_strlchr(line, last, LF) - line, line);
+        }
+    }
+
+    ngx_free(p);
+
+    /* the prefix */
+
+    ngx_memzero(&ctx, sizeof(ngx_tree_ctx_t));
+
+    ctx.file_handler = ngx_check_h2_delete_file;
+    ctx.pre_tree_handler = ngx_check_h2_noop;
+    ctx.post_tree_handler = ngx_check_h2_delete_dir;
+    ctx.spec_handler = ngx_check_h2_delete_file;
+    ctx.log = ngx_test_log;
+
+    tree.data = (u_char *) ngx_check_h2_prefix;
+    tree.len = ngx_strlen(ngx_check_h2_prefix);
+
+    if (ngx_walk_tree(&ctx, &tree) != NGX_OK
+        || ngx_delete_dir(ngx_check_h2_prefix) == NGX_FILE_ERROR)
+    {
+        ngx_test_fail("removing %s failed", ngx_check_h2_prefix);
+    }
+
+    ngx_check_h2_kept = 0;
+}
+
+
+static void
+ngx_check_h2_exit(void)
+{
+    int  status;
+
+    if (ngx_check_h2_pid) {
+        kill(ngx_check_h2_pid, SIGKILL);
+        (void) waitpid(ngx_check_h2_pid, &status, 0);
+    }
+
+    if (ngx_check_h2_kept) {
+        fprintf(stderr, "the prefix %s is kept\n", ngx_check_h2_prefix);
+    }
+}
+
+
+static ngx_int_t
+ngx_check_h2_delete_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    if (ngx_delete_file(path->data) == NGX_FILE_ERROR) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_check_h2_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_check_h2_delete_dir(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    if (ngx_delete_dir(path->data) == NGX_FILE_ERROR) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static int
+ngx_check_h2_connect(void)
+{
+    int                  fd;
+    struct timeval       tv;
+    struct sockaddr_un   sun;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        ngx_test_fail("socket() failed");
+    }
+
+    ngx_memzero(&sun, sizeof(struct sockaddr_un));
+    sun.sun_family = AF_UNIX;
+    ngx_sprintf((u_char *) sun.sun_path, "%s/nginx.sock%Z",
+                ngx_check_h2_prefix);
+
+    if (connect(fd, (struct sockaddr *) &sun, sizeof(struct sockaddr_un))
+        == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    tv.tv_sec = NGX_CHECK_H2_TIMEOUT;
+    tv.tv_usec = 0;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+        ngx_test_fail("setsockopt(SO_RCVTIMEO) failed");
+    }
+
+    return fd;
+}
+
+
+/*
+ * n GET requests for the path are sent at once, then the frames are read
+ * until every stream is ended; the response body of the last stream is
+ * copied to body if it is given
+ */
+
+static void
+ngx_check_h2_round(int fd, ngx_uint_t n, u_char *path, u_char *body,
+    size_t *len)
+{
+    u_char      *p, *out;
+    size_t       size, plen, copied;
+    ngx_uint_t   i, type, flags, sid, first, done;
+    u_char       hdr[NGX_HTTP_V2_FRAME_HEADER_SIZE];
+    u_char       buf[NGX_CHECK_H2_BUFFER];
+
+    plen = ngx_strlen(path);
+
+    /* :method GET, :scheme http, :path, :authority localhost */
+
+    size = 2 + 2 + plen + 2 + sizeof("localhost") - 1;
+
+    out = ngx_alloc(n * (NGX_HTTP_V2_FRAME_HEADER_SIZE + size), ngx_test_log);
+    if (out == NULL) {
+        ngx_test_fail("ngx_alloc() failed");
+    }
+
+    first = ngx_check_h2_sid;
+    p = out;
+
+    for (i = 0; i < n; i++) {
+        p = ngx_check_h2_frame(p, NGX_HTTP_V2_HEADERS_FRAME,
+                               NGX_HTTP_V2_END_HEADERS_FLAG
+                               |NGX_HTTP_V2_END_STREAM_FLAG,
+                               ngx_check_h2_sid, size);
+
+        *p++ = 0x82;
+        *p++ = 0x86;
+
+        /* literals without indexing, with indexed names */
+
+        *p++ = 0x04;
+        *p++ = (u_char) plen;
+        p = ngx_cpymem(p, path, plen);
+
+        *p++ = 0x01;
+        *p++ = sizeof("localhost") - 1;
+        p = ngx_cpymem(p, "localhost", sizeof("localhost") - 1);
+
+        ngx_check_h2_sid += 2;
+    }
+
+    ngx_check_h2_write(fd, out, p - out);
+
+    ngx_free(out);
+
+    copied = 0;
+
+    for (done = 0; done < n; /* void */) {
+
+        ngx_check_h2_read(fd, hdr, NGX_HTTP_V2_FRAME_HEADER_SIZE);
+
+        size = (hdr[0] << 16) | (hdr[1] << 8) | hdr[2];
+        type = hdr[3];
+        flags = hdr[4];
+        sid = ngx_http_v2_parse_sid(&hdr[5]);
+
+        if (size > sizeof(buf)) {
+            ngx_test_fail("frame of %uz bytes", size);
+        }
+
+        ngx_check_h2_read(fd, buf, size);
+
+        switch (type) {
+
+        case NGX_HTTP_V2_SETTINGS_FRAME:
+
+            if (!(flags & NGX_HTTP_V2_ACK_FLAG)) {
+                p = ngx_check_h2_frame(hdr, NGX_HTTP_V2_SETTINGS_FRAME,
+                                       NGX_HTTP_V2_ACK_FLAG, 0, 0);
+                ngx_check_h2_write(fd, hdr, p - hdr);
+            }
+
+            continue;
+
+        case NGX_HTTP_V2_RST_STREAM_FRAME:
+        case NGX_HTTP_V2_GOAWAY_FRAME:
+            ngx_test_fail("frame type %ui on stream %ui", type, sid);
+            break;
+
+        case NGX_HTTP_V2_DATA_FRAME:
+
+            if (body && sid == ngx_check_h2_sid - 2) {
+                size = ngx_min(size, *len - copied);
+                ngx_memcpy(body + copied, buf, size);
+                copied += size;
+            }
+
+            break;
+
+        case NGX_HTTP_V2_HEADERS_FRAME:
+            break;
+
+        default:
+            continue;
+        }
+
+        if (sid < first || sid >= ngx_check_h2_sid) {
+            ngx_test_fail("unexpected stream %ui", sid);
+        }
+
+        if (flags & NGX_HTTP_V2_END_STREAM_FLAG) {
+            done++;
+        }
+    }
+
+    if (body) {
+        *len = copied;
+    }
+}
+
+
+static u_char *
+ngx_check_h2_frame(u_char *p, ngx_uint_t type, ngx_uint_t flags,
+    ngx_uint_t sid, size_t size)
+{
+    p = ngx_http_v2_write_len_and_type(p, size, type);
+    *p++ = (u_char) flags;
+    p = ngx_http_v2_write_sid(p, sid);
+
+    return p;
+}
+
+
+static void
+ngx_check_h2_read(int fd, u_char *buf, size_t size)
+{
+    ssize_t  n;
+
+    while (size) {
+        n = read(fd, buf, size);
+
+        if (n <= 0) {
+            ngx_test_fail("read() failed or the connection is closed");
+        }
+
+        buf += n;
+        size -= n;
+    }
+}
+
+
+static void
+ngx_check_h2_write(int fd, u_char *buf, size_t size)
+{
+    ssize_t  n;
+
+    while (size) {
+        n = write(fd, buf, size);
+
+        if (n <= 0) {
+            ngx_test_fail("write() failed");
+        }
+
+        buf += n;
+        size -= n;
+    }
+}
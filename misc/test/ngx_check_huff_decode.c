@@ -0,0 +1,389 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * ngx_http_huff_decode() is compared with the nibble state machine alone,
+ * the previous decoder: pieces shorter than 8 bytes never enter the fast
+ * path.  The inputs are the corpus below, valid encodings of random
+ * strings, their mutations and random bytes; the whole input and random
+ * pieces of it must decode to the same string or both fail, without
+ * writing past the 8/5 of the input length that HTTP/2 allocates.
+ *
+ *     ngx_check_huff_decode [inputs] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_test.h>
+
+
+#define NGX_CHECK_HUFF_DECODE_LEN    4096
+#define NGX_CHECK_HUFF_DECODE_GUARD  64
+
+
+typedef struct {
+    ngx_str_t   in;
+    ngx_str_t   out;
+    ngx_int_t   rc;
+} ngx_check_huff_decode_case_t;
+
+
+static void ngx_check_huff_decode_input(u_char *in, size_t *len);
+static ngx_int_t ngx_check_huff_decode_compare(u_char *in, size_t len,
+    ngx_str_t *out);
+static ngx_int_t ngx_check_huff_decode(u_char *in, size_t len,
+    ngx_uint_t piece, ngx_str_t *out);
+
+
+/*
+ * the examples of RFC 7541, Appendix C.4 and C.6, padding, EOS and
+ * the longest codes at and around the 8 byte fast path threshold
+ */
+
+static ngx_check_huff_decode_case_t  ngx_check_huff_decode_corpus[] = {
+
+    { ngx_string("\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff"),
+      ngx_string("www.example.com"), NGX_OK },
+
+    { ngx_string("\xa8\xeb\x10\x64\x9c\xbf"),
+      ngx_string("no-cache"), NGX_OK },
+
+    { ngx_string("\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f"),
+      ngx_string("custom-key"), NGX_OK },
+
+    { ngx_string("\x25\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf"),
+      ngx_string("custom-value"), NGX_OK },
+
+    { ngx_string("\x64\x02"),
+      ngx_string("302"), NGX_OK },
+
+    { ngx_string("\xae\xc3\x77\x1a\x4b"),
+      ngx_string("private"), NGX_OK },
+
+    { ngx_string("\xd0\x7a\xbe\x94\x10\x54\xd4\x44\xa8\x20\x05\x95\x04\x0b"
+                 "\x81\x66\xe0\x82\xa6\x2d\x1b\xff"),
+      ngx_string("Mon, 21 Oct 2013 20:13:21 GMT"), NGX_OK },
+
+    { ngx_string("\x9d\x29\xad\x17\x18\x63\xc7\x8f\x0b\x97\xc8\xe9\xae\x82"
+                 "\xae\x43\xd3"),
+      ngx_string("https://www.example.com"), NGX_OK },
+
+    { ngx_string("\x9b\xd9\xab"),
+      ngx_string("gzip"), NGX_OK },
+
+    { ngx_string("\x94\xe7\x82\x1d\xd7\xf2\xe6\xc7\xb3\x35\xdf\xdf\xcd\x5b"
+                 "\x39\x60\xd5\xaf\x27\x08\x7f\x36\x72\xc1\xab\x27\x0f\xb5"
+                 "\x29\x1f\x95\x87\x31\x60\x65\xc0\x03\xed\x4e\xe5\xb1\x06"
+                 "\x3d\x50\x07"),
+      ngx_string("foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"),
+      NGX_OK },
+
+    /*
+     * "a" with 3 bits of padding and with zero padding; padding longer
+     * than 7 bits is accepted as long as it is a prefix of EOS, as the
+     * state machine always did
+     */
+
+    { ngx_string("\x1f"), ngx_string("a"), NGX_OK },
+    { ngx_string("\x18"), ngx_null_string, NGX_ERROR },
+    { ngx_string("\x1f\xff"), ngx_string("a"), NGX_OK },
+    { ngx_string("\xff"), ngx_string(""), NGX_OK },
+    { ngx_string(""), ngx_string(""), NGX_OK },
+
+    /* EOS, alone and in the fast path */
+
+    { ngx_string("\xff\xff\xff\xff"), ngx_null_string, NGX_ERROR },
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x00\x7f\xff\xff\xff"),
+      ngx_null_string, NGX_ERROR },
+    { ngx_string("\xff\xff\xff\xfc\x03\x00\x00\x00\x00\x00"),
+      ngx_null_string, NGX_ERROR },
+
+    /* 30 bit codes: "\n", "\r", 0x16 */
+
+    { ngx_string("\xff\xff\xff\xf3"), ngx_string("\n"), NGX_OK },
+    { ngx_string("\xff\xff\xff\xf7"), ngx_string("\r"), NGX_OK },
+    { ngx_string("\xff\xff\xff\xfb\xff\xff\xff\xcf\xff\xff\xff\x7f"),
+      ngx_string("\x16\n\r"), NGX_OK },
+
+    /* codes ending at and after the fast path, with and without padding */
+
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x7f"),
+      ngx_string("00000000000000a"), NGX_OK },
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x0f\xff\xff\xff\x07\x19"
+                 "\x3f"),
+      ngx_string("000000000000\nabc"), NGX_OK },
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+                 "\x00"),
+      ngx_string("000000000000000000000000"), NGX_OK },
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x00\x0f\xff"),
+      ngx_string("0000000000000a"), NGX_OK },
+    { ngx_string("\x00\x00\x00\x00\x00\x00\x00\x00\x0f\xf0"),
+      ngx_null_string, NGX_ERROR }
+};
+
+
+#define NGX_CHECK_HUFF_DECODE_CORPUS                                          \
+    (sizeof(ngx_check_huff_decode_corpus)                                     \
+     / sizeof(ngx_check_huff_decode_case_t))
+
+
+static u_char  ngx_check_huff_decode_buf[NGX_CHECK_HUFF_DECODE_LEN * 2];
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                         len;
+    uint64_t                       n, failed;
+    ngx_int_t                      rc;
+    ngx_str_t                      out;
+    ngx_uint_t                     i;
+    ngx_check_huff_decode_case_t  *c;
+    u_char                         in[NGX_CHECK_HUFF_DECODE_LEN];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 1000000;
+    }
+
+    for (i = 0; i < NGX_CHECK_HUFF_DECODE_CORPUS; i++) {
+        c = &ngx_check_huff_decode_corpus[i];
+
+        rc = ngx_check_huff_decode_compare(c->in.data, c->in.len, &out);
+
+        if (rc != c->rc
+            || (rc == NGX_OK
+                && (out.len != c->out.len
+                    || ngx_memcmp(out.data, c->out.data, out.len) != 0)))
+        {
+            ngx_test_fail("corpus %ui: %i \"%V\"", i, rc, &out);
+        }
+    }
+
+    failed = 0;
+
+    for (n = 0; n < ngx_test_iterations; n++) {
+        ngx_check_huff_decode_input(in, &len);
+
+        if (ngx_check_huff_decode_compare(in, len, &out) != NGX_OK) {
+            failed++;
+        }
+    }
+
+    printf("    %llu inputs, %llu invalid\n",
+           (unsigned long long) ngx_test_iterations,
+           (unsigned long long) failed);
+
+    return 0;
+}
+
+
+static void
+ngx_check_huff_decode_input(u_char *in, size_t *len)
+{
+    u_char                        *p, src[NGX_CHECK_HUFF_DECODE_LEN / 2];
+    size_t                         n, i;
+    ngx_str_t                      out;
+    ngx_uint_t                     lower;
+    ngx_check_huff_decode_case_t  *c;
+
+    switch (ngx_test_random() % 4) {
+
+    case 0:
+
+        /* a corpus entry */
+
+        c = &ngx_check_huff_decode_corpus[ngx_test_random()
+                                          % NGX_CHECK_HUFF_DECODE_CORPUS];
+
+        *len = c->in.len;
+        ngx_memcpy(in, c->in.data, c->in.len);
+        break;
+
+    case 1:
+
+        /* random bytes */
+
+        *len = ngx_test_random() % 64;
+
+        for (i = 0; i < *len; i++) {
+            in[i] = (u_char) ngx_test_random();
+        }
+
+        break;
+
+    default:
+
+        /* a random string, mostly of header characters */
+
+        n = ngx_test_random() % 8 ? ngx_test_random() % 64
+                                  : ngx_test_random() % sizeof(src);
+
+        for (i = 0; i < n; i++) {
+            src[i] = (ngx_test_random() % 16)
+                     ? (u_char) (' ' + ngx_test_random() % 95)
+                     : (u_char) ngx_test_random();
+        }
+
+        lower = ngx_test_random() % 2;
+
+        *len = ngx_http_huff_encode(src, n, in, lower);
+
+        if (*len == 0) {
+
+            /* not shorter than the string, sent as is */
+
+            return;
+        }
+
+        if (lower) {
+            ngx_strlow(src, src, n);
+        }
+
+        if (ngx_check_huff_decode(in, *len, *len, &out) != NGX_OK
+            || out.len != n
+            || ngx_memcmp(out.data, src, n) != 0)
+        {
+            ngx_test_fail("encoding of %uz bytes is not decoded", n);
+        }
+
+        break;
+    }
+
+    /* mutations */
+
+    if (*len && ngx_test_random() % 2) {
+
+        switch (ngx_test_random() % 5) {
+
+        case 0:
+            p = &in[ngx_test_random() % *len];
+            *p ^= (u_char) (1 << ngx_test_random() % 8);
+            break;
+
+        case 1:
+
+            /* 32 ones, EOS if a code starts at one of the first bits */
+
+            n = ngx_test_random() % *len;
+            i = ngx_min(4, *len - n);
+            ngx_memset(in + n, 0xff, i);
+            break;
+
+        case 2:
+            *len = ngx_test_random() % *len;
+            break;
+
+        case 3:
+            n = ngx_min(1 + ngx_test_random() % 8,
+                        NGX_CHECK_HUFF_DECODE_LEN - *len);
+            ngx_memset(in + *len, 0xff, n);
+            *len += n;
+            break;
+
+        default:
+            p = &in[ngx_test_random() % *len];
+            *p = (u_char) ngx_test_random();
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_check_huff_decode_compare(u_char *in, size_t len, ngx_str_t *out)
+{
+    u_char     whole[NGX_CHECK_HUFF_DECODE_LEN * 2];
+    ngx_int_t  rc, rcp, rcs;
+    ngx_str_t  pieces, scalar;
+
+    rc = ngx_check_huff_decode(in, len, len, out);
+
+    if (rc == NGX_OK) {
+        ngx_memcpy(whole, out->data, out->len);
+        out->data = whole;
+    }
+
+    /* random pieces, including ones long enough for the fast path */
+
+    rcp = ngx_check_huff_decode(in, len, 1 + ngx_test_random() % 32,
+                                &pieces);
+
+    if (rcp != rc
+        || (rc == NGX_OK
+            && (pieces.len != out->len
+                || ngx_memcmp(pieces.data, out->data, out->len) != 0)))
+    {
+        ngx_test_fail("pieces: %i \"%V\" instead of %i \"%V\"",
+                      rcp, &pieces, rc, out);
+    }
+
+    /* the state machine only */
+
+    rcs = ngx_check_huff_decode(in, len, 1 + ngx_test_random() % 7, &scalar);
+
+    if (rcs != rc
+        || (rc == NGX_OK
+            && (scalar.len != out->len
+                || ngx_memcmp(scalar.data, out->data, out->len) != 0)))
+    {
+        ngx_test_fail("state machine: %i \"%V\" instead of %i \"%V\"",
+                      rcs, &scalar, rc, out);
+    }
+
+    return rc;
+}
+
+
+/*
+ * the same as ngx_http_v2_state_field_huff(), with the piece size
+ * limiting the input of each call
+ */
+
+static ngx_int_t
+ngx_check_huff_decode(u_char *in, size_t len, ngx_uint_t piece,
+    ngx_str_t *out)
+{
+    u_char      *p, *dst, *end, state;
+    size_t       size, n;
+    ngx_int_t    rc;
+    ngx_uint_t   i;
+
+    p = ngx_check_huff_decode_buf;
+    size = len * 8 / 5;
+
+    end = p + size;
+    ngx_memset(end, 0xa5, NGX_CHECK_HUFF_DECODE_GUARD);
+
+    dst = p;
+    state = 0;
+    rc = NGX_OK;
+
+    for (i = 0; i < len; i += n) {
+        n = ngx_min(piece, len - i);
+
+        rc = ngx_http_huff_decode(&state, in + i, n, &dst, i + n == len,
+                                  ngx_test_log);
+        if (rc != NGX_OK) {
+            break;
+        }
+    }
+
+    for (i = 0; i < NGX_CHECK_HUFF_DECODE_GUARD; i++) {
+        if (end[i] != 0xa5) {
+            ngx_test_fail("%uz bytes decoded past %uz", i + 1, size);
+        }
+    }
+
+    out->len = dst - p;
+    out->data = p;
+
+    return rc;
+}
@@ -0,0 +1,479 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Sets of regexes, the corpus below and random ones, are prefiltered by
+ * ngx_regex_set_match() over the literals of ngx_regex_literal(); every
+ * regex which ngx_regex_exec() matches must be a candidate of the set.
+ * The corpus literals are also compared with the expected ones.
+ *
+ *     ngx_check_regex_set [subjects] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_test.h>
+
+
+#if (NGX_PCRE)
+
+#define NGX_CHECK_REGEX_SET_MAX       32
+#define NGX_CHECK_REGEX_SET_SUBJECTS  1000
+#define NGX_CHECK_REGEX_SET_PATTERN   256
+#define NGX_CHECK_REGEX_SET_SUBJECT   64
+
+
+/* random regexes may backtrack too much, such runs tell nothing */
+
+#if (NGX_PCRE2)
+#define ngx_check_regex_set_limit(rc)                                         \
+    ((rc) == PCRE2_ERROR_MATCHLIMIT || (rc) == PCRE2_ERROR_DEPTHLIMIT         \
+     || (rc) == PCRE2_ERROR_HEAPLIMIT)
+#else
+#define ngx_check_regex_set_limit(rc)                                         \
+    ((rc) == PCRE_ERROR_MATCHLIMIT || (rc) == PCRE_ERROR_RECURSIONLIMIT)
+#endif
+
+
+typedef struct {
+    ngx_str_t   pattern;
+    ngx_str_t   literal;
+    ngx_str_t   subject;
+} ngx_check_regex_set_case_t;
+
+
+typedef struct {
+    ngx_uint_t      nelts;
+    ngx_regex_t    *regex[NGX_CHECK_REGEX_SET_MAX];
+    ngx_str_t       pattern[NGX_CHECK_REGEX_SET_MAX];
+    ngx_str_t       literal[NGX_CHECK_REGEX_SET_MAX];
+    ngx_regex_set_t *set;
+} ngx_check_regex_set_t;
+
+
+static ngx_int_t ngx_check_regex_set_add(ngx_check_regex_set_t *rs,
+    ngx_str_t *pattern, ngx_pool_t *pool);
+static u_char *ngx_check_regex_set_pattern(u_char *p, u_char *last,
+    ngx_uint_t depth);
+static size_t ngx_check_regex_set_subject(u_char *p);
+static ngx_uint_t ngx_check_regex_set_match(ngx_check_regex_set_t *rs,
+    ngx_str_t *s);
+
+
+/*
+ * location, server name and map regexes, and the constructs which yield
+ * no literal: verbs anywhere outside classes, \Q...\E and the "x" option;
+ * the subject matches the regex
+ */
+
+static ngx_check_regex_set_case_t  ngx_check_regex_set_corpus[] = {
+
+    { ngx_string("^(www\\.)?example\\.com$"),
+      ngx_string("example.com"), ngx_string("www.example.com") },
+
+    { ngx_string("\\.php$"),
+      ngx_string(".php"), ngx_string("/index.php") },
+
+    { ngx_string("^/api/v[0-9]+/users/(\\d+)$"),
+      ngx_string("/users/"), ngx_string("/api/v2/users/42") },
+
+    { ngx_string("\\.(gif|jpg|png)$"),
+      ngx_string("."), ngx_string("/a.png") },
+
+    { ngx_string("(?i)^/Admin/"),
+      ngx_string("/admin/"), ngx_string("/ADMIN/users") },
+
+    { ngx_string("^/static/(?#comment)images/"),
+      ngx_string("/static/"), ngx_string("/static/images/a.png") },
+
+    { ngx_string("colou?r"),
+      ngx_string("colo"), ngx_string("color") },
+
+    { ngx_string("a{2}bc"),
+      ngx_string("bc"), ngx_string("aabc") },
+
+    { ngx_string("[(*]abcd"),
+      ngx_string("abcd"), ngx_string("*abcd") },
+
+    { ngx_string("fo(*ACCEPT)barx"),
+      ngx_null_string, ngx_string("xfoy") },
+
+    { ngx_string("(fo(*ACCEPT))barx"),
+      ngx_null_string, ngx_string("xfoy") },
+
+    { ngx_string("^(?:a|b(*ACCEPT))cdef"),
+      ngx_null_string, ngx_string("b") },
+
+    { ngx_string("(?:x(?:y(*ACCEPT)))zzzz"),
+      ngx_null_string, ngx_string("xy") },
+
+    { ngx_string("(*UTF)^/caf\\x{e9}/menu"),
+      ngx_null_string, ngx_string("/caf\xc3\xa9/menu") },
+
+    { ngx_string("(\\Q)\\E)abcd"),
+      ngx_null_string, ngx_string(")abcd") },
+
+    { ngx_string("ab(?x) cd"),
+      ngx_null_string, ngx_string("abcd") }
+};
+
+
+#define NGX_CHECK_REGEX_SET_CORPUS                                            \
+    (sizeof(ngx_check_regex_set_corpus)                                       \
+     / sizeof(ngx_check_regex_set_case_t))
+
+
+static char      ngx_check_regex_set_chars[] = "abcd./-";
+
+static uint64_t  ngx_check_regex_set_limits;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                       len;
+    uint64_t                     n, sets, matches, skipped;
+    ngx_int_t                    rc;
+    ngx_str_t                    s, pattern;
+    ngx_uint_t                   i, k;
+    ngx_pool_t                  *pool;
+    ngx_check_regex_set_t        rs;
+    ngx_check_regex_set_case_t  *c;
+    u_char                       buf[NGX_CHECK_REGEX_SET_PATTERN];
+    u_char                       subject[NGX_CHECK_REGEX_SET_SUBJECT];
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_test_iterations == 0) {
+        ngx_test_iterations = 200000;
+    }
+
+    /* the corpus as one set */
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+    if (pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    rs.nelts = 0;
+
+    for (i = 0; i < NGX_CHECK_REGEX_SET_CORPUS; i++) {
+        c = &ngx_check_regex_set_corpus[i];
+
+        if (ngx_check_regex_set_add(&rs, &c->pattern, pool) != NGX_OK) {
+            ngx_test_fail("corpus %ui: \"%V\" is not compiled",
+                          i, &c->pattern);
+        }
+
+        if (rs.literal[i].len != c->literal.len
+            || ngx_strncmp(rs.literal[i].data, c->literal.data,
+                           c->literal.len)
+               != 0)
+        {
+            ngx_test_fail("corpus %ui: \"%V\" literal \"%V\" instead of \"%V\"",
+                          i, &c->pattern, &rs.literal[i], &c->literal);
+        }
+    }
+
+    rs.set = ngx_regex_set_create(pool, rs.literal, rs.nelts);
+    if (rs.set == NULL) {
+        ngx_test_fail("ngx_regex_set_create() failed");
+    }
+
+    for (i = 0; i < NGX_CHECK_REGEX_SET_CORPUS; i++) {
+        c = &ngx_check_regex_set_corpus[i];
+
+        if (ngx_regex_exec(rs.regex[i], &c->subject, NULL, 0) < 0) {
+            ngx_test_fail("corpus %ui: \"%V\" does not match \"%V\"",
+                          i, &c->pattern, &c->subject);
+        }
+
+        (void) ngx_check_regex_set_match(&rs, &c->subject);
+    }
+
+    ngx_destroy_pool(pool);
+
+    /* random sets */
+
+    sets = 0;
+    matches = 0;
+    skipped = 0;
+
+    for (n = 0; n < ngx_test_iterations; n++) {
+
+        if (n % NGX_CHECK_REGEX_SET_SUBJECTS == 0) {
+            if (sets) {
+                ngx_destroy_pool(pool);
+            }
+
+            pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_test_log);
+            if (pool == NULL) {
+                ngx_test_fail("ngx_create_pool() failed");
+            }
+
+            rs.nelts = 0;
+            k = 1 + ngx_test_random() % NGX_CHECK_REGEX_SET_MAX;
+
+            while (rs.nelts < k) {
+                pattern.data = buf;
+                pattern.len = ngx_check_regex_set_pattern(buf,
+                                      buf + NGX_CHECK_REGEX_SET_PATTERN - 64, 0)
+                              - buf;
+
+                (void) ngx_check_regex_set_add(&rs, &pattern, pool);
+            }
+
+            rs.set = ngx_regex_set_create(pool, rs.literal, rs.nelts);
+            if (rs.set == NULL) {
+                ngx_test_fail("ngx_regex_set_create() failed");
+            }
+
+            sets++;
+        }
+
+        len = ngx_check_regex_set_subject(subject);
+
+        s.data = subject;
+        s.len = len;
+
+        rc = ngx_check_regex_set_match(&rs, &s);
+
+        matches += rc;
+
+        for (i = 0; i < rs.nelts; i++) {
+            if (!ngx_regex_set_test(rs.set, i)) {
+                skipped++;
+            }
+        }
+    }
+
+    if (sets) {
+        ngx_destroy_pool(pool);
+    }
+
+    printf("    %llu subjects, %llu random sets, %llu matches, "
+           "%llu regexes skipped, %llu over the match limit\n",
+           (unsigned long long) ngx_test_iterations,
+           (unsigned long long) sets, (unsigned long long) matches,
+           (unsigned long long) skipped,
+           (unsigned long long) ngx_check_regex_set_limits);
+
+    return 0;
+}
+
+
+/* the same as ngx_http_regex_compile(), invalid patterns are ignored */
+
+static ngx_int_t
+ngx_check_regex_set_add(ngx_check_regex_set_t *rs, ngx_str_t *pattern,
+    ngx_pool_t *pool)
+{
+    u_char               errstr[NGX_MAX_CONF_ERRSTR];
+    ngx_uint_t           i;
+    ngx_regex_compile_t  rc;
+
+    i = rs->nelts;
+
+    ngx_memzero(&rc, sizeof(ngx_regex_compile_t));
+
+    /* null-terminated as the configuration arguments */
+
+    rc.pattern.data = ngx_pnalloc(pool, pattern->len + 1);
+    if (rc.pattern.data == NULL) {
+        ngx_test_fail("ngx_pnalloc() failed");
+    }
+
+    ngx_cpystrn(rc.pattern.data, pattern->data, pattern->len + 1);
+    rc.pattern.len = pattern->len;
+    rc.pool = pool;
+    rc.err.len = NGX_MAX_CONF_ERRSTR;
+    rc.err.data = errstr;
+
+    if (ngx_test_random() % 4 == 0) {
+        rc.options = NGX_REGEX_CASELESS;
+    }
+
+    if (ngx_regex_compile(&rc) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    if (ngx_regex_literal(pool, &rc.pattern, &rs->literal[i]) != NGX_OK) {
+        ngx_test_fail("ngx_regex_literal() failed");
+    }
+
+    rs->regex[i] = rc.regex;
+    rs->pattern[i] = rc.pattern;
+    rs->nelts++;
+
+    return NGX_OK;
+}
+
+
+/*
+ * characters, escapes, classes, groups with alternatives and options,
+ * verbs and anchors, with quantifiers
+ */
+
+static u_char *
+ngx_check_regex_set_pattern(u_char *p, u_char *last, ngx_uint_t depth)
+{
+    ngx_uint_t  n;
+
+    static char  *escapes[] = { "\\.", "\\-", "\\/", "\\d", "\\w", "\\S",
+                                "\\x61", "\\x{62}", "\\141", "\\b" };
+    static char  *classes[] = { "[ab]", "[^a]", "[a-c.]", "[(*]", "[]a]",
+                                "[[:alpha:]]", "[\\]b]" };
+    static char  *groups[] = { "(", "(?:", "(?i:", "(?i)(", "(?<n>",
+                               "(?=", "(?!", "(?>" };
+    static char  *verbs[] = { "(*ACCEPT)", "(*COMMIT)", "(*SKIP)",
+                              "(*PRUNE)", "(*FAIL)", "(*THEN)" };
+    static char  *quantifiers[] = { "?", "*", "+", "{2}", "{0,2}", "{1,}",
+                                    "??", "*?", "++", "{1,3}?" };
+
+    n = 1 + ngx_test_random() % 6;
+
+    while (n-- && p < last) {
+
+        switch (ngx_test_random() % 16) {
+
+        case 0:
+            p = ngx_sprintf(p, "%s",
+                            escapes[ngx_test_random() % 10]);
+            break;
+
+        case 1:
+            p = ngx_sprintf(p, "%s",
+                            classes[ngx_test_random() % 7]);
+            break;
+
+        case 2:
+        case 3:
+            if (depth == 3 || last - p < 32) {
+                *p++ = 'a';
+                break;
+            }
+
+            p = ngx_sprintf(p, "%s", groups[ngx_test_random() % 8]);
+            p = ngx_check_regex_set_pattern(p, last - 16, depth + 1);
+
+            if (ngx_test_random() % 4 == 0) {
+                *p++ = '|';
+                p = ngx_check_regex_set_pattern(p, last - 16, depth + 1);
+            }
+
+            *p++ = ')';
+            break;
+
+        case 4:
+            if (ngx_test_random() % 4) {
+                *p++ = 'b';
+                break;
+            }
+
+            p = ngx_sprintf(p, "%s", verbs[ngx_test_random() % 6]);
+            break;
+
+        case 5:
+            *p++ = (ngx_test_random() % 2) ? '^' : '$';
+            break;
+
+        case 6:
+            *p++ = '.';
+            break;
+
+        default:
+            *p++ = ngx_check_regex_set_chars[ngx_test_random()
+                                  % (sizeof(ngx_check_regex_set_chars) - 1)];
+        }
+
+        if (ngx_test_random() % 4 == 0) {
+            p = ngx_sprintf(p, "%s", quantifiers[ngx_test_random() % 10]);
+        }
+    }
+
+    if (depth == 0 && ngx_test_random() % 8 == 0 && p < last) {
+        *p++ = '|';
+        p = ngx_check_regex_set_pattern(p, last, 1);
+    }
+
+    return p;
+}
+
+
+static size_t
+ngx_check_regex_set_subject(u_char *p)
+{
+    size_t      len, i;
+    ngx_uint_t  c;
+
+    len = ngx_test_random() % NGX_CHECK_REGEX_SET_SUBJECT;
+
+    for (i = 0; i < len; i++) {
+        c = ngx_test_random() % 32;
+
+        p[i] = (c < 24) ? ngx_check_regex_set_chars[c % 7]
+                        : (c < 28) ? (u_char) ('A' + c % 4)
+                                   : (u_char) ngx_test_random();
+    }
+
+    return len;
+}
+
+
+static ngx_uint_t
+ngx_check_regex_set_match(ngx_check_regex_set_t *rs, ngx_str_t *s)
+{
+    ngx_int_t   rc;
+    ngx_uint_t  i, matches;
+
+    ngx_regex_set_match(rs->set, s);
+
+    matches = 0;
+
+    for (i = 0; i < rs->nelts; i++) {
+
+        rc = ngx_regex_exec(rs->regex[i], s, NULL, 0);
+
+        if (rc == NGX_REGEX_NO_MATCHED) {
+            continue;
+        }
+
+        if (ngx_check_regex_set_limit(rc)) {
+            ngx_check_regex_set_limits++;
+            continue;
+        }
+
+        if (rc < 0) {
+            ngx_test_fail(ngx_regex_exec_n " failed: %i on \"%V\" using \"%V\"",
+                          rc, s, &rs->pattern[i]);
+        }
+
+        if (!ngx_regex_set_test(rs->set, i)) {
+            ngx_test_fail("\"%V\" matches \"%V\" without its literal \"%V\"",
+                          &rs->pattern[i], s, &rs->literal[i]);
+        }
+
+        matches++;
+    }
+
+    return matches;
+}
+
+
+#else
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    printf("    no PCRE\n");
+
+    return 0;
+}
+
+#endif
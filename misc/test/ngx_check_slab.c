@@ -0,0 +1,239 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * One process keeps chunks in its magazine, another one exhausts the zone;
+ * the first process must return its chunks on its next locked operation,
+ * so that the second one can allocate again.
+ *
+ *     ngx_check_slab
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_test.h>
+
+
+#define NGX_CHECK_SLAB_ZONE      (256 * 1024)
+#define NGX_CHECK_SLAB_SIZE      1024
+#define NGX_CHECK_SLAB_HOARD     48
+
+
+static void ngx_check_slab_hoard(ngx_cycle_t *cycle, ngx_slab_pool_t *sp,
+    int in, int out);
+static void ngx_check_slab_exhaust(ngx_cycle_t *cycle, ngx_slab_pool_t *sp,
+    int in, int out);
+static ngx_uint_t ngx_check_slab_fill(ngx_slab_pool_t *sp);
+static void ngx_check_slab_send(int fd);
+static void ngx_check_slab_wait(int fd);
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    int               status, a[2], b[2];
+    ngx_uint_t        i;
+    ngx_pid_t         pid;
+    ngx_cycle_t       cycle;
+    ngx_shm_zone_t   *zone;
+    ngx_slab_pool_t  *sp;
+
+    if (ngx_test_init(argc, argv) != NGX_OK) {
+        return 1;
+    }
+
+    ngx_slab_sizes_init();
+
+    ngx_memzero(&cycle, sizeof(ngx_cycle_t));
+
+    cycle.log = ngx_test_log;
+    cycle.pool = ngx_create_pool(NGX_CYCLE_POOL_SIZE, ngx_test_log);
+    if (cycle.pool == NULL) {
+        ngx_test_fail("ngx_create_pool() failed");
+    }
+
+    if (ngx_list_init(&cycle.shared_memory, cycle.pool, 1,
+                      sizeof(ngx_shm_zone_t))
+        != NGX_OK)
+    {
+        ngx_test_fail("ngx_list_init() failed");
+    }
+
+    zone = ngx_list_push(&cycle.shared_memory);
+    if (zone == NULL) {
+        ngx_test_fail("ngx_list_push() failed");
+    }
+
+    ngx_memzero(zone, sizeof(ngx_shm_zone_t));
+
+    zone->magazine = 64;
+    zone->shm.size = NGX_CHECK_SLAB_ZONE;
+    zone->shm.log = ngx_test_log;
+    ngx_str_set(&zone->shm.name, "check");
+
+    if (ngx_shm_alloc(&zone->shm) != NGX_OK) {
+        ngx_test_fail("ngx_shm_alloc() failed");
+    }
+
+    /* the same as ngx_init_zone_pool() */
+
+    sp = (ngx_slab_pool_t *) zone->shm.addr;
+
+    sp->end = zone->shm.addr + zone->shm.size;
+    sp->min_shift = 3;
+    sp->addr = zone->shm.addr;
+
+    if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+        ngx_test_fail("ngx_shmtx_create() failed");
+    }
+
+    ngx_slab_init(sp);
+
+    sp->log_nomem = 0;
+
+    if (pipe(a) == -1 || pipe(b) == -1) {
+        ngx_test_fail("pipe() failed");
+    }
+
+    (void) fflush(stdout);
+
+    for (i = 0; i < 2; i++) {
+
+        pid = fork();
+
+        if (pid == -1) {
+            ngx_test_fail("fork() failed");
+        }
+
+        if (pid == 0) {
+            if (i == 0) {
+                ngx_check_slab_hoard(&cycle, sp, b[0], a[1]);
+
+            } else {
+                ngx_check_slab_exhaust(&cycle, sp, a[0], b[1]);
+            }
+
+            exit(0);
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (wait(&status) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            ngx_test_fail("process failed");
+        }
+    }
+
+    printf("    drain requests: %lu\n", (unsigned long) sp->drain);
+
+    ngx_shm_free(&zone->shm);
+    ngx_destroy_pool(cycle.pool);
+
+    return 0;
+}
+
+
+static void
+ngx_check_slab_hoard(ngx_cycle_t *cycle, ngx_slab_pool_t *sp, int in,
+    int out)
+{
+    void        *keep, *p[NGX_CHECK_SLAB_HOARD];
+    ngx_uint_t   i;
+
+    if (ngx_slab_cache_init(cycle) != NGX_OK) {
+        ngx_test_fail("ngx_slab_cache_init() failed");
+    }
+
+    keep = ngx_slab_alloc(sp, NGX_CHECK_SLAB_SIZE);
+
+    for (i = 0; i < NGX_CHECK_SLAB_HOARD; i++) {
+        p[i] = ngx_slab_alloc(sp, NGX_CHECK_SLAB_SIZE);
+    }
+
+    for (i = 0; i < NGX_CHECK_SLAB_HOARD; i++) {
+        ngx_test_assert(p[i] != NULL);
+        ngx_slab_free(sp, p[i]);
+    }
+
+    ngx_test_assert(keep != NULL);
+    ngx_test_assert(sp->stats[ngx_slab_nslots(sp) - 2].cached != 0);
+
+    ngx_check_slab_send(out);
+
+    /* the zone is exhausted now, the next free takes the lock */
+
+    ngx_check_slab_wait(in);
+
+    ngx_slab_free(sp, keep);
+
+    ngx_check_slab_send(out);
+
+    /* exits without ngx_slab_cache_flush(), as a crashed worker would */
+}
+
+
+static void
+ngx_check_slab_exhaust(ngx_cycle_t *cycle, ngx_slab_pool_t *sp, int in,
+    int out)
+{
+    ngx_uint_t  n;
+
+    if (ngx_slab_cache_init(cycle) != NGX_OK) {
+        ngx_test_fail("ngx_slab_cache_init() failed");
+    }
+
+    ngx_check_slab_wait(in);
+
+    n = ngx_check_slab_fill(sp);
+
+    if (sp->drain == 0) {
+        ngx_test_fail("no drain requested after %ui chunks", n);
+    }
+
+    ngx_check_slab_send(out);
+    ngx_check_slab_wait(in);
+
+    n = ngx_check_slab_fill(sp);
+
+    if (n < NGX_CHECK_SLAB_HOARD) {
+        ngx_test_fail("only %ui chunks are returned by the other process", n);
+    }
+}
+
+
+static ngx_uint_t
+ngx_check_slab_fill(ngx_slab_pool_t *sp)
+{
+    ngx_uint_t  n;
+
+    for (n = 0; ngx_slab_alloc(sp, NGX_CHECK_SLAB_SIZE); n++) {
+        /* void */
+    }
+
+    return n;
+}
+
+
+static void
+ngx_check_slab_send(int fd)
+{
+    if (write(fd, "", 1) != 1) {
+        ngx_test_fail("write() failed");
+    }
+}
+
+
+static void
+ngx_check_slab_wait(int fd)
+{
+    u_char  c;
+
+    if (read(fd, &c, 1) != 1) {
+        ngx_test_fail("read() failed");
+    }
+}
@@ -0,0 +1,287 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * the binary tree of prefix-nested lists that matched static locations
+ * before the radix trie, as the reference for the checks
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include <ngx_http_location_tree.h>
+
+
+typedef struct {
+    ngx_queue_t                  queue;
+    ngx_http_core_loc_conf_t    *exact;
+    ngx_http_core_loc_conf_t    *inclusive;
+    ngx_str_t                   *name;
+    ngx_queue_t                  list;
+} ngx_http_location_tree_queue_t;
+
+
+static void ngx_http_location_tree_list(ngx_queue_t *locations,
+    ngx_queue_t *q);
+static ngx_http_location_tree_node_t *ngx_http_location_tree_node(
+    ngx_conf_t *cf, ngx_queue_t *locations, size_t prefix);
+
+
+/*
+ * the locations are sorted and joined by ngx_http_init_locations(),
+ * they are copied since the lists are built within the queue
+ */
+
+ngx_http_location_tree_node_t *
+ngx_http_location_tree_create(ngx_conf_t *cf, ngx_queue_t *locations)
+{
+    ngx_queue_t                     *q, queue;
+    ngx_http_location_queue_t       *lq;
+    ngx_http_location_tree_queue_t  *tq;
+
+    ngx_queue_init(&queue);
+
+    for (q = ngx_queue_head(locations);
+         q != ngx_queue_sentinel(locations);
+         q = ngx_queue_next(q))
+    {
+        lq = (ngx_http_location_queue_t *) q;
+
+        tq = ngx_palloc(cf->temp_pool, sizeof(ngx_http_location_tree_queue_t));
+        if (tq == NULL) {
+            return NULL;
+        }
+
+        tq->exact = lq->exact;
+        tq->inclusive = lq->inclusive;
+        tq->name = lq->name;
+        ngx_queue_init(&tq->list);
+
+        ngx_queue_insert_tail(&queue, &tq->queue);
+    }
+
+    if (ngx_queue_empty(&queue)) {
+        return NULL;
+    }
+
+    ngx_http_location_tree_list(&queue, ngx_queue_head(&queue));
+
+    return ngx_http_location_tree_node(cf, &queue, 0);
+}
+
+
+static void
+ngx_http_location_tree_list(ngx_queue_t *locations, ngx_queue_t *q)
+{
+    u_char                          *name;
+    size_t                           len;
+    ngx_queue_t                     *x, tail;
+    ngx_http_location_tree_queue_t  *lq, *lx;
+
+    if (q == ngx_queue_last(locations)) {
+        return;
+    }
+
+    lq = (ngx_http_location_tree_queue_t *) q;
+
+    if (lq->inclusive == NULL) {
+        ngx_http_location_tree_list(locations, ngx_queue_next(q));
+        return;
+    }
+
+    len = lq->name->len;
+    name = lq->name->data;
+
+    for (x = ngx_queue_next(q);
+         x != ngx_queue_sentinel(locations);
+         x = ngx_queue_next(x))
+    {
+        lx = (ngx_http_location_tree_queue_t *) x;
+
+        if (len > lx->name->len
+            || ngx_filename_cmp(name, lx->name->data, len) != 0)
+        {
+            break;
+        }
+    }
+
+    q = ngx_queue_next(q);
+
+    if (q == x) {
+        ngx_http_location_tree_list(locations, x);
+        return;
+    }
+
+    ngx_queue_split(locations, q, &tail);
+    ngx_queue_add(&lq->list, &tail);
+
+    if (x == ngx_queue_sentinel(locations)) {
+        ngx_http_location_tree_list(&lq->list, ngx_queue_head(&lq->list));
+        return;
+    }
+
+    ngx_queue_split(&lq->list, x, &tail);
+    ngx_queue_add(locations, &tail);
+
+    ngx_http_location_tree_list(&lq->list, ngx_queue_head(&lq->list));
+
+    ngx_http_location_tree_list(locations, x);
+}
+
+
+static ngx_http_location_tree_node_t *
+ngx_http_location_tree_node(ngx_conf_t *cf, ngx_queue_t *locations,
+    size_t prefix)
+{
+    size_t                           len;
+    ngx_queue_t                     *q, tail;
+    ngx_http_location_tree_node_t   *node;
+    ngx_http_location_tree_queue_t  *lq;
+
+    q = ngx_queue_middle(locations);
+
+    lq = (ngx_http_location_tree_queue_t *) q;
+    len = lq->name->len - prefix;
+
+    node = ngx_palloc(cf->pool,
+                      offsetof(ngx_http_location_tree_node_t, name) + len);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->tree = NULL;
+    node->exact = lq->exact;
+    node->inclusive = lq->inclusive;
+
+    node->auto_redirect = (u_char) ((lq->exact && lq->exact->auto_redirect)
+                           || (lq->inclusive && lq->inclusive->auto_redirect));
+
+    node->len = (u_short) len;
+    ngx_memcpy(node->name, &lq->name->data[prefix], len);
+
+    ngx_queue_split(locations, q, &tail);
+
+    if (ngx_queue_empty(locations)) {
+        /*
+         * ngx_queue_split() insures that if left part is empty,
+         * then right one is empty too
+         */
+        goto inclusive;
+    }
+
+    node->left = ngx_http_location_tree_node(cf, locations, prefix);
+    if (node->left == NULL) {
+        return NULL;
+    }
+
+    ngx_queue_remove(q);
+
+    if (ngx_queue_empty(&tail)) {
+        goto inclusive;
+    }
+
+    node->right = ngx_http_location_tree_node(cf, &tail, prefix);
+    if (node->right == NULL) {
+        return NULL;
+    }
+
+inclusive:
+
+    if (ngx_queue_empty(&lq->list)) {
+        return node;
+    }
+
+    node->tree = ngx_http_location_tree_node(cf, &lq->list, prefix + len);
+    if (node->tree == NULL) {
+        return NULL;
+    }
+
+    return node;
+}
+
+
+ngx_int_t
+ngx_http_location_tree_find(ngx_http_request_t *r,
+    ngx_http_location_tree_node_t *node)
+{
+    u_char     *uri;
+    size_t      len, n;
+    ngx_int_t   rc, rv;
+
+    len = r->uri.len;
+    uri = r->uri.data;
+
+    rv = NGX_DECLINED;
+
+    for ( ;; ) {
+
+        if (node == NULL) {
+            return rv;
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "test location: \"%*s\"",
+                       (size_t) node->len, node->name);
+
+        n = (len <= (size_t) node->len) ? len : node->len;
+
+        rc = ngx_filename_cmp(uri, node->name, n);
+
+        if (rc != 0) {
+            node = (rc < 0) ? node->left : node->right;
+
+            continue;
+        }
+
+        if (len > (size_t) node->len) {
+
+            if (node->inclusive) {
+
+                r->loc_conf = node->inclusive->loc_conf;
+                rv = NGX_AGAIN;
+
+                node = node->tree;
+                uri += n;
+                len -= n;
+
+                continue;
+            }
+
+            /* exact only */
+
+            node = node->right;
+
+            continue;
+        }
+
+        if (len == (size_t) node->len) {
+
+            if (node->exact) {
+                r->loc_conf = node->exact->loc_conf;
+                return NGX_OK;
+
+            } else {
+                r->loc_conf = node->inclusive->loc_conf;
+                return NGX_AGAIN;
+            }
+        }
+
+        /* len < node->len */
+
+        if (len + 1 == (size_t) node->len && node->auto_redirect) {
+
+            r->loc_conf = (node->exact) ? node->exact->loc_conf:
+                                          node->inclusive->loc_conf;
+            rv = NGX_DONE;
+        }
+
+        node = node->left;
+    }
+}
@@ -0,0 +1,48 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HTTP_LOCATION_TREE_H_INCLUDED_
+#define _NGX_HTTP_LOCATION_TREE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct ngx_http_location_tree_node_s  ngx_http_location_tree_node_t;
+
+struct ngx_http_location_tree_node_s {
+    ngx_http_location_tree_node_t   *left;
+    ngx_http_location_tree_node_t   *right;
+    ngx_http_location_tree_node_t   *tree;
+
+    ngx_http_core_loc_conf_t        *exact;
+    ngx_http_core_loc_conf_t        *inclusive;
+
+    u_short                          len;
+    u_char                           auto_redirect;
+    u_char                           name[1];
+};
+
+
+/* the previous static location tree and walk, the reference */
+
+ngx_http_location_tree_node_t *ngx_http_location_tree_create(ngx_conf_t *cf,
+    ngx_queue_t *locations);
+ngx_int_t ngx_http_location_tree_find(ngx_http_request_t *r,
+    ngx_http_location_tree_node_t *node);
+
+
+/* ngx_http_init_locations() and the static location trie of a level */
+
+ngx_int_t ngx_test_http_init_locations(ngx_conf_t *cf,
+    ngx_http_core_srv_conf_t *cscf, ngx_http_core_loc_conf_t *pclcf);
+ngx_int_t ngx_test_http_find_static_location(ngx_http_request_t *r,
+    ngx_http_location_trie_t *node);
+
+
+#endif /* _NGX_HTTP_LOCATION_TREE_H_INCLUDED_ */
@@ -0,0 +1,36 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * ngx_http.c and ngx_http_core_module.c built into the programs in place
+ * of their objects, so that the static location trie can be built and
+ * walked directly
+ */
+
+
+#include <ngx_http.c>
+#include <ngx_http_core_module.c>
+#include <ngx_http_location_tree.h>
+
+
+ngx_int_t
+ngx_test_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
+    ngx_http_core_loc_conf_t *pclcf)
+{
+    if (ngx_http_init_locations(cf, cscf, pclcf) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return ngx_http_init_static_location_trees(cf, pclcf);
+}
+
+
+ngx_int_t
+ngx_test_http_find_static_location(ngx_http_request_t *r,
+    ngx_http_location_trie_t *node)
+{
+    return ngx_http_core_find_static_location(r, node);
+}
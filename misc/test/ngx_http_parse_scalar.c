@@ -0,0 +1,30 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * ngx_http_parse.c built without the SSE2 fast paths as the reference
+ * for the checks, the exported functions get the "_scalar" suffix
+ */
+
+
+#define NGX_HAVE_SSE2  0
+
+#define ngx_http_parse_request_line       ngx_http_parse_request_line_scalar
+#define ngx_http_parse_header_line        ngx_http_parse_header_line_scalar
+#define ngx_http_parse_uri                ngx_http_parse_uri_scalar
+#define ngx_http_parse_complex_uri        ngx_http_parse_complex_uri_scalar
+#define ngx_http_parse_status_line        ngx_http_parse_status_line_scalar
+#define ngx_http_parse_unsafe_uri         ngx_http_parse_unsafe_uri_scalar
+#define ngx_http_parse_multi_header_lines                                     \
+    ngx_http_parse_multi_header_lines_scalar
+#define ngx_http_parse_set_cookie_lines                                       \
+    ngx_http_parse_set_cookie_lines_scalar
+#define ngx_http_arg                      ngx_http_arg_scalar
+#define ngx_http_split_args               ngx_http_split_args_scalar
+#define ngx_http_parse_chunked            ngx_http_parse_chunked_scalar
+
+
+#include <ngx_http_parse.c>
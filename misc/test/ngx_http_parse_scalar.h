@@ -0,0 +1,24 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HTTP_PARSE_SCALAR_H_INCLUDED_
+#define _NGX_HTTP_PARSE_SCALAR_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+ngx_int_t ngx_http_parse_request_line_scalar(ngx_http_request_t *r,
+    ngx_buf_t *b);
+ngx_int_t ngx_http_parse_header_line_scalar(ngx_http_request_t *r,
+    ngx_buf_t *b, ngx_uint_t allow_underscores);
+ngx_int_t ngx_http_parse_chunked_scalar(ngx_http_request_t *r, ngx_buf_t *b,
+    ngx_http_chunked_t *ctx);
+
+
+#endif /* _NGX_HTTP_PARSE_SCALAR_H_INCLUDED_ */
@@ -0,0 +1,140 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_test.h>
+
+
+static ngx_open_file_t  ngx_test_stderr;
+static ngx_log_t        ngx_test_stderr_log;
+static ngx_cycle_t      ngx_test_cycle;
+static uint32_t         ngx_test_state;
+
+ngx_log_t              *ngx_test_log = &ngx_test_stderr_log;
+
+uint64_t                ngx_test_iterations;
+uint32_t                ngx_test_seed;
+
+
+/*
+ * the programs take the optional number of iterations and the random seed,
+ * the environment is prepared the same way as ngx_os_init() does it
+ */
+
+ngx_int_t
+ngx_test_init(int argc, char *const *argv)
+{
+    ngx_uint_t  n;
+
+    ngx_test_iterations = (argc > 1) ? strtoull(argv[1], NULL, 10) : 0;
+    ngx_test_seed = (argc > 2) ? (uint32_t) strtoul(argv[2], NULL, 10)
+                               : (uint32_t) time(NULL);
+
+    ngx_test_srandom(ngx_test_seed);
+
+    if (ngx_strerror_init() != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ngx_time_init();
+
+#if (NGX_PCRE)
+    ngx_regex_init();
+#endif
+
+    ngx_pid = ngx_getpid();
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    for (n = ngx_pagesize; n >>= 1; ngx_pagesize_shift++) { /* void */ }
+
+    ngx_ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ngx_ncpu < 1) {
+        ngx_ncpu = 1;
+    }
+
+    ngx_test_stderr.fd = ngx_stderr;
+    ngx_test_stderr_log.file = &ngx_test_stderr;
+    ngx_test_stderr_log.log_level = NGX_LOG_WARN;
+
+    ngx_test_cycle.log = ngx_test_log;
+    ngx_cycle = &ngx_test_cycle;
+
+    return NGX_OK;
+}
+
+
+void
+ngx_test_failed(const char *file, int line, const char *fmt, ...)
+{
+    u_char   *p, *last;
+    va_list   args;
+    u_char    errstr[NGX_MAX_ERROR_STR];
+
+    last = errstr + NGX_MAX_ERROR_STR - 1;
+
+    p = ngx_slprintf(errstr, last, "%s:%d: ", file, line);
+
+    va_start(args, fmt);
+    p = ngx_vslprintf(p, last, fmt, args);
+    va_end(args);
+
+    p = ngx_slprintf(p, last, " (seed %uD)", ngx_test_seed);
+
+    *p++ = LF;
+
+    (void) ngx_write_fd(ngx_stderr, errstr, p - errstr);
+
+    exit(1);
+}
+
+
+uint64_t
+ngx_test_nsec(void)
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void
+ngx_test_srandom(uint32_t seed)
+{
+    ngx_test_state = seed ? seed : 2463534242;
+}
+
+
+/* xorshift32, the sequence is reproducible from the seed */
+
+uint32_t
+ngx_test_random(void)
+{
+    uint32_t  x;
+
+    x = ngx_test_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    ngx_test_state = x;
+
+    return x;
+}
+
+
+void
+ngx_test_report(const char *name, uint64_t ops, uint64_t nsec)
+{
+    printf("    %-40s %12.1f ns/op %14.0f op/s\n", name,
+           ops ? (double) nsec / ops : 0.0,
+           nsec ? (double) ops * 1000000000 / nsec : 0.0);
+}
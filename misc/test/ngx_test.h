@@ -0,0 +1,40 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_TEST_H_INCLUDED_
+#define _NGX_TEST_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define ngx_test_fail(...)                                                    \
+    ngx_test_failed(__FILE__, __LINE__, __VA_ARGS__)
+
+#define ngx_test_assert(expr)                                                 \
+    if (!(expr)) ngx_test_fail("assertion \"%s\" failed", #expr)
+
+
+extern ngx_log_t  *ngx_test_log;
+
+
+ngx_int_t ngx_test_init(int argc, char *const *argv);
+void ngx_test_failed(const char *file, int line, const char *fmt, ...);
+uint64_t ngx_test_nsec(void);
+void ngx_test_srandom(uint32_t seed);
+uint32_t ngx_test_random(void);
+void ngx_test_report(const char *name, uint64_t ops, uint64_t nsec);
+
+/* main() of nginx.o, renamed */
+int ngx_cdecl ngx_test_nginx_main(int argc, char *const *argv);
+
+
+extern uint64_t     ngx_test_iterations;
+extern uint32_t     ngx_test_seed;
+
+
+#endif /* _NGX_TEST_H_INCLUDED_ */
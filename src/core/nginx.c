@@ -20,6 +20,8 @@ static void *ngx_core_module_create_conf(ngx_cycle_t *cycle);
 static char *ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf);
 static char *ngx_set_user(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_set_env(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_set_shm_options(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_set_priority(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -113,6 +115,13 @@ static ngx_command_t ngx_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("reuseport_cpu_steering"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_core_conf_t, cpu_steering),
+      NULL },
+
     { ngx_string("worker_rlimit_nofile"),
       NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_num_slot,
@@ -148,6 +157,20 @@ static ngx_command_t ngx_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("shared_memory_options"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_2MORE,
+      ngx_set_shm_options,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("pool_block_cache"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      0,
+      offsetof(ngx_core_conf_t, pool_cache),
+      NULL },
+
     { ngx_string("load_module"),
       NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
       ngx_load_module,
@@ -1110,6 +1133,8 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle)
 
     ccf->worker_processes = NGX_CONF_UNSET;
     ccf->debug_points = NGX_CONF_UNSET;
+    ccf->cpu_steering = NGX_CONF_UNSET;
+    ccf->pool_cache = NGX_CONF_UNSET_SIZE;
 
     ccf->rlimit_nofile = NGX_CONF_UNSET;
     ccf->rlimit_core = NGX_CONF_UNSET;
@@ -1123,6 +1148,13 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle)
         return NULL;
     }
 
+    if (ngx_array_init(&ccf->shm_options, cycle->pool, 1,
+                       sizeof(ngx_shm_options_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
     return ccf;
 }
 
@@ -1139,6 +1171,8 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
 
     ngx_conf_init_value(ccf->worker_processes, 1);
     ngx_conf_init_value(ccf->debug_points, 0);
+    ngx_conf_init_value(ccf->cpu_steering, 0);
+    ngx_conf_init_size_value(ccf->pool_cache, 0);
 
 #if (NGX_HAVE_CPU_AFFINITY)
 
@@ -1153,6 +1187,26 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
                       "using last mask for remaining worker processes");
     }
 
+#endif
+
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+
+    if (ccf->cpu_steering && ccf->cpu_affinity == NULL) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "\"reuseport_cpu_steering\" requires "
+                      "\"worker_cpu_affinity\", ignored");
+        ccf->cpu_steering = 0;
+    }
+
+#else
+
+    if (ccf->cpu_steering) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "\"reuseport_cpu_steering\" is not supported "
+                      "on this platform, ignored");
+        ccf->cpu_steering = 0;
+    }
+
 #endif
 
 
@@ -1349,6 +1403,132 @@ ngx_set_env(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_set_shm_options(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_core_conf_t  *ccf = conf;
+
+    ngx_int_t           n;
+    ngx_str_t          *value;
+    ngx_uint_t          i;
+    ngx_shm_options_t  *opt;
+
+    value = cf->args->elts;
+
+    opt = ccf->shm_options.elts;
+
+    for (i = 0; i < ccf->shm_options.nelts; i++) {
+        if (opt[i].name.len == value[1].len
+            && ngx_strncmp(opt[i].name.data, value[1].data, value[1].len) == 0)
+        {
+            return "is duplicate";
+        }
+    }
+
+    opt = ngx_array_push(&ccf->shm_options);
+    if (opt == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    opt->name = value[1];
+    opt->flags = 0;
+    opt->node = 0;
+    opt->magazine = 0;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strcmp(value[i].data, "hugetlb") == 0) {
+            opt->flags |= NGX_SHM_HUGETLB;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "thp") == 0) {
+            opt->flags |= NGX_SHM_THP;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "prefault") == 0) {
+            opt->flags |= NGX_SHM_PREFAULT;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "numa=interleave") == 0) {
+            opt->flags |= NGX_SHM_INTERLEAVE;
+            continue;
+        }
+
+        /*
+         * magazine=N：每个worker为每个大小类缓存最多N个空闲块；
+         * 共享内存区耗尽时会请求其他worker在下一次加锁操作时归还缓存的块。
+         * worker异常退出时其缓存的块不会归还，每个大小类最多丢失N个块，
+         * 直到重启nginx或重新创建该共享内存区
+         */
+
+        if (ngx_strncmp(value[i].data, "magazine=", 9) == 0) {
+            n = ngx_atoi(value[i].data + 9, value[i].len - 9);
+
+            if (n < 4 || n > 4096) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid magazine size \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            opt->magazine = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "numa=", 5) == 0) {
+            n = ngx_atoi(value[i].data + 5, value[i].len - 5);
+
+            if (n == NGX_ERROR || n >= (ngx_int_t) (8 * sizeof(unsigned long)))
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid NUMA node \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            opt->flags |= NGX_SHM_BIND;
+            opt->node = n;
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    if ((opt->flags & NGX_SHM_INTERLEAVE) && (opt->flags & NGX_SHM_BIND)) {
+        return "has conflicting \"numa\" parameters";
+    }
+
+#if !(NGX_HAVE_MAP_HUGETLB)
+    if (opt->flags & NGX_SHM_HUGETLB) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"hugetlb\" is not supported "
+                           "on this platform, ignored");
+    }
+#endif
+
+#if !(NGX_HAVE_MADV_HUGEPAGE)
+    if (opt->flags & NGX_SHM_THP) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"thp\" is not supported "
+                           "on this platform, ignored");
+    }
+#endif
+
+#if !(NGX_HAVE_MBIND)
+    if (opt->flags & (NGX_SHM_INTERLEAVE|NGX_SHM_BIND)) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"numa\" is not supported "
+                           "on this platform, ignored");
+    }
+#endif
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_set_priority(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1489,17 +1669,25 @@ ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
 ngx_cpuset_t *
 ngx_get_cpu_affinity(ngx_uint_t n)
+{
+    ngx_core_conf_t  *ccf;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
+                                           ngx_core_module);
+
+    return ngx_get_worker_cpu_affinity(ccf, n);
+}
+
+
+ngx_cpuset_t *
+ngx_get_worker_cpu_affinity(ngx_core_conf_t *ccf, ngx_uint_t n)
 {
 #if (NGX_HAVE_CPU_AFFINITY)
     ngx_uint_t        i, j;
     ngx_cpuset_t     *mask;
-    ngx_core_conf_t  *ccf;
 
     static ngx_cpuset_t  result;
 
-    ccf = (ngx_core_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
-                                           ngx_core_module);
-
     if (ccf->cpu_affinity == NULL) {
         return NULL;
     }
@@ -176,7 +176,8 @@ ngx_array_push_n(ngx_array_t *a, ngx_uint_t n)
             // 计算新的数组容量，取 n 和原容量的两者中较大的值的两倍
             nalloc = 2 * ((n >= a->nalloc) ? n : a->nalloc);
 
-            // 分配新的内存空间            new = ngx_palloc(p, nalloc * a->size);
+            // 分配新的内存空间
+            new = ngx_palloc(p, nalloc * a->size);
             if (new == NULL) {
                 return NULL;
             }
@@ -32,8 +32,6 @@ void *ngx_array_push(ngx_array_t *a);
 // 向数组中添加n个元素，并返回添加的第一个元素的指针
 void *ngx_array_push_n(ngx_array_t *a, ngx_uint_t n);
 
-#endif /* _NGX_ARRAY_H_INCLUDED_ */
-
 
 
 static ngx_inline ngx_int_t
@@ -93,6 +93,11 @@
 
 #endif
 
+
+typedef intptr_t        ngx_int_t;
+typedef uintptr_t       ngx_uint_t;
+typedef intptr_t        ngx_flag_t;
+
 /*
  * 类型定义: ngx_fd_t
  * ----------------
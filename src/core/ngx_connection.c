@@ -14,6 +14,10 @@ ngx_os_io_t  ngx_io;
 
 
 static void ngx_drain_connections(ngx_cycle_t *cycle);
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+static ngx_int_t ngx_reuseport_cpu_program(ngx_cycle_t *cycle,
+    ngx_core_conf_t *ccf, struct sock_fprog *prog);
+#endif
 
 
 /*
@@ -102,79 +106,8 @@ ngx_create_listening(ngx_conf_t *cf, struct sockaddr *sockaddr, socklen_t sockle
     ls->fastopen = -1;
 #endif
 
-    return ls;
-}
-
-{
-    size_t            len;
-    ngx_listening_t  *ls;
-    struct sockaddr  *sa;
-    u_char            text[NGX_SOCKADDR_STRLEN];
-
-    ls = ngx_array_push(&cf->cycle->listening);
-    if (ls == NULL) {
-        return NULL;
-    }
-
-    ngx_memzero(ls, sizeof(ngx_listening_t));
-
-    sa = ngx_palloc(cf->pool, socklen);
-    if (sa == NULL) {
-        return NULL;
-    }
-
-    ngx_memcpy(sa, sockaddr, socklen);
-
-    ls->sockaddr = sa;
-    ls->socklen = socklen;
-
-    len = ngx_sock_ntop(sa, socklen, text, NGX_SOCKADDR_STRLEN, 1);
-    ls->addr_text.len = len;
-
-    switch (ls->sockaddr->sa_family) {
-#if (NGX_HAVE_INET6)
-    case AF_INET6:
-        ls->addr_text_max_len = NGX_INET6_ADDRSTRLEN;
-        break;
-#endif
-#if (NGX_HAVE_UNIX_DOMAIN)
-    case AF_UNIX:
-        ls->addr_text_max_len = NGX_UNIX_ADDRSTRLEN;
-        len++;
-        break;
-#endif
-    case AF_INET:
-        ls->addr_text_max_len = NGX_INET_ADDRSTRLEN;
-        break;
-    default:
-        ls->addr_text_max_len = NGX_SOCKADDR_STRLEN;
-        break;
-    }
-
-    ls->addr_text.data = ngx_pnalloc(cf->pool, len);
-    if (ls->addr_text.data == NULL) {
-        return NULL;
-    }
-
-    ngx_memcpy(ls->addr_text.data, text, len);
-
-#if !(NGX_WIN32)
-    ngx_rbtree_init(&ls->rbtree, &ls->sentinel, ngx_udp_rbtree_insert_value);
-#endif
-
-    ls->fd = (ngx_socket_t) -1;
-    ls->type = SOCK_STREAM;
-
-    ls->backlog = NGX_LISTEN_BACKLOG;
-    ls->rcvbuf = -1;
-    ls->sndbuf = -1;
-
-#if (NGX_HAVE_SETFIB)
-    ls->setfib = -1;
-#endif
-
-#if (NGX_HAVE_TCP_FASTOPEN)
-    ls->fastopen = -1;
+#if (NGX_HAVE_BUSY_POLL)
+    ls->busy_poll = -1;
 #endif
 
     return ls;
@@ -808,6 +741,15 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
     struct accept_filter_arg   af;
 #endif
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+    struct sock_fprog          prog;
+    ngx_core_conf_t           *ccf;
+#endif
+
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+    prog.len = 0;
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+#endif
 
     ls = cycle->listening.elts;
     for (i = 0; i < cycle->listening.nelts; i++) {
@@ -924,6 +866,57 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
         }
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+        if (ls[i].busy_poll != -1) {
+            if (setsockopt(ls[i].fd, SOL_SOCKET, SO_BUSY_POLL,
+                           (const void *) &ls[i].busy_poll, sizeof(int))
+                == -1)
+            {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_BUSY_POLL, %d) %V failed, ignored",
+                              ls[i].busy_poll, &ls[i].addr_text);
+            }
+        }
+
+#ifdef SO_PREFER_BUSY_POLL
+        if (ls[i].prefer_busy_poll) {
+            value = 1;
+
+            if (setsockopt(ls[i].fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                           (const void *) &value, sizeof(int))
+                == -1)
+            {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_PREFER_BUSY_POLL) %V failed, "
+                              "ignored",
+                              &ls[i].addr_text);
+            }
+        }
+#endif
+#endif
+
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+        if (ccf->cpu_steering && ls[i].reuseport && ls[i].worker == 0) {
+
+            if (prog.len == 0
+                && ngx_reuseport_cpu_program(cycle, ccf, &prog) != NGX_OK)
+            {
+                ccf->cpu_steering = 0;
+
+            } else if (setsockopt(ls[i].fd, SOL_SOCKET,
+                                  SO_ATTACH_REUSEPORT_CBPF,
+                                  (const void *) &prog,
+                                  sizeof(struct sock_fprog))
+                       == -1)
+            {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_ATTACH_REUSEPORT_CBPF) "
+                              "%V failed, ignored",
+                              &ls[i].addr_text);
+            }
+        }
+#endif
+
 #if 0
         if (1) {
             int tcp_nodelay = 1;
@@ -1106,6 +1099,86 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+
+/*
+ * 为reuseport监听组生成一个经典BPF程序：按照接收连接的CPU
+ * 选择绑定在该CPU上的worker。组内socket按worker编号的顺序加入，
+ * 因此返回的索引就是worker编号；未绑定任何worker的CPU返回越界索引，
+ * 内核会退回到默认的哈希分发。
+ */
+
+static ngx_int_t
+ngx_reuseport_cpu_program(ngx_cycle_t *cycle, ngx_core_conf_t *ccf,
+    struct sock_fprog *prog)
+{
+    ngx_uint_t           cpu, n, w;
+    ngx_cpuset_t        *mask;
+    struct sock_filter  *code, *p;
+
+    n = 0;
+
+    for (w = 0; w < (ngx_uint_t) ccf->worker_processes; w++) {
+        mask = ngx_get_worker_cpu_affinity(ccf, w);
+
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, mask)) {
+                n++;
+            }
+        }
+    }
+
+    if (n == 0 || 2 * n + 2 > BPF_MAXINSNS) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "cannot steer %ui worker processes by CPU, ignored",
+                      (ngx_uint_t) ccf->worker_processes);
+        return NGX_DECLINED;
+    }
+
+    code = ngx_pnalloc(cycle->pool, (2 * n + 2) * sizeof(struct sock_filter));
+    if (code == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = code;
+
+    /* A = raw_smp_processor_id() */
+
+    *p++ = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+                                         SKF_AD_OFF + SKF_AD_CPU);
+
+    /*
+     * if several workers share a CPU, the first one wins;
+     * the rest still get connections from other CPUs via hashing
+     */
+
+    for (w = 0; w < (ngx_uint_t) ccf->worker_processes; w++) {
+        mask = ngx_get_worker_cpu_affinity(ccf, w);
+
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, mask)) {
+                *p++ = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,
+                                                     cpu, 0, 1);
+                *p++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, w);
+            }
+        }
+    }
+
+    *p++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, 0xffffffff);
+
+    prog->len = (unsigned short) (p - code);
+    prog->filter = code;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "reuseport cpu steering: %ui workers, %ui insns",
+                   (ngx_uint_t) ccf->worker_processes, (ngx_uint_t) prog->len);
+
+    return NGX_OK;
+}
+
+#endif
+
+
 void
 ngx_close_listening_sockets(ngx_cycle_t *cycle)
 {
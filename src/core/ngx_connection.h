@@ -90,79 +90,13 @@ struct ngx_listening_s {
     int                 fastopen;         /* TCP Fast Open配置 */
 #endif
 
-};
-
-    ngx_socket_t        fd;
-
-    struct sockaddr    *sockaddr;
-    socklen_t           socklen;    /* size of sockaddr */
-    size_t              addr_text_max_len;
-    ngx_str_t           addr_text;
-
-    int                 type;
-
-    int                 backlog;
-    int                 rcvbuf;
-    int                 sndbuf;
-#if (NGX_HAVE_KEEPALIVE_TUNABLE)
-    int                 keepidle;
-    int                 keepintvl;
-    int                 keepcnt;
+#if (NGX_HAVE_BUSY_POLL)
+    int                 busy_poll;        /* SO_BUSY_POLL微秒数 */
+    unsigned            prefer_busy_poll:1;   /* 是否设置SO_PREFER_BUSY_POLL */
 #endif
 
-    /* handler of accepted connection */
-    ngx_connection_handler_pt   handler;
-
-    void               *servers;  /* array of ngx_http_in_addr_t, for example */
-
-    ngx_log_t           log;
-    ngx_log_t          *logp;
-
-    size_t              pool_size;
-    /* should be here because of the AcceptEx() preread */
-    size_t              post_accept_buffer_size;
-
-    ngx_listening_t    *previous;
-    ngx_connection_t   *connection;
-
-    ngx_rbtree_t        rbtree;
-    ngx_rbtree_node_t   sentinel;
-
-    ngx_uint_t          worker;
-
-    unsigned            open:1;
-    unsigned            remain:1;
-    unsigned            ignore:1;
-
-    unsigned            bound:1;       /* already bound */
-    unsigned            inherited:1;   /* inherited from previous process */
-    unsigned            nonblocking_accept:1;
-    unsigned            listen:1;
-    unsigned            nonblocking:1;
-    unsigned            shared:1;    /* shared between threads or processes */
-    unsigned            addr_ntop:1;
-    unsigned            wildcard:1;
-
-#if (NGX_HAVE_INET6)
-    unsigned            ipv6only:1;
-#endif
-    unsigned            reuseport:1;
-    unsigned            add_reuseport:1;
-    unsigned            keepalive:2;
-
-    unsigned            deferred_accept:1;
-    unsigned            delete_deferred:1;
-    unsigned            add_deferred:1;
-#if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
-    char               *accept_filter;
-#endif
-#if (NGX_HAVE_SETFIB)
-    int                 setfib;
-#endif
-
-#if (NGX_HAVE_TCP_FASTOPEN)
-    int                 fastopen;
-#endif
+    ngx_uint_t          udp_batch;        /* recvmmsg()/sendmmsg()批量数据报数 */
+    unsigned            udp_gso:1;        /* 是否启用UDP分段卸载(UDP_SEGMENT) */
 
 };
 
@@ -197,6 +131,10 @@ typedef enum {
 
 /*
  * 结构体 ngx_connection_s 表示一个连接对象，用于描述一个客户端与服务器的连接。
+ *
+ * 字段按访问频率排列：第一个缓存行为每次I/O都要访问的事件及收发函数，
+ * 第二个缓存行为处理请求时常用的字段及标志位，
+ * 其余为仅在建立连接、记录日志或特定协议中使用的字段。
  */
 struct ngx_connection_s {
     void               *data;                 // 保留指针，可以由用户自定义使用
@@ -210,38 +148,20 @@ struct ngx_connection_s {
     ngx_recv_chain_pt   recv_chain;           // 链式接收数据的回调函数指针
     ngx_send_chain_pt   send_chain;           // 链式发送数据的回调函数指针
 
-    ngx_listening_t    *listening;            // 监听对象，指向当前连接所属的监听对象
-
     off_t               sent;                 // 表示已经发送出去的字节数
 
     ngx_log_t          *log;                  // 连接相关的日志对象
 
     ngx_pool_t         *pool;                 // 内存池对象，用于分配内存
 
-    int                 type;                 // 连接的类型
-
-    struct sockaddr    *sockaddr;             // 远端地址
-    socklen_t           socklen;              // 远端地址长度
-    ngx_str_t           addr_text;            // 字符串形式的远端地址
-
-    ngx_proxy_protocol_t  *proxy_protocol;    // 代理协议相关信息
+    ngx_buf_t          *buffer;               // 用于接收和发送数据的缓冲区
 
 #if (NGX_SSL || NGX_COMPAT)
     ngx_ssl_connection_t  *ssl;               // SSL/TLS 连接相关信息
 #endif
 
-    ngx_udp_connection_t  *udp;               // UDP 连接相关信息
-
-    struct sockaddr    *local_sockaddr;      // 本地地址
-    socklen_t           local_socklen;        // 本地地址长度
-
-    ngx_buf_t          *buffer;               // 用于接收和发送数据的缓冲区
-
-    ngx_queue_t         queue;                // 用于将连接对象加入到某个队列中
-
     ngx_atomic_uint_t   number;               // 连接的编号，用于标识连接
 
-    ngx_msec_t          start_time;           // 连接建立的时间
     ngx_uint_t          requests;             // 处理的请求数量
 
     unsigned            buffered:8;          // 缓冲区中的数据长度
@@ -273,6 +193,29 @@ struct ngx_connection_s {
 #if (NGX_THREADS || NGX_COMPAT)
     ngx_thread_task_t  *sendfile_task;        // 用于多线程发送文件任务
 #endif
+
+#if (NGX_HAVE_MSG_ZEROCOPY || NGX_COMPAT)
+    ngx_linux_zerocopy_t  *zerocopy;          // MSG_ZEROCOPY 发送状态
+#endif
+
+    ngx_queue_t         queue;                // 用于将连接对象加入到某个队列中
+
+    ngx_listening_t    *listening;            // 监听对象，指向当前连接所属的监听对象
+
+    int                 type;                 // 连接的类型
+
+    struct sockaddr    *sockaddr;             // 远端地址
+    socklen_t           socklen;              // 远端地址长度
+    ngx_str_t           addr_text;            // 字符串形式的远端地址
+
+    ngx_proxy_protocol_t  *proxy_protocol;    // 代理协议相关信息
+
+    ngx_udp_connection_t  *udp;               // UDP 连接相关信息
+
+    struct sockaddr    *local_sockaddr;      // 本地地址
+    socklen_t           local_socklen;        // 本地地址长度
+
+    ngx_msec_t          start_time;           // 连接建立的时间
 };
 
 
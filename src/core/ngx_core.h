@@ -29,6 +29,7 @@ typedef struct ngx_ssl_s             ngx_ssl_t;
 typedef struct ngx_proxy_protocol_s  ngx_proxy_protocol_t;
 typedef struct ngx_ssl_connection_s  ngx_ssl_connection_t;
 typedef struct ngx_udp_connection_s  ngx_udp_connection_t;
+typedef struct ngx_linux_zerocopy_s  ngx_linux_zerocopy_t;
 
 /*
  * 函数指针类型 ngx_event_handler_pt 的定义
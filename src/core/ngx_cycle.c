@@ -12,6 +12,7 @@ static void ngx_destroy_cycle_pools(ngx_conf_t *conf);
 static ngx_int_t ngx_init_zone_pool(ngx_cycle_t *cycle,
                                     ngx_shm_zone_t *shm_zone);
 static ngx_int_t ngx_test_lockfile(u_char *file, ngx_log_t *log);
+static void ngx_shm_zone_options(ngx_core_conf_t *ccf, ngx_shm_zone_t *zone);
 static void ngx_clean_old_cycles(ngx_event_t *ev);
 static void ngx_shutdown_timer_handler(ngx_event_t *ev);
 
@@ -504,6 +505,10 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
         // 设置共享内存区域的日志指针
         shm_zone[i].shm.log = cycle->log;
 
+        // 按shared_memory_options设置大页、NUMA及弹匣缓存选项，
+        // 复用的共享内存区保留原有的映射方式
+        ngx_shm_zone_options(ccf, &shm_zone[i]);
+
         // 获取旧周期中的共享内存区域数组
         opart = &old_cycle->shared_memory.part;
         oshm_zone = opart->elts;
@@ -543,6 +548,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
             {
                 // 复用旧周期中共享内存区域的地址，并调用初始化函数
                 shm_zone[i].shm.addr = oshm_zone[n].shm.addr;
+                shm_zone[i].shm.flags = oshm_zone[n].shm.flags;
+                shm_zone[i].shm.node = oshm_zone[n].shm.node;
 #if (NGX_WIN32)
                 shm_zone[i].shm.handle = oshm_zone[n].shm.handle;
 #endif
@@ -1125,6 +1132,47 @@ ngx_destroy_cycle_pools(ngx_conf_t *conf)
     ngx_destroy_pool(conf->pool);
 }
 
+/*
+ * 查找与共享内存区同名的shared_memory_options，
+ * 没有同名配置时使用"*"的配置
+ */
+static void
+ngx_shm_zone_options(ngx_core_conf_t *ccf, ngx_shm_zone_t *zone)
+{
+    ngx_uint_t i;
+    ngx_shm_t *shm;
+    ngx_shm_options_t *opt, *any;
+
+    shm = &zone->shm;
+
+    any = NULL;
+    opt = ccf->shm_options.elts;
+
+    for (i = 0; i < ccf->shm_options.nelts; i++)
+    {
+        if (opt[i].name.len == 1 && opt[i].name.data[0] == '*')
+        {
+            any = &opt[i];
+            continue;
+        }
+
+        if (opt[i].name.len == shm->name.len && ngx_strncmp(opt[i].name.data, shm->name.data, shm->name.len) == 0)
+        {
+            any = &opt[i];
+            break;
+        }
+    }
+
+    if (any == NULL)
+    {
+        return;
+    }
+
+    shm->flags = any->flags;
+    shm->node = any->node;
+    zone->magazine = any->magazine;
+}
+
 static ngx_int_t
 ngx_init_zone_pool(ngx_cycle_t *cycle, ngx_shm_zone_t *zn)
 {
@@ -1612,9 +1660,12 @@ ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
     shm_zone->shm.size = size;
     shm_zone->shm.name = *name;
     shm_zone->shm.exists = 0;
+    shm_zone->shm.flags = 0;
+    shm_zone->shm.node = 0;
     shm_zone->init = NULL;
     shm_zone->tag = tag;
     shm_zone->noreuse = 0;
+    shm_zone->magazine = 0;
 
     return shm_zone;
 }
@@ -26,6 +26,13 @@ typedef struct ngx_shm_zone_s  ngx_shm_zone_t;
 
 typedef ngx_int_t (*ngx_shm_zone_init_pt) (ngx_shm_zone_t *zone, void *data);
 
+typedef struct {
+    ngx_str_t                 name;     /* 共享内存区名称，"*"匹配所有 */
+    ngx_uint_t                flags;    /* NGX_SHM_HUGETLB等 */
+    ngx_uint_t                node;     /* NGX_SHM_BIND时绑定的NUMA节点 */
+    ngx_uint_t                magazine; /* worker弹匣缓存每个大小类的块数 */
+} ngx_shm_options_t;
+
 struct ngx_shm_zone_s {
     void                     *data;
     ngx_shm_t                 shm;
@@ -33,6 +40,7 @@ struct ngx_shm_zone_s {
     void                     *tag;
     void                     *sync;
     ngx_uint_t                noreuse;  /* unsigned  noreuse:1; */
+    ngx_uint_t                magazine;
 };
 
 
@@ -111,6 +119,7 @@ typedef struct {
     ngx_uint_t                cpu_affinity_auto;    /**< CPU亲和性是否自动设置 */
     ngx_uint_t                cpu_affinity_n;       /**< CPU亲和性的CPU个数 */
     ngx_cpuset_t             *cpu_affinity;         /**< CPU亲和性的CPU集合 */
+    ngx_flag_t                cpu_steering;         /**< 是否按CPU将reuseport连接分发给对应worker */
 
     char                     *username;             /**< 运行进程的用户名 */
     ngx_uid_t                 user;                 /**< 运行进程的用户ID */
@@ -123,6 +132,8 @@ typedef struct {
     ngx_str_t                 oldpid;               /**< 旧的PID文件路径 */
 
     ngx_array_t               env;                  /**< 环境变量数组 */
+    ngx_array_t               shm_options;          /**< 共享内存区的大页、NUMA及弹匣缓存选项 */
+    size_t                    pool_cache;           /**< worker进程缓存的空闲内存池块的总大小上限，0表示关闭 */
     char                    **environment;          /**< 环境变量指针数组 */
 
     ngx_uint_t                transparent;          /**< 是否开启透明模式，1表示是，0表示否 */
@@ -141,6 +152,7 @@ void ngx_reopen_files(ngx_cycle_t *cycle, ngx_uid_t user);
 char **ngx_set_environment(ngx_cycle_t *cycle, ngx_uint_t *last);
 ngx_pid_t ngx_exec_new_binary(ngx_cycle_t *cycle, char *const *argv);
 ngx_cpuset_t *ngx_get_cpu_affinity(ngx_uint_t n);
+ngx_cpuset_t *ngx_get_worker_cpu_affinity(ngx_core_conf_t *ccf, ngx_uint_t n);
 ngx_shm_zone_t *ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name,
     size_t size, void *tag);
 void ngx_set_shutdown_timer(ngx_cycle_t *cycle);
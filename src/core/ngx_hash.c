@@ -257,6 +257,45 @@ ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key, u_char *name,
 }
 
 
+/**
+ * 在完美散列表中查找指定键值对应的值，只需比较一个元素；
+ * 未知的键通常落在空槽位或者在比较哈希值时即被排除，不会比较名字。
+ * @param hash 完美散列表指针
+ * @param key 键的哈希值
+ * @param name 键的名字
+ * @param len 键的长度
+ * @return 返回键对应的值，如果未找到则返回 NULL
+ */
+void *
+ngx_hash_find_perfect(ngx_hash_perfect_t *hash, ngx_uint_t key, u_char *name,
+    size_t len)
+{
+    ngx_uint_t               n;
+    ngx_hash_perfect_elt_t  *elt;
+
+    if (hash->index == NULL) {
+        return ngx_hash_find(hash->hash, key, name, len);
+    }
+
+    n = hash->index[(key * hash->seed) >> hash->shift];
+
+    if (n == 0) {
+        return NULL;
+    }
+
+    elt = &hash->elts[n - 1];
+
+    if (elt->key != key
+        || elt->len != len
+        || ngx_memcmp(elt->name, name, len) != 0)
+    {
+        return NULL;
+    }
+
+    return elt->value;
+}
+
+
 /**
  * 宏定义 NGX_HASH_ELT_SIZE 用于计算散列表元素 ngx_hash_elt_t 的大小。
  * @param name 键值对结构体 ngx_hash_key_t 的指针
@@ -371,6 +410,42 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts)
 
 found:
 
+    for (i = 0; i < size; i++) {
+        test[i] = sizeof(void *);
+    }
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        key = names[n].key_hash % size;
+        len = test[key] + NGX_HASH_ELT_SIZE(&names[n]);
+
+        if (len > 65536 - ngx_cacheline_size) {
+            ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
+                          "could not build %s, you should "
+                          "increase %s_max_size: %i",
+                          hinit->name, hinit->name, hinit->max_size);
+            ngx_free(test);
+            return NGX_ERROR;
+        }
+
+        test[key] = (u_short) len;
+    }
+
+    len = 0;
+
+    for (i = 0; i < size; i++) {
+        if (test[i] == sizeof(void *)) {
+            continue;
+        }
+
+        test[i] = (u_short) (ngx_align(test[i], ngx_cacheline_size));
+
+        len += test[i];
+    }
+
     // 分配散列表桶
     if (hinit->hash == NULL) {
         hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t)
@@ -483,6 +558,129 @@ found:
 }
 
 
+/* 每种大小尝试的乘数个数 */
+#define NGX_HASH_PERFECT_TRIES    4096
+
+
+/**
+ * 生成完美散列表：从不小于元素个数两倍的2的幂开始，
+ * 逐个尝试奇数乘数，直到所有键落在不同的槽位；
+ * 在 max_size 以内找不到时返回 NGX_DECLINED，查找使用 fallback 散列表。
+ * @param hash 完美散列表
+ * @param fallback 包含同样键的普通散列表
+ * @param names 键值对数组，键的哈希值需由 ngx_hash_key_lc() 计算
+ * @param nelts 键值对数组元素个数
+ * @param max_size 槽位数的上限
+ * @param pool 内存池
+ * @return 成功返回 NGX_OK，没有找到布局返回 NGX_DECLINED，失败返回 NGX_ERROR
+ */
+ngx_int_t
+ngx_hash_perfect_init(ngx_hash_perfect_t *hash, ngx_hash_t *fallback,
+    ngx_hash_key_t *names, ngx_uint_t nelts, ngx_uint_t max_size,
+    ngx_pool_t *pool)
+{
+    u_char                  *index;
+    ngx_uint_t               i, n, bits, size, seed, shift, tries;
+    ngx_hash_perfect_elt_t  *elts;
+
+    hash->index = NULL;
+    hash->hash = fallback;
+
+    if (nelts == 0 || nelts > 255) {
+        return NGX_DECLINED;
+    }
+
+    for (bits = 1; ((ngx_uint_t) 1 << bits) < 2 * nelts; bits++) {
+        /* void */
+    }
+
+    index = NULL;
+    seed = 0;
+    shift = 0;
+
+    for ( /* void */ ; ((ngx_uint_t) 1 << bits) <= max_size; bits++) {
+
+        size = (ngx_uint_t) 1 << bits;
+        shift = sizeof(ngx_uint_t) * 8 - bits;
+
+        index = ngx_alloc(size, pool->log);
+        if (index == NULL) {
+            return NGX_ERROR;
+        }
+
+        seed = (ngx_uint_t) 0x9e3779b97f4a7c15ULL;
+
+        for (tries = 0; tries < NGX_HASH_PERFECT_TRIES; tries++) {
+
+            ngx_memzero(index, size);
+
+            for (i = 0; i < nelts; i++) {
+                n = (names[i].key_hash * seed) >> shift;
+
+                if (index[n]) {
+                    break;
+                }
+
+                index[n] = (u_char) (i + 1);
+            }
+
+            if (i == nelts) {
+                goto found;
+            }
+
+            seed = (seed * 6364136223846793005ULL + 1442695040888963407ULL)
+                   | 1;
+        }
+
+        ngx_free(index);
+        index = NULL;
+    }
+
+    return NGX_DECLINED;
+
+found:
+
+    hash->index = ngx_palloc(pool, size);
+    if (hash->index == NULL) {
+        ngx_free(index);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(hash->index, index, size);
+    ngx_free(index);
+
+    elts = ngx_palloc(pool, nelts * sizeof(ngx_hash_perfect_elt_t));
+    if (elts == NULL) {
+        hash->index = NULL;
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < nelts; i++) {
+        elts[i].key = names[i].key_hash;
+        elts[i].len = names[i].key.len;
+        elts[i].value = names[i].value;
+
+        elts[i].name = ngx_pnalloc(pool, names[i].key.len);
+        if (elts[i].name == NULL) {
+            hash->index = NULL;
+            return NGX_ERROR;
+        }
+
+        ngx_strlow(elts[i].name, names[i].key.data, names[i].key.len);
+    }
+
+    hash->elts = elts;
+    hash->seed = seed;
+    hash->shift = shift;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_CORE, pool->log, 0,
+                   "perfect hash: %ui keys, %ui slots, seed:%xi",
+                   nelts, size, seed);
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts)
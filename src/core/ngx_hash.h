@@ -66,6 +66,26 @@ typedef struct {
     ngx_hash_wildcard_t  *wc_tail;
 } ngx_hash_combined_t;
 
+/**
+ * 结构体 ngx_hash_perfect_t 表示配置时生成的完美散列表，每个槽位最多一个元素。
+ * index 按 (key * seed) >> shift 索引，保存元素在 elts 中的下标加一，0 表示空槽位；
+ * 找不到无冲突的布局时 index 为 NULL，查找退回到普通散列表 hash。
+ */
+typedef struct {
+    ngx_uint_t        key;
+    size_t            len;
+    u_char           *name;
+    void             *value;
+} ngx_hash_perfect_elt_t;
+
+typedef struct {
+    u_char                  *index;
+    ngx_hash_perfect_elt_t  *elts;
+    ngx_uint_t               seed;
+    ngx_uint_t               shift;
+    ngx_hash_t              *hash;
+} ngx_hash_perfect_t;
+
 /**
  * 结构体 ngx_hash_init_t 表示初始化散列表所需的参数。
  * hash 是散列表结构体指针，key 是用于计算哈希值的回调函数指针。
@@ -129,11 +149,16 @@ void *ngx_hash_find_wc_head(ngx_hash_wildcard_t *hwc, u_char *name, size_t len);
 void *ngx_hash_find_wc_tail(ngx_hash_wildcard_t *hwc, u_char *name, size_t len);
 void *ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key,
     u_char *name, size_t len);
+void *ngx_hash_find_perfect(ngx_hash_perfect_t *hash, ngx_uint_t key,
+    u_char *name, size_t len);
 
 ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
 ngx_int_t ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
+ngx_int_t ngx_hash_perfect_init(ngx_hash_perfect_t *hash, ngx_hash_t *fallback,
+    ngx_hash_key_t *names, ngx_uint_t nelts, ngx_uint_t max_size,
+    ngx_pool_t *pool);
 
 #define ngx_hash(key, c)   ((ngx_uint_t) key * 31 + c)
 ngx_uint_t ngx_hash_key(u_char *data, size_t len);
@@ -106,7 +106,9 @@
 #define NGX_MODULE_SIGNATURE_16  "0"
 #endif
 
-#define NGX_MODULE_SIGNATURE_17  "0"
+/* ngx_connection_t 及 ngx_event_t 的字段已按访问频率重新排列 */
+#define NGX_MODULE_SIGNATURE_17  "1"
+
 #define NGX_MODULE_SIGNATURE_18  "0"
 
 #if (NGX_HAVE_OPENAT)
@@ -13,6 +13,48 @@ static ngx_inline void *ngx_palloc_small(ngx_pool_t *pool, size_t size,
     ngx_uint_t align);
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static void *ngx_get_cached_block(size_t *size, ngx_log_t *log);
+static void ngx_put_cached_block(void *p, size_t size);
+
+
+/*
+ * 空闲内存块缓存按2的幂分为多个大小类，从512字节到64K；
+ * 分配时向上取整到所属的大小类，释放时放入不超过块大小的最大的大小类
+ */
+
+#define NGX_POOL_CACHE_MIN_SHIFT  9
+#define NGX_POOL_CACHE_MAX_SHIFT  16
+#define NGX_POOL_CACHE_MAX_SIZE   ((size_t) 1 << NGX_POOL_CACHE_MAX_SHIFT)
+#define NGX_POOL_CACHE_SLOTS                                                  \
+    (NGX_POOL_CACHE_MAX_SHIFT - NGX_POOL_CACHE_MIN_SHIFT + 1)
+
+
+typedef struct ngx_cached_block_s  ngx_cached_block_t;
+
+struct ngx_cached_block_s {
+    ngx_cached_block_t   *next;
+};
+
+
+typedef struct {
+    ngx_cached_block_t   *block;
+    ngx_uint_t            number;
+} ngx_cached_block_slot_t;
+
+
+static ngx_cached_block_slot_t  ngx_pool_cache[NGX_POOL_CACHE_SLOTS];
+static size_t                   ngx_pool_cache_max;
+
+ngx_pool_cache_stat_t           ngx_pool_cache_stat;
+
+
+/* 在worker进程中启用块缓存，max为缓存的空闲块总大小的上限 */
+
+void
+ngx_pool_cache_init(size_t max)
+{
+    ngx_pool_cache_max = max;
+}
 
 
 ngx_pool_t *
@@ -20,8 +62,8 @@ ngx_create_pool(size_t size, ngx_log_t *log)
 {
     ngx_pool_t  *p;  // 指向创建的内存池的指针
 
-    // 使用 ngx_memalign 函数分配内存池，并检查分配是否成功
-    p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
+    // 分配内存池，启用块缓存时大小向上取整到所属的大小类
+    p = ngx_get_cached_block(&size, log);
     if (p == NULL) {
         return NULL;
     }
@@ -91,13 +133,13 @@ ngx_destroy_pool(ngx_pool_t *pool)
     // 释放大块内存链表中的每个大块内存
     for (l = pool->large; l; l = l->next) {
         if (l->alloc) {
-            ngx_free(l->alloc);
+            ngx_put_cached_block(l->alloc, l->size);
         }
     }
 
     // 释放内存池链表中的每个内存池
     for (p = pool, n = pool->d.next; /* void */; p = n, n = n->d.next) {
-        ngx_free(p);
+        ngx_put_cached_block(p, p->d.end - (u_char *) p);
 
         if (n == NULL) {
             break;
@@ -116,7 +158,7 @@ ngx_reset_pool(ngx_pool_t *pool)
     // 释放大块内存链表中的每个大块内存
     for (l = pool->large; l; l = l->next) {
         if (l->alloc) {
-            ngx_free(l->alloc);
+            ngx_put_cached_block(l->alloc, l->size);
         }
     }
 
@@ -221,8 +263,8 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size)
     // 计算内存块的总大小
     psize = (size_t) (pool->d.end - (u_char *) pool);
 
-    // 使用 ngx_memalign 分配内存块
-    m = ngx_memalign(NGX_POOL_ALIGNMENT, psize, pool->log);
+    // 分配内存块，启用块缓存时大小可能向上取整
+    m = ngx_get_cached_block(&psize, pool->log);
     if (m == NULL) {
         return NULL;
     }
@@ -263,8 +305,14 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
     ngx_uint_t         n;        // 记录循环次数
     ngx_pool_large_t  *large;    // 大块内存链表节点指针
 
-    // 使用 ngx_alloc 函数分配大块内存
-    p = ngx_alloc(size, pool->log);
+    // 分配大块内存，不超过最大的大小类时使用块缓存
+    if (ngx_pool_cache_max && size <= NGX_POOL_CACHE_MAX_SIZE) {
+        p = ngx_get_cached_block(&size, pool->log);
+
+    } else {
+        p = ngx_alloc(size, pool->log);
+    }
+
     if (p == NULL) {
         return NULL;
     }
@@ -275,6 +323,7 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
     for (large = pool->large; large; large = large->next) {
         if (large->alloc == NULL) {
             large->alloc = p;
+            large->size = size;
             return p;
         }
 
@@ -293,6 +342,7 @@ ngx_palloc_large(ngx_pool_t *pool, size_t size)
 
     // 初始化新节点信息
     large->alloc = p;
+    large->size = size;
     large->next = pool->large;
     pool->large = large;
 
@@ -319,6 +369,7 @@ ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment)
     }
 
     large->alloc = p;
+    large->size = 0;
     large->next = pool->large;
     pool->large = large;
 
@@ -339,8 +390,8 @@ ngx_pfree(ngx_pool_t *pool, void *p)
             // 在调试日志中记录要释放的内存地址
             ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
                            "free: %p", l->alloc);
-            // 使用ngx_free释放large节点中的内存
-            ngx_free(l->alloc);
+            // 释放large节点中的内存，可能放入块缓存
+            ngx_put_cached_block(l->alloc, l->size);
             // 将large节点的alloc指针置为NULL，表示该内存已被释放
             l->alloc = NULL;
 
@@ -486,30 +537,90 @@ void ngx_pool_delete_file(void *data)
 
 
 
-#if 0
-
 static void *
-ngx_get_cached_block(size_t size)
+ngx_get_cached_block(size_t *size, ngx_log_t *log)
 {
     void                     *p;
+    size_t                    s;
+    ngx_uint_t                shift;
     ngx_cached_block_slot_t  *slot;
 
-    if (ngx_cycle->cache == NULL) {
-        return NULL;
+    if (ngx_pool_cache_max == 0 || *size > NGX_POOL_CACHE_MAX_SIZE) {
+        return ngx_memalign(NGX_POOL_ALIGNMENT, *size, log);
     }
 
-    slot = &ngx_cycle->cache[(size + ngx_pagesize - 1) / ngx_pagesize];
+    shift = NGX_POOL_CACHE_MIN_SHIFT;
+
+    while (((size_t) 1 << shift) < *size) {
+        shift++;
+    }
 
-    slot->tries++;
+    s = (size_t) 1 << shift;
+    slot = &ngx_pool_cache[shift - NGX_POOL_CACHE_MIN_SHIFT];
+
+    *size = s;
 
     if (slot->number) {
         p = slot->block;
         slot->block = slot->block->next;
         slot->number--;
+
+        ngx_pool_cache_stat.size -= s;
+        ngx_pool_cache_stat.hits++;
+
         return p;
     }
 
-    return NULL;
+    ngx_pool_cache_stat.misses++;
+
+    return ngx_memalign(NGX_POOL_ALIGNMENT, s, log);
 }
 
-#endif
+
+static void
+ngx_put_cached_block(void *p, size_t size)
+{
+    ngx_uint_t                shift;
+    ngx_cached_block_t       *block;
+    ngx_cached_block_slot_t  *slot;
+
+    /*
+     * the blocks allocated before the cache was enabled may be
+     * of any size, and the large ones may be not aligned
+     */
+
+    if (ngx_pool_cache_max == 0
+        || size < ((size_t) 1 << NGX_POOL_CACHE_MIN_SHIFT)
+        || size > NGX_POOL_CACHE_MAX_SIZE
+        || ((uintptr_t) p & (NGX_POOL_ALIGNMENT - 1)))
+    {
+        ngx_free(p);
+        return;
+    }
+
+    shift = NGX_POOL_CACHE_MAX_SHIFT;
+
+    while (((size_t) 1 << shift) > size) {
+        shift--;
+    }
+
+    size = (size_t) 1 << shift;
+
+    if (ngx_pool_cache_stat.size + size > ngx_pool_cache_max) {
+        ngx_free(p);
+        return;
+    }
+
+    slot = &ngx_pool_cache[shift - NGX_POOL_CACHE_MIN_SHIFT];
+
+    block = p;
+    block->next = slot->block;
+    slot->block = block;
+    slot->number++;
+
+    ngx_pool_cache_stat.size += size;
+
+    if (ngx_pool_cache_stat.size > ngx_pool_cache_stat.peak) {
+        ngx_pool_cache_stat.peak = ngx_pool_cache_stat.size;
+    }
+}
@@ -43,6 +43,7 @@ typedef struct ngx_pool_large_s  ngx_pool_large_t;
 struct ngx_pool_large_s {
     ngx_pool_large_t     *next;
     void                 *alloc;
+    size_t                size;    // 分配的大小，0表示不可放入块缓存
 };
 
 
@@ -74,6 +75,17 @@ typedef struct {
 } ngx_pool_cleanup_file_t;
 
 
+/* 每个worker进程的空闲内存块缓存的统计 */
+typedef struct {
+    ngx_uint_t            hits;
+    ngx_uint_t            misses;
+    size_t                size;    // 当前缓存的字节数
+    size_t                peak;    // 缓存字节数的最高值
+} ngx_pool_cache_stat_t;
+
+
+void ngx_pool_cache_init(size_t max);
+
 ngx_pool_t *ngx_create_pool(size_t size, ngx_log_t *log);
 void ngx_destroy_pool(ngx_pool_t *pool);
 void ngx_reset_pool(ngx_pool_t *pool);
@@ -91,4 +103,7 @@ void ngx_pool_cleanup_file(void *data);
 void ngx_pool_delete_file(void *data);
 
 
+extern ngx_pool_cache_stat_t  ngx_pool_cache_stat;
+
+
 #endif /* _NGX_PALLOC_H_INCLUDED_ */
@@ -27,6 +27,11 @@ static void ngx_libc_cdecl ngx_regex_free(void *p);
 #endif
 static void ngx_regex_cleanup(void *data);
 
+static u_char *ngx_regex_skip_escape(u_char *p, u_char *last);
+static u_char *ngx_regex_skip_class(u_char *p, u_char *last);
+static u_char *ngx_regex_skip_group(u_char *p, u_char *last);
+static u_char *ngx_regex_quantifier(u_char *p, u_char *last, ngx_uint_t *min);
+
 static ngx_int_t ngx_regex_module_init(ngx_cycle_t *cycle);
 
 static void *ngx_regex_create_conf(ngx_cycle_t *cycle);
@@ -495,6 +500,611 @@ ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log)
 }
 
 
+/*
+ * finds the longest run of bytes which every match of the pattern has to
+ * contain, e.g., "example.com" for "^(www\.)?example\.com$"; the literal
+ * is lowercased to be searched for regardless of case.  The pattern is
+ * assumed to be valid, and anything not understood yields no literal:
+ * alternation at the top level, \Q...\E, the "x" option, or verbs like
+ * (*UTF) or (*ACCEPT) anywhere outside classes
+ */
+
+ngx_int_t
+ngx_regex_literal(ngx_pool_t *pool, ngx_str_t *pattern, ngx_str_t *literal)
+{
+    u_char      c, *p, *q, *last, *buf, *start, *end;
+    ngx_uint_t  lit, min;
+
+    ngx_str_null(literal);
+
+    p = pattern->data;
+    last = p + pattern->len;
+
+    if (p == last) {
+        return NGX_OK;
+    }
+
+    buf = ngx_pnalloc(pool, pattern->len);
+    if (buf == NULL) {
+        return NGX_ERROR;
+    }
+
+    start = buf;
+    end = buf;
+
+    while (p < last) {
+
+        c = *p++;
+        lit = 0;
+
+        switch (c) {
+
+        case '\\':
+            if (p == last) {
+                goto none;
+            }
+
+            c = *p;
+
+            if (c == 'Q' || c == 'E') {
+                goto none;
+            }
+
+            if (c >= 0x80
+                || (c >= '0' && c <= '9')
+                || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'))
+            {
+                p = ngx_regex_skip_escape(p, last);
+                break;
+            }
+
+            /* escaped punctuation */
+
+            p++;
+            lit = 1;
+            break;
+
+        case '[':
+            p = ngx_regex_skip_class(p, last);
+            if (p == NULL) {
+                goto none;
+            }
+
+            break;
+
+        case '(':
+            p = ngx_regex_skip_group(p, last);
+            if (p == NULL) {
+                goto none;
+            }
+
+            break;
+
+        case ')':
+        case '|':
+            goto none;
+
+        case '.':
+        case '^':
+        case '$':
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            break;
+
+        default:
+            lit = (c < 0x80);
+            break;
+        }
+
+        q = ngx_regex_quantifier(p, last, &min);
+
+        if (lit && min) {
+            *end++ = ngx_tolower(c);
+        }
+
+        if (!lit || min == 0 || q != p) {
+
+            /* the run ends here */
+
+            if (end - start > (ssize_t) literal->len) {
+                literal->data = start;
+                literal->len = end - start;
+            }
+
+            start = end;
+        }
+
+        p = q;
+    }
+
+    if (end - start > (ssize_t) literal->len) {
+        literal->data = start;
+        literal->len = end - start;
+    }
+
+    return NGX_OK;
+
+none:
+
+    /* a literal found before the construct may not be required */
+
+    ngx_str_null(literal);
+
+    return NGX_OK;
+}
+
+
+static u_char *
+ngx_regex_skip_escape(u_char *p, u_char *last)
+{
+    u_char      c, close;
+    ngx_uint_t  n;
+
+    c = *p++;
+
+    switch (c) {
+
+    case 'x':
+    case 'o':
+    case 'p':
+    case 'P':
+    case 'k':
+    case 'g':
+    case 'N':
+
+        if (p < last && (*p == '{' || *p == '<' || *p == '\'')) {
+            close = (*p == '{') ? '}' : (*p == '<') ? '>' : '\'';
+
+            p = ngx_strlchr(p, last, close);
+
+            return (p == NULL) ? last : p + 1;
+        }
+
+        if (c == 'x') {
+            for (n = 0; n < 2 && p < last; n++) {
+                if (ngx_hextoi(p, 1) == NGX_ERROR) {
+                    break;
+                }
+
+                p++;
+            }
+
+        } else if (c == 'p' || c == 'P') {
+            if (p < last) {
+                p++;
+            }
+
+        } else if (c == 'g') {
+            if (p < last && (*p == '-' || *p == '+')) {
+                p++;
+            }
+
+            while (p < last && *p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+
+        return p;
+
+    case 'c':
+        return (p < last) ? p + 1 : p;
+
+    default:
+
+        /* backreferences and octal escapes */
+
+        if (c >= '0' && c <= '9') {
+            while (p < last && *p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+
+        return p;
+    }
+}
+
+
+static u_char *
+ngx_regex_skip_class(u_char *p, u_char *last)
+{
+    u_char  *q;
+
+    if (p < last && *p == '^') {
+        p++;
+    }
+
+    if (p < last && *p == ']') {
+        p++;
+    }
+
+    while (p < last) {
+
+        switch (*p) {
+
+        case '\\':
+            p += 2;
+            continue;
+
+        case '[':
+            if (p + 1 < last && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+
+                /* [:alpha:] */
+
+                for (q = p + 2; q + 1 < last; q++) {
+                    if (q[0] == p[1] && q[1] == ']') {
+                        break;
+                    }
+                }
+
+                if (q + 1 < last) {
+                    p = q + 2;
+                    continue;
+                }
+            }
+
+            break;
+
+        case ']':
+            return p + 1;
+        }
+
+        p++;
+    }
+
+    return NULL;
+}
+
+
+static u_char *
+ngx_regex_skip_group(u_char *p, u_char *last)
+{
+    u_char  *q;
+
+    if (p < last && *p == '*') {
+
+        /*
+         * verbs: leading ones like (*UTF) change how the pattern is read,
+         * and (*ACCEPT) ends a match early, even within a group
+         */
+
+        return NULL;
+    }
+
+    if (p < last && *p == '?') {
+
+        for (q = p + 1; q < last; q++) {
+
+            if (*q == 'x') {
+                return NULL;
+            }
+
+            if (!((*q | 0x20) >= 'a' && (*q | 0x20) <= 'z')
+                && *q != '-' && *q != '^')
+            {
+                break;
+            }
+        }
+
+        if (q < last && *q == '#') {
+
+            /* (?# comment ) */
+
+            q = ngx_strlchr(q, last, ')');
+
+            return (q == NULL) ? NULL : q + 1;
+        }
+    }
+
+    while (p < last) {
+
+        switch (*p) {
+
+        case '\\':
+            if (p + 1 < last && (p[1] == 'Q' || p[1] == 'E')) {
+                return NULL;
+            }
+
+            p += 2;
+            continue;
+
+        case '[':
+            p = ngx_regex_skip_class(p + 1, last);
+            if (p == NULL) {
+                return NULL;
+            }
+
+            continue;
+
+        case '(':
+            p = ngx_regex_skip_group(p + 1, last);
+            if (p == NULL) {
+                return NULL;
+            }
+
+            continue;
+
+        case ')':
+            return p + 1;
+        }
+
+        p++;
+    }
+
+    return NULL;
+}
+
+
+static u_char *
+ngx_regex_quantifier(u_char *p, u_char *last, ngx_uint_t *min)
+{
+    u_char  *q;
+
+    *min = 1;
+
+    if (p == last) {
+        return p;
+    }
+
+    switch (*p) {
+
+    case '?':
+    case '*':
+        *min = 0;
+        p++;
+        break;
+
+    case '+':
+        p++;
+        break;
+
+    case '{':
+        *min = 0;
+
+        for (q = p + 1; q < last && *q >= '0' && *q <= '9'; q++) {
+            if (*q != '0') {
+                *min = 1;
+            }
+        }
+
+        if (q == p + 1 && (q == last || *q != ',')) {
+            *min = 1;
+            return p;
+        }
+
+        if (q < last && *q == ',') {
+            for (q++; q < last && *q >= '0' && *q <= '9'; q++) {
+                /* void */
+            }
+        }
+
+        if (q == last || *q != '}') {
+            /* not a quantifier */
+            *min = 1;
+            return p;
+        }
+
+        p = q + 1;
+        break;
+
+    default:
+        return p;
+    }
+
+    /* lazy and possessive quantifiers */
+
+    if (p < last && (*p == '?' || *p == '+')) {
+        p++;
+    }
+
+    return p;
+}
+
+
+/*
+ * the literals are compiled into an Aho-Corasick automaton over
+ * case-folded bytes; regexes without a literal, or with one which does
+ * not fit into 64K states, are always candidates
+ */
+
+ngx_regex_set_t *
+ngx_regex_set_create(ngx_pool_t *pool, ngx_str_t *literals, ngx_uint_t n)
+{
+    size_t            size;
+    uint16_t         *term, *queue;
+    ngx_uint_t        i, j, k, c, s, t, nc, max, nstates, head, tail;
+    ngx_regex_set_t  *set;
+
+    set = ngx_pcalloc(pool, sizeof(ngx_regex_set_t));
+    if (set == NULL) {
+        return NULL;
+    }
+
+    set->nelts = n;
+
+    size = (n + 7) / 8;
+
+    set->always = ngx_pcalloc(pool, size);
+    if (set->always == NULL) {
+        return NULL;
+    }
+
+    set->matched = ngx_pnalloc(pool, size);
+    if (set->matched == NULL) {
+        return NULL;
+    }
+
+    /* bytes absent from all literals share class 0 */
+
+    max = 1;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < literals[i].len; j++) {
+            set->classes[ngx_tolower(literals[i].data[j])] = 1;
+        }
+
+        max += literals[i].len;
+    }
+
+    nc = 1;
+
+    for (c = 0; c < 256; c++) {
+        if (set->classes[c]) {
+            set->classes[c] = (u_char) nc++;
+        }
+    }
+
+    for (c = 'A'; c <= 'Z'; c++) {
+        set->classes[c] = set->classes[c | 0x20];
+    }
+
+    set->nclasses = nc;
+
+    if (max > 65535) {
+        max = 65535;
+    }
+
+    set->next = ngx_pcalloc(pool, max * nc * sizeof(uint16_t));
+    set->fail = ngx_pcalloc(pool, max * sizeof(uint16_t));
+    set->report = ngx_pcalloc(pool, max * sizeof(uint16_t));
+    set->output = ngx_pcalloc(pool, (max + 1) * sizeof(uint32_t));
+    set->outputs = ngx_pnalloc(pool, (n + 1) * sizeof(uint32_t));
+
+    term = ngx_alloc(n * sizeof(uint16_t), pool->log);
+    queue = ngx_alloc(max * sizeof(uint16_t), pool->log);
+
+    if (set->next == NULL || set->fail == NULL || set->report == NULL
+        || set->output == NULL || set->outputs == NULL
+        || term == NULL || queue == NULL)
+    {
+        set = NULL;
+        goto done;
+    }
+
+    /* the goto function */
+
+    nstates = 1;
+
+    for (i = 0; i < n; i++) {
+
+        term[i] = 0;
+
+        if (literals[i].len == 0 || nstates + literals[i].len > max) {
+            set->always[i >> 3] |= 1 << (i & 7);
+            continue;
+        }
+
+        s = 0;
+
+        for (j = 0; j < literals[i].len; j++) {
+            k = s * nc + set->classes[literals[i].data[j]];
+
+            if (set->next[k] == 0) {
+                set->next[k] = (uint16_t) nstates++;
+            }
+
+            s = set->next[k];
+        }
+
+        term[i] = (uint16_t) s;
+        set->output[s + 1]++;
+    }
+
+    /* regexes by their final states */
+
+    for (s = 0; s < nstates; s++) {
+        set->output[s + 1] += set->output[s];
+    }
+
+    for (i = 0; i < n; i++) {
+        if (term[i]) {
+            set->outputs[set->output[term[i]]++] = (uint32_t) i;
+        }
+    }
+
+    for (s = nstates; s > 0; s--) {
+        set->output[s] = set->output[s - 1];
+    }
+
+    set->output[0] = 0;
+
+    /* the failure function, and the goto function made complete */
+
+    head = 0;
+    tail = 0;
+
+    for (c = 0; c < nc; c++) {
+        if (set->next[c]) {
+            queue[tail++] = set->next[c];
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+
+        set->report[s] = (set->output[s] != set->output[s + 1])
+                         ? (uint16_t) s : set->report[set->fail[s]];
+
+        for (c = 0; c < nc; c++) {
+            k = s * nc + c;
+            t = set->next[k];
+
+            if (t) {
+                set->fail[t] = set->next[set->fail[s] * nc + c];
+                queue[tail++] = (uint16_t) t;
+
+            } else {
+                set->next[k] = set->next[set->fail[s] * nc + c];
+            }
+        }
+    }
+
+done:
+
+    if (term) {
+        ngx_free(term);
+    }
+
+    if (queue) {
+        ngx_free(queue);
+    }
+
+    return set;
+}
+
+
+/*
+ * marks in set->matched the regexes which may match the subject;
+ * set->matched is shared, and is valid until the next call
+ */
+
+void
+ngx_regex_set_match(ngx_regex_set_t *set, ngx_str_t *s)
+{
+    u_char      *p, *last;
+    uint32_t     i, r;
+    ngx_uint_t   state, t;
+
+    ngx_memcpy(set->matched, set->always, (set->nelts + 7) / 8);
+
+    state = 0;
+
+    for (p = s->data, last = p + s->len; p < last; p++) {
+
+        state = set->next[state * set->nclasses + set->classes[*p]];
+
+        for (t = set->report[state]; t; t = set->report[set->fail[t]]) {
+
+            for (i = set->output[t]; i < set->output[t + 1]; i++) {
+                r = set->outputs[i];
+                set->matched[r >> 3] |= 1 << (r & 7);
+            }
+        }
+    }
+}
+
+
 #if (NGX_PCRE2)
 
 static void * ngx_libc_cdecl
@@ -60,6 +60,35 @@ typedef struct {
 } ngx_regex_elt_t;
 
 
+/*
+ * a set of regexes sharing one scan of the subject: the required literals
+ * of the regexes are searched for at once, and only the regexes whose
+ * literal is found, or which have none, may match
+ */
+
+#define NGX_REGEX_SET_MIN      2
+
+typedef struct {
+    ngx_uint_t    nelts;
+    ngx_uint_t    nclasses;
+
+    u_char        classes[256];
+
+    uint16_t     *next;        /* state transitions by byte class */
+    uint16_t     *fail;
+    uint16_t     *report;      /* the nearest state with output */
+    uint32_t     *output;      /* regexes ending in a state */
+    uint32_t     *outputs;
+
+    u_char       *always;      /* regexes without a literal */
+    u_char       *matched;
+} ngx_regex_set_t;
+
+
+#define ngx_regex_set_test(set, i)                                            \
+    ((set)->matched[(i) >> 3] & (1 << ((i) & 7)))
+
+
 void ngx_regex_init(void);
 ngx_int_t ngx_regex_compile(ngx_regex_compile_t *rc);
 
@@ -74,5 +103,11 @@ ngx_int_t ngx_regex_exec(ngx_regex_t *re, ngx_str_t *s, int *captures,
 
 ngx_int_t ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log);
 
+ngx_int_t ngx_regex_literal(ngx_pool_t *pool, ngx_str_t *pattern,
+    ngx_str_t *literal);
+ngx_regex_set_t *ngx_regex_set_create(ngx_pool_t *pool, ngx_str_t *literals,
+    ngx_uint_t n);
+void ngx_regex_set_match(ngx_regex_set_t *set, ngx_str_t *s);
+
 
 #endif /* _NGX_REGEX_H_INCLUDED_ */
@@ -69,6 +69,42 @@
 
 #endif
 
+/*
+ * 每个worker进程私有的弹匣缓存：按大小类缓存一批空闲块，
+ * 命中时不访问共享的页描述及位图，批量补充和归还时才操作slab
+ */
+
+typedef struct {
+    ngx_uint_t         n;           /* 当前缓存的块数 */
+    ngx_uint_t         synced;      /* 上次同步到stats的块数 */
+    ngx_uint_t         hits;        /* 尚未同步到stats的命中次数 */
+    void             **chunks;
+} ngx_slab_magazine_t;
+
+
+typedef struct ngx_slab_cache_s  ngx_slab_cache_t;
+
+struct ngx_slab_cache_s {
+    ngx_slab_pool_t      *pool;
+    ngx_uint_t            size;     /* 每个大小类最多缓存的块数 */
+    ngx_uint_t            nslots;
+    ngx_uint_t            drain;    /* 已响应的pool->drain */
+    ngx_slab_magazine_t  *magazines;
+    ngx_slab_cache_t     *next;
+};
+
+
+static void *ngx_slab_alloc_chunk(ngx_slab_pool_t *pool, size_t size);
+static void ngx_slab_free_chunk(ngx_slab_pool_t *pool, void *p);
+static ngx_slab_cache_t *ngx_slab_cache_find(ngx_slab_pool_t *pool);
+static ngx_uint_t ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size);
+static ngx_int_t ngx_slab_chunk_slot(ngx_slab_pool_t *pool, void *p);
+static void *ngx_slab_cache_alloc(ngx_slab_cache_t *cache, size_t size);
+static void ngx_slab_cache_free(ngx_slab_cache_t *cache, ngx_uint_t slot,
+    void *p);
+static void ngx_slab_cache_drain(ngx_slab_cache_t *cache, ngx_uint_t slot,
+    ngx_uint_t n);
+static void ngx_slab_cache_drain_all(ngx_slab_cache_t *cache);
 static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
     ngx_uint_t pages);
 static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
@@ -81,6 +117,8 @@ static ngx_uint_t  ngx_slab_max_size;
 static ngx_uint_t  ngx_slab_exact_size;
 static ngx_uint_t  ngx_slab_exact_shift;
 
+static ngx_slab_cache_t  *ngx_slab_caches;
+
 
 void
 ngx_slab_sizes_init(void)
@@ -158,6 +196,7 @@ ngx_slab_init(ngx_slab_pool_t *pool)
 
     pool->last = pool->pages + pages;
     pool->pfree = pages;
+    pool->drain = 0;
 
     pool->log_nomem = 1;
     pool->log_ctx = &pool->zero;
@@ -168,7 +207,22 @@ ngx_slab_init(ngx_slab_pool_t *pool)
 void *
 ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size)
 {
-    void  *p;
+    void                 *p;
+    ngx_slab_cache_t     *cache;
+    ngx_slab_magazine_t  *mag;
+
+    if (ngx_slab_caches && size <= ngx_slab_max_size) {
+        cache = ngx_slab_cache_find(pool);
+
+        if (cache && cache->drain == pool->drain) {
+            mag = &cache->magazines[ngx_slab_size_slot(pool, size)];
+
+            if (mag->n) {
+                mag->hits++;
+                return mag->chunks[--mag->n];
+            }
+        }
+    }
 
     ngx_shmtx_lock(&pool->mutex);
 
@@ -182,6 +236,27 @@ ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size)
 
 void *
 ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
+{
+    ngx_slab_cache_t  *cache;
+
+    if (ngx_slab_caches && size <= ngx_slab_max_size) {
+        cache = ngx_slab_cache_find(pool);
+
+        if (cache) {
+            if (cache->drain != pool->drain) {
+                ngx_slab_cache_drain_all(cache);
+            }
+
+            return ngx_slab_cache_alloc(cache, size);
+        }
+    }
+
+    return ngx_slab_alloc_chunk(pool, size);
+}
+
+
+static void *
+ngx_slab_alloc_chunk(ngx_slab_pool_t *pool, size_t size)
 {
     size_t            s;
     uintptr_t         p, m, mask, *bitmap;
@@ -449,6 +524,27 @@ ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size)
 void
 ngx_slab_free(ngx_slab_pool_t *pool, void *p)
 {
+    ngx_int_t             slot;
+    ngx_slab_cache_t     *cache;
+    ngx_slab_magazine_t  *mag;
+
+    if (ngx_slab_caches) {
+        cache = ngx_slab_cache_find(pool);
+
+        if (cache && cache->drain == pool->drain) {
+            slot = ngx_slab_chunk_slot(pool, p);
+
+            if (slot != NGX_ERROR) {
+                mag = &cache->magazines[slot];
+
+                if (mag->n < cache->size) {
+                    mag->chunks[mag->n++] = p;
+                    return;
+                }
+            }
+        }
+    }
+
     ngx_shmtx_lock(&pool->mutex);
 
     ngx_slab_free_locked(pool, p);
@@ -459,6 +555,33 @@ ngx_slab_free(ngx_slab_pool_t *pool, void *p)
 
 void
 ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
+{
+    ngx_int_t          slot;
+    ngx_slab_cache_t  *cache;
+
+    if (ngx_slab_caches) {
+        cache = ngx_slab_cache_find(pool);
+
+        if (cache) {
+            if (cache->drain != pool->drain) {
+                ngx_slab_cache_drain_all(cache);
+            }
+
+            slot = ngx_slab_chunk_slot(pool, p);
+
+            if (slot != NGX_ERROR) {
+                ngx_slab_cache_free(cache, slot, p);
+                return;
+            }
+        }
+    }
+
+    ngx_slab_free_chunk(pool, p);
+}
+
+
+static void
+ngx_slab_free_chunk(ngx_slab_pool_t *pool, void *p)
 {
     size_t            size;
     uintptr_t         slab, m, *bitmap;
@@ -674,6 +797,362 @@ fail:
 }
 
 
+/*
+ * 复制共享内存区的统计：持有锁期间只复制各大小类的计数并遍历空闲页链表，
+ * 比例等由调用者在锁外计算；slots为NULL时不复制各大小类的计数
+ */
+
+void
+ngx_slab_get_stat(ngx_slab_pool_t *pool, ngx_slab_pool_stat_t *stat,
+    ngx_slab_stat_t *slots)
+{
+    ngx_slab_page_t  *page;
+
+    stat->pages = pool->last - pool->pages;
+    stat->nslots = ngx_slab_nslots(pool);
+    stat->runs = 0;
+    stat->max_run = 0;
+
+    ngx_shmtx_lock(&pool->mutex);
+
+    stat->free = pool->pfree;
+
+    for (page = pool->free.next; page != &pool->free; page = page->next) {
+        stat->runs++;
+
+        if (page->slab > stat->max_run) {
+            stat->max_run = page->slab;
+        }
+    }
+
+    if (slots) {
+        ngx_memcpy(slots, pool->stats, stat->nslots * sizeof(ngx_slab_stat_t));
+    }
+
+    ngx_shmtx_unlock(&pool->mutex);
+}
+
+
+/*
+ * 在worker进程中为配置了magazine的共享内存区创建弹匣缓存；
+ * master进程中不能使用，否则fork后各worker会持有相同的空闲块
+ */
+
+ngx_int_t
+ngx_slab_cache_init(ngx_cycle_t *cycle)
+{
+    void               **chunks;
+    ngx_uint_t           i, n;
+    ngx_list_part_t     *part;
+    ngx_shm_zone_t      *shm_zone;
+    ngx_slab_cache_t    *cache;
+    ngx_slab_pool_t     *pool;
+
+    ngx_slab_caches = NULL;
+
+    part = &cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (shm_zone[i].magazine == 0) {
+            continue;
+        }
+
+        pool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        cache = ngx_palloc(cycle->pool, sizeof(ngx_slab_cache_t));
+        if (cache == NULL) {
+            return NGX_ERROR;
+        }
+
+        cache->pool = pool;
+        cache->size = shm_zone[i].magazine;
+        cache->nslots = ngx_pagesize_shift - pool->min_shift;
+        cache->drain = pool->drain;
+
+        cache->magazines = ngx_pcalloc(cycle->pool,
+                                   cache->nslots * sizeof(ngx_slab_magazine_t));
+        if (cache->magazines == NULL) {
+            return NGX_ERROR;
+        }
+
+        chunks = ngx_palloc(cycle->pool,
+                            cache->nslots * cache->size * sizeof(void *));
+        if (chunks == NULL) {
+            return NGX_ERROR;
+        }
+
+        for (n = 0; n < cache->nslots; n++) {
+            cache->magazines[n].chunks = &chunks[n * cache->size];
+        }
+
+        cache->next = ngx_slab_caches;
+        ngx_slab_caches = cache;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, cycle->log, 0,
+                       "slab cache: \"%V\" %ui", &shm_zone[i].shm.name,
+                       cache->size);
+    }
+
+    return NGX_OK;
+}
+
+
+/* 进程退出前将缓存的块归还给各个共享内存区 */
+
+void
+ngx_slab_cache_flush(void)
+{
+    ngx_slab_cache_t  *cache;
+
+    for (cache = ngx_slab_caches; cache; cache = cache->next) {
+
+        ngx_shmtx_lock(&cache->pool->mutex);
+
+        ngx_slab_cache_drain_all(cache);
+
+        ngx_shmtx_unlock(&cache->pool->mutex);
+    }
+
+    ngx_slab_caches = NULL;
+}
+
+
+static ngx_slab_cache_t *
+ngx_slab_cache_find(ngx_slab_pool_t *pool)
+{
+    ngx_slab_cache_t  *cache;
+
+    for (cache = ngx_slab_caches; cache; cache = cache->next) {
+        if (cache->pool == pool) {
+            return cache;
+        }
+    }
+
+    return NULL;
+}
+
+
+static ngx_uint_t
+ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size)
+{
+    size_t      s;
+    ngx_uint_t  shift;
+
+    if (size <= pool->min_size) {
+        return 0;
+    }
+
+    shift = 1;
+    for (s = size - 1; s >>= 1; shift++) { /* void */ }
+
+    return shift - pool->min_shift;
+}
+
+
+/*
+ * 不加锁读取块所在页的类型：块未释放前页的类型和块大小不会改变，
+ * 整页分配的块及池外的指针不进入缓存
+ */
+
+static ngx_int_t
+ngx_slab_chunk_slot(ngx_slab_pool_t *pool, void *p)
+{
+    ngx_uint_t        shift;
+    ngx_slab_page_t  *page;
+
+    if ((u_char *) p < pool->start || (u_char *) p >= pool->end) {
+        return NGX_ERROR;
+    }
+
+    page = &pool->pages[((u_char *) p - pool->start) >> ngx_pagesize_shift];
+
+    switch (ngx_slab_page_type(page)) {
+
+    case NGX_SLAB_SMALL:
+    case NGX_SLAB_BIG:
+        shift = page->slab & NGX_SLAB_SHIFT_MASK;
+        break;
+
+    case NGX_SLAB_EXACT:
+        shift = ngx_slab_exact_shift;
+        break;
+
+    default: /* NGX_SLAB_PAGE */
+        return NGX_ERROR;
+    }
+
+    if ((uintptr_t) p & (((uintptr_t) 1 << shift) - 1)) {
+        return NGX_ERROR;
+    }
+
+    return shift - pool->min_shift;
+}
+
+
+/* 将本进程的命中次数及缓存块数同步到共享的统计中，需持有锁 */
+
+static ngx_inline void
+ngx_slab_cache_sync(ngx_slab_cache_t *cache, ngx_uint_t slot)
+{
+    ngx_slab_stat_t      *stat;
+    ngx_slab_magazine_t  *mag;
+
+    mag = &cache->magazines[slot];
+    stat = &cache->pool->stats[slot];
+
+    stat->hits += mag->hits;
+    stat->cached += mag->n - mag->synced;
+
+    mag->hits = 0;
+    mag->synced = mag->n;
+}
+
+
+static void *
+ngx_slab_cache_alloc(ngx_slab_cache_t *cache, size_t size)
+{
+    void                 *p;
+    ngx_uint_t            slot, i;
+    ngx_slab_pool_t      *pool;
+    ngx_slab_page_t      *slots;
+    ngx_slab_magazine_t  *mag;
+
+    pool = cache->pool;
+    slot = ngx_slab_size_slot(pool, size);
+    mag = &cache->magazines[slot];
+
+    if (mag->n) {
+        mag->hits++;
+        p = mag->chunks[--mag->n];
+        goto done;
+    }
+
+    p = ngx_slab_alloc_chunk(pool, size);
+
+    if (p == NULL) {
+
+        /*
+         * return the chunks cached for other sizes and retry; if the zone
+         * is still exhausted, ask the other workers to return their chunks
+         * on their next slab operation, so that a later retry can succeed
+         */
+
+        ngx_slab_cache_drain_all(cache);
+
+        p = ngx_slab_alloc_chunk(pool, size);
+
+        if (p == NULL) {
+            pool->drain++;
+            cache->drain = pool->drain;
+
+            ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                           "slab cache drain requested: %ui", pool->drain);
+        }
+
+        goto done;
+    }
+
+    /*
+     * refill half of the magazine, but only from the pages already
+     * used by this size or from free pages, to not fail allocations
+     */
+
+    slots = ngx_slab_slots(pool);
+
+    for (i = 1; i < cache->size / 2; i++) {
+
+        if (slots[slot].next == &slots[slot] && pool->pfree == 0) {
+            break;
+        }
+
+        mag->chunks[mag->n] = ngx_slab_alloc_chunk(pool, size);
+
+        if (mag->chunks[mag->n] == NULL) {
+            break;
+        }
+
+        mag->n++;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                   "slab cache refill: slot:%ui n:%ui", slot, mag->n);
+
+done:
+
+    ngx_slab_cache_sync(cache, slot);
+
+    return p;
+}
+
+
+static void
+ngx_slab_cache_free(ngx_slab_cache_t *cache, ngx_uint_t slot, void *p)
+{
+    ngx_slab_magazine_t  *mag;
+
+    mag = &cache->magazines[slot];
+
+    if (mag->n == cache->size) {
+        ngx_slab_cache_drain(cache, slot, cache->size / 2);
+    }
+
+    mag->chunks[mag->n++] = p;
+
+    ngx_slab_cache_sync(cache, slot);
+}
+
+
+/* 归还缓存的块直到剩余n个，需持有锁 */
+
+static void
+ngx_slab_cache_drain(ngx_slab_cache_t *cache, ngx_uint_t slot, ngx_uint_t n)
+{
+    ngx_slab_magazine_t  *mag;
+
+    mag = &cache->magazines[slot];
+
+    if (mag->n <= n) {
+        return;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                   "slab cache drain: slot:%ui n:%ui of %ui",
+                   slot, mag->n - n, mag->n);
+
+    while (mag->n > n) {
+        ngx_slab_free_chunk(cache->pool, mag->chunks[--mag->n]);
+    }
+
+    ngx_slab_cache_sync(cache, slot);
+}
+
+
+/* 归还所有缓存的块，并记录已响应的归还请求，需持有锁 */
+
+static void
+ngx_slab_cache_drain_all(ngx_slab_cache_t *cache)
+{
+    ngx_uint_t  slot;
+
+    for (slot = 0; slot < cache->nslots; slot++) {
+        ngx_slab_cache_drain(cache, slot, 0);
+    }
+
+    cache->drain = cache->pool->drain;
+}
+
+
 static ngx_slab_page_t *
 ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
 {
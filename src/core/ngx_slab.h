@@ -28,9 +28,22 @@ typedef struct {
 
     ngx_uint_t        reqs;
     ngx_uint_t        fails;
+
+    /* worker magazines, updated on refill and drain */
+    ngx_uint_t        hits;
+    ngx_uint_t        cached;
 } ngx_slab_stat_t;
 
 
+typedef struct {
+    ngx_uint_t        pages;
+    ngx_uint_t        free;
+    ngx_uint_t        runs;         /* 空闲页块数 */
+    ngx_uint_t        max_run;      /* 最大的连续空闲页数 */
+    ngx_uint_t        nslots;
+} ngx_slab_pool_stat_t;
+
+
 typedef struct {
     ngx_shmtx_sh_t    lock;
 
@@ -44,6 +57,8 @@ typedef struct {
     ngx_slab_stat_t  *stats;
     ngx_uint_t        pfree;
 
+    ngx_uint_t        drain;        /* 请求各worker归还弹匣缓存的次数 */
+
     u_char           *start;
     u_char           *end;
 
@@ -67,6 +82,13 @@ void *ngx_slab_calloc(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size);
 void ngx_slab_free(ngx_slab_pool_t *pool, void *p);
 void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p);
+void ngx_slab_get_stat(ngx_slab_pool_t *pool, ngx_slab_pool_stat_t *stat,
+    ngx_slab_stat_t *slots);
+ngx_int_t ngx_slab_cache_init(ngx_cycle_t *cycle);
+void ngx_slab_cache_flush(void);
+
+
+#define ngx_slab_nslots(pool)  (ngx_pagesize_shift - (pool)->min_shift)
 
 
 #endif /* _NGX_SLAB_H_INCLUDED_ */
@@ -96,11 +96,17 @@ struct io_event
  * 它包含两个 ngx_uint_t 类型的变量：'events' 和 'aio_requests'。
  * 'events' 存储 epoll 能够处理的最大事件数。
  * 'aio_requests' 存储异步 I/O 请求的最大数量。
+ * 'spin' 为阻塞前非阻塞轮询epoll_wait的最大次数，0表示不自旋。
+ * 'busy_poll_*' 为epoll实例的内核busy poll参数。
  */
 typedef struct
 {
     ngx_uint_t events;
     ngx_uint_t aio_requests;
+    ngx_uint_t spin;
+    ngx_uint_t busy_poll_usecs;
+    ngx_uint_t busy_poll_budget;
+    ngx_flag_t prefer_busy_poll;
 } ngx_epoll_conf_t;
 
 
@@ -130,13 +136,25 @@ static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
 static void ngx_epoll_eventfd_handler(ngx_event_t *ev);
 #endif
 
+static int ngx_epoll_spin(void);
+#if (NGX_HAVE_EPOLL_BUSY_POLL)
+static void ngx_epoll_busy_poll_init(ngx_cycle_t *cycle,
+                                     ngx_epoll_conf_t *epcf);
+#endif
+
 static void *ngx_epoll_create_conf(ngx_cycle_t *cycle);
 static char *ngx_epoll_init_conf(ngx_cycle_t *cycle, void *conf);
+static char *ngx_epoll_busy_poll(ngx_conf_t *cf, ngx_command_t *cmd,
+                                 void *conf);
 
 static int ep = -1;
 static struct epoll_event *event_list;
 static ngx_uint_t nevents;
 
+/* 自适应自旋：当前自旋次数及其上限 */
+static ngx_uint_t spin;
+static ngx_uint_t spin_max;
+
 #if (NGX_HAVE_EVENTFD)
 static int notify_fd = -1;
 static ngx_event_t notify_event;
@@ -191,6 +209,28 @@ static ngx_command_t ngx_epoll_commands[] = {
      offsetof(ngx_epoll_conf_t, aio_requests),
      NULL},
 
+    /*
+     * 描述：设置阻塞等待前以零超时调用epoll_wait的最大次数，
+     *       实际次数根据最近是否轮询到事件自适应调整。
+     */
+    {ngx_string("epoll_spin"),
+     NGX_EVENT_CONF | NGX_CONF_TAKE1,
+     ngx_conf_set_num_slot,
+     0,
+     offsetof(ngx_epoll_conf_t, spin),
+     NULL},
+
+    /*
+     * 描述：设置epoll实例的busy poll参数，
+     *       格式为 epoll_busy_poll usecs [budget=number] [prefer]。
+     */
+    {ngx_string("epoll_busy_poll"),
+     NGX_EVENT_CONF | NGX_CONF_TAKE123,
+     ngx_epoll_busy_poll,
+     0,
+     0,
+     NULL},
+
     ngx_null_command};
 
 
@@ -382,6 +422,11 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
 #if (NGX_HAVE_EPOLLRDHUP)
         ngx_epoll_test_rdhup(cycle);
 #endif
+
+        // 设置 epoll 实例的 busy poll 参数
+#if (NGX_HAVE_EPOLL_BUSY_POLL)
+        ngx_epoll_busy_poll_init(cycle, epcf);
+#endif
     }
 
     // 如果当前事件数组大小小于配置的事件数，则重新分配内存
@@ -406,6 +451,10 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
     // 更新当前事件数组大小为配置的事件数
     nevents = epcf->events;
 
+    // 自适应自旋从上限开始，之后按是否轮询到事件调整
+    spin_max = epcf->spin;
+    spin = spin_max;
+
     // 设置全局变量 ngx_io 为系统的 I/O 操作
     ngx_io = ngx_os_io;
 
@@ -424,69 +473,6 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
     return NGX_OK;
 }
 
-{
-    ngx_epoll_conf_t *epcf;
-
-    epcf = ngx_event_get_conf(cycle->conf_ctx, ngx_epoll_module);
-
-    if (ep == -1)
-    {
-        ep = epoll_create(cycle->connection_n / 2);
-
-        if (ep == -1)
-        {
-            ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
-                          "epoll_create() failed");
-            return NGX_ERROR;
-        }
-
-#if (NGX_HAVE_EVENTFD)
-        if (ngx_epoll_notify_init(cycle->log) != NGX_OK)
-        {
-            ngx_epoll_module_ctx.actions.notify = NULL;
-        }
-#endif
-
-#if (NGX_HAVE_FILE_AIO)
-        ngx_epoll_aio_init(cycle, epcf);
-#endif
-
-#if (NGX_HAVE_EPOLLRDHUP)
-        ngx_epoll_test_rdhup(cycle);
-#endif
-    }
-
-    if (nevents < epcf->events)
-    {
-        if (event_list)
-        {
-            ngx_free(event_list);
-        }
-
-        event_list = ngx_alloc(sizeof(struct epoll_event) * epcf->events,
-                               cycle->log);
-        if (event_list == NULL)
-        {
-            return NGX_ERROR;
-        }
-    }
-
-    nevents = epcf->events;
-
-    ngx_io = ngx_os_io;
-
-    ngx_event_actions = ngx_epoll_module_ctx.actions;
-
-#if (NGX_HAVE_CLEAR_EVENT)
-    ngx_event_flags = NGX_USE_CLEAR_EVENT
-#else
-    ngx_event_flags = NGX_USE_LEVEL_EVENT
-#endif
-                      | NGX_USE_GREEDY_EVENT | NGX_USE_EPOLL_EVENT;
-
-    return NGX_OK;
-}
-
 #if (NGX_HAVE_EVENTFD)
 
 static ngx_int_t
@@ -950,8 +936,25 @@ static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
     ngx_queue_t *queue;
     ngx_connection_t *c;
 
+    // 阻塞前先以零超时轮询，避免睡眠与唤醒的开销
+    events = 0;
+
+    if (spin && timer != 0)
+    {
+        events = ngx_epoll_spin();
+    }
+
     // 使用 epoll_wait 等待事件的发生
-    events = epoll_wait(ep, event_list, (int)nevents, timer);
+    if (events == 0)
+    {
+        events = epoll_wait(ep, event_list, (int)nevents, timer);
+
+        // 阻塞后等到了事件，下一轮重新尝试自旋
+        if (events > 0 && spin == 0 && spin_max)
+        {
+            spin = 1;
+        }
+    }
 
     // 获取 epoll_wait 的返回值，判断是否出错
     err = (events == -1) ? ngx_errno : 0;
@@ -1033,6 +1036,14 @@ static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
                            "epoll_wait() error on fd:%d ev:%04XD",
                            c->fd, revents);
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+            // MSG_ZEROCOPY 的完成通知也通过 EPOLLERR 报告，先读出错误队列
+            if ((revents & EPOLLERR) && c->zerocopy)
+            {
+                ngx_linux_zerocopy_complete(c);
+            }
+#endif
+
             // 处理错误事件，添加 EPOLLIN 和 EPOLLOUT 以处理至少一个激活的处理程序
             revents |= EPOLLIN | EPOLLOUT;
         }
@@ -1061,7 +1072,7 @@ static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
             }
             else
             {
-                rev->handler(rev);
+                ngx_event_call_handler(rev);
             }
         }
 
@@ -1090,178 +1101,7 @@ static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
             }
             else
             {
-                wev->handler(wev);
-            }
-        }
-    }
-
-    return NGX_OK;
-}
-
-{
-    int events;
-    uint32_t revents;
-    ngx_int_t instance, i;
-    ngx_uint_t level;
-    ngx_err_t err;
-    ngx_event_t *rev, *wev;
-    ngx_queue_t *queue;
-    ngx_connection_t *c;
-
-    /* NGX_TIMER_INFINITE == INFTIM */
-
-    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                   "epoll timer: %M", timer);
-
-    events = epoll_wait(ep, event_list, (int)nevents, timer);
-
-    err = (events == -1) ? ngx_errno : 0;
-
-    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm)
-    {
-        ngx_time_update();
-    }
-
-    if (err)
-    {
-        if (err == NGX_EINTR)
-        {
-
-            if (ngx_event_timer_alarm)
-            {
-                ngx_event_timer_alarm = 0;
-                return NGX_OK;
-            }
-
-            level = NGX_LOG_INFO;
-        }
-        else
-        {
-            level = NGX_LOG_ALERT;
-        }
-
-        ngx_log_error(level, cycle->log, err, "epoll_wait() failed");
-        return NGX_ERROR;
-    }
-
-    if (events == 0)
-    {
-        if (timer != NGX_TIMER_INFINITE)
-        {
-            return NGX_OK;
-        }
-
-        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
-                      "epoll_wait() returned no events without timeout");
-        return NGX_ERROR;
-    }
-
-    for (i = 0; i < events; i++)
-    {
-        c = event_list[i].data.ptr;
-
-        instance = (uintptr_t)c & 1;
-        c = (ngx_connection_t *)((uintptr_t)c & (uintptr_t)~1);
-
-        rev = c->read;
-
-        if (c->fd == -1 || rev->instance != instance)
-        {
-
-            /*
-             * the stale event from a file descriptor
-             * that was just closed in this iteration
-             */
-
-            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                           "epoll: stale event %p", c);
-            continue;
-        }
-
-        revents = event_list[i].events;
-
-        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                       "epoll: fd:%d ev:%04XD d:%p",
-                       c->fd, revents, event_list[i].data.ptr);
-
-        if (revents & (EPOLLERR | EPOLLHUP))
-        {
-            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                           "epoll_wait() error on fd:%d ev:%04XD",
-                           c->fd, revents);
-
-            /*
-             * if the error events were returned, add EPOLLIN and EPOLLOUT
-             * to handle the events at least in one active handler
-             */
-
-            revents |= EPOLLIN | EPOLLOUT;
-        }
-
-#if 0
-        if (revents & ~(EPOLLIN|EPOLLOUT|EPOLLERR|EPOLLHUP)) {
-            ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
-                          "strange epoll_wait() events fd:%d ev:%04XD",
-                          c->fd, revents);
-        }
-#endif
-
-        if ((revents & EPOLLIN) && rev->active)
-        {
-
-#if (NGX_HAVE_EPOLLRDHUP)
-            if (revents & EPOLLRDHUP)
-            {
-                rev->pending_eof = 1;
-            }
-#endif
-
-            rev->ready = 1;
-            rev->available = -1;
-
-            if (flags & NGX_POST_EVENTS)
-            {
-                queue = rev->accept ? &ngx_posted_accept_events
-                                    : &ngx_posted_events;
-
-                ngx_post_event(rev, queue);
-            }
-            else
-            {
-                rev->handler(rev);
-            }
-        }
-
-        wev = c->write;
-
-        if ((revents & EPOLLOUT) && wev->active)
-        {
-
-            if (c->fd == -1 || wev->instance != instance)
-            {
-
-                /*
-                 * the stale event from a file descriptor
-                 * that was just closed in this iteration
-                 */
-
-                ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                               "epoll: stale event %p", c);
-                continue;
-            }
-
-            wev->ready = 1;
-#if (NGX_THREADS)
-            wev->complete = 1;
-#endif
-
-            if (flags & NGX_POST_EVENTS)
-            {
-                ngx_post_event(wev, &ngx_posted_events);
-            }
-            else
-            {
-                wev->handler(wev);
+                ngx_event_call_handler(wev);
             }
         }
     }
@@ -1382,6 +1222,10 @@ ngx_epoll_create_conf(ngx_cycle_t *cycle)
     // 初始化配置结构体的成员变量
     epcf->events = NGX_CONF_UNSET;        // events 默认值为 NGX_CONF_UNSET
     epcf->aio_requests = NGX_CONF_UNSET;  // aio_requests 默认值为 NGX_CONF_UNSET
+    epcf->spin = NGX_CONF_UNSET;
+    epcf->busy_poll_usecs = NGX_CONF_UNSET_UINT;
+    epcf->busy_poll_budget = NGX_CONF_UNSET_UINT;
+    epcf->prefer_busy_poll = NGX_CONF_UNSET;
 
     return epcf;  // 返回创建并初始化后的配置结构体指针
 }
@@ -1394,6 +1238,143 @@ ngx_epoll_init_conf(ngx_cycle_t *cycle, void *conf)
 
     ngx_conf_init_uint_value(epcf->events, 512);
     ngx_conf_init_uint_value(epcf->aio_requests, 32);
+    ngx_conf_init_uint_value(epcf->spin, 0);
+    ngx_conf_init_uint_value(epcf->busy_poll_usecs, 0);
+    ngx_conf_init_uint_value(epcf->busy_poll_budget, 0);
+    ngx_conf_init_value(epcf->prefer_busy_poll, 0);
+
+    return NGX_CONF_OK;
+}
+
+
+/*
+ * 阻塞前以零超时轮询epoll_wait，最多spin次。
+ * 轮询到事件说明事件到达频繁，下一轮自旋次数加倍；
+ * 一直空转则减半，直至为0时退化为直接阻塞等待。
+ */
+static int
+ngx_epoll_spin(void)
+{
+    int events;
+    ngx_uint_t n;
+
+    for (n = 0; n < spin; n++)
+    {
+        events = epoll_wait(ep, event_list, (int)nevents, 0);
+
+        if (events > 0)
+        {
+            spin = ngx_min(spin * 2, spin_max);
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
+                           "epoll spin: %d events after %ui polls",
+                           events, n + 1);
+
+            return events;
+        }
+
+        if (events == -1)
+        {
+            return events;
+        }
+
+        ngx_cpu_pause();
+    }
+
+    spin /= 2;
+
+    return 0;
+}
+
+
+#if (NGX_HAVE_EPOLL_BUSY_POLL)
+
+static void
+ngx_epoll_busy_poll_init(ngx_cycle_t *cycle, ngx_epoll_conf_t *epcf)
+{
+    struct epoll_params params;
+
+    if (epcf->busy_poll_usecs == 0)
+    {
+        return;
+    }
+
+    ngx_memzero(&params, sizeof(struct epoll_params));
+
+    params.busy_poll_usecs = (uint32_t)epcf->busy_poll_usecs;
+    params.busy_poll_budget = (uint16_t)epcf->busy_poll_budget;
+    params.prefer_busy_poll = (uint8_t)epcf->prefer_busy_poll;
+
+    if (ioctl(ep, EPIOCSPARAMS, &params) == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "ioctl(EPIOCSPARAMS) failed, ignored");
+    }
+}
+
+#endif
+
+
+static char *
+ngx_epoll_busy_poll(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_epoll_conf_t *epcf = conf;
+
+    ngx_int_t n;
+    ngx_str_t *value;
+    ngx_uint_t i;
+
+    if (epcf->busy_poll_usecs != NGX_CONF_UNSET_UINT)
+    {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    n = ngx_atoi(value[1].data, value[1].len);
+    if (n == NGX_ERROR || n > 0x7fffffff)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    epcf->busy_poll_usecs = n;
+
+    for (i = 2; i < cf->args->nelts; i++)
+    {
+        if (ngx_strncmp(value[i].data, "budget=", 7) == 0)
+        {
+            n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+            if (n == NGX_ERROR || n > 0xffff)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid budget \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            epcf->busy_poll_budget = n;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "prefer") == 0)
+        {
+            epcf->prefer_busy_poll = 1;
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+#if !(NGX_HAVE_EPOLL_BUSY_POLL)
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "\"%V\" is not supported on this platform, ignored",
+                       &cmd->name);
+
+#endif
 
     return NGX_CONF_OK;
 }
@@ -0,0 +1,1940 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/*
+ * io_uring 事件模块。
+ *
+ * 对外仍然表现为一个边缘触发的事件模块（NGX_USE_CLEAR_EVENT），
+ * 上层代码无需修改；区别在于：
+ *
+ *   - 可读/可写通知使用 multishot poll，每轮循环只有一次 io_uring_enter()，
+ *     其中同时完成所有 SQE 的提交与 CQE 的等待；
+ *   - 监听套接字使用 multishot accept，新连接由内核直接接受，
+ *     ngx_event_accept() 通过 ngx_iouring_accept() 取走已接受的描述符；
+ *   - 普通 TCP 连接在第一次 recv() 返回 EAGAIN 之后切换为
+ *     multishot recv，数据由内核直接写入 provided buffer ring，
+ *     c->recv()/c->recv_chain() 从这些缓冲区中取数据。
+ *
+ * 只有通过 ngx_io.recv/ngx_io.recv_chain 读取数据的连接才会切换为
+ * multishot recv，SSL 等自行读取套接字的连接始终停留在 poll 模式。
+ *
+ * io_uring 的请求持有文件的引用，close() 并不会撤销它们，
+ * 因此关闭连接之前必须同步提交取消请求。
+ */
+
+
+#define NGX_IOURING_POLL_IN      0
+#define NGX_IOURING_POLL_OUT     1
+#define NGX_IOURING_ACCEPT       2
+#define NGX_IOURING_RECV         3
+
+#define NGX_IOURING_NONE         0xffff
+
+#define NGX_IOURING_ACCEPT_QUEUE 512
+
+/*
+ * user_data 的高 32 位是连接的序号加一，低 2 位是操作，其余是连接的代数：
+ * 连接每次关闭代数加一，所以槽位被重用任意多次之后，
+ * 旧请求迟到的完成事件也不会被当作新连接的事件
+ */
+
+#define NGX_IOURING_NOTIFY       0xffffffff
+#define NGX_IOURING_GENERATION   0x3fffffff
+
+
+typedef struct {
+    ngx_uint_t                entries;
+    ngx_bufs_t                buffers;
+    ngx_flag_t                multishot_recv;
+} ngx_iouring_conf_t;
+
+
+typedef struct {
+    ngx_socket_t             *fds;
+    ngx_uint_t                head;
+    ngx_uint_t                nelts;
+    ngx_err_t                 err;
+    unsigned                  paused:1;
+} ngx_iouring_accept_t;
+
+
+typedef struct {
+    ngx_iouring_accept_t     *accept;
+
+    /* provided buffers already received but not yet consumed */
+    uint16_t                  first;
+    uint16_t                  last;
+    uint16_t                  nbufs;
+
+    /* bitmasks indexed by NGX_IOURING_* operations */
+    uint8_t                   armed;
+    uint8_t                   removing;
+
+    ngx_err_t                 err;
+
+    uint32_t                  generation;
+
+    unsigned                  recv:1;
+    unsigned                  eof:1;
+} ngx_iouring_conn_t;
+
+
+typedef struct {
+    u_char                   *start;
+    u_char                   *pos;
+    u_char                   *last;
+    uint16_t                  next;
+} ngx_iouring_buf_t;
+
+
+typedef struct {
+    uint32_t                 *head;
+    uint32_t                 *tail;
+    uint32_t                  mask;
+    uint32_t                  entries;
+    uint32_t                 *array;
+    struct io_uring_sqe      *sqes;
+    uint32_t                  local_tail;
+    void                     *ring;
+    size_t                    ring_size;
+    size_t                    sqes_size;
+} ngx_iouring_sq_t;
+
+
+typedef struct {
+    uint32_t                 *head;
+    uint32_t                 *tail;
+    uint32_t                  mask;
+    uint32_t                  entries;
+    struct io_uring_cqe      *cqes;
+    void                     *ring;
+    size_t                    ring_size;
+} ngx_iouring_cq_t;
+
+
+static ngx_int_t ngx_iouring_init(ngx_cycle_t *cycle, ngx_msec_t timer);
+static ngx_int_t ngx_iouring_setup(ngx_cycle_t *cycle,
+    ngx_iouring_conf_t *iucf);
+static ngx_int_t ngx_iouring_buffers_init(ngx_cycle_t *cycle,
+    ngx_iouring_conf_t *iucf);
+static void ngx_iouring_buffers_done(ngx_cycle_t *cycle);
+#if (NGX_HAVE_EVENTFD)
+static ngx_int_t ngx_iouring_notify_init(ngx_log_t *log);
+static void ngx_iouring_notify_handler(ngx_event_t *ev);
+#endif
+static void ngx_iouring_done(ngx_cycle_t *cycle);
+static ngx_int_t ngx_iouring_add_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_iouring_del_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_iouring_add_connection(ngx_connection_t *c);
+static ngx_int_t ngx_iouring_del_connection(ngx_connection_t *c,
+    ngx_uint_t flags);
+#if (NGX_HAVE_EVENTFD)
+static ngx_int_t ngx_iouring_notify(ngx_event_handler_pt handler);
+#endif
+static ngx_int_t ngx_iouring_process_events(ngx_cycle_t *cycle,
+    ngx_msec_t timer, ngx_uint_t flags);
+
+static ngx_iouring_conn_t *ngx_iouring_conn(ngx_connection_t *c);
+static uint64_t ngx_iouring_user_data(ngx_iouring_conn_t *ic, ngx_uint_t op);
+static struct io_uring_sqe *ngx_iouring_get_sqe(ngx_log_t *log);
+static ngx_int_t ngx_iouring_submit(ngx_log_t *log);
+static ngx_int_t ngx_iouring_arm(ngx_connection_t *c, ngx_iouring_conn_t *ic,
+    ngx_uint_t op);
+static ngx_int_t ngx_iouring_remove(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic, ngx_uint_t op);
+static ngx_int_t ngx_iouring_sync_read(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic);
+static ngx_int_t ngx_iouring_sync_write(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic);
+static void ngx_iouring_reset(ngx_connection_t *c, ngx_iouring_conn_t *ic);
+static void ngx_iouring_post(ngx_event_t *ev, ngx_uint_t flags);
+static void ngx_iouring_handle_recv(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic, int res, uint32_t cflags);
+static void ngx_iouring_handle_accept(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic, int res);
+static void ngx_iouring_recycle(uint16_t bid);
+static ssize_t ngx_iouring_copy(ngx_connection_t *c, ngx_iouring_conn_t *ic,
+    u_char *buf, size_t size);
+static ssize_t ngx_iouring_recv(ngx_connection_t *c, u_char *buf, size_t size);
+static ssize_t ngx_iouring_recv_chain(ngx_connection_t *c, ngx_chain_t *in,
+    off_t limit);
+static ssize_t ngx_iouring_recv_result(ngx_connection_t *c,
+    ngx_iouring_conn_t *ic, ssize_t n);
+
+static void *ngx_iouring_create_conf(ngx_cycle_t *cycle);
+static char *ngx_iouring_init_conf(ngx_cycle_t *cycle, void *conf);
+
+
+static int                    ring = -1;
+static ngx_iouring_sq_t       sq;
+static ngx_iouring_cq_t       cq;
+
+static ngx_iouring_conn_t    *conns;
+static ngx_uint_t             nconns;
+
+static struct io_uring_buf_ring  *buf_ring;
+static size_t                 buf_ring_size;
+static ngx_iouring_buf_t     *bufs;
+static u_char                *buf_data;
+static size_t                 buf_size;
+static ngx_uint_t             nbufs;
+static ngx_uint_t             buf_max_per_conn;
+
+static ngx_uint_t             ngx_iouring_multishot_accept = 1;
+static ngx_uint_t             ngx_iouring_multishot_recv;
+
+static ngx_os_io_t            ngx_iouring_io;
+
+#if (NGX_HAVE_EVENTFD)
+static int                    notify_fd = -1;
+static ngx_event_t            notify_event;
+static ngx_connection_t       notify_conn;
+static ngx_iouring_conn_t     notify_iconn;
+#endif
+
+
+static ngx_str_t      iouring_name = ngx_string("io_uring");
+
+static ngx_command_t  ngx_iouring_commands[] = {
+
+    { ngx_string("io_uring_entries"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_iouring_conf_t, entries),
+      NULL },
+
+    { ngx_string("io_uring_buffers"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE2,
+      ngx_conf_set_bufs_slot,
+      0,
+      offsetof(ngx_iouring_conf_t, buffers),
+      NULL },
+
+    { ngx_string("io_uring_multishot_recv"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_iouring_conf_t, multishot_recv),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_event_module_t  ngx_iouring_module_ctx = {
+    &iouring_name,
+    ngx_iouring_create_conf,               /* create configuration */
+    ngx_iouring_init_conf,                 /* init configuration */
+
+    {
+        ngx_iouring_add_event,             /* add an event */
+        ngx_iouring_del_event,             /* delete an event */
+        ngx_iouring_add_event,             /* enable an event */
+        ngx_iouring_del_event,             /* disable an event */
+        ngx_iouring_add_connection,        /* add an connection */
+        ngx_iouring_del_connection,        /* delete an connection */
+#if (NGX_HAVE_EVENTFD)
+        ngx_iouring_notify,                /* trigger a notify */
+#else
+        NULL,                              /* trigger a notify */
+#endif
+        ngx_iouring_process_events,        /* process the events */
+        ngx_iouring_init,                  /* init the events */
+        ngx_iouring_done,                  /* done the events */
+    }
+};
+
+ngx_module_t  ngx_iouring_module = {
+    NGX_MODULE_V1,
+    &ngx_iouring_module_ctx,               /* module context */
+    ngx_iouring_commands,                  /* module directives */
+    NGX_EVENT_MODULE,                      /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * liburing 并不是必需的，与 epoll 模块中的 aio 一样直接使用系统调用
+ */
+
+static int
+io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+
+static int
+io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void *arg, size_t argsz)
+{
+    return syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+
+static int
+io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return syscall(SYS_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+static ngx_int_t
+ngx_iouring_init(ngx_cycle_t *cycle, ngx_msec_t timer)
+{
+    ngx_iouring_conf_t  *iucf;
+
+    iucf = ngx_event_get_conf(cycle->conf_ctx, ngx_iouring_module);
+
+    if (ring == -1) {
+        if (ngx_iouring_setup(cycle, iucf) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+#if (NGX_HAVE_EVENTFD)
+        if (ngx_iouring_notify_init(cycle->log) != NGX_OK) {
+            ngx_iouring_module_ctx.actions.notify = NULL;
+        }
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+
+        /* linux native aio is bound to the eventfd of the epoll module */
+
+        ngx_file_aio = 0;
+#endif
+    }
+
+    if (nconns < cycle->connection_n) {
+        if (conns) {
+            ngx_free(conns);
+        }
+
+        conns = ngx_calloc(sizeof(ngx_iouring_conn_t) * cycle->connection_n,
+                           cycle->log);
+        if (conns == NULL) {
+            return NGX_ERROR;
+        }
+
+        nconns = cycle->connection_n;
+    }
+
+    ngx_iouring_multishot_recv = 0;
+
+    if (iucf->multishot_recv && buf_ring == NULL) {
+        if (ngx_iouring_buffers_init(cycle, iucf) == NGX_OK) {
+            ngx_iouring_multishot_recv = 1;
+        }
+
+    } else if (buf_ring) {
+        ngx_iouring_multishot_recv = 1;
+    }
+
+    ngx_iouring_io = ngx_os_io;
+
+    if (ngx_iouring_multishot_recv) {
+        ngx_iouring_io.recv = ngx_iouring_recv;
+        ngx_iouring_io.recv_chain = ngx_iouring_recv_chain;
+    }
+
+    ngx_io = ngx_iouring_io;
+
+    ngx_event_actions = ngx_iouring_module_ctx.actions;
+
+    ngx_event_flags = NGX_USE_CLEAR_EVENT
+                      |NGX_USE_GREEDY_EVENT
+                      |NGX_USE_IO_URING_EVENT;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_iouring_setup(ngx_cycle_t *cycle, ngx_iouring_conf_t *iucf)
+{
+    u_char                  *p;
+    uint32_t                 i;
+    struct io_uring_params   params;
+
+    ngx_memzero(&params, sizeof(struct io_uring_params));
+
+    /* multishot operations may produce many completions per submission */
+
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = iucf->entries * 4;
+
+    ring = io_uring_setup(iucf->entries, &params);
+
+    if (ring == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "io_uring_setup(%ui) failed", iucf->entries);
+        return NGX_ERROR;
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_NODROP)
+        || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "io_uring features 0x%xD are not sufficient, "
+                      "at least Linux 5.19 is required", params.features);
+        goto failed;
+    }
+
+    sq.ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq.ring_size = params.cq_off.cqes
+                   + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (cq.ring_size > sq.ring_size) {
+        sq.ring_size = cq.ring_size;
+    }
+
+    cq.ring_size = sq.ring_size;
+
+    p = mmap(NULL, sq.ring_size, PROT_READ|PROT_WRITE,
+             MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+    if (p == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQ_RING) failed");
+        goto failed;
+    }
+
+    sq.ring = p;
+    cq.ring = p;
+
+    sq.head = (uint32_t *) (p + params.sq_off.head);
+    sq.tail = (uint32_t *) (p + params.sq_off.tail);
+    sq.mask = *(uint32_t *) (p + params.sq_off.ring_mask);
+    sq.entries = *(uint32_t *) (p + params.sq_off.ring_entries);
+    sq.array = (uint32_t *) (p + params.sq_off.array);
+    sq.local_tail = *sq.tail;
+
+    cq.head = (uint32_t *) (p + params.cq_off.head);
+    cq.tail = (uint32_t *) (p + params.cq_off.tail);
+    cq.mask = *(uint32_t *) (p + params.cq_off.ring_mask);
+    cq.entries = *(uint32_t *) (p + params.cq_off.ring_entries);
+    cq.cqes = (struct io_uring_cqe *) (p + params.cq_off.cqes);
+
+    sq.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    p = mmap(NULL, sq.sqes_size, PROT_READ|PROT_WRITE,
+             MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQES);
+
+    if (p == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQES) failed");
+        goto failed;
+    }
+
+    sq.sqes = (struct io_uring_sqe *) p;
+
+    /* the submission array is an identity mapping */
+
+    for (i = 0; i < sq.entries; i++) {
+        sq.array[i] = i;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring: fd:%d sq:%uD cq:%uD",
+                   ring, sq.entries, cq.entries);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_iouring_done(cycle);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_iouring_buffers_init(ngx_cycle_t *cycle, ngx_iouring_conf_t *iucf)
+{
+    u_char                   *p;
+    uint16_t                  i;
+    struct io_uring_buf_reg   reg;
+
+    nbufs = iucf->buffers.num;
+    buf_size = iucf->buffers.size;
+    buf_max_per_conn = ngx_max(nbufs / 8, 2);
+
+    buf_ring_size = ngx_align(nbufs * sizeof(struct io_uring_buf),
+                              ngx_pagesize);
+
+    buf_ring = mmap(NULL, buf_ring_size, PROT_READ|PROT_WRITE,
+                    MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+
+    if (buf_ring == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "mmap(%uz) failed", buf_ring_size);
+        buf_ring = NULL;
+        return NGX_ERROR;
+    }
+
+    buf_data = ngx_memalign(ngx_pagesize, nbufs * iucf->buffers.size,
+                            cycle->log);
+    if (buf_data == NULL) {
+        goto failed;
+    }
+
+    bufs = ngx_alloc(nbufs * sizeof(ngx_iouring_buf_t), cycle->log);
+    if (bufs == NULL) {
+        goto failed;
+    }
+
+    ngx_memzero(&reg, sizeof(struct io_uring_buf_reg));
+
+    reg.ring_addr = (uint64_t) (uintptr_t) buf_ring;
+    reg.ring_entries = nbufs;
+    reg.bgid = 0;
+
+    if (io_uring_register(ring, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, ngx_errno,
+                      "io_uring_register(IORING_REGISTER_PBUF_RING) failed, "
+                      "multishot recv disabled");
+        goto failed;
+    }
+
+    buf_ring->tail = 0;
+
+    p = buf_data;
+
+    for (i = 0; i < nbufs; i++) {
+        bufs[i].start = p;
+        bufs[i].pos = p;
+        bufs[i].last = p;
+        bufs[i].next = NGX_IOURING_NONE;
+
+        buf_ring->bufs[i].addr = (uint64_t) (uintptr_t) p;
+        buf_ring->bufs[i].len = iucf->buffers.size;
+        buf_ring->bufs[i].bid = i;
+
+        p += iucf->buffers.size;
+    }
+
+    ngx_memory_barrier();
+
+    buf_ring->tail = (uint16_t) nbufs;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring: %ui provided buffers of %uz",
+                   nbufs, iucf->buffers.size);
+
+    return NGX_OK;
+
+failed:
+
+    if (bufs) {
+        ngx_free(bufs);
+        bufs = NULL;
+    }
+
+    if (buf_data) {
+        ngx_free(buf_data);
+        buf_data = NULL;
+    }
+
+    if (munmap(buf_ring, buf_ring_size) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "munmap(%uz) failed", buf_ring_size);
+    }
+
+    buf_ring = NULL;
+    nbufs = 0;
+
+    return NGX_ERROR;
+}
+
+
+static void
+ngx_iouring_buffers_done(ngx_cycle_t *cycle)
+{
+    struct io_uring_buf_reg  reg;
+
+    if (buf_ring == NULL) {
+        return;
+    }
+
+    if (ring != -1) {
+        ngx_memzero(&reg, sizeof(struct io_uring_buf_reg));
+
+        if (io_uring_register(ring, IORING_UNREGISTER_PBUF_RING, &reg, 1)
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "io_uring_register(IORING_UNREGISTER_PBUF_RING) "
+                          "failed");
+        }
+    }
+
+    if (munmap(buf_ring, buf_ring_size) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "munmap(%uz) failed", buf_ring_size);
+    }
+
+    ngx_free(bufs);
+    ngx_free(buf_data);
+
+    buf_ring = NULL;
+    bufs = NULL;
+    buf_data = NULL;
+    nbufs = 0;
+}
+
+
+#if (NGX_HAVE_EVENTFD)
+
+static ngx_int_t
+ngx_iouring_notify_init(ngx_log_t *log)
+{
+#if (NGX_HAVE_SYS_EVENTFD_H)
+    notify_fd = eventfd(0, 0);
+#else
+    notify_fd = syscall(SYS_eventfd, 0);
+#endif
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_iouring_notify_handler;
+    notify_event.log = log;
+    notify_event.active = 1;
+
+    notify_conn.fd = notify_fd;
+    notify_conn.read = &notify_event;
+    notify_conn.log = log;
+
+    if (ngx_iouring_arm(&notify_conn, &notify_iconn, NGX_IOURING_POLL_IN)
+        != NGX_OK)
+    {
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_iouring_notify_handler(ngx_event_t *ev)
+{
+    ssize_t               n;
+    uint64_t              count;
+    ngx_err_t             err;
+    ngx_event_handler_pt  handler;
+
+    if (++ev->index == NGX_MAX_UINT32_VALUE) {
+        ev->index = 0;
+
+        n = read(notify_fd, &count, sizeof(uint64_t));
+
+        err = ngx_errno;
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+        if ((size_t) n != sizeof(uint64_t)) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err,
+                          "read() eventfd %d failed", notify_fd);
+        }
+    }
+
+    handler = ev->data;
+    handler(ev);
+}
+
+
+static ngx_int_t
+ngx_iouring_notify(ngx_event_handler_pt handler)
+{
+    static uint64_t inc = 1;
+
+    notify_event.data = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t))
+    {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static void
+ngx_iouring_done(ngx_cycle_t *cycle)
+{
+    ngx_iouring_buffers_done(cycle);
+
+#if (NGX_HAVE_EVENTFD)
+
+    if (notify_fd != -1) {
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+    }
+
+    ngx_memzero(&notify_iconn, sizeof(ngx_iouring_conn_t));
+
+#endif
+
+    if (sq.sqes) {
+        if (munmap(sq.sqes, sq.sqes_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQES) failed");
+        }
+    }
+
+    if (sq.ring) {
+        if (munmap(sq.ring, sq.ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQ_RING) failed");
+        }
+    }
+
+    ngx_memzero(&sq, sizeof(ngx_iouring_sq_t));
+    ngx_memzero(&cq, sizeof(ngx_iouring_cq_t));
+
+    if (ring != -1 && close(ring) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "io_uring close() failed");
+    }
+
+    ring = -1;
+
+    if (conns) {
+        ngx_free(conns);
+    }
+
+    conns = NULL;
+    nconns = 0;
+}
+
+
+static ngx_int_t
+ngx_iouring_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    ngx_connection_t    *c;
+    ngx_iouring_conn_t  *ic;
+
+    c = ev->data;
+
+    ic = ngx_iouring_conn(c);
+    if (ic == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring add event: fd:%d ev:%i armed:%02xd",
+                   c->fd, event, ic->armed);
+
+    ev->active = 1;
+
+    if (event == NGX_READ_EVENT) {
+        return ngx_iouring_sync_read(c, ic);
+    }
+
+    return ngx_iouring_sync_write(c, ic);
+}
+
+
+static ngx_int_t
+ngx_iouring_del_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    ngx_connection_t    *c;
+    ngx_iouring_conn_t  *ic;
+
+    c = ev->data;
+
+    ic = ngx_iouring_conn(c);
+    if (ic == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring del event: fd:%d ev:%i armed:%02xd",
+                   c->fd, event, ic->armed);
+
+    ev->active = 0;
+
+    if (event == NGX_READ_EVENT) {
+        if (ngx_iouring_remove(c, ic, NGX_IOURING_POLL_IN) != NGX_OK
+            || ngx_iouring_remove(c, ic, NGX_IOURING_RECV) != NGX_OK
+            || ngx_iouring_remove(c, ic, NGX_IOURING_ACCEPT) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+    } else {
+        if (ngx_iouring_remove(c, ic, NGX_IOURING_POLL_OUT) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (flags & NGX_CLOSE_EVENT) {
+
+        /* the cancellation must reach the kernel before close() */
+
+        if (ngx_iouring_submit(ev->log) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (event == NGX_READ_EVENT) {
+            ngx_iouring_reset(c, ic);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_iouring_add_connection(ngx_connection_t *c)
+{
+    ngx_iouring_conn_t  *ic;
+
+    ic = ngx_iouring_conn(c);
+    if (ic == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring add connection: fd:%d", c->fd);
+
+    c->read->active = 1;
+    c->write->active = 1;
+
+    if (ngx_iouring_sync_read(c, ic) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return ngx_iouring_sync_write(c, ic);
+}
+
+
+static ngx_int_t
+ngx_iouring_del_connection(ngx_connection_t *c, ngx_uint_t flags)
+{
+    struct io_uring_sqe  *sqe;
+    ngx_iouring_conn_t   *ic;
+
+    ic = ngx_iouring_conn(c);
+    if (ic == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring del connection: fd:%d armed:%02xd",
+                   c->fd, ic->armed);
+
+    c->read->active = 0;
+    c->write->active = 0;
+
+    if (ic->armed) {
+        sqe = ngx_iouring_get_sqe(c->log);
+        if (sqe == NULL) {
+            return NGX_ERROR;
+        }
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = c->fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD|IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+
+        ic->removing = ic->armed;
+
+        /*
+         * io_uring requests hold their own reference to the file,
+         * so they must be cancelled before the descriptor is closed
+         * and its number is reused
+         */
+
+        if ((flags & NGX_CLOSE_EVENT)
+            && ngx_iouring_submit(c->log) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (flags & NGX_CLOSE_EVENT) {
+        ngx_iouring_reset(c, ic);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_iouring_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
+    ngx_uint_t flags)
+{
+    int                             n, res;
+    uint32_t                        head, tail, cflags, revents;
+    uint64_t                        data, id;
+    uint32_t                        generation;
+    ngx_uint_t                      op, level, wait;
+    ngx_err_t                       err;
+    ngx_event_t                    *rev, *wev;
+    ngx_queue_t                    *queue;
+    ngx_connection_t               *c;
+    ngx_iouring_conn_t             *ic;
+    struct __kernel_timespec        ts;
+    struct io_uring_getevents_arg   arg;
+
+    /* NGX_TIMER_INFINITE == INFTIM */
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring timer: %M", timer);
+
+    ngx_memory_barrier();
+    *sq.tail = sq.local_tail;
+
+    head = *cq.head;
+    tail = *cq.tail;
+    ngx_memory_barrier();
+
+    /* completions left from the previous iteration need no waiting */
+
+    wait = (timer != 0 && head == tail) ? 1 : 0;
+
+    ngx_memzero(&arg, sizeof(struct io_uring_getevents_arg));
+
+    if (timer != NGX_TIMER_INFINITE) {
+        ts.tv_sec = timer / 1000;
+        ts.tv_nsec = (timer % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    n = io_uring_enter(ring, sq.local_tail - *sq.head, wait,
+                       IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                       &arg, sizeof(struct io_uring_getevents_arg));
+
+    err = (n == -1) ? ngx_errno : 0;
+
+    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
+        ngx_time_update();
+    }
+
+    if (err && err != ETIME && err != NGX_EBUSY && err != NGX_EAGAIN) {
+        if (err == NGX_EINTR) {
+
+            if (ngx_event_timer_alarm) {
+                ngx_event_timer_alarm = 0;
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_INFO;
+
+        } else {
+            level = NGX_LOG_ALERT;
+        }
+
+        ngx_log_error(level, cycle->log, err, "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    head = *cq.head;
+    tail = *cq.tail;
+    ngx_memory_barrier();
+
+    if (head == tail) {
+        if (timer != NGX_TIMER_INFINITE) {
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "io_uring_enter() returned no events without timeout");
+        return NGX_ERROR;
+    }
+
+    for ( /* void */ ; head != tail; head++) {
+
+        data = cq.cqes[head & cq.mask].user_data;
+        res = cq.cqes[head & cq.mask].res;
+        cflags = cq.cqes[head & cq.mask].flags;
+
+        if (data == 0) {
+            /* a completion of a cancel or remove request */
+            continue;
+        }
+
+        id = data >> 32;
+        generation = (data >> 2) & NGX_IOURING_GENERATION;
+        op = data & 3;
+
+#if (NGX_HAVE_EVENTFD)
+        if (id == NGX_IOURING_NOTIFY) {
+            c = &notify_conn;
+            ic = &notify_iconn;
+
+        } else
+#endif
+        if (id - 1 < cycle->connection_n) {
+            c = &cycle->connections[id - 1];
+            ic = &conns[id - 1];
+
+        } else {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                          "io_uring: unknown completion %uL", data);
+            continue;
+        }
+
+        ngx_log_debug5(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "io_uring: fd:%d op:%ui res:%d fl:%xD d:%p",
+                       c->fd, op, res, cflags, c);
+
+        rev = c->read;
+
+        if (c->fd == -1
+            || (ic->generation & NGX_IOURING_GENERATION) != generation)
+        {
+
+            /*
+             * the stale event from a file descriptor that was closed,
+             * possibly with the connection reused since
+             */
+
+            if (cflags & IORING_CQE_F_BUFFER) {
+                ngx_iouring_recycle(cflags >> IORING_CQE_BUFFER_SHIFT);
+            }
+
+            if (op == NGX_IOURING_ACCEPT && res >= 0) {
+                (void) ngx_close_socket(res);
+            }
+
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: stale event %p", c);
+            continue;
+        }
+
+        if (!(cflags & IORING_CQE_F_MORE)) {
+            ic->armed &= ~(1 << op);
+            ic->removing &= ~(1 << op);
+        }
+
+        switch (op) {
+
+        case NGX_IOURING_RECV:
+            ngx_iouring_handle_recv(c, ic, res, cflags);
+            break;
+
+        case NGX_IOURING_ACCEPT:
+            ngx_iouring_handle_accept(c, ic, res);
+            break;
+        }
+
+        /*
+         * rearm a terminated multishot request or switch between
+         * recv and poll modes before calling handlers
+         */
+
+        if (op == NGX_IOURING_POLL_OUT) {
+            if (!(cflags & IORING_CQE_F_MORE)) {
+                (void) ngx_iouring_sync_write(c, ic);
+            }
+
+        } else {
+            (void) ngx_iouring_sync_read(c, ic);
+        }
+
+        if (res == -ECANCELED) {
+            continue;
+        }
+
+        switch (op) {
+
+        case NGX_IOURING_POLL_IN:
+
+            revents = (res < 0) ? POLLERR : (uint32_t) res;
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+            if (res > 0 && (revents & POLLERR) && c->zerocopy) {
+                /* MSG_ZEROCOPY completions are reported with POLLERR */
+                ngx_linux_zerocopy_complete(c);
+                revents &= ~POLLERR;
+            }
+#endif
+
+            if (!rev->active || ic->recv) {
+                break;
+            }
+
+            if (revents & (POLLERR|POLLHUP|POLLRDHUP)) {
+                rev->pending_eof = 1;
+            }
+
+            rev->ready = 1;
+            rev->available = -1;
+
+            queue = rev->accept ? &ngx_posted_accept_events
+                                : &ngx_posted_events;
+
+            if (flags & NGX_POST_EVENTS) {
+                ngx_post_event(rev, queue);
+
+            } else {
+                ngx_event_call_handler(rev);
+            }
+
+            break;
+
+        case NGX_IOURING_POLL_OUT:
+
+            wev = c->write;
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+            if (res > 0 && (res & POLLERR) && c->zerocopy) {
+                ngx_linux_zerocopy_complete(c);
+            }
+#endif
+
+            if (!wev->active) {
+                break;
+            }
+
+            wev->ready = 1;
+#if (NGX_THREADS)
+            wev->complete = 1;
+#endif
+
+            ngx_iouring_post(wev, flags);
+
+            break;
+
+        case NGX_IOURING_RECV:
+
+            if (!rev->active || res == -ENOBUFS) {
+                break;
+            }
+
+            rev->ready = 1;
+
+            ngx_iouring_post(rev, flags);
+
+            break;
+
+        case NGX_IOURING_ACCEPT:
+
+            if (!rev->active || (ic->accept->nelts == 0 && !ic->accept->err)) {
+                break;
+            }
+
+            rev->ready = 1;
+
+            if (flags & NGX_POST_EVENTS) {
+                ngx_post_event(rev, &ngx_posted_accept_events);
+
+            } else {
+                ngx_event_call_handler(rev);
+            }
+
+            break;
+        }
+    }
+
+    ngx_memory_barrier();
+    *cq.head = head;
+
+    return NGX_OK;
+}
+
+
+ngx_socket_t
+ngx_iouring_accept(ngx_event_t *ev, struct sockaddr *sa, socklen_t *socklen)
+{
+    ngx_err_t              err;
+    ngx_socket_t           s;
+    ngx_connection_t      *c;
+    ngx_iouring_conn_t    *ic;
+    ngx_iouring_accept_t  *ia;
+
+    c = ev->data;
+
+    ic = ngx_iouring_conn(c);
+
+    if (ic == NULL || ic->accept == NULL) {
+
+        /* multishot accept is not supported or not armed yet */
+
+        return accept4(c->fd, sa, socklen, SOCK_NONBLOCK);
+    }
+
+    ia = ic->accept;
+
+    if (ia->nelts == 0) {
+
+        if (ia->err) {
+            err = ia->err;
+            ia->err = 0;
+            ngx_set_socket_errno(err);
+            return (ngx_socket_t) -1;
+        }
+
+        if (!ngx_iouring_multishot_accept) {
+            return accept4(c->fd, sa, socklen, SOCK_NONBLOCK);
+        }
+
+        ngx_set_socket_errno(NGX_EAGAIN);
+        return (ngx_socket_t) -1;
+    }
+
+    s = ia->fds[ia->head];
+
+    ia->head = (ia->head + 1) % NGX_IOURING_ACCEPT_QUEUE;
+    ia->nelts--;
+
+    if (ia->paused && ia->nelts < NGX_IOURING_ACCEPT_QUEUE / 2) {
+        ia->paused = 0;
+        (void) ngx_iouring_sync_read(c, ic);
+    }
+
+    /* multishot accept cannot return the peer address */
+
+    if (getpeername(s, sa, socklen) == -1) {
+        err = ngx_socket_errno;
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                       "getpeername(%d) failed", s);
+
+        (void) ngx_close_socket(s);
+
+        ngx_set_socket_errno(NGX_ECONNABORTED);
+        return (ngx_socket_t) -1;
+    }
+
+    return s;
+}
+
+
+static ngx_iouring_conn_t *
+ngx_iouring_conn(ngx_connection_t *c)
+{
+    ngx_uint_t  n;
+
+#if (NGX_HAVE_EVENTFD)
+    if (c == &notify_conn) {
+        return &notify_iconn;
+    }
+#endif
+
+    n = c - ngx_cycle->connections;
+
+    if (c < ngx_cycle->connections || n >= nconns) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "io_uring: unknown connection %p", c);
+        return NULL;
+    }
+
+    return &conns[n];
+}
+
+
+static uint64_t
+ngx_iouring_user_data(ngx_iouring_conn_t *ic, ngx_uint_t op)
+{
+    uint64_t  id;
+
+#if (NGX_HAVE_EVENTFD)
+    if (ic == &notify_iconn) {
+        id = NGX_IOURING_NOTIFY;
+
+    } else
+#endif
+    {
+        id = ic - conns + 1;
+    }
+
+    return (id << 32)
+           | ((uint64_t) (ic->generation & NGX_IOURING_GENERATION) << 2)
+           | op;
+}
+
+
+static struct io_uring_sqe *
+ngx_iouring_get_sqe(ngx_log_t *log)
+{
+    struct io_uring_sqe  *sqe;
+
+    if (sq.local_tail - *sq.head >= sq.entries) {
+        if (ngx_iouring_submit(log) != NGX_OK) {
+            return NULL;
+        }
+    }
+
+    sqe = &sq.sqes[sq.local_tail & sq.mask];
+    sq.local_tail++;
+
+    ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+    return sqe;
+}
+
+
+static ngx_int_t
+ngx_iouring_submit(ngx_log_t *log)
+{
+    int  n;
+
+    ngx_memory_barrier();
+    *sq.tail = sq.local_tail;
+
+    while (sq.local_tail != *sq.head) {
+
+        n = io_uring_enter(ring, sq.local_tail - *sq.head, 0, 0, NULL, 0);
+
+        if (n == -1) {
+            if (ngx_errno == NGX_EINTR) {
+                continue;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "io_uring_enter() submit failed");
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_iouring_arm(ngx_connection_t *c, ngx_iouring_conn_t *ic, ngx_uint_t op)
+{
+    struct io_uring_sqe   *sqe;
+    ngx_iouring_accept_t  *ia;
+
+    if (op == NGX_IOURING_ACCEPT && ic->accept == NULL) {
+        ia = ngx_pcalloc(ngx_cycle->pool, sizeof(ngx_iouring_accept_t));
+        if (ia == NULL) {
+            return NGX_ERROR;
+        }
+
+        ia->fds = ngx_palloc(ngx_cycle->pool,
+                             NGX_IOURING_ACCEPT_QUEUE * sizeof(ngx_socket_t));
+        if (ia->fds == NULL) {
+            return NGX_ERROR;
+        }
+
+        ic->accept = ia;
+    }
+
+    sqe = ngx_iouring_get_sqe(c->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->fd = c->fd;
+    sqe->user_data = ngx_iouring_user_data(ic, op);
+
+    switch (op) {
+
+    case NGX_IOURING_POLL_IN:
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLIN|POLLRDHUP;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        break;
+
+    case NGX_IOURING_POLL_OUT:
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLOUT;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        break;
+
+    case NGX_IOURING_ACCEPT:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK;
+        break;
+
+    default: /* NGX_IOURING_RECV */
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        break;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring arm: fd:%d op:%ui", c->fd, op);
+
+    ic->armed |= 1 << op;
+    ic->removing &= ~(1 << op);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_iouring_remove(ngx_connection_t *c, ngx_iouring_conn_t *ic, ngx_uint_t op)
+{
+    struct io_uring_sqe  *sqe;
+
+    if (!(ic->armed & (1 << op)) || (ic->removing & (1 << op))) {
+        return NGX_OK;
+    }
+
+    sqe = ngx_iouring_get_sqe(c->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = (op == NGX_IOURING_POLL_IN || op == NGX_IOURING_POLL_OUT)
+                  ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = ngx_iouring_user_data(ic, op);
+    sqe->user_data = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring remove: fd:%d op:%ui", c->fd, op);
+
+    ic->removing |= 1 << op;
+
+    return NGX_OK;
+}
+
+
+/*
+ * 确保读方向上只有期望的那一个请求处于活动状态：
+ * 监听套接字使用 accept，已切换到 multishot recv 的连接使用 recv，
+ * 其余使用 poll
+ */
+
+static ngx_int_t
+ngx_iouring_sync_read(ngx_connection_t *c, ngx_iouring_conn_t *ic)
+{
+    ngx_uint_t    op, o;
+    ngx_event_t  *rev;
+
+    rev = c->read;
+
+    if (c->fd == (ngx_socket_t) -1) {
+        return NGX_OK;
+    }
+
+    if (rev->accept && c->type == SOCK_STREAM
+        && ngx_iouring_multishot_accept)
+    {
+        op = (ic->accept && ic->accept->paused) ? NGX_IOURING_NONE
+                                                : NGX_IOURING_ACCEPT;
+
+    } else if (ic->recv) {
+
+        /* nothing more can be received after eof or error */
+
+        op = (ic->eof || ic->err) ? NGX_IOURING_NONE : NGX_IOURING_RECV;
+
+    } else {
+        op = NGX_IOURING_POLL_IN;
+    }
+
+    if (!rev->active) {
+        op = NGX_IOURING_NONE;
+    }
+
+    for (o = NGX_IOURING_POLL_IN; o <= NGX_IOURING_RECV; o++) {
+        if (o == NGX_IOURING_POLL_OUT || o == op) {
+            continue;
+        }
+
+        if (ngx_iouring_remove(c, ic, o) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (op == NGX_IOURING_NONE || (ic->armed & (1 << op))) {
+        return NGX_OK;
+    }
+
+    return ngx_iouring_arm(c, ic, op);
+}
+
+
+static ngx_int_t
+ngx_iouring_sync_write(ngx_connection_t *c, ngx_iouring_conn_t *ic)
+{
+    if (c->fd == (ngx_socket_t) -1 || c->write == NULL) {
+        return NGX_OK;
+    }
+
+    if (!c->write->active) {
+        return ngx_iouring_remove(c, ic, NGX_IOURING_POLL_OUT);
+    }
+
+    if (ic->armed & (1 << NGX_IOURING_POLL_OUT)) {
+        return NGX_OK;
+    }
+
+    return ngx_iouring_arm(c, ic, NGX_IOURING_POLL_OUT);
+}
+
+
+static void
+ngx_iouring_reset(ngx_connection_t *c, ngx_iouring_conn_t *ic)
+{
+    uint16_t               bid;
+    uint32_t               generation;
+    ngx_iouring_accept_t  *ia;
+
+    while (ic->nbufs) {
+        bid = ic->first;
+        ic->first = bufs[bid].next;
+        ic->nbufs--;
+
+        ngx_iouring_recycle(bid);
+    }
+
+    ia = ic->accept;
+
+    if (ia) {
+        while (ia->nelts) {
+            (void) ngx_close_socket(ia->fds[ia->head]);
+            ia->head = (ia->head + 1) % NGX_IOURING_ACCEPT_QUEUE;
+            ia->nelts--;
+        }
+
+        ia->err = 0;
+        ia->paused = 0;
+    }
+
+    generation = ic->generation;
+
+    ngx_memzero(ic, sizeof(ngx_iouring_conn_t));
+
+    ic->accept = ia;
+    ic->generation = generation + 1;
+    ic->first = NGX_IOURING_NONE;
+    ic->last = NGX_IOURING_NONE;
+
+    c->read->available = -1;
+}
+
+
+static void
+ngx_iouring_post(ngx_event_t *ev, ngx_uint_t flags)
+{
+    if (flags & NGX_POST_EVENTS) {
+        ngx_post_event(ev, &ngx_posted_events);
+
+    } else {
+        ngx_event_call_handler(ev);
+    }
+}
+
+
+static void
+ngx_iouring_handle_recv(ngx_connection_t *c, ngx_iouring_conn_t *ic, int res,
+    uint32_t cflags)
+{
+    uint16_t  bid;
+
+    if (cflags & IORING_CQE_F_BUFFER) {
+        bid = cflags >> IORING_CQE_BUFFER_SHIFT;
+
+        if (res <= 0) {
+            ngx_iouring_recycle(bid);
+
+        } else {
+            bufs[bid].pos = bufs[bid].start;
+            bufs[bid].last = bufs[bid].start + res;
+            bufs[bid].next = NGX_IOURING_NONE;
+
+            if (ic->nbufs == 0) {
+                ic->first = bid;
+
+            } else {
+                bufs[ic->last].next = bid;
+            }
+
+            ic->last = bid;
+            ic->nbufs++;
+
+            if (c->read->available < 0) {
+                c->read->available = 0;
+            }
+
+            c->read->available += res;
+
+            if (ic->nbufs >= buf_max_per_conn) {
+
+                /* the consumer is slow, leave the rest in the socket */
+
+                ic->recv = 0;
+            }
+
+            return;
+        }
+    }
+
+    if (res == 0) {
+        ic->eof = 1;
+        c->read->pending_eof = 1;
+        return;
+    }
+
+    switch (-res) {
+
+    case ECANCELED:
+        return;
+
+    case ENOBUFS:
+
+        /* the buffer ring is exhausted, fall back to poll and recv() */
+
+        ic->recv = 0;
+        return;
+
+    case EINVAL:
+    case EOPNOTSUPP:
+
+        ngx_log_error(NGX_LOG_WARN, c->log, -res,
+                      "io_uring multishot recv is not supported, disabled");
+
+        ngx_iouring_multishot_recv = 0;
+        ic->recv = 0;
+        return;
+
+    default:
+        ic->err = -res;
+        return;
+    }
+}
+
+
+static void
+ngx_iouring_handle_accept(ngx_connection_t *c, ngx_iouring_conn_t *ic,
+    int res)
+{
+    ngx_iouring_accept_t  *ia;
+
+    ia = ic->accept;
+
+    if (res >= 0) {
+
+        if (ia->nelts == NGX_IOURING_ACCEPT_QUEUE) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                          "io_uring accept queue overflow");
+            (void) ngx_close_socket(res);
+            return;
+        }
+
+        ia->fds[(ia->head + ia->nelts) % NGX_IOURING_ACCEPT_QUEUE] = res;
+        ia->nelts++;
+
+        if (ia->nelts >= NGX_IOURING_ACCEPT_QUEUE * 3 / 4 && !ia->paused) {
+
+            /* let the backlog hold new connections until the queue drains */
+
+            ia->paused = 1;
+            (void) ngx_iouring_remove(c, ic, NGX_IOURING_ACCEPT);
+        }
+
+        return;
+    }
+
+    switch (-res) {
+
+    case ECANCELED:
+        return;
+
+    case EINVAL:
+    case EOPNOTSUPP:
+
+        ngx_log_error(NGX_LOG_WARN, c->log, -res,
+                      "io_uring multishot accept is not supported, disabled");
+
+        ngx_iouring_multishot_accept = 0;
+        return;
+
+    default:
+        ia->err = -res;
+        return;
+    }
+}
+
+
+static void
+ngx_iouring_recycle(uint16_t bid)
+{
+    struct io_uring_buf  *buf;
+
+    buf = &buf_ring->bufs[buf_ring->tail & (nbufs - 1)];
+
+    buf->addr = (uint64_t) (uintptr_t) bufs[bid].start;
+    buf->len = buf_size;
+    buf->bid = bid;
+
+    ngx_memory_barrier();
+
+    buf_ring->tail++;
+}
+
+
+static ssize_t
+ngx_iouring_copy(ngx_connection_t *c, ngx_iouring_conn_t *ic, u_char *buf,
+    size_t size)
+{
+    size_t              n, len;
+    uint16_t            bid;
+    ngx_iouring_buf_t  *b;
+
+    n = 0;
+
+    while (ic->nbufs && n < size) {
+        bid = ic->first;
+        b = &bufs[bid];
+
+        len = ngx_min((size_t) (b->last - b->pos), size - n);
+
+        ngx_memcpy(buf + n, b->pos, len);
+
+        b->pos += len;
+        n += len;
+
+        if (b->pos == b->last) {
+            ic->first = b->next;
+            ic->nbufs--;
+
+            if (ic->nbufs == 0) {
+                ic->last = NGX_IOURING_NONE;
+            }
+
+            ngx_iouring_recycle(bid);
+        }
+    }
+
+    c->read->available -= n;
+
+    return n;
+}
+
+
+static ssize_t
+ngx_iouring_recv(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    ssize_t              n;
+    ngx_iouring_conn_t  *ic;
+
+    ic = ngx_iouring_conn(c);
+
+    if (ic == NULL || c->type != SOCK_STREAM) {
+        return ngx_os_io.recv(c, buf, size);
+    }
+
+    if (ic->nbufs == 0 && !ic->recv && !ic->eof && !ic->err
+        && !(ic->armed & (1 << NGX_IOURING_RECV)))
+    {
+        n = ngx_os_io.recv(c, buf, size);
+
+        if (n == NGX_AGAIN && ngx_iouring_multishot_recv) {
+
+            /* the socket is drained, let the kernel fill our buffers */
+
+            ic->recv = 1;
+            c->read->available = 0;
+
+            if (ngx_iouring_sync_read(c, ic) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+
+        return n;
+    }
+
+    n = ngx_iouring_copy(c, ic, buf, size);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring recv: fd:%d %z of %uz", c->fd, n, size);
+
+    return ngx_iouring_recv_result(c, ic, n);
+}
+
+
+static ssize_t
+ngx_iouring_recv_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
+{
+    size_t               size;
+    ssize_t              n, total;
+    ngx_iouring_conn_t  *ic;
+
+    ic = ngx_iouring_conn(c);
+
+    if (ic == NULL || c->type != SOCK_STREAM) {
+        return ngx_os_io.recv_chain(c, in, limit);
+    }
+
+    if (ic->nbufs == 0 && !ic->recv && !ic->eof && !ic->err
+        && !(ic->armed & (1 << NGX_IOURING_RECV)))
+    {
+        n = ngx_os_io.recv_chain(c, in, limit);
+
+        if (n == NGX_AGAIN && ngx_iouring_multishot_recv) {
+            ic->recv = 1;
+            c->read->available = 0;
+
+            if (ngx_iouring_sync_read(c, ic) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+
+        return n;
+    }
+
+    total = 0;
+
+    for ( /* void */ ; in && ic->nbufs; in = in->next) {
+
+        if (ngx_buf_special(in->buf)) {
+            continue;
+        }
+
+        size = in->buf->end - in->buf->last;
+
+        if (limit) {
+            if (total >= limit) {
+                break;
+            }
+
+            if (size > (size_t) (limit - total)) {
+                size = (size_t) (limit - total);
+            }
+        }
+
+        total += ngx_iouring_copy(c, ic, in->buf->last, size);
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "io_uring recv chain: fd:%d %z", c->fd, total);
+
+    return ngx_iouring_recv_result(c, ic, total);
+}
+
+
+static ssize_t
+ngx_iouring_recv_result(ngx_connection_t *c, ngx_iouring_conn_t *ic,
+    ssize_t n)
+{
+    ngx_event_t  *rev;
+
+    rev = c->read;
+
+    if (n > 0) {
+        rev->ready = (ic->nbufs || ic->eof || ic->err || !ic->recv) ? 1 : 0;
+        return n;
+    }
+
+    if (ic->err) {
+        rev->ready = 0;
+        rev->error = 1;
+
+        return ngx_connection_error(c, ic->err, "recv() failed");
+    }
+
+    if (ic->eof) {
+        rev->ready = 0;
+        rev->eof = 1;
+
+        return 0;
+    }
+
+    if (!ic->recv && !(ic->armed & (1 << NGX_IOURING_RECV))) {
+
+        /* multishot recv has stopped, the socket may still have data */
+
+        rev->available = -1;
+        rev->ready = 1;
+
+        return NGX_AGAIN;
+    }
+
+    rev->ready = 0;
+
+    return NGX_AGAIN;
+}
+
+
+static void *
+ngx_iouring_create_conf(ngx_cycle_t *cycle)
+{
+    ngx_iouring_conf_t  *iucf;
+
+    iucf = ngx_pcalloc(cycle->pool, sizeof(ngx_iouring_conf_t));
+    if (iucf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     iucf->buffers = { 0, 0 };
+     */
+
+    iucf->entries = NGX_CONF_UNSET_UINT;
+    iucf->multishot_recv = NGX_CONF_UNSET;
+
+    return iucf;
+}
+
+
+static char *
+ngx_iouring_init_conf(ngx_cycle_t *cycle, void *conf)
+{
+    ngx_iouring_conf_t *iucf = conf;
+
+    ngx_conf_init_uint_value(iucf->entries, 1024);
+    ngx_conf_init_value(iucf->multishot_recv, 1);
+
+    if (iucf->buffers.num == 0) {
+        iucf->buffers.num = 1024;
+        iucf->buffers.size = 4096;
+    }
+
+    if (iucf->buffers.num > 32768
+        || (iucf->buffers.num & (iucf->buffers.num - 1)))
+    {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "\"io_uring_buffers\" number must be a power of 2 "
+                      "not greater than 32768");
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
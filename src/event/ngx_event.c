@@ -24,6 +24,10 @@ static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
                                    void *conf);
 static char *ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_event_accept_budget(ngx_conf_t *cf, ngx_command_t *cmd,
+                                     void *conf);
+static char *ngx_event_loop_stats_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+                                       void *conf);
 static char *ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd,
                                         void *conf);
 
@@ -49,6 +53,9 @@ ngx_uint_t ngx_accept_mutex_held;
 ngx_msec_t ngx_accept_mutex_delay;
 ngx_int_t ngx_accept_disabled;
 ngx_uint_t ngx_use_exclusive_accept;
+ngx_uint_t ngx_use_accept_budget;
+ngx_uint_t ngx_accept_budget;
+ngx_uint_t ngx_accept_listeners;
 
 #if (NGX_STAT_STUB)
 
@@ -182,6 +189,38 @@ static ngx_command_t ngx_event_core_commands[] = {
      offsetof(ngx_event_conf_t, accept_mutex_delay),
      NULL},
 
+    /* timer_wheel指令，配置是否使用时间轮代替红黑树管理定时器 */
+    {ngx_string("timer_wheel"),
+     NGX_EVENT_CONF | NGX_CONF_FLAG,
+     ngx_conf_set_flag_slot,
+     0,
+     offsetof(ngx_event_conf_t, timer_wheel),
+     NULL},
+
+    /* accept_budget指令，配置每轮事件循环接受新连接的预算 */
+    {ngx_string("accept_budget"),
+     NGX_EVENT_CONF | NGX_CONF_TAKE1,
+     ngx_event_accept_budget,
+     0,
+     0,
+     NULL},
+
+    /* event_loop_stats指令，配置是否在共享内存中统计每个worker的事件循环 */
+    {ngx_string("event_loop_stats"),
+     NGX_EVENT_CONF | NGX_CONF_FLAG,
+     ngx_event_loop_stats_zone,
+     0,
+     0,
+     NULL},
+
+    /* slow_event_threshold指令，配置慢事件处理函数的告警阈值 */
+    {ngx_string("slow_event_threshold"),
+     NGX_EVENT_CONF | NGX_CONF_TAKE1,
+     ngx_conf_set_msec_slot,
+     0,
+     offsetof(ngx_event_conf_t, slow_event_threshold),
+     NULL},
+
     /* debug_connection指令，配置是否开启调试连接 */
     {ngx_string("debug_connection"),
      NGX_EVENT_CONF | NGX_CONF_TAKE1,
@@ -230,7 +269,7 @@ ngx_module_t ngx_event_core_module = {
 void ngx_process_events_and_timers(ngx_cycle_t *cycle)
 {
     ngx_uint_t flags;
-    ngx_msec_t timer, delta;
+    ngx_msec_t timer, delta, start;
 
     // 如果定时器分辨率开启
     if (ngx_timer_resolution)
@@ -314,6 +353,17 @@ void ngx_process_events_and_timers(ngx_cycle_t *cycle)
         timer = 0;
     }
 
+    // 计算本轮事件循环的accept预算
+    if (ngx_use_accept_budget)
+    {
+        ngx_event_reset_accept_budget(cycle);
+    }
+
+    if (ngx_event_loop_stat)
+    {
+        ngx_event_loop_start();
+    }
+
     delta = ngx_current_msec;
 
     /**
@@ -330,6 +380,15 @@ void ngx_process_events_and_timers(ngx_cycle_t *cycle)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "timer delta: %M", delta);
 
+    // 记录事件返回的时间，用于衡量本轮事件循环的处理延迟
+    start = ngx_current_msec;
+
+    // 按阶段累计本轮事件循环的耗时
+    if (ngx_event_loop_stat)
+    {
+        ngx_event_loop_mark(NGX_EVENT_LOOP_IO);
+    }
+
     ngx_event_process_posted(cycle, &ngx_posted_accept_events);
 
     // 如果持有接受互斥锁，释放锁
@@ -338,89 +397,30 @@ void ngx_process_events_and_timers(ngx_cycle_t *cycle)
         ngx_shmtx_unlock(&ngx_accept_mutex);
     }
 
-    ngx_event_expire_timers();
-
-    ngx_event_process_posted(cycle, &ngx_posted_events);
-}
-
-{
-    ngx_uint_t flags;
-    ngx_msec_t timer, delta;
-
-    if (ngx_timer_resolution)
+    if (ngx_event_loop_stat)
     {
-        timer = NGX_TIMER_INFINITE;
-        flags = 0;
+        ngx_event_loop_mark(NGX_EVENT_LOOP_ACCEPT);
     }
-    else
-    {
-        timer = ngx_event_find_timer();
-        flags = NGX_UPDATE_TIME;
-
-#if (NGX_WIN32)
-
-        /* handle signals from master in case of network inactivity */
 
-        if (timer == NGX_TIMER_INFINITE || timer > 500)
-        {
-            timer = 500;
-        }
-
-#endif
-    }
+    ngx_event_expire_timers();
 
-    if (ngx_use_accept_mutex)
+    if (ngx_event_loop_stat)
     {
-        if (ngx_accept_disabled > 0)
-        {
-            ngx_accept_disabled--;
-        }
-        else
-        {
-            if (ngx_trylock_accept_mutex(cycle) == NGX_ERROR)
-            {
-                return;
-            }
-
-            if (ngx_accept_mutex_held)
-            {
-                flags |= NGX_POST_EVENTS;
-            }
-            else
-            {
-                if (timer == NGX_TIMER_INFINITE || timer > ngx_accept_mutex_delay)
-                {
-                    timer = ngx_accept_mutex_delay;
-                }
-            }
-        }
+        ngx_event_loop_mark(NGX_EVENT_LOOP_TIMERS);
     }
 
-    if (!ngx_queue_empty(&ngx_posted_next_events))
+    ngx_event_process_posted(cycle, &ngx_posted_events);
+
+    if (ngx_event_loop_stat)
     {
-        ngx_event_move_posted_next(cycle);
-        timer = 0;
+        ngx_event_loop_mark(NGX_EVENT_LOOP_POSTED);
     }
 
-    delta = ngx_current_msec;
-
-    (void)ngx_process_events(cycle, timer, flags);
-
-    delta = ngx_current_msec - delta;
-
-    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                   "timer delta: %M", delta);
-
-    ngx_event_process_posted(cycle, &ngx_posted_accept_events);
-
-    if (ngx_accept_mutex_held)
+    // 根据本轮事件循环的延迟调整accept预算
+    if (ngx_use_accept_budget)
     {
-        ngx_shmtx_unlock(&ngx_accept_mutex);
+        ngx_event_adjust_accept_budget(cycle, start);
     }
-
-    ngx_event_expire_timers();
-
-    ngx_event_process_posted(cycle, &ngx_posted_events);
 }
 
 ngx_int_t
@@ -800,6 +800,8 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     shm.size = size;
     ngx_str_set(&shm.name, "nginx_shared_zone");
     shm.log = cycle->log;
+    shm.flags = 0;
+    shm.node = 0;
 
     /* 分配共享内存 */
     if (ngx_shm_alloc(&shm) != NGX_OK)
@@ -851,132 +853,6 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     return NGX_OK;
 }
 
-{
-    void ***cf;
-    u_char *shared;
-    size_t size, cl;
-    ngx_shm_t shm;
-    ngx_time_t *tp;
-    ngx_core_conf_t *ccf;
-    ngx_event_conf_t *ecf;
-
-    cf = ngx_get_conf(cycle->conf_ctx, ngx_events_module);
-    ecf = (*cf)[ngx_event_core_module.ctx_index];
-
-    if (!ngx_test_config && ngx_process <= NGX_PROCESS_MASTER)
-    {
-        ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
-                      "using the \"%s\" event method", ecf->name);
-    }
-
-    ccf = (ngx_core_conf_t *)ngx_get_conf(cycle->conf_ctx, ngx_core_module);
-
-    ngx_timer_resolution = ccf->timer_resolution;
-
-#if !(NGX_WIN32)
-    {
-        ngx_int_t limit;
-        struct rlimit rlmt;
-
-        if (getrlimit(RLIMIT_NOFILE, &rlmt) == -1)
-        {
-            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
-                          "getrlimit(RLIMIT_NOFILE) failed, ignored");
-        }
-        else
-        {
-            if (ecf->connections > (ngx_uint_t)rlmt.rlim_cur && (ccf->rlimit_nofile == NGX_CONF_UNSET || ecf->connections > (ngx_uint_t)ccf->rlimit_nofile))
-            {
-                limit = (ccf->rlimit_nofile == NGX_CONF_UNSET) ? (ngx_int_t)rlmt.rlim_cur : ccf->rlimit_nofile;
-
-                ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
-                              "%ui worker_connections exceed "
-                              "open file resource limit: %i",
-                              ecf->connections, limit);
-            }
-        }
-    }
-#endif /* !(NGX_WIN32) */
-
-    if (ccf->master == 0)
-    {
-        return NGX_OK;
-    }
-
-    if (ngx_accept_mutex_ptr)
-    {
-        return NGX_OK;
-    }
-
-    /* cl should be equal to or greater than cache line size */
-
-    cl = 128;
-
-    size = cl    /* ngx_accept_mutex */
-           + cl  /* ngx_connection_counter */
-           + cl; /* ngx_temp_number */
-
-#if (NGX_STAT_STUB)
-
-    size += cl    /* ngx_stat_accepted */
-            + cl  /* ngx_stat_handled */
-            + cl  /* ngx_stat_requests */
-            + cl  /* ngx_stat_active */
-            + cl  /* ngx_stat_reading */
-            + cl  /* ngx_stat_writing */
-            + cl; /* ngx_stat_waiting */
-
-#endif
-
-    shm.size = size;
-    ngx_str_set(&shm.name, "nginx_shared_zone");
-    shm.log = cycle->log;
-
-    if (ngx_shm_alloc(&shm) != NGX_OK)
-    {
-        return NGX_ERROR;
-    }
-
-    shared = shm.addr;
-
-    ngx_accept_mutex_ptr = (ngx_atomic_t *)shared;
-    ngx_accept_mutex.spin = (ngx_uint_t)-1;
-
-    if (ngx_shmtx_create(&ngx_accept_mutex, (ngx_shmtx_sh_t *)shared,
-                         cycle->lock_file.data) != NGX_OK)
-    {
-        return NGX_ERROR;
-    }
-
-    ngx_connection_counter = (ngx_atomic_t *)(shared + 1 * cl);
-
-    (void)ngx_atomic_cmp_set(ngx_connection_counter, 0, 1);
-
-    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
-                   "counter: %p, %uA",
-                   ngx_connection_counter, *ngx_connection_counter);
-
-    ngx_temp_number = (ngx_atomic_t *)(shared + 2 * cl);
-
-    tp = ngx_timeofday();
-
-    ngx_random_number = (tp->msec << 16) + ngx_pid;
-
-#if (NGX_STAT_STUB)
-
-    ngx_stat_accepted = (ngx_atomic_t *)(shared + 3 * cl);
-    ngx_stat_handled = (ngx_atomic_t *)(shared + 4 * cl);
-    ngx_stat_requests = (ngx_atomic_t *)(shared + 5 * cl);
-    ngx_stat_active = (ngx_atomic_t *)(shared + 6 * cl);
-    ngx_stat_reading = (ngx_atomic_t *)(shared + 7 * cl);
-    ngx_stat_writing = (ngx_atomic_t *)(shared + 8 * cl);
-    ngx_stat_waiting = (ngx_atomic_t *)(shared + 9 * cl);
-
-#endif
-
-    return NGX_OK;
-}
-
 #if !(NGX_WIN32)
 
 /*
@@ -1042,12 +918,25 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
     ngx_use_exclusive_accept = 0;
 
+    // 按配置启用每轮事件循环的accept预算
+    ngx_use_accept_budget = ecf->accept_budget ? 1 : 0;
+    ngx_accept_listeners = 0;
+
+    // 选择事件循环统计的槽位，并按需对事件处理函数计时
+    if (ngx_event_stat_init(cycle, ecf->loop_stats,
+                            ecf->slow_event_threshold) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
     // 初始化用于已发布事件的队列
     ngx_queue_init(&ngx_posted_accept_events);
     ngx_queue_init(&ngx_posted_next_events);
     ngx_queue_init(&ngx_posted_events);
 
-    // 初始化事件计时器
+    // 初始化事件计时器，按配置选择红黑树或时间轮
+    ngx_event_timer_wheel = ecf->timer_wheel;
+
     if (ngx_event_timer_init(cycle->log) == NGX_ERROR)
     {
         return NGX_ERROR;
@@ -1078,6 +967,8 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         break;
     }
 
+#if !(NGX_WIN32)
+
     /*
      * 在非 Win32 系统上，如果定义了 ngx_timer_resolution 并且未使用定时器事件，则配置定时器分辨率和信号处理程序。
      */
@@ -1159,9 +1050,13 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
 #endif
 
-    // 分配连接数组、读事件数组和写事件数组的内存
+    // 分配连接数组、读事件数组和写事件数组的内存，
+    // 按缓存行对齐；结构体大小不是缓存行的整数倍，补齐到整数倍
+    // 实测反而更慢（占用更多缓存），见 misc/test/ngx_bench_event.c
     cycle->connections =
-        ngx_alloc(sizeof(ngx_connection_t) * cycle->connection_n, cycle->log);
+        ngx_memalign(NGX_CPU_CACHE_LINE,
+                     sizeof(ngx_connection_t) * cycle->connection_n,
+                     cycle->log);
     if (cycle->connections == NULL)
     {
         return NGX_ERROR;
@@ -1169,8 +1064,9 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
     c = cycle->connections;
 
-    cycle->read_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                   cycle->log);
+    cycle->read_events = ngx_memalign(NGX_CPU_CACHE_LINE,
+                                      sizeof(ngx_event_t) * cycle->connection_n,
+                                      cycle->log);
     if (cycle->read_events == NULL)
     {
         return NGX_ERROR;
@@ -1183,8 +1079,9 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         rev[i].instance = 1;
     }
 
-    cycle->write_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                    cycle->log);
+    cycle->write_events = ngx_memalign(NGX_CPU_CACHE_LINE,
+                                       sizeof(ngx_event_t) * cycle->connection_n,
+                                       cycle->log);
     if (cycle->write_events == NULL)
     {
         return NGX_ERROR;
@@ -1315,6 +1212,12 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         rev->handler = (c->type == SOCK_STREAM) ? ngx_event_accept
                                                 : ngx_event_recvmsg;
 
+        // 统计本进程负责的TCP监听套接字数量，用于分摊accept预算
+        if (c->type == SOCK_STREAM)
+        {
+            ngx_accept_listeners++;
+        }
+
 #if (NGX_HAVE_REUSEPORT)
 
         if (ls[i].reuseport)
@@ -1499,93 +1402,6 @@ ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     return NGX_CONF_OK;
 }
 
-{
-    char *rv;
-    void ***ctx;
-    ngx_uint_t i;
-    ngx_conf_t pcf;
-    ngx_event_module_t *m;
-
-    if (*(void **)conf)
-    {
-        return "is duplicate";
-    }
-
-    /* count the number of the event modules and set up their indices */
-
-    ngx_event_max_module = ngx_count_modules(cf->cycle, NGX_EVENT_MODULE);
-
-    ctx = ngx_pcalloc(cf->pool, sizeof(void *));
-    if (ctx == NULL)
-    {
-        return NGX_CONF_ERROR;
-    }
-
-    *ctx = ngx_pcalloc(cf->pool, ngx_event_max_module * sizeof(void *));
-    if (*ctx == NULL)
-    {
-        return NGX_CONF_ERROR;
-    }
-
-    *(void **)conf = ctx;
-
-    for (i = 0; cf->cycle->modules[i]; i++)
-    {
-        if (cf->cycle->modules[i]->type != NGX_EVENT_MODULE)
-        {
-            continue;
-        }
-
-        m = cf->cycle->modules[i]->ctx;
-
-        if (m->create_conf)
-        {
-            (*ctx)[cf->cycle->modules[i]->ctx_index] =
-                m->create_conf(cf->cycle);
-            if ((*ctx)[cf->cycle->modules[i]->ctx_index] == NULL)
-            {
-                return NGX_CONF_ERROR;
-            }
-        }
-    }
-
-    pcf = *cf;
-    cf->ctx = ctx;
-    cf->module_type = NGX_EVENT_MODULE;
-    cf->cmd_type = NGX_EVENT_CONF;
-
-    rv = ngx_conf_parse(cf, NULL);
-
-    *cf = pcf;
-
-    if (rv != NGX_CONF_OK)
-    {
-        return rv;
-    }
-
-    for (i = 0; cf->cycle->modules[i]; i++)
-    {
-        if (cf->cycle->modules[i]->type != NGX_EVENT_MODULE)
-        {
-            continue;
-        }
-
-        m = cf->cycle->modules[i]->ctx;
-
-        if (m->init_conf)
-        {
-            rv = m->init_conf(cf->cycle,
-                              (*ctx)[cf->cycle->modules[i]->ctx_index]);
-            if (rv != NGX_CONF_OK)
-            {
-                return rv;
-            }
-        }
-    }
-
-    return NGX_CONF_OK;
-}
-
 static char *
 ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1680,6 +1496,85 @@ ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     return NGX_CONF_ERROR;
 }
 
+static char *
+ngx_event_accept_budget(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_event_conf_t *ecf = conf;
+
+    ngx_int_t n;
+    ngx_str_t *value;
+
+    if (ecf->accept_budget != NGX_CONF_UNSET_UINT)
+    {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0)
+    {
+        ecf->accept_budget = 0;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcmp(value[1].data, "auto") == 0)
+    {
+        ecf->accept_budget = NGX_ACCEPT_BUDGET_AUTO;
+        return NGX_CONF_OK;
+    }
+
+    n = ngx_atoi(value[1].data, value[1].len);
+    if (n == NGX_ERROR || n == 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\"", &value[1]);
+
+        return NGX_CONF_ERROR;
+    }
+
+    ecf->accept_budget = n;
+
+    return NGX_CONF_OK;
+}
+
+static char *
+ngx_event_loop_stats_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_event_conf_t *ecf = conf;
+
+    ngx_str_t *value;
+
+    if (ecf->loop_stats != NGX_CONF_UNSET_PTR)
+    {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcasecmp(value[1].data, (u_char *)"off") == 0)
+    {
+        ecf->loop_stats = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcasecmp(value[1].data, (u_char *)"on") != 0)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\" in \"%V\" directive, "
+                           "it must be \"on\" or \"off\"",
+                           &value[1], &cmd->name);
+        return NGX_CONF_ERROR;
+    }
+
+    ecf->loop_stats = ngx_event_stat_add_zone(cf);
+    if (ecf->loop_stats == NULL)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
 static char *
 ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1820,6 +1715,10 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
     ecf->name = (void *)NGX_CONF_UNSET;
+    ecf->timer_wheel = NGX_CONF_UNSET;
+    ecf->accept_budget = NGX_CONF_UNSET_UINT;
+    ecf->loop_stats = NGX_CONF_UNSET_PTR;
+    ecf->slow_event_threshold = NGX_CONF_UNSET_MSEC;
 
 #if (NGX_DEBUG)
 
@@ -1835,35 +1734,6 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     return ecf;
 }
 
-{
-    ngx_event_conf_t *ecf;
-
-    ecf = ngx_palloc(cycle->pool, sizeof(ngx_event_conf_t));
-    if (ecf == NULL)
-    {
-        return NULL;
-    }
-
-    ecf->connections = NGX_CONF_UNSET_UINT;
-    ecf->use = NGX_CONF_UNSET_UINT;
-    ecf->multi_accept = NGX_CONF_UNSET;
-    ecf->accept_mutex = NGX_CONF_UNSET;
-    ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
-    ecf->name = (void *)NGX_CONF_UNSET;
-
-#if (NGX_DEBUG)
-
-    if (ngx_array_init(&ecf->debug_connection, cycle->pool, 4,
-                       sizeof(ngx_cidr_t)) == NGX_ERROR)
-    {
-        return NULL;
-    }
-
-#endif
-
-    return ecf;
-}
-
 /*
  * 函数: ngx_event_core_init_conf
  * -----------------------------
@@ -1966,99 +1836,10 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 0);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
-
-    return NGX_CONF_OK;
-}
-
-ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
-{
-    ngx_event_conf_t *ecf = conf;
-
-#if (NGX_HAVE_EPOLL) && !(NGX_TEST_BUILD_EPOLL)
-    int fd;
-#endif
-    ngx_int_t i;
-    ngx_module_t *module;
-    ngx_event_module_t *event_module;
-
-    module = NULL;
-
-#if (NGX_HAVE_EPOLL) && !(NGX_TEST_BUILD_EPOLL)
-
-    fd = epoll_create(100);
-
-    if (fd != -1)
-    {
-        (void)close(fd);
-        module = &ngx_epoll_module;
-    }
-    else if (ngx_errno != NGX_ENOSYS)
-    {
-        module = &ngx_epoll_module;
-    }
-
-#endif
-
-#if (NGX_HAVE_DEVPOLL) && !(NGX_TEST_BUILD_DEVPOLL)
-
-    module = &ngx_devpoll_module;
-
-#endif
-
-#if (NGX_HAVE_KQUEUE)
-
-    module = &ngx_kqueue_module;
-
-#endif
-
-#if (NGX_HAVE_SELECT)
-
-    if (module == NULL)
-    {
-        module = &ngx_select_module;
-    }
-
-#endif
-
-    if (module == NULL)
-    {
-        for (i = 0; cycle->modules[i]; i++)
-        {
-
-            if (cycle->modules[i]->type != NGX_EVENT_MODULE)
-            {
-                continue;
-            }
-
-            event_module = cycle->modules[i]->ctx;
-
-            if (ngx_strcmp(event_module->name->data, event_core_name.data) == 0)
-            {
-                continue;
-            }
-
-            module = cycle->modules[i];
-            break;
-        }
-    }
-
-    if (module == NULL)
-    {
-        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "no events module found");
-        return NGX_CONF_ERROR;
-    }
-
-    ngx_conf_init_uint_value(ecf->connections, DEFAULT_CONNECTIONS);
-    cycle->connection_n = ecf->connections;
-
-    ngx_conf_init_uint_value(ecf->use, module->ctx_index);
-
-    event_module = module->ctx;
-    ngx_conf_init_ptr_value(ecf->name, event_module->name->data);
-
-    ngx_conf_init_value(ecf->multi_accept, 0);
-    ngx_conf_init_value(ecf->accept_mutex, 0);
-    ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_value(ecf->timer_wheel, 0);
+    ngx_conf_init_uint_value(ecf->accept_budget, 0);
+    ngx_conf_init_ptr_value(ecf->loop_stats, NULL);
+    ngx_conf_init_msec_value(ecf->slow_event_threshold, 0);
 
     return NGX_CONF_OK;
 }
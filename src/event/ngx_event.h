@@ -102,127 +102,22 @@ struct ngx_event_s {
 
     ngx_event_handler_pt  handler;       /* 事件处理函数指针 */
 
-
-#if (NGX_HAVE_IOCP)
-    ngx_event_ovlp_t ovlp;               /* iocp 专用 */
-#endif
-
-    ngx_uint_t       index;              /* 事件在事件数组中的索引 */
-
-    ngx_log_t       *log;                /* 日志对象指针 */
+    /*
+     * 定时器节点紧接在处理函数之后，使标志位、处理函数及定时器
+     * 位于同一个64字节的缓存行中；较少使用的字段放在最后
+     */
 
     ngx_rbtree_node_t   timer;           /* 定时器红黑树节点 */
 
     /* 事件队列 */
     ngx_queue_t      queue;
-};
-
-    void            *data;
-
-    unsigned         write:1;
-
-    unsigned         accept:1;
-
-    /* used to detect the stale events in kqueue and epoll */
-    unsigned         instance:1;
-
-    /*
-     * the event was passed or would be passed to a kernel;
-     * in aio mode - operation was posted.
-     */
-    unsigned         active:1;
-
-    unsigned         disabled:1;
-
-    /* the ready event; in aio mode 0 means that no operation can be posted */
-    unsigned         ready:1;
-
-    unsigned         oneshot:1;
-
-    /* aio operation is complete */
-    unsigned         complete:1;
-
-    unsigned         eof:1;
-    unsigned         error:1;
-
-    unsigned         timedout:1;
-    unsigned         timer_set:1;
-
-    unsigned         delayed:1;
-
-    unsigned         deferred_accept:1;
-
-    /* the pending eof reported by kqueue, epoll or in aio chain operation */
-    unsigned         pending_eof:1;
-
-    unsigned         posted:1;
-
-    unsigned         closed:1;
-
-    /* to test on worker exit */
-    unsigned         channel:1;
-    unsigned         resolver:1;
-
-    unsigned         cancelable:1;
-
-#if (NGX_HAVE_KQUEUE)
-    unsigned         kq_vnode:1;
-
-    /* the pending errno reported by kqueue */
-    int              kq_errno;
-#endif
 
-    /*
-     * kqueue only:
-     *   accept:     number of sockets that wait to be accepted
-     *   read:       bytes to read when event is ready
-     *               or lowat when event is set with NGX_LOWAT_EVENT flag
-     *   write:      available space in buffer when event is ready
-     *               or lowat when event is set with NGX_LOWAT_EVENT flag
-     *
-     * iocp: TODO
-     *
-     * otherwise:
-     *   accept:     1 if accept many, 0 otherwise
-     *   read:       bytes to read when event is ready, -1 if not known
-     */
-
-    int              available;
-
-    ngx_event_handler_pt  handler;
+    ngx_log_t       *log;                /* 日志对象指针 */
 
+    ngx_uint_t       index;              /* 事件在事件数组中的索引 */
 
 #if (NGX_HAVE_IOCP)
-    ngx_event_ovlp_t ovlp;
-#endif
-
-    ngx_uint_t       index;
-
-    ngx_log_t       *log;
-
-    ngx_rbtree_node_t   timer;
-
-    /* the posted queue */
-    ngx_queue_t      queue;
-
-#if 0
-
-    /* the threads support */
-
-    /*
-     * the event thread context, we store it here
-     * if $(CC) does not understand __thread declaration
-     * and pthread_getspecific() is too costly
-     */
-
-    void            *thr_ctx;
-
-#if (NGX_EVENT_T_PADDING)
-
-    /* event should not cross cache line in SMP */
-
-    uint32_t         padding[NGX_EVENT_T_PADDING];
-#endif
+    ngx_event_ovlp_t ovlp;               /* iocp 专用 */
 #endif
 };
 
@@ -373,6 +268,12 @@ extern ngx_uint_t            ngx_use_epoll_rdhup;
  */
 #define NGX_USE_VNODE_EVENT      0x00002000
 
+/*
+ * The event filter is io_uring, accepted sockets are returned
+ * by multishot accept: io_uring.
+ */
+#define NGX_USE_IO_URING_EVENT   0x00004000
+
 
 /*
  * The event filter is deleted just before the closing file.
@@ -542,6 +443,10 @@ extern ngx_os_io_t  ngx_io;
  *   - ngx_flag_t accept_mutex: 是否开启连接互斥锁
  *   - ngx_msec_t accept_mutex_delay: 互斥锁延迟时间
  *   - u_char *name: 事件核心的名称
+ *   - ngx_flag_t timer_wheel: 是否使用时间轮代替红黑树管理定时器
+ *   - ngx_uint_t accept_budget: 每轮事件循环接受新连接的预算（0为不限制）
+ *   - ngx_shm_zone_t *loop_stats: 事件循环统计的共享内存区（未开启时为NULL）
+ *   - ngx_msec_t slow_event_threshold: 慢事件处理函数的阈值（0为不检测）
  *   - ngx_array_t debug_connection: 调试连接数组（仅在调试模式下有效）
  * 返回: ngx_event_conf_t结构体，包含了事件核心模块的各项配置信息。
  */
@@ -555,6 +460,12 @@ typedef struct {
     ngx_msec_t    accept_mutex_delay;      /* 互斥锁延迟时间 */
     u_char       *name;                    /* 事件核心的名称 */
 
+    ngx_flag_t    timer_wheel;             /* 是否使用时间轮管理定时器 */
+    ngx_uint_t    accept_budget;           /* 每轮事件循环的accept预算 */
+
+    ngx_shm_zone_t *loop_stats;            /* 事件循环统计的共享内存区 */
+    ngx_msec_t    slow_event_threshold;    /* 慢事件处理函数的阈值 */
+
 #if (NGX_DEBUG)
     ngx_array_t   debug_connection;        /* 调试连接数组（仅在调试模式下有效） */
 #endif
@@ -586,6 +497,9 @@ extern ngx_uint_t             ngx_accept_mutex_held;
 extern ngx_msec_t             ngx_accept_mutex_delay;
 extern ngx_int_t              ngx_accept_disabled;
 extern ngx_uint_t             ngx_use_exclusive_accept;
+extern ngx_uint_t             ngx_use_accept_budget;
+extern ngx_uint_t             ngx_accept_budget;
+extern ngx_uint_t             ngx_accept_listeners;
 
 
 #if (NGX_STAT_STUB)
@@ -605,6 +519,9 @@ extern ngx_atomic_t  *ngx_stat_waiting;
 #define NGX_POST_EVENTS         2
 
 
+#define NGX_ACCEPT_BUDGET_AUTO  (ngx_uint_t) NGX_MAX_INT_T_VALUE
+
+
 extern sig_atomic_t           ngx_event_timer_alarm;
 extern ngx_uint_t             ngx_event_flags;
 extern ngx_module_t           ngx_events_module;
@@ -626,8 +543,14 @@ extern ngx_module_t           ngx_event_core_module;
 
 
 void ngx_event_accept(ngx_event_t *ev);
+#if (NGX_HAVE_IO_URING)
+ngx_socket_t ngx_iouring_accept(ngx_event_t *ev, struct sockaddr *sa,
+    socklen_t *socklen);
+#endif
 ngx_int_t ngx_trylock_accept_mutex(ngx_cycle_t *cycle);
 ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
+void ngx_event_reset_accept_budget(ngx_cycle_t *cycle);
+void ngx_event_adjust_accept_budget(ngx_cycle_t *cycle, ngx_msec_t start);
 u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 #if (NGX_DEBUG)
 void ngx_debug_accepted_connection(ngx_event_conf_t *ecf, ngx_connection_t *c);
@@ -655,6 +578,7 @@ ngx_int_t ngx_send_lowat(ngx_connection_t *c, size_t lowat);
 
 #include <ngx_event_timer.h>
 #include <ngx_event_posted.h>
+#include <ngx_event_stat.h>
 #include <ngx_event_udp.h>
 
 #if (NGX_WIN32)
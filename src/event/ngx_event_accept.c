@@ -10,6 +10,13 @@
 #include <ngx_event.h>
 
 
+#define NGX_ACCEPT_BUDGET_MIN   16
+#define NGX_ACCEPT_BUDGET_MAX   1024
+
+/* the event loop lag in milliseconds that halves the auto budget */
+#define NGX_ACCEPT_BUDGET_LAG   10
+
+
 static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all);
 #if (NGX_HAVE_EPOLLEXCLUSIVE)
 static void ngx_reorder_accept_events(ngx_listening_t *ls);
@@ -17,13 +24,18 @@ static void ngx_reorder_accept_events(ngx_listening_t *ls);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
 
 
+static ngx_uint_t  ngx_accept_share;
+static ngx_uint_t  ngx_accept_total;
+static ngx_uint_t  ngx_accept_limit = 4 * NGX_ACCEPT_BUDGET_MIN;
+
+
 void
 ngx_event_accept(ngx_event_t *ev)
 {
     socklen_t          socklen;
     ngx_err_t          err;
     ngx_log_t         *log;
-    ngx_uint_t         level;
+    ngx_uint_t         level, quota;
     ngx_socket_t       s;
     ngx_event_t       *rev, *wev;
     ngx_sockaddr_t     sa;
@@ -48,16 +60,55 @@ ngx_event_accept(ngx_event_t *ev)
         ev->available = ecf->multi_accept;
     }
 
+    if (ngx_event_flags & NGX_USE_IO_URING_EVENT) {
+
+        /*
+         * the connections were already accepted by multishot accept,
+         * a single event may stand for many of them
+         */
+
+        ev->available = 1;
+    }
+
     lc = ev->data;
     ls = lc->listening;
     ev->ready = 0;
 
-    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
-                   "accept on %V, ready: %d", &ls->addr_text, ev->available);
+    quota = 0;
+
+    if (ngx_use_accept_budget) {
+
+        /*
+         * each listening socket takes at most its share of the budget
+         * of this iteration, and is posted to the next iteration when
+         * the share is used up, so the listening sockets are served
+         * in a round-robin manner
+         */
+
+        quota = ngx_min(ngx_accept_share, ngx_accept_budget);
+
+        if (quota == 0) {
+            ngx_post_event(ev, &ngx_posted_next_events);
+            return;
+        }
+
+        if (!(ngx_event_flags & NGX_USE_KQUEUE_EVENT)) {
+            ev->available = 1;
+        }
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "accept on %V, ready: %d, quota: %ui",
+                   &ls->addr_text, ev->available, quota);
 
     do {
         socklen = sizeof(ngx_sockaddr_t);
 
+#if (NGX_HAVE_IO_URING)
+        if (ngx_event_flags & NGX_USE_IO_URING_EVENT) {
+            s = ngx_iouring_accept(ev, &sa.sockaddr, &socklen);
+        } else
+#endif
 #if (NGX_HAVE_ACCEPT4)
         if (use_accept4) {
             s = accept4(lc->fd, &sa.sockaddr, &socklen, SOCK_NONBLOCK);
@@ -300,7 +351,10 @@ ngx_event_accept(ngx_event_t *ev)
         }
 #endif
 
-        if (ngx_add_conn && (ngx_event_flags & NGX_USE_EPOLL_EVENT) == 0) {
+        if (ngx_add_conn
+            && (ngx_event_flags & (NGX_USE_EPOLL_EVENT|NGX_USE_IO_URING_EVENT))
+               == 0)
+        {
             if (ngx_add_conn(c) == NGX_ERROR) {
                 ngx_close_accepted_connection(c);
                 return;
@@ -316,6 +370,15 @@ ngx_event_accept(ngx_event_t *ev)
             ev->available--;
         }
 
+        if (quota) {
+            ngx_accept_budget--;
+
+            if (--quota == 0) {
+                ngx_post_event(ev, &ngx_posted_next_events);
+                break;
+            }
+        }
+
     } while (ev->available);
 
 #if (NGX_HAVE_EPOLLEXCLUSIVE)
@@ -324,6 +387,99 @@ ngx_event_accept(ngx_event_t *ev)
 }
 
 
+/*
+ * 描述：计算本轮事件循环的accept预算，并按监听套接字数量平均分摊。
+ *
+ * 参数：
+ *   - cycle：指向ngx_cycle_t结构的指针，表示当前周期。
+ */
+
+void
+ngx_event_reset_accept_budget(ngx_cycle_t *cycle)
+{
+    ngx_uint_t         budget;
+    ngx_event_conf_t  *ecf;
+
+    ecf = ngx_event_get_conf(cycle->conf_ctx, ngx_event_core_module);
+
+    if (ecf->accept_budget == NGX_ACCEPT_BUDGET_AUTO) {
+        budget = ngx_accept_limit;
+
+    } else {
+        budget = ecf->accept_budget;
+    }
+
+    /*
+     * do not take more than a half of the free connections at once,
+     * the rest is left for the connections being already served
+     */
+
+    if (budget > cycle->free_connection_n / 2) {
+        budget = cycle->free_connection_n / 2;
+    }
+
+    if (budget == 0) {
+        budget = 1;
+    }
+
+    ngx_accept_budget = budget;
+    ngx_accept_total = budget;
+
+    ngx_accept_share = budget;
+
+    if (ngx_accept_listeners > 1) {
+        ngx_accept_share = ngx_max(budget / ngx_accept_listeners, 1);
+    }
+}
+
+
+/*
+ * 描述：根据本轮事件循环的处理延迟调整自动accept预算，
+ *       延迟过大时减半，预算用尽且延迟较小时逐步增加。
+ *
+ * 参数：
+ *   - cycle：指向ngx_cycle_t结构的指针，表示当前周期。
+ *   - start：本轮事件返回时的时间。
+ */
+
+void
+ngx_event_adjust_accept_budget(ngx_cycle_t *cycle, ngx_msec_t start)
+{
+    ngx_msec_t         lag;
+    ngx_event_conf_t  *ecf;
+
+    if (ngx_accept_budget == ngx_accept_total) {
+        /* nothing was accepted in this iteration */
+        return;
+    }
+
+    ecf = ngx_event_get_conf(cycle->conf_ctx, ngx_event_core_module);
+
+    if (ecf->accept_budget != NGX_ACCEPT_BUDGET_AUTO) {
+        return;
+    }
+
+    ngx_time_update();
+
+    lag = ngx_current_msec - start;
+
+    if (lag > NGX_ACCEPT_BUDGET_LAG) {
+        ngx_accept_limit = ngx_max(ngx_accept_limit / 2,
+                                   NGX_ACCEPT_BUDGET_MIN);
+
+    } else if (ngx_accept_budget == 0
+               && ngx_accept_limit < NGX_ACCEPT_BUDGET_MAX)
+    {
+        ngx_accept_limit += NGX_ACCEPT_BUDGET_MIN;
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "accept budget: %ui of %ui, lag: %M, limit: %ui",
+                   ngx_accept_total - ngx_accept_budget, ngx_accept_total,
+                   lag, ngx_accept_limit);
+}
+
+
 /*
  * 描述：尝试获取接受互斥锁。
  *
@@ -44,7 +44,7 @@ void ngx_event_process_posted(ngx_cycle_t *cycle, ngx_queue_t *posted)
         ngx_delete_posted_event(ev);
 
         // 调用事件的处理函数
-        ev->handler(ev);
+        ngx_event_call_handler(ev);
     }
 }
 
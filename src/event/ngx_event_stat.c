@@ -0,0 +1,262 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+static ngx_int_t ngx_event_stat_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+
+
+ngx_uint_t              ngx_event_timing;
+ngx_event_loop_stat_t  *ngx_event_loop_stats;
+ngx_uint_t              ngx_event_loop_stats_n;
+ngx_event_loop_stat_t  *ngx_event_loop_stat;
+
+static uint64_t         ngx_event_slow_threshold;
+
+/* 本轮循环的状态 */
+static uint64_t         ngx_event_loop_last;
+static uint64_t         ngx_event_loop_begin;
+static uint64_t         ngx_event_loop_handlers;
+static ngx_uint_t       ngx_event_loop_events;
+
+
+/*
+ * 添加保存事件循环统计的共享内存区，每个worker进程一个槽位；
+ * 槽位按最大进程数预留，未使用的页不会占用物理内存
+ */
+
+ngx_shm_zone_t *
+ngx_event_stat_add_zone(ngx_conf_t *cf)
+{
+    size_t           size;
+    ngx_str_t        name;
+    ngx_shm_zone_t  *shm_zone;
+
+    ngx_str_set(&name, "nginx_event_loop");
+
+    size = NGX_MAX_PROCESSES * sizeof(ngx_event_loop_stat_t)
+           + 8 * ngx_pagesize;
+
+    shm_zone = ngx_shared_memory_add(cf, &name, size, &ngx_event_core_module);
+    if (shm_zone == NULL) {
+        return NULL;
+    }
+
+    shm_zone->init = ngx_event_stat_init_zone;
+
+    return shm_zone;
+}
+
+
+static ngx_int_t
+ngx_event_stat_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_slab_pool_t  *shpool;
+
+    if (data) {
+        /* reload: keep the counters of the previous configuration */
+        shm_zone->data = data;
+        return NGX_OK;
+    }
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        shm_zone->data = shpool->data;
+        return NGX_OK;
+    }
+
+    shm_zone->data = ngx_slab_calloc(shpool, NGX_MAX_PROCESSES
+                                             * sizeof(ngx_event_loop_stat_t));
+    if (shm_zone->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    shpool->data = shm_zone->data;
+
+    return NGX_OK;
+}
+
+
+/*
+ * 在worker进程中调用：选择本进程的槽位，
+ * slow不为0时对每个事件处理函数计时以发现阻塞事件循环的处理函数
+ */
+
+ngx_int_t
+ngx_event_stat_init(ngx_cycle_t *cycle, ngx_shm_zone_t *shm_zone,
+    ngx_msec_t slow)
+{
+    ngx_core_conf_t  *ccf;
+
+    ngx_event_loop_stats = NULL;
+    ngx_event_loop_stats_n = 0;
+    ngx_event_loop_stat = NULL;
+
+    ngx_event_slow_threshold = (uint64_t) slow * 1000;
+
+    if (shm_zone) {
+        ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx,
+                                               ngx_core_module);
+
+        ngx_event_loop_stats = shm_zone->data;
+        ngx_event_loop_stats_n = ccf->master ? ccf->worker_processes : 1;
+
+        /*
+         * 缓存管理进程和加载进程也以ngx_worker为0调用本函数，
+         * 不能占用worker 0的槽位
+         */
+        if ((ngx_process == NGX_PROCESS_WORKER
+             || ngx_process == NGX_PROCESS_SINGLE)
+            && ngx_worker < NGX_MAX_PROCESSES)
+        {
+            ngx_event_loop_stat = &ngx_event_loop_stats[ngx_worker];
+            ngx_memzero(ngx_event_loop_stat, sizeof(ngx_event_loop_stat_t));
+            ngx_event_loop_stat->pid = ngx_pid;
+        }
+    }
+
+    ngx_event_timing = (ngx_event_loop_stat || slow) ? 1 : 0;
+
+    return NGX_OK;
+}
+
+
+uint64_t
+ngx_event_usec(void)
+{
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+#else
+    struct timeval   tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+#endif
+}
+
+
+void
+ngx_event_timed_handler(ngx_event_t *ev)
+{
+    uint64_t               start, elapsed;
+    ngx_event_handler_pt   handler;
+
+    /* the event may be freed by its handler */
+
+    handler = ev->handler;
+
+    start = ngx_event_usec();
+
+    handler(ev);
+
+    elapsed = ngx_event_usec() - start;
+
+    ngx_event_loop_handlers += elapsed;
+    ngx_event_loop_events++;
+
+    if (ngx_event_slow_threshold == 0 || elapsed < ngx_event_slow_threshold) {
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                  "slow event handler %p took %uLus, event %p",
+                  handler, elapsed, ev);
+
+    if (ngx_event_loop_stat) {
+        ngx_event_loop_stat->slow++;
+        ngx_event_loop_stat->slow_handler = (uintptr_t) handler;
+        ngx_event_loop_stat->slow_time = (ngx_msec_t) (elapsed / 1000);
+        ngx_event_loop_stat->slow_sec = ngx_time();
+    }
+}
+
+
+void
+ngx_event_loop_start(void)
+{
+    ngx_event_loop_last = ngx_event_usec();
+    ngx_event_loop_begin = ngx_event_loop_last;
+    ngx_event_loop_handlers = 0;
+    ngx_event_loop_events = 0;
+}
+
+
+void
+ngx_event_loop_mark(ngx_uint_t phase)
+{
+    uint64_t                now, elapsed, busy;
+    ngx_uint_t              i, n;
+    ngx_event_loop_stat_t  *st;
+
+    st = ngx_event_loop_stat;
+
+    now = ngx_event_usec();
+    elapsed = now - ngx_event_loop_last;
+    ngx_event_loop_last = now;
+
+    if (phase == NGX_EVENT_LOOP_IO) {
+
+        /*
+         * the handlers called directly by ngx_process_events() are timed,
+         * the rest of the time is spent waiting in the kernel
+         */
+
+        if (elapsed > ngx_event_loop_handlers) {
+            st->phase[NGX_EVENT_LOOP_WAIT] += elapsed - ngx_event_loop_handlers;
+            elapsed = ngx_event_loop_handlers;
+        }
+
+        /* time spent in handlers since the wait ended */
+        ngx_event_loop_begin = now - elapsed;
+    }
+
+    st->phase[phase] += elapsed;
+
+    if (phase != NGX_EVENT_LOOP_POSTED) {
+        return;
+    }
+
+    /* the iteration is complete */
+
+    busy = now - ngx_event_loop_begin;
+
+    st->iterations++;
+    st->events += ngx_event_loop_events;
+
+    if (busy > st->max_busy) {
+        st->max_busy = busy;
+    }
+
+    for (i = 0; i < NGX_EVENT_LOOP_BUSY_BUCKETS - 1; i++) {
+        if (busy < ((uint64_t) NGX_EVENT_LOOP_BUSY_MIN << i)) {
+            break;
+        }
+    }
+
+    st->busy[i]++;
+
+    for (i = 0, n = ngx_event_loop_events;
+         n && i < NGX_EVENT_LOOP_BATCH_BUCKETS - 1;
+         i++, n >>= 1)
+    {
+        /* void */
+    }
+
+    st->batch[i]++;
+}
@@ -0,0 +1,80 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_EVENT_STAT_H_INCLUDED_
+#define _NGX_EVENT_STAT_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/* 事件循环的各个阶段 */
+#define NGX_EVENT_LOOP_WAIT      0     /* 阻塞在内核中等待事件 */
+#define NGX_EVENT_LOOP_IO        1     /* ngx_process_events()中直接调用的处理函数 */
+#define NGX_EVENT_LOOP_ACCEPT    2     /* ngx_posted_accept_events */
+#define NGX_EVENT_LOOP_TIMERS    3     /* ngx_event_expire_timers() */
+#define NGX_EVENT_LOOP_POSTED    4     /* ngx_posted_events */
+#define NGX_EVENT_LOOP_PHASES    5
+
+/* 单轮循环忙碌时间直方图：第i个桶为小于 (16 << i) 微秒，最后一个桶不设上限 */
+#define NGX_EVENT_LOOP_BUSY_BUCKETS   16
+#define NGX_EVENT_LOOP_BUSY_MIN       16
+
+/* 单轮循环事件数直方图：0, 1, 2-3, 4-7, ..., 最后一个桶不设上限 */
+#define NGX_EVENT_LOOP_BATCH_BUCKETS  10
+
+
+/*
+ * 每个worker进程一个槽位，位于共享内存中，仅由对应的worker写入，
+ * 因此计数器不使用原子操作，读取方可能看到稍旧的值
+ */
+typedef struct {
+    ngx_pid_t          pid;
+    ngx_msec_t         slow_time;       /* 最近一次慢处理函数耗时 */
+    uintptr_t          slow_handler;    /* 最近一次慢处理函数地址 */
+    time_t             slow_sec;        /* 最近一次慢处理函数发生的时间 */
+
+    uint64_t           iterations;      /* 循环次数 */
+    uint64_t           events;          /* 调用的事件处理函数次数 */
+    uint64_t           slow;            /* 慢处理函数次数 */
+    uint64_t           max_busy;        /* 单轮循环的最长忙碌时间，微秒 */
+
+    uint64_t           phase[NGX_EVENT_LOOP_PHASES];          /* 微秒 */
+    uint64_t           busy[NGX_EVENT_LOOP_BUSY_BUCKETS];
+    uint64_t           batch[NGX_EVENT_LOOP_BATCH_BUCKETS];
+} ngx_event_loop_stat_t;
+
+
+#define ngx_event_call_handler(ev)                                            \
+    do {                                                                      \
+        if (ngx_event_timing) {                                               \
+            ngx_event_timed_handler(ev);                                      \
+                                                                              \
+        } else {                                                              \
+            (ev)->handler(ev);                                                \
+        }                                                                     \
+    } while (0)
+
+
+ngx_shm_zone_t *ngx_event_stat_add_zone(ngx_conf_t *cf);
+ngx_int_t ngx_event_stat_init(ngx_cycle_t *cycle, ngx_shm_zone_t *shm_zone,
+    ngx_msec_t slow);
+void ngx_event_timed_handler(ngx_event_t *ev);
+void ngx_event_loop_start(void);
+void ngx_event_loop_mark(ngx_uint_t phase);
+uint64_t ngx_event_usec(void);
+
+
+extern ngx_uint_t              ngx_event_timing;
+extern ngx_event_loop_stat_t  *ngx_event_loop_stats;
+extern ngx_uint_t              ngx_event_loop_stats_n;
+extern ngx_event_loop_stat_t  *ngx_event_loop_stat;
+
+
+#endif /* _NGX_EVENT_STAT_H_INCLUDED_ */
@@ -10,9 +10,56 @@
 #include <ngx_event.h>
 
 
+/*
+ * 分层时间轮：4 层，每层 256 个槽位，第 0 层的刻度为 1 毫秒，
+ * 第 n 层的每个槽位覆盖 256^n 毫秒。
+ *
+ * 定时器节点仍然是 ev->timer，复用红黑树节点的字段：
+ * left/right 作为双向链表的前后指针，parent 指向所在链表的表头。
+ * 添加与删除都是 O(1)，到期的定时器按槽位成批处理，
+ * 高层槽位中的定时器在到达槽位起始时间时降级到低层。
+ */
+
+#define NGX_TIMER_WHEEL_LEVELS  4
+#define NGX_TIMER_WHEEL_BITS    8
+#define NGX_TIMER_WHEEL_SIZE    (1 << NGX_TIMER_WHEEL_BITS)
+#define NGX_TIMER_WHEEL_MASK    (NGX_TIMER_WHEEL_SIZE - 1)
+
+/* the longest distance the top level can hold, 255 * 2^24 */
+#define NGX_TIMER_WHEEL_MAX     (ngx_msec_t) 0xff000000
+
+
+typedef struct {
+    /* the next tick to be processed */
+    ngx_msec_t                now;
+    ngx_uint_t                count;
+
+    /* timers to be run right now */
+    ngx_rbtree_node_t         expired;
+
+    ngx_rbtree_node_t         slots[NGX_TIMER_WHEEL_LEVELS]
+                                   [NGX_TIMER_WHEEL_SIZE];
+    uint64_t                  bitmap[NGX_TIMER_WHEEL_LEVELS
+                                     * NGX_TIMER_WHEEL_SIZE / 64];
+} ngx_event_timer_wheel_t;
+
+
+static void ngx_event_wheel_insert(ngx_rbtree_node_t *node);
+static void ngx_event_wheel_unlink(ngx_rbtree_node_t *node);
+static ngx_uint_t ngx_event_wheel_next(ngx_uint_t level, ngx_uint_t slot,
+    ngx_uint_t range);
+static void ngx_event_wheel_cascade(ngx_uint_t level, ngx_uint_t slot);
+static ngx_msec_t ngx_event_wheel_find(void);
+static void ngx_event_wheel_expire(void);
+static ngx_int_t ngx_event_wheel_no_timers_left(void);
+
+
 ngx_rbtree_t              ngx_event_timer_rbtree;
 static ngx_rbtree_node_t  ngx_event_timer_sentinel;
 
+ngx_uint_t                ngx_event_timer_wheel;
+static ngx_event_timer_wheel_t  *ngx_event_wheel;
+
 /*
  * the event timer rbtree may contain the duplicate keys, however,
  * it should not be a problem, because we use the rbtree to find
@@ -29,10 +76,39 @@ static ngx_rbtree_node_t  ngx_event_timer_sentinel;
 ngx_int_t
 ngx_event_timer_init(ngx_log_t *log)
 {
+    ngx_uint_t                i, j;
+    ngx_rbtree_node_t        *head;
+    ngx_event_timer_wheel_t  *w;
+
     // 使用红黑树初始化事件计时器
     ngx_rbtree_init(&ngx_event_timer_rbtree, &ngx_event_timer_sentinel,
                     ngx_rbtree_insert_timer_value);
 
+    if (!ngx_event_timer_wheel || ngx_event_wheel) {
+        return NGX_OK;
+    }
+
+    // 使用时间轮时，每个槽位初始化为空的循环链表
+    w = ngx_calloc(sizeof(ngx_event_timer_wheel_t), log);
+    if (w == NULL) {
+        return NGX_ERROR;
+    }
+
+    w->now = ngx_current_msec;
+
+    w->expired.left = &w->expired;
+    w->expired.right = &w->expired;
+
+    for (i = 0; i < NGX_TIMER_WHEEL_LEVELS; i++) {
+        for (j = 0; j < NGX_TIMER_WHEEL_SIZE; j++) {
+            head = &w->slots[i][j];
+            head->left = head;
+            head->right = head;
+        }
+    }
+
+    ngx_event_wheel = w;
+
     return NGX_OK;
 }
 
@@ -44,6 +120,10 @@ ngx_event_find_timer(void)
     ngx_msec_int_t      timer;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        return ngx_event_wheel_find();
+    }
+
     if (ngx_event_timer_rbtree.root == &ngx_event_timer_sentinel) {
         return NGX_TIMER_INFINITE;
     }
@@ -65,6 +145,11 @@ ngx_event_expire_timers(void)
     ngx_event_t        *ev;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        ngx_event_wheel_expire();
+        return;
+    }
+
     sentinel = ngx_event_timer_rbtree.sentinel;
 
     for ( ;; ) {
@@ -100,7 +185,7 @@ ngx_event_expire_timers(void)
 
         ev->timedout = 1;
 
-        ev->handler(ev);
+        ngx_event_call_handler(ev);
     }
 }
 
@@ -111,6 +196,10 @@ ngx_event_no_timers_left(void)
     ngx_event_t        *ev;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        return ngx_event_wheel_no_timers_left();
+    }
+
     sentinel = ngx_event_timer_rbtree.sentinel;
     root = ngx_event_timer_rbtree.root;
 
@@ -133,3 +222,351 @@ ngx_event_no_timers_left(void)
 
     return NGX_OK;
 }
+
+
+void
+ngx_event_timer_wheel_add(ngx_event_t *ev)
+{
+    ngx_event_wheel_insert(&ev->timer);
+    ngx_event_wheel->count++;
+}
+
+
+void
+ngx_event_timer_wheel_del(ngx_event_t *ev)
+{
+    ngx_event_wheel_unlink(&ev->timer);
+    ngx_event_wheel->count--;
+}
+
+
+static void
+ngx_event_wheel_insert(ngx_rbtree_node_t *node)
+{
+    ngx_msec_t                key, diff;
+    ngx_uint_t                level, slot;
+    ngx_rbtree_node_t        *head;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+
+    if ((ngx_msec_int_t) (node->key - w->now) < 0) {
+        head = &w->expired;
+        goto link;
+    }
+
+    key = node->key;
+    diff = key - w->now;
+
+    if (diff > NGX_TIMER_WHEEL_MAX) {
+
+        /* park the timer in the farthest slot, it will be reinserted */
+
+        key = w->now + NGX_TIMER_WHEEL_MAX;
+        diff = NGX_TIMER_WHEEL_MAX;
+    }
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS - 1; level++) {
+        if (diff < ((ngx_msec_t) 1 << (NGX_TIMER_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+
+    slot = (key >> (NGX_TIMER_WHEEL_BITS * level)) & NGX_TIMER_WHEEL_MASK;
+
+    head = &w->slots[level][slot];
+
+    slot += level * NGX_TIMER_WHEEL_SIZE;
+    w->bitmap[slot / 64] |= (uint64_t) 1 << (slot % 64);
+
+link:
+
+    node->left = head->left;
+    node->right = head;
+    node->parent = head;
+
+    head->left->right = node;
+    head->left = node;
+}
+
+
+static void
+ngx_event_wheel_unlink(ngx_rbtree_node_t *node)
+{
+    ngx_uint_t                n;
+    ngx_rbtree_node_t        *head;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+    head = node->parent;
+
+    node->left->right = node->right;
+    node->right->left = node->left;
+
+    if (head->right == head && head != &w->expired) {
+        n = (ngx_rbtree_node_t *) head - (ngx_rbtree_node_t *) w->slots;
+        w->bitmap[n / 64] &= ~((uint64_t) 1 << (n % 64));
+    }
+}
+
+
+/*
+ * returns the distance from the slot to the next non-empty slot
+ * of the level, the search covers "range" slots and wraps around;
+ * "range" is returned if there is no such slot
+ */
+
+static ngx_uint_t
+ngx_event_wheel_next(ngx_uint_t level, ngx_uint_t slot, ngx_uint_t range)
+{
+    uint64_t    word;
+    ngx_uint_t  d, n, bit;
+
+    d = 0;
+
+    while (d < range) {
+        n = level * NGX_TIMER_WHEEL_SIZE + ((slot + d) & NGX_TIMER_WHEEL_MASK);
+        bit = n % 64;
+
+        word = ngx_event_wheel->bitmap[n / 64] >> bit;
+
+        if (word == 0) {
+            d += 64 - bit;
+            continue;
+        }
+
+        while (!(word & 1)) {
+            word >>= 1;
+            d++;
+        }
+
+        break;
+    }
+
+    return ngx_min(d, range);
+}
+
+
+static void
+ngx_event_wheel_cascade(ngx_uint_t level, ngx_uint_t slot)
+{
+    ngx_uint_t                n;
+    ngx_rbtree_node_t        *head, *node, *next;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+    head = &w->slots[level][slot];
+
+    if (head->right == head) {
+        return;
+    }
+
+    node = head->right;
+    head->left->right = NULL;
+
+    head->left = head;
+    head->right = head;
+
+    n = level * NGX_TIMER_WHEEL_SIZE + slot;
+    w->bitmap[n / 64] &= ~((uint64_t) 1 << (n % 64));
+
+    while (node) {
+        next = node->right;
+        ngx_event_wheel_insert(node);
+        node = next;
+    }
+}
+
+
+static ngx_msec_t
+ngx_event_wheel_find(void)
+{
+    ngx_msec_t                min, t, hi;
+    ngx_uint_t                level, shift, cur, start, d;
+    ngx_msec_int_t            timer;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+
+    if (w->count == 0) {
+        return NGX_TIMER_INFINITE;
+    }
+
+    if (w->expired.right != &w->expired) {
+        return 0;
+    }
+
+    /*
+     * the start time of the nearest non-empty slot is not later
+     * than any timer it holds, so the result is never late
+     */
+
+    min = NGX_TIMER_INFINITE;
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+        shift = NGX_TIMER_WHEEL_BITS * level;
+
+        hi = w->now >> shift;
+        cur = hi & NGX_TIMER_WHEEL_MASK;
+
+        /* the current slot of a higher level is already cascaded */
+
+        start = (level == 0
+                 || (w->now & (((ngx_msec_t) 1 << shift) - 1)) == 0)
+                ? 0 : 1;
+
+        d = ngx_event_wheel_next(level, cur + start, NGX_TIMER_WHEEL_SIZE);
+
+        if (d == NGX_TIMER_WHEEL_SIZE) {
+            continue;
+        }
+
+        t = ((hi + start + d) << shift) - w->now;
+
+        if (t < min) {
+            min = t;
+        }
+    }
+
+    if (min == NGX_TIMER_INFINITE) {
+        return NGX_TIMER_INFINITE;
+    }
+
+    timer = (ngx_msec_int_t) (w->now + min - ngx_current_msec);
+
+    return (ngx_msec_t) (timer > 0 ? timer : 0);
+}
+
+
+static void
+ngx_event_wheel_expire(void)
+{
+    ngx_uint_t                level, slot, d, left;
+    ngx_event_t              *ev;
+    ngx_rbtree_node_t        *head, *node;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+
+    for ( ;; ) {
+
+        while (w->expired.right != &w->expired) {
+            node = w->expired.right;
+
+            ev = ngx_rbtree_data(node, ngx_event_t, timer);
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "event timer del: %d: %M",
+                           ngx_event_ident(ev->data), ev->timer.key);
+
+            ngx_event_timer_wheel_del(ev);
+
+#if (NGX_DEBUG)
+            ev->timer.left = NULL;
+            ev->timer.right = NULL;
+            ev->timer.parent = NULL;
+#endif
+
+            ev->timer_set = 0;
+
+            ev->timedout = 1;
+
+            ngx_event_call_handler(ev);
+        }
+
+        if ((ngx_msec_int_t) (w->now - ngx_current_msec) > 0) {
+            return;
+        }
+
+        left = ngx_current_msec - w->now + 1;
+
+        if (w->count == 0) {
+            w->now += left;
+            continue;
+        }
+
+        slot = w->now & NGX_TIMER_WHEEL_MASK;
+
+        if (slot == 0) {
+            for (level = 1; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+                slot = (w->now >> (NGX_TIMER_WHEEL_BITS * level))
+                       & NGX_TIMER_WHEEL_MASK;
+
+                ngx_event_wheel_cascade(level, slot);
+
+                if (slot != 0) {
+                    break;
+                }
+            }
+
+            slot = 0;
+        }
+
+        /* skip empty ticks up to the next boundary */
+
+        d = ngx_event_wheel_next(0, slot,
+                                 ngx_min(left, NGX_TIMER_WHEEL_SIZE - slot));
+
+        if (d) {
+            w->now += d;
+            continue;
+        }
+
+        /* move the whole slot to the expired list */
+
+        head = &w->slots[0][slot];
+
+        for (node = head->right; node != head; node = node->right) {
+            node->parent = &w->expired;
+        }
+
+        if (head->right != head) {
+            head->right->left = w->expired.left;
+            head->left->right = &w->expired;
+            w->expired.left->right = head->right;
+            w->expired.left = head->left;
+
+            head->left = head;
+            head->right = head;
+
+            w->bitmap[slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+        }
+
+        w->now++;
+    }
+}
+
+
+static ngx_int_t
+ngx_event_wheel_no_timers_left(void)
+{
+    ngx_uint_t                i;
+    ngx_event_t              *ev;
+    ngx_rbtree_node_t        *head, *node;
+    ngx_event_timer_wheel_t  *w;
+
+    w = ngx_event_wheel;
+
+    if (w->count == 0) {
+        return NGX_OK;
+    }
+
+    for (i = 0; i <= NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SIZE; i++) {
+
+        head = (i == NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SIZE)
+               ? &w->expired
+               : &w->slots[i / NGX_TIMER_WHEEL_SIZE][i % NGX_TIMER_WHEEL_SIZE];
+
+        for (node = head->right; node != head; node = node->right) {
+            ev = ngx_rbtree_data(node, ngx_event_t, timer);
+
+            if (!ev->cancelable) {
+                return NGX_AGAIN;
+            }
+        }
+    }
+
+    /* only cancelable timers left */
+
+    return NGX_OK;
+}
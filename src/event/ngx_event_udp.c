@@ -19,6 +19,11 @@ struct ngx_udp_connection_s {
 };
 
 
+#if (NGX_HAVE_MMSG)
+static void ngx_event_recvmmsg(ngx_event_t *ev);
+#endif
+static ngx_int_t ngx_event_udp_datagram(ngx_event_t *ev, struct msghdr *msg,
+    u_char *buffer, ssize_t n);
 static void ngx_close_accepted_udp_connection(ngx_connection_t *c);
 static ssize_t ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf,
     size_t size);
@@ -32,18 +37,13 @@ void
 ngx_event_recvmsg(ngx_event_t *ev)
 {
     ssize_t            n;
-    ngx_buf_t          buf;
-    ngx_log_t         *log;
     ngx_err_t          err;
-    socklen_t          socklen, local_socklen;
-    ngx_event_t       *rev, *wev;
     struct iovec       iov[1];
     struct msghdr      msg;
-    ngx_sockaddr_t     sa, lsa;
-    struct sockaddr   *sockaddr, *local_sockaddr;
+    ngx_sockaddr_t     sa;
     ngx_listening_t   *ls;
     ngx_event_conf_t  *ecf;
-    ngx_connection_t  *c, *lc;
+    ngx_connection_t  *lc;
     static u_char      buffer[65535];
 
 #if (NGX_HAVE_ADDRINFO_CMSG)
@@ -71,6 +71,13 @@ ngx_event_recvmsg(ngx_event_t *ev)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "recvmsg on %V, ready: %d", &ls->addr_text, ev->available);
 
+#if (NGX_HAVE_MMSG)
+    if (ls->udp_batch > 1) {
+        ngx_event_recvmmsg(ev);
+        return;
+    }
+#endif
+
     do {
         ngx_memzero(&msg, sizeof(struct msghdr));
 
@@ -115,243 +122,387 @@ ngx_event_recvmsg(ngx_event_t *ev)
         }
 #endif
 
-        sockaddr = msg.msg_name;
-        socklen = msg.msg_namelen;
+        if (ngx_event_udp_datagram(ev, &msg, buffer, n) != NGX_OK) {
+            return;
+        }
 
-        if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
-            socklen = sizeof(ngx_sockaddr_t);
+        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+            ev->available -= n;
         }
 
-        if (socklen == 0) {
+    } while (ev->available);
+}
 
-            /*
-             * on Linux recvmsg() returns zero msg_namelen
-             * when receiving packets from unbound AF_UNIX sockets
-             */
 
-            socklen = sizeof(struct sockaddr);
-            ngx_memzero(&sa, sizeof(struct sockaddr));
-            sa.sockaddr.sa_family = ls->sockaddr->sa_family;
-        }
+#if (NGX_HAVE_MMSG)
 
-        local_sockaddr = ls->sockaddr;
-        local_socklen = ls->socklen;
+static void
+ngx_event_recvmmsg(ngx_event_t *ev)
+{
+    int                    i, n;
+    u_char                *p;
+    ngx_err_t              err;
+    ngx_uint_t             batch;
+    ngx_listening_t       *ls;
+    ngx_connection_t      *lc;
+    static u_char         *buffers;
+    static ngx_uint_t      nbuffers;
+    static struct iovec    iovs[NGX_UDP_BATCH_MAX];
+    static struct mmsghdr  msgs[NGX_UDP_BATCH_MAX];
+    static ngx_sockaddr_t  sas[NGX_UDP_BATCH_MAX];
 
 #if (NGX_HAVE_ADDRINFO_CMSG)
+    static u_char          msg_control[NGX_UDP_BATCH_MAX]
+                                      [CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#endif
 
-        if (ls->wildcard) {
-            struct cmsghdr  *cmsg;
+    lc = ev->data;
+    ls = lc->listening;
+    batch = ls->udp_batch;
 
-            ngx_memcpy(&lsa, local_sockaddr, local_socklen);
-            local_sockaddr = &lsa.sockaddr;
+    /*
+     * datagram buffers are shared by all listening sockets of a worker,
+     * and sized for the largest batch seen so far
+     */
 
-            for (cmsg = CMSG_FIRSTHDR(&msg);
-                 cmsg != NULL;
-                 cmsg = CMSG_NXTHDR(&msg, cmsg))
-            {
-                if (ngx_get_srcaddr_cmsg(cmsg, local_sockaddr) == NGX_OK) {
-                    break;
-                }
-            }
+    if (nbuffers < batch) {
+        p = ngx_alloc(batch * 65535, ev->log);
+        if (p == NULL) {
+            return;
         }
 
-#endif
+        if (buffers) {
+            ngx_free(buffers);
+        }
 
-        c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
-                                      local_socklen);
+        buffers = p;
+        nbuffers = batch;
+    }
 
-        if (c) {
+    do {
+        for (i = 0; i < (int) batch; i++) {
+            ngx_memzero(&msgs[i], sizeof(struct mmsghdr));
 
-#if (NGX_DEBUG)
-            if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
-                ngx_log_handler_pt  handler;
+            iovs[i].iov_base = (void *) (buffers + i * 65535);
+            iovs[i].iov_len = 65535;
 
-                handler = c->log->handler;
-                c->log->handler = NULL;
+            msgs[i].msg_hdr.msg_name = &sas[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(ngx_sockaddr_t);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
 
-                ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                               "recvmsg: fd:%d n:%z", c->fd, n);
+#if (NGX_HAVE_ADDRINFO_CMSG)
+            if (ls->wildcard) {
+                msgs[i].msg_hdr.msg_control = msg_control[i];
+                msgs[i].msg_hdr.msg_controllen = sizeof(msg_control[i]);
 
-                c->log->handler = handler;
+                ngx_memzero(msg_control[i], sizeof(msg_control[i]));
             }
 #endif
+        }
 
-            ngx_memzero(&buf, sizeof(ngx_buf_t));
+        n = recvmmsg(lc->fd, msgs, batch, 0, NULL);
 
-            buf.pos = buffer;
-            buf.last = buffer + n;
+        if (n == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EAGAIN) {
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                               "recvmmsg() not ready");
+                return;
+            }
 
-            rev = c->read;
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmmsg() failed");
 
-            c->udp->buffer = &buf;
+            return;
+        }
 
-            rev->ready = 1;
-            rev->active = 0;
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "recvmmsg: %d of %ui", n, batch);
 
-            rev->handler(rev);
+        for (i = 0; i < n; i++) {
 
-            if (c->udp) {
-                c->udp->buffer = NULL;
+#if (NGX_HAVE_ADDRINFO_CMSG)
+            if (msgs[i].msg_hdr.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
+                ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                              "recvmmsg() truncated data");
+                continue;
             }
+#endif
 
-            rev->ready = 0;
-            rev->active = 1;
+            if (ngx_event_udp_datagram(ev, &msgs[i].msg_hdr, iovs[i].iov_base,
+                                       msgs[i].msg_len)
+                != NGX_OK)
+            {
+                return;
+            }
 
-            goto next;
+            if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+                ev->available -= msgs[i].msg_len;
+            }
         }
 
-#if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
-#endif
-
-        ngx_accept_disabled = ngx_cycle->connection_n / 8
-                              - ngx_cycle->free_connection_n;
-
-        c = ngx_get_connection(lc->fd, ev->log);
-        if (c == NULL) {
+        if (n < (int) batch) {
+            /* the socket receive queue is drained */
             return;
         }
 
-        c->shared = 1;
-        c->type = SOCK_DGRAM;
-        c->socklen = socklen;
+    } while (ev->available);
+}
 
-#if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
 #endif
 
-        c->pool = ngx_create_pool(ls->pool_size, ev->log);
-        if (c->pool == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
 
-        c->sockaddr = ngx_palloc(c->pool, socklen);
-        if (c->sockaddr == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+static ngx_int_t
+ngx_event_udp_datagram(ngx_event_t *ev, struct msghdr *msg, u_char *buffer,
+    ssize_t n)
+{
+    ngx_buf_t          buf;
+    ngx_log_t         *log;
+    socklen_t          socklen, local_socklen;
+    ngx_event_t       *rev, *wev;
+    ngx_sockaddr_t     lsa;
+    struct sockaddr   *sockaddr, *local_sockaddr;
+    ngx_listening_t   *ls;
+    ngx_connection_t  *c, *lc;
 
-        ngx_memcpy(c->sockaddr, sockaddr, socklen);
+    lc = ev->data;
+    ls = lc->listening;
 
-        log = ngx_palloc(c->pool, sizeof(ngx_log_t));
-        if (log == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    sockaddr = msg->msg_name;
+    socklen = msg->msg_namelen;
+
+    if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
+        socklen = sizeof(ngx_sockaddr_t);
+    }
 
-        *log = ls->log;
+    if (socklen == 0) {
+
+        /*
+         * on Linux recvmsg() returns zero msg_namelen
+         * when receiving packets from unbound AF_UNIX sockets
+         */
 
-        c->recv = ngx_udp_shared_recv;
-        c->send = ngx_udp_send;
-        c->send_chain = ngx_udp_send_chain;
+        socklen = sizeof(struct sockaddr);
+        ngx_memzero(sockaddr, sizeof(struct sockaddr));
+        sockaddr->sa_family = ls->sockaddr->sa_family;
+    }
 
-        c->need_flush_buf = 1;
+    local_sockaddr = ls->sockaddr;
+    local_socklen = ls->socklen;
 
-        c->log = log;
-        c->pool->log = log;
-        c->listening = ls;
+#if (NGX_HAVE_ADDRINFO_CMSG)
 
-        if (local_sockaddr == &lsa.sockaddr) {
-            local_sockaddr = ngx_palloc(c->pool, local_socklen);
-            if (local_sockaddr == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    if (ls->wildcard) {
+        struct cmsghdr  *cmsg;
+
+        ngx_memcpy(&lsa, local_sockaddr, local_socklen);
+        local_sockaddr = &lsa.sockaddr;
 
-            ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+        for (cmsg = CMSG_FIRSTHDR(msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(msg, cmsg))
+        {
+            if (ngx_get_srcaddr_cmsg(cmsg, local_sockaddr) == NGX_OK) {
+                break;
+            }
         }
+    }
 
-        c->local_sockaddr = local_sockaddr;
-        c->local_socklen = local_socklen;
+#endif
 
-        c->buffer = ngx_create_temp_buf(c->pool, n);
-        if (c->buffer == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
+    c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
+                                  local_socklen);
+
+    if (c) {
+
+#if (NGX_DEBUG)
+        if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
+            ngx_log_handler_pt  handler;
+
+            handler = c->log->handler;
+            c->log->handler = NULL;
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "recvmsg: fd:%d n:%z", c->fd, n);
+
+            c->log->handler = handler;
         }
+#endif
+
+        ngx_memzero(&buf, sizeof(ngx_buf_t));
 
-        c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
+        buf.pos = buffer;
+        buf.last = buffer + n;
 
         rev = c->read;
-        wev = c->write;
 
+        c->udp->buffer = &buf;
+
+        rev->ready = 1;
+        rev->active = 0;
+
+        rev->handler(rev);
+
+        if (c->udp) {
+            c->udp->buffer = NULL;
+        }
+
+        rev->ready = 0;
         rev->active = 1;
-        wev->ready = 1;
 
-        rev->log = log;
-        wev->log = log;
+        return NGX_OK;
+    }
 
-        /*
-         * TODO: MT: - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         *
-         * TODO: MP: - allocated in a shared memory
-         *           - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         */
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
+#endif
 
-        c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    ngx_accept_disabled = ngx_cycle->connection_n / 8
+                          - ngx_cycle->free_connection_n;
 
-        c->start_time = ngx_current_msec;
+    c = ngx_get_connection(lc->fd, ev->log);
+    if (c == NULL) {
+        return NGX_ERROR;
+    }
+
+    c->shared = 1;
+    c->type = SOCK_DGRAM;
+    c->socklen = socklen;
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
 #endif
 
-        if (ls->addr_ntop) {
-            c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
-            if (c->addr_text.data == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    c->pool = ngx_create_pool(ls->pool_size, ev->log);
+    if (c->pool == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-            c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
-                                             c->addr_text.data,
-                                             ls->addr_text_max_len, 0);
-            if (c->addr_text.len == 0) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
-        }
+    c->sockaddr = ngx_palloc(c->pool, socklen);
+    if (c->sockaddr == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-#if (NGX_DEBUG)
-        {
-        ngx_str_t  addr;
-        u_char     text[NGX_SOCKADDR_STRLEN];
+    ngx_memcpy(c->sockaddr, sockaddr, socklen);
 
-        ngx_debug_accepted_connection(ecf, c);
+    log = ngx_palloc(c->pool, sizeof(ngx_log_t));
+    if (log == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        if (log->log_level & NGX_LOG_DEBUG_EVENT) {
-            addr.data = text;
-            addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
-                                     NGX_SOCKADDR_STRLEN, 1);
+    *log = ls->log;
 
-            ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
-                           "*%uA recvmsg: %V fd:%d n:%z",
-                           c->number, &addr, c->fd, n);
-        }
+    c->recv = ngx_udp_shared_recv;
+    c->send = ngx_udp_send;
+    c->send_chain = ngx_udp_send_chain;
+
+    c->need_flush_buf = 1;
+
+    c->log = log;
+    c->pool->log = log;
+    c->listening = ls;
 
+    if (local_sockaddr == &lsa.sockaddr) {
+        local_sockaddr = ngx_palloc(c->pool, local_socklen);
+        if (local_sockaddr == NULL) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
+
+        ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+    }
+
+    c->local_sockaddr = local_sockaddr;
+    c->local_socklen = local_socklen;
+
+    c->buffer = ngx_create_temp_buf(c->pool, n);
+    if (c->buffer == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
+
+    c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
+
+    rev = c->read;
+    wev = c->write;
+
+    rev->active = 1;
+    wev->ready = 1;
+
+    rev->log = log;
+    wev->log = log;
+
+    /*
+     * TODO: MT: - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     *
+     * TODO: MP: - allocated in a shared memory
+     *           - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     */
+
+    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+
+    c->start_time = ngx_current_msec;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
 #endif
 
-        if (ngx_insert_udp_connection(c) != NGX_OK) {
+    if (ls->addr_ntop) {
+        c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
+        if (c->addr_text.data == NULL) {
             ngx_close_accepted_udp_connection(c);
-            return;
+            return NGX_ERROR;
+        }
+
+        c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
+                                         c->addr_text.data,
+                                         ls->addr_text_max_len, 0);
+        if (c->addr_text.len == 0) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
+    }
 
-        log->data = NULL;
-        log->handler = NULL;
+#if (NGX_DEBUG)
+    {
+    ngx_str_t          addr;
+    u_char             text[NGX_SOCKADDR_STRLEN];
+    ngx_event_conf_t  *ecf;
 
-        ls->handler(c);
+    ecf = ngx_event_get_conf(ngx_cycle->conf_ctx, ngx_event_core_module);
 
-    next:
+    ngx_debug_accepted_connection(ecf, c);
 
-        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
-            ev->available -= n;
-        }
+    if (log->log_level & NGX_LOG_DEBUG_EVENT) {
+        addr.data = text;
+        addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
+                                 NGX_SOCKADDR_STRLEN, 1);
 
-    } while (ev->available);
+        ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "*%uA recvmsg: %V fd:%d n:%z",
+                       c->number, &addr, c->fd, n);
+    }
+
+    }
+#endif
+
+    if (ngx_insert_udp_connection(c) != NGX_OK) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
+
+    log->data = NULL;
+    log->handler = NULL;
+
+    ls->handler(c);
+
+    return NGX_OK;
 }
 
 
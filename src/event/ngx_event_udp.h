@@ -14,6 +14,10 @@
 
 #if !(NGX_WIN32)
 
+/* the maximum number of datagrams in recvmmsg() and sendmmsg() batches */
+#define NGX_UDP_BATCH_MAX       64
+
+
 #if ((NGX_HAVE_MSGHDR_MSG_CONTROL)                                            \
      && (NGX_HAVE_IP_SENDSRCADDR || NGX_HAVE_IP_RECVDSTADDR                   \
          || NGX_HAVE_IP_PKTINFO                                               \
@@ -124,6 +124,7 @@ ngx_http_addition_header_filter(ngx_http_request_t *r)
     ngx_http_weak_etag(r);
 
     r->preserve_body = 1;
+    r->filter_identity = 0;
 
     return ngx_http_next_header_filter(r);
 }
@@ -531,6 +531,7 @@ ngx_http_charset_ctx(ngx_http_request_t *r, ngx_http_charset_t *charsets,
     ctx->to_utf8 = charsets[charset].utf8;
 
     r->filter_need_in_memory = 1;
+    r->filter_identity = 0;
 
     if ((ctx->to_utf8 || ctx->from_utf8) && r == r->main) {
         ngx_http_clear_content_length(r);
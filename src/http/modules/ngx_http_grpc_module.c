@@ -10,14 +10,6 @@
 #include <ngx_http.h>
 
 
-typedef struct {
-    ngx_array_t               *flushes;
-    ngx_array_t               *lengths;
-    ngx_array_t               *values;
-    ngx_hash_t                 hash;
-} ngx_http_grpc_headers_t;
-
-
 typedef struct {
     ngx_http_upstream_conf_t   upstream;
 
@@ -57,6 +49,13 @@ typedef enum {
 } ngx_http_grpc_state_e;
 
 
+#if (NGX_HTTP_UPSTREAM_MULTIPLEX)
+
+/* 与多路复用的上游连接共享同一连接级状态 */
+typedef ngx_http_upstream_multiplex_conn_t  ngx_http_grpc_conn_t;
+
+#else
+
 typedef struct {
     size_t                     init_window;
     size_t                     send_window;
@@ -64,6 +63,8 @@ typedef struct {
     ngx_uint_t                 last_stream_id;
 } ngx_http_grpc_conn_t;
 
+#endif
+
 
 typedef struct {
     ngx_http_grpc_state_e      state;
@@ -122,10 +123,14 @@ typedef struct {
     unsigned                   status:1;
     unsigned                   rst:1;
     unsigned                   goaway:1;
+    unsigned                   multiplexed:1;
+    unsigned                   host_set:1;
 
     ngx_http_request_t        *request;
 
     ngx_str_t                  host;
+    ngx_str_t                  uri;
+    ngx_http_grpc_headers_t   *headers;
 } ngx_http_grpc_ctx_t;
 
 
@@ -142,8 +147,8 @@ typedef struct {
 } ngx_http_grpc_frame_t;
 
 
-static ngx_int_t ngx_http_grpc_eval(ngx_http_request_t *r,
-    ngx_http_grpc_ctx_t *ctx, ngx_http_grpc_loc_conf_t *glcf);
+static ngx_int_t ngx_http_grpc_eval(ngx_http_request_t *r, ngx_str_t *host,
+    ngx_http_grpc_loc_conf_t *glcf);
 static ngx_int_t ngx_http_grpc_create_request(ngx_http_request_t *r);
 static ngx_int_t ngx_http_grpc_reinit_request(ngx_http_request_t *r);
 static ngx_int_t ngx_http_grpc_body_output_filter(void *data, ngx_chain_t *in);
@@ -539,29 +544,20 @@ static ngx_int_t
 ngx_http_grpc_handler(ngx_http_request_t *r)
 {
     ngx_int_t                  rc;
+    ngx_str_t                  host;
     ngx_http_upstream_t       *u;
-    ngx_http_grpc_ctx_t       *ctx;
     ngx_http_grpc_loc_conf_t  *glcf;
 
     if (ngx_http_upstream_create(r) != NGX_OK) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_grpc_ctx_t));
-    if (ctx == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
-    }
-
-    ctx->request = r;
-
-    ngx_http_set_ctx(r, ctx, ngx_http_grpc_module);
-
     glcf = ngx_http_get_module_loc_conf(r, ngx_http_grpc_module);
 
     u = r->upstream;
 
     if (glcf->grpc_lengths == NULL) {
-        ctx->host = glcf->host;
+        host = glcf->host;
 
 #if (NGX_HTTP_SSL)
         u->ssl = glcf->ssl;
@@ -577,7 +573,7 @@ ngx_http_grpc_handler(ngx_http_request_t *r)
 #endif
 
     } else {
-        if (ngx_http_grpc_eval(r, ctx, glcf) != NGX_OK) {
+        if (ngx_http_grpc_eval(r, &host, glcf) != NGX_OK) {
             return NGX_HTTP_INTERNAL_SERVER_ERROR;
         }
     }
@@ -586,6 +582,50 @@ ngx_http_grpc_handler(ngx_http_request_t *r)
 
     u->conf = &glcf->upstream;
 
+    if (ngx_http_grpc_init_upstream(r, &host, NULL, &glcf->headers,
+                                    glcf->host_set)
+        != NGX_OK)
+    {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    rc = ngx_http_read_client_request_body(r, ngx_http_upstream_init);
+
+    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+        return rc;
+    }
+
+    return NGX_DONE;
+}
+
+
+ngx_int_t
+ngx_http_grpc_init_upstream(ngx_http_request_t *r, ngx_str_t *host,
+    ngx_str_t *uri, ngx_http_grpc_headers_t *headers, ngx_uint_t host_set)
+{
+    ngx_http_upstream_t  *u;
+    ngx_http_grpc_ctx_t  *ctx;
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_grpc_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->request = r;
+    ctx->host = *host;
+    ctx->headers = headers;
+    ctx->host_set = host_set;
+
+    if (uri) {
+        ctx->uri = *uri;
+    }
+
+    ngx_http_set_ctx(r, ctx, ngx_http_grpc_module);
+
+    u = r->upstream;
+
+    u->multiplex = 1;
+
     u->create_request = ngx_http_grpc_create_request;
     u->reinit_request = ngx_http_grpc_reinit_request;
     u->process_header = ngx_http_grpc_process_header;
@@ -598,18 +638,12 @@ ngx_http_grpc_handler(ngx_http_request_t *r)
 
     r->request_body_no_buffering = 1;
 
-    rc = ngx_http_read_client_request_body(r, ngx_http_upstream_init);
-
-    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
-        return rc;
-    }
-
-    return NGX_DONE;
+    return NGX_OK;
 }
 
 
 static ngx_int_t
-ngx_http_grpc_eval(ngx_http_request_t *r, ngx_http_grpc_ctx_t *ctx,
+ngx_http_grpc_eval(ngx_http_request_t *r, ngx_str_t *host,
     ngx_http_grpc_loc_conf_t *glcf)
 {
     size_t                add;
@@ -690,15 +724,15 @@ ngx_http_grpc_eval(ngx_http_request_t *r, ngx_http_grpc_ctx_t *ctx,
     if (url.family != AF_UNIX) {
 
         if (url.no_port) {
-            ctx->host = url.host;
+            *host = url.host;
 
         } else {
-            ctx->host.len = url.host.len + 1 + url.port_text.len;
-            ctx->host.data = url.host.data;
+            host->len = url.host.len + 1 + url.port_text.len;
+            host->data = url.host.data;
         }
 
     } else {
-        ngx_str_set(&ctx->host, "localhost");
+        ngx_str_set(host, "localhost");
     }
 
     return NGX_OK;
@@ -720,16 +754,16 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
     ngx_http_upstream_t          *u;
     ngx_http_grpc_frame_t        *f;
     ngx_http_script_code_pt       code;
-    ngx_http_grpc_loc_conf_t     *glcf;
+    ngx_http_grpc_headers_t      *headers;
     ngx_http_script_engine_t      e, le;
     ngx_http_script_len_code_pt   lcode;
 
     u = r->upstream;
 
-    glcf = ngx_http_get_module_loc_conf(r, ngx_http_grpc_module);
-
     ctx = ngx_http_get_module_ctx(r, ngx_http_grpc_module);
 
+    headers = ctx->headers;
+
     len = sizeof(ngx_http_grpc_connection_start) - 1
           + sizeof(ngx_http_grpc_frame_t);             /* headers frame */
 
@@ -750,7 +784,11 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     /* :path header */
 
-    if (r->valid_unparsed_uri) {
+    if (ctx->uri.len) {
+        escape = 0;
+        uri_len = ctx->uri.len;
+
+    } else if (r->valid_unparsed_uri) {
         escape = 0;
         uri_len = r->unparsed_uri.len;
 
@@ -768,7 +806,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     /* :authority header */
 
-    if (!glcf->host_set) {
+    if (!ctx->host_set) {
         len += 1 + NGX_HTTP_V2_INT_OCTETS + ctx->host.len;
 
         if (tmp_len < ctx->host.len) {
@@ -778,10 +816,10 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     /* other headers */
 
-    ngx_http_script_flush_no_cacheable_variables(r, glcf->headers.flushes);
+    ngx_http_script_flush_no_cacheable_variables(r, headers->flushes);
     ngx_memzero(&le, sizeof(ngx_http_script_engine_t));
 
-    le.ip = glcf->headers.lengths->elts;
+    le.ip = headers->lengths->elts;
     le.request = r;
     le.flushed = 1;
 
@@ -811,7 +849,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
         }
     }
 
-    if (glcf->upstream.pass_request_headers) {
+    if (u->conf->pass_request_headers) {
         part = &r->headers_in.headers.part;
         header = part->elts;
 
@@ -827,7 +865,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
                 i = 0;
             }
 
-            if (ngx_hash_find(&glcf->headers.hash, header[i].hash,
+            if (ngx_hash_find(&headers->hash, header[i].hash,
                               header[i].lowcase_key, header[i].key.len))
             {
                 continue;
@@ -931,7 +969,21 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
                        "grpc header: \":scheme: http\"");
     }
 
-    if (r->valid_unparsed_uri) {
+    if (ctx->uri.len) {
+
+        if (ctx->uri.len == 1 && ctx->uri.data[0] == '/') {
+            *b->last++ = ngx_http_v2_indexed(NGX_HTTP_V2_PATH_ROOT_INDEX);
+
+        } else {
+            *b->last++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_PATH_INDEX);
+            b->last = ngx_http_v2_write_value(b->last, ctx->uri.data,
+                                              ctx->uri.len, tmp);
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "grpc header: \":path: %V\"", &ctx->uri);
+
+    } else if (r->valid_unparsed_uri) {
 
         if (r->unparsed_uri.len == 1 && r->unparsed_uri.data[0] == '/') {
             *b->last++ = ngx_http_v2_indexed(NGX_HTTP_V2_PATH_ROOT_INDEX);
@@ -976,7 +1028,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
                        "grpc header: \":path: %V\"", &r->uri);
     }
 
-    if (!glcf->host_set) {
+    if (!ctx->host_set) {
         *b->last++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_AUTHORITY_INDEX);
         b->last = ngx_http_v2_write_value(b->last, ctx->host.data,
                                           ctx->host.len, tmp);
@@ -987,11 +1039,11 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 
     ngx_memzero(&e, sizeof(ngx_http_script_engine_t));
 
-    e.ip = glcf->headers.values->elts;
+    e.ip = headers->values->elts;
     e.request = r;
     e.flushed = 1;
 
-    le.ip = glcf->headers.lengths->elts;
+    le.ip = headers->lengths->elts;
 
     while (*(uintptr_t *) le.ip) {
 
@@ -1047,7 +1099,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
 #endif
     }
 
-    if (glcf->upstream.pass_request_headers) {
+    if (u->conf->pass_request_headers) {
         part = &r->headers_in.headers.part;
         header = part->elts;
 
@@ -1063,7 +1115,7 @@ ngx_http_grpc_create_request(ngx_http_request_t *r)
                 i = 0;
             }
 
-            if (ngx_hash_find(&glcf->headers.hash, header[i].hash,
+            if (ngx_hash_find(&headers->hash, header[i].hash,
                               header[i].lowcase_key, header[i].key.len))
             {
                 continue;
@@ -1214,6 +1266,7 @@ ngx_http_grpc_reinit_request(ngx_http_request_t *r)
     ctx->status = 0;
     ctx->rst = 0;
     ctx->goaway = 0;
+    ctx->multiplexed = 0;
     ctx->connection = NULL;
 
     return NGX_OK;
@@ -1262,28 +1315,29 @@ ngx_http_grpc_body_output_filter(void *data, ngx_chain_t *in)
 
         ctx->header_sent = 1;
 
-        if (ctx->id != 1) {
-            /*
-             * keepalive connection: skip connection preface,
-             * update stream identifiers
-             */
+        b = ctx->in->buf;
+        p = b->pos + sizeof(ngx_http_grpc_connection_start) - 1;
 
-            b = ctx->in->buf;
-            b->pos += sizeof(ngx_http_grpc_connection_start) - 1;
+        if (ctx->id != 1 || ctx->multiplexed) {
+            /* keepalive or multiplexed connection: skip connection preface */
+            b->pos = p;
+        }
 
-            p = b->pos;
+        /*
+         * update stream identifiers: a request retried on a new connection
+         * still has the identifiers of its previous stream
+         */
 
-            while (p < b->last) {
-                f = (ngx_http_grpc_frame_t *) p;
-                p += sizeof(ngx_http_grpc_frame_t);
+        while (p < b->last) {
+            f = (ngx_http_grpc_frame_t *) p;
+            p += sizeof(ngx_http_grpc_frame_t);
 
-                f->stream_id_0 = (u_char) ((ctx->id >> 24) & 0xff);
-                f->stream_id_1 = (u_char) ((ctx->id >> 16) & 0xff);
-                f->stream_id_2 = (u_char) ((ctx->id >> 8) & 0xff);
-                f->stream_id_3 = (u_char) (ctx->id & 0xff);
+            f->stream_id_0 = (u_char) ((ctx->id >> 24) & 0xff);
+            f->stream_id_1 = (u_char) ((ctx->id >> 16) & 0xff);
+            f->stream_id_2 = (u_char) ((ctx->id >> 8) & 0xff);
+            f->stream_id_3 = (u_char) (ctx->id & 0xff);
 
-                p += (f->length_0 << 16) + (f->length_1 << 8) + f->length_2;
-            }
+            p += (f->length_0 << 16) + (f->length_1 << 8) + f->length_2;
         }
 
         if (ctx->in->buf->last_buf) {
@@ -1570,6 +1624,7 @@ ngx_http_grpc_body_output_filter(void *data, ngx_chain_t *in)
             && ctx->output_closed
             && !ctx->output_blocked
             && !ctx->goaway
+            && !ctx->multiplexed
             && ctx->state == ngx_http_grpc_st_start)
         {
             u->keepalive = 1;
@@ -1919,6 +1974,7 @@ ngx_http_grpc_process_header(ngx_http_request_t *r)
                         && ctx->output_closed
                         && !ctx->output_blocked
                         && !ctx->goaway
+                        && !ctx->multiplexed
                         && b->last == b->pos)
                     {
                         u->keepalive = 1;
@@ -2048,6 +2104,7 @@ ngx_http_grpc_filter(void *data, ssize_t bytes)
                         && ctx->output_closed
                         && !ctx->output_blocked
                         && !ctx->goaway
+                        && !ctx->multiplexed
                         && ctx->state == ngx_http_grpc_st_start)
                     {
                         u->keepalive = 1;
@@ -2074,7 +2131,12 @@ ngx_http_grpc_filter(void *data, ssize_t bytes)
                 return NGX_ERROR;
             }
 
-            if (ctx->type == NGX_HTTP_V2_DATA_FRAME) {
+            if (ctx->type == NGX_HTTP_V2_DATA_FRAME && !ctx->multiplexed) {
+
+                /*
+                 * on multiplexed connections flow control of received
+                 * data is done by the upstream multiplex module
+                 */
 
                 if (ctx->stream_id != ctx->id) {
                     ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
@@ -4199,6 +4261,28 @@ ngx_http_grpc_get_connection_data(ngx_http_request_t *r,
 
     c = pc->connection;
 
+#if (NGX_HTTP_UPSTREAM_MULTIPLEX)
+
+    switch (ngx_http_upstream_multiplex_open_stream(c, &ctx->connection,
+                                                    &ctx->id))
+    {
+    case NGX_OK:
+        ctx->multiplexed = 1;
+        ctx->send_window = ctx->connection->init_window;
+        ctx->recv_window = NGX_HTTP_V2_MAX_WINDOW;
+        return NGX_OK;
+
+    case NGX_DECLINED:
+        break;
+
+    default: /* NGX_ERROR */
+        ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                      "multiplexed http2 connection is closed");
+        return NGX_ERROR;
+    }
+
+#endif
+
     if (pc->cached) {
 
         /*
@@ -0,0 +1,33 @@
+
+/*
+ * Copyright (C) Maxim Dounin
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HTTP_GRPC_H_INCLUDED_
+#define _NGX_HTTP_GRPC_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct {
+    ngx_array_t               *flushes;
+    ngx_array_t               *lengths;
+    ngx_array_t               *values;
+    ngx_hash_t                 hash;
+} ngx_http_grpc_headers_t;
+
+
+/*
+ * 让请求经HTTP/2转发到上游：u->conf、u->schema及u->ssl由调用者设置；
+ * uri为NULL时:path取自请求行，host_set时不发送:authority
+ */
+ngx_int_t ngx_http_grpc_init_upstream(ngx_http_request_t *r, ngx_str_t *host,
+    ngx_str_t *uri, ngx_http_grpc_headers_t *headers, ngx_uint_t host_set);
+
+
+#endif /* _NGX_HTTP_GRPC_H_INCLUDED_ */
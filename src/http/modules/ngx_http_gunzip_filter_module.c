@@ -159,6 +159,7 @@ ngx_http_gunzip_header_filter(ngx_http_request_t *r)
     ctx->request = r;
 
     r->filter_need_in_memory = 1;
+    r->filter_identity = 0;
 
     r->headers_out.content_encoding->hash = 0;
     r->headers_out.content_encoding = NULL;
@@ -287,6 +287,7 @@ ngx_http_gzip_header_filter(ngx_http_request_t *r)
     r->headers_out.content_encoding = h;
 
     r->main_filter_need_in_memory = 1;
+    r->filter_identity = 0;
 
     ngx_http_clear_content_length(r);
     ngx_http_clear_accept_ranges(r);
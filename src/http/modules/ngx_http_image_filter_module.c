@@ -282,6 +282,7 @@ ngx_http_image_header_filter(ngx_http_request_t *r)
     }
 
     r->main_filter_need_in_memory = 1;
+    r->filter_identity = 0;
     r->allow_ranges = 0;
 
     return NGX_OK;
@@ -44,6 +44,10 @@ static int ngx_libc_cdecl ngx_http_map_cmp_dns_wildcards(const void *one,
 static void *ngx_http_map_create_conf(ngx_conf_t *cf);
 static char *ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf);
+#if (NGX_PCRE)
+static ngx_int_t ngx_http_map_regex_set(ngx_conf_t *cf, ngx_pool_t *pool,
+    ngx_http_map_t *map);
+#endif
 
 
 static ngx_command_t  ngx_http_map_commands[] = {
@@ -355,6 +359,11 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     if (ctx.regexes.nelts) {
         map->map.regex = ctx.regexes.elts;
         map->map.nregex = ctx.regexes.nelts;
+
+        if (ngx_http_map_regex_set(cf, pool, &map->map) != NGX_OK) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
     }
 
 #endif
@@ -365,6 +374,44 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+#if (NGX_PCRE)
+
+static ngx_int_t
+ngx_http_map_regex_set(ngx_conf_t *cf, ngx_pool_t *pool, ngx_http_map_t *map)
+{
+    ngx_str_t   *literals;
+    ngx_uint_t   i, n;
+
+    literals = ngx_palloc(pool, map->nregex * sizeof(ngx_str_t));
+    if (literals == NULL) {
+        return NGX_ERROR;
+    }
+
+    n = 0;
+
+    for (i = 0; i < map->nregex; i++) {
+        literals[i] = map->regex[i].regex->literal;
+
+        if (literals[i].len) {
+            n++;
+        }
+    }
+
+    if (n < NGX_REGEX_SET_MIN) {
+        return NGX_OK;
+    }
+
+    map->regex_set = ngx_regex_set_create(cf->pool, literals, map->nregex);
+    if (map->regex_set == NULL) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static int ngx_libc_cdecl
 ngx_http_map_cmp_dns_wildcards(const void *one, const void *two)
 {
@@ -70,6 +70,12 @@ typedef struct {
 } ngx_http_proxy_vars_t;
 
 
+#if (NGX_HTTP_GRPC)
+
+typedef ngx_http_grpc_headers_t  ngx_http_proxy_headers_t;
+
+#else
+
 typedef struct {
     ngx_array_t                   *flushes;
     ngx_array_t                   *lengths;
@@ -77,6 +83,8 @@ typedef struct {
     ngx_hash_t                     hash;
 } ngx_http_proxy_headers_t;
 
+#endif
+
 
 typedef struct {
     ngx_http_upstream_conf_t       upstream;
@@ -89,6 +97,10 @@ typedef struct {
     ngx_http_proxy_headers_t       headers;
 #if (NGX_HTTP_CACHE)
     ngx_http_proxy_headers_t       headers_cache;
+#endif
+#if (NGX_HTTP_GRPC)
+    ngx_http_proxy_headers_t       headers_v2;
+    ngx_uint_t                     host_set;
 #endif
     ngx_array_t                   *headers_source;
 
@@ -150,6 +162,10 @@ static ngx_int_t ngx_http_proxy_eval(ngx_http_request_t *r,
 static ngx_int_t ngx_http_proxy_create_key(ngx_http_request_t *r);
 #endif
 static ngx_int_t ngx_http_proxy_create_request(ngx_http_request_t *r);
+#if (NGX_HTTP_GRPC)
+static ngx_int_t ngx_http_proxy_v2_init(ngx_http_request_t *r,
+    ngx_http_proxy_ctx_t *ctx, ngx_http_proxy_loc_conf_t *plcf);
+#endif
 static ngx_int_t ngx_http_proxy_reinit_request(ngx_http_request_t *r);
 static ngx_int_t ngx_http_proxy_body_output_filter(void *data, ngx_chain_t *in);
 static ngx_int_t ngx_http_proxy_process_status_line(ngx_http_request_t *r);
@@ -199,6 +215,10 @@ static void *ngx_http_proxy_create_main_conf(ngx_conf_t *cf);
 static void *ngx_http_proxy_create_loc_conf(ngx_conf_t *cf);
 static char *ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf,
     void *parent, void *child);
+#if (NGX_HTTP_GRPC)
+static ngx_int_t ngx_http_proxy_merge_v2(ngx_conf_t *cf,
+    ngx_http_proxy_loc_conf_t *conf);
+#endif
 static ngx_int_t ngx_http_proxy_init_headers(ngx_conf_t *cf,
     ngx_http_proxy_loc_conf_t *conf, ngx_http_proxy_headers_t *headers,
     ngx_keyval_t *default_headers);
@@ -287,6 +307,9 @@ static ngx_conf_post_t  ngx_http_proxy_ssl_conf_command_post =
 static ngx_conf_enum_t  ngx_http_proxy_http_version[] = {
     { ngx_string("1.0"), NGX_HTTP_VERSION_10 },
     { ngx_string("1.1"), NGX_HTTP_VERSION_11 },
+#if (NGX_HTTP_GRPC)
+    { ngx_string("2"), NGX_HTTP_VERSION_20 },
+#endif
     { ngx_null_string, 0 }
 };
 
@@ -380,6 +403,13 @@ static ngx_command_t  ngx_http_proxy_commands[] = {
       offsetof(ngx_http_proxy_loc_conf_t, upstream.socket_keepalive),
       NULL },
 
+    { ngx_string("proxy_splice"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_proxy_loc_conf_t, upstream.splice),
+      NULL },
+
     { ngx_string("proxy_connect_timeout"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_msec_slot,
@@ -869,6 +899,24 @@ static ngx_keyval_t  ngx_http_proxy_cache_headers[] = {
 #endif
 
 
+#if (NGX_HTTP_GRPC)
+
+static ngx_keyval_t  ngx_http_proxy_v2_headers[] = {
+    { ngx_string("Host"), ngx_string("") },
+    { ngx_string("Content-Length"), ngx_string("$content_length") },
+    { ngx_string("Connection"), ngx_string("") },
+    { ngx_string("Transfer-Encoding"), ngx_string("") },
+    { ngx_string("TE"), ngx_string("") },
+    { ngx_string("Keep-Alive"), ngx_string("") },
+    { ngx_string("Proxy-Connection"), ngx_string("") },
+    { ngx_string("Expect"), ngx_string("") },
+    { ngx_string("Upgrade"), ngx_string("") },
+    { ngx_null_string, ngx_null_string }
+};
+
+#endif
+
+
 static ngx_http_variable_t  ngx_http_proxy_vars[] = {
 
     { ngx_string("proxy_host"), NULL, ngx_http_proxy_host_variable, 0,
@@ -996,6 +1044,27 @@ ngx_http_proxy_handler(ngx_http_request_t *r)
         u->rewrite_cookie = ngx_http_proxy_rewrite_cookie;
     }
 
+    u->accel = 1;
+
+#if (NGX_HTTP_GRPC)
+
+    if (plcf->http_version == NGX_HTTP_VERSION_20) {
+
+        if (ngx_http_proxy_v2_init(r, ctx, plcf) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        rc = ngx_http_read_client_request_body(r, ngx_http_upstream_init);
+
+        if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+            return rc;
+        }
+
+        return NGX_DONE;
+    }
+
+#endif
+
     u->buffering = plcf->upstream.buffering;
 
     u->pipe = ngx_pcalloc(r->pool, sizeof(ngx_event_pipe_t));
@@ -1010,8 +1079,6 @@ ngx_http_proxy_handler(ngx_http_request_t *r)
     u->input_filter = ngx_http_proxy_non_buffered_copy_filter;
     u->input_filter_ctx = r;
 
-    u->accel = 1;
-
     if (!plcf->upstream.request_buffering
         && plcf->body_values == NULL && plcf->upstream.pass_request_body
         && (!r->headers_in.chunked
@@ -1605,6 +1672,95 @@ ngx_http_proxy_create_request(ngx_http_request_t *r)
 }
 
 
+#if (NGX_HTTP_GRPC)
+
+static ngx_int_t
+ngx_http_proxy_v2_init(ngx_http_request_t *r, ngx_http_proxy_ctx_t *ctx,
+    ngx_http_proxy_loc_conf_t *plcf)
+{
+    u_char               *p;
+    size_t                len, loc_len;
+    uintptr_t             escape;
+    ngx_http_upstream_t  *u;
+
+    /*
+     * HTTP/2 framing and response parsing are done by the grpc module,
+     * the request line is replaced by the :path pseudo-header
+     */
+
+    u = r->upstream;
+
+    if (plcf->proxy_lengths && ctx->vars.uri.len) {
+        u->uri = ctx->vars.uri;
+
+    } else if (ctx->vars.uri.len == 0 && r->valid_unparsed_uri) {
+        u->uri = r->unparsed_uri;
+
+    } else {
+        loc_len = (r->valid_location && ctx->vars.uri.len) ?
+                      plcf->location.len : 0;
+
+        if (r->quoted_uri || r->internal) {
+            escape = 2 * ngx_escape_uri(NULL, r->uri.data + loc_len,
+                                        r->uri.len - loc_len, NGX_ESCAPE_URI);
+        } else {
+            escape = 0;
+        }
+
+        len = ctx->vars.uri.len + r->uri.len - loc_len + escape
+              + sizeof("?") - 1 + r->args.len;
+
+        p = ngx_pnalloc(r->pool, len);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        u->uri.data = p;
+
+        if (r->valid_location) {
+            p = ngx_copy(p, ctx->vars.uri.data, ctx->vars.uri.len);
+        }
+
+        if (escape) {
+            ngx_escape_uri(p, r->uri.data + loc_len,
+                           r->uri.len - loc_len, NGX_ESCAPE_URI);
+            p += r->uri.len - loc_len + escape;
+
+        } else {
+            p = ngx_copy(p, r->uri.data + loc_len, r->uri.len - loc_len);
+        }
+
+        if (r->args.len > 0) {
+            *p++ = '?';
+            p = ngx_copy(p, r->args.data, r->args.len);
+        }
+
+        u->uri.len = p - u->uri.data;
+    }
+
+    if (u->uri.len == 0) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "zero length URI to proxy");
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_grpc_init_upstream(r, &ctx->vars.host_header, &u->uri,
+                                    &plcf->headers_v2, plcf->host_set)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (plcf->upstream.request_buffering) {
+        r->request_body_no_buffering = 0;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_proxy_reinit_request(ngx_http_request_t *r)
 {
@@ -2092,6 +2248,9 @@ ngx_http_proxy_input_filter_init(void *data)
 
         u->pipe->length = u->headers_in.content_length_n;
         u->length = u->headers_in.content_length_n;
+
+        /* the body is passed as is, see ngx_http_upstream_splice_pipe() */
+        u->spliceable = 1;
     }
 
     return NGX_OK;
@@ -3363,6 +3522,7 @@ ngx_http_proxy_create_loc_conf(ngx_conf_t *cf)
 
     conf->upstream.local = NGX_CONF_UNSET_PTR;
     conf->upstream.socket_keepalive = NGX_CONF_UNSET;
+    conf->upstream.splice = NGX_CONF_UNSET;
 
     conf->upstream.connect_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.send_timeout = NGX_CONF_UNSET_MSEC;
@@ -3495,6 +3655,8 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_value(conf->upstream.socket_keepalive,
                               prev->upstream.socket_keepalive, 0);
+    ngx_conf_merge_value(conf->upstream.splice,
+                              prev->upstream.splice, 0);
 
     ngx_conf_merge_msec_value(conf->upstream.connect_timeout,
                               prev->upstream.connect_timeout, 60000);
@@ -3904,6 +4066,9 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         conf->headers = prev->headers;
 #if (NGX_HTTP_CACHE)
         conf->headers_cache = prev->headers_cache;
+#endif
+#if (NGX_HTTP_GRPC)
+        conf->headers_v2 = prev->headers_v2;
 #endif
     }
 
@@ -3923,6 +4088,17 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         }
     }
 
+#endif
+
+#if (NGX_HTTP_GRPC)
+
+    if (conf->http_version == NGX_HTTP_VERSION_20) {
+
+        if (ngx_http_proxy_merge_v2(cf, conf) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
 #endif
 
     /*
@@ -3936,6 +4112,9 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         prev->headers = conf->headers;
 #if (NGX_HTTP_CACHE)
         prev->headers_cache = conf->headers_cache;
+#endif
+#if (NGX_HTTP_GRPC)
+        prev->headers_v2 = conf->headers_v2;
 #endif
     }
 
@@ -3943,6 +4122,73 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 }
 
 
+#if (NGX_HTTP_GRPC)
+
+static ngx_int_t
+ngx_http_proxy_merge_v2(ngx_conf_t *cf, ngx_http_proxy_loc_conf_t *conf)
+{
+    char          *name;
+    ngx_uint_t     i;
+    ngx_keyval_t  *h;
+
+    if (conf->body_source.data) {
+        name = "proxy_set_body";
+
+    } else if (conf->method) {
+        name = "proxy_method";
+
+    } else if (!conf->upstream.pass_request_body) {
+        name = "proxy_pass_request_body off";
+
+    } else if (conf->upstream.store > 0) {
+        name = "proxy_store";
+
+#if (NGX_HTTP_CACHE)
+    } else if (conf->upstream.cache > 0) {
+        name = "proxy_cache";
+#endif
+
+    } else {
+        name = NULL;
+    }
+
+    if (name) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"proxy_http_version 2\" is incompatible "
+                           "with \"%s\"", name);
+        return NGX_ERROR;
+    }
+
+    /*
+     * responses are passed as they are read, as with grpc_pass,
+     * and the request body may still be sent after the response header
+     */
+
+    conf->upstream.change_buffering = 0;
+    conf->upstream.pass_trailers = 1;
+    conf->upstream.preserve_output = 1;
+
+    conf->host_set = 0;
+
+    if (conf->headers_source) {
+        h = conf->headers_source->elts;
+
+        for (i = 0; i < conf->headers_source->nelts; i++) {
+            if (h[i].key.len == 4
+                && ngx_strncasecmp(h[i].key.data, (u_char *) "Host", 4) == 0)
+            {
+                conf->host_set = 1;
+            }
+        }
+    }
+
+    return ngx_http_proxy_init_headers(cf, conf, &conf->headers_v2,
+                                       ngx_http_proxy_v2_headers);
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_proxy_init_headers(ngx_conf_t *cf, ngx_http_proxy_loc_conf_t *conf,
     ngx_http_proxy_headers_t *headers, ngx_keyval_t *default_headers)
@@ -196,6 +196,7 @@ ngx_http_slice_header_filter(ngx_http_request_t *r)
     }
 
     r->preserve_body = 1;
+    r->filter_identity = 0;
 
     if (r->headers_out.status == NGX_HTTP_PARTIAL_CONTENT) {
         if (ctx->start + (off_t) slcf->size <= r->headers_out.content_offset) {
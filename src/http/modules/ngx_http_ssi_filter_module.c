@@ -367,6 +367,7 @@ ngx_http_ssi_header_filter(ngx_http_request_t *r)
                 "[an error occurred while processing the directive]");
 
     r->filter_need_in_memory = 1;
+    r->filter_identity = 0;
 
     if (r == r->main) {
 
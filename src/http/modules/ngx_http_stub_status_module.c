@@ -11,8 +11,15 @@
 
 
 static ngx_int_t ngx_http_stub_status_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_stub_status_loop_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_stub_status_zones_handler(ngx_http_request_t *r);
 static ngx_int_t ngx_http_stub_status_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_stub_status_zone_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_stub_status_pool_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_shm_zone_t *ngx_http_stub_status_find_zone(ngx_str_t *name);
 static ngx_int_t ngx_http_stub_status_add_variables(ngx_conf_t *cf);
 static char *ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -76,6 +83,35 @@ static ngx_http_variable_t  ngx_http_stub_status_vars[] = {
     { ngx_string("connections_waiting"), NULL, ngx_http_stub_status_variable,
       3, NGX_HTTP_VAR_NOCACHEABLE, 0 },
 
+    { ngx_string("pool_cache_hits"), NULL, ngx_http_stub_status_pool_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("pool_cache_misses"), NULL,
+      ngx_http_stub_status_pool_variable,
+      1, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("pool_cache_size"), NULL, ngx_http_stub_status_pool_variable,
+      2, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("pool_cache_peak"), NULL, ngx_http_stub_status_pool_variable,
+      3, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("worker_peak_rss"), NULL, ngx_http_stub_status_pool_variable,
+      4, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("slab_free_"), NULL, ngx_http_stub_status_zone_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_PREFIX, 0 },
+
+    { ngx_string("slab_used_"), NULL, ngx_http_stub_status_zone_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_PREFIX, 0 },
+
+    { ngx_string("slab_fragmentation_"), NULL,
+      ngx_http_stub_status_zone_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_PREFIX, 0 },
+
+    { ngx_string("slab_fails_"), NULL, ngx_http_stub_status_zone_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE|NGX_HTTP_VAR_PREFIX, 0 },
+
       ngx_http_null_variable
 };
 
@@ -150,6 +186,268 @@ ngx_http_stub_status_handler(ngx_http_request_t *r)
 }
 
 
+static ngx_int_t
+ngx_http_stub_status_loop_handler(ngx_http_request_t *r)
+{
+    size_t                  size;
+    ngx_int_t               rc;
+    ngx_buf_t              *b;
+    ngx_uint_t              i, k;
+    ngx_chain_t             out;
+    ngx_event_loop_stat_t  *st;
+
+    static const char  *phases[] = {
+        "wait", "io", "accept", "timers", "posted"
+    };
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    r->headers_out.content_type_len = sizeof("text/plain") - 1;
+    ngx_str_set(&r->headers_out.content_type, "text/plain");
+    r->headers_out.content_type_lowcase = NULL;
+
+    size = ngx_event_loop_stats_n
+           * (sizeof("worker  pid  iterations  events  max_busy us\n")
+              + NGX_INT_T_LEN + 4 * NGX_INT64_LEN
+              + sizeof(" phases us:\n")
+              + NGX_EVENT_LOOP_PHASES * (sizeof(" timers:") + NGX_INT64_LEN)
+              + sizeof(" busy us:\n")
+              + NGX_EVENT_LOOP_BUSY_BUCKETS * (2 + 2 * NGX_INT64_LEN)
+              + sizeof(" batch:\n")
+              + NGX_EVENT_LOOP_BATCH_BUCKETS * (2 + 2 * NGX_INT_T_LEN)
+              + sizeof(" slow:  last:  ms at \n")
+              + NGX_INT64_LEN + NGX_PTR_SIZE * 2 + 2 + NGX_INT_T_LEN
+              + NGX_TIME_T_LEN);
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    out.buf = b;
+    out.next = NULL;
+
+    for (i = 0; i < ngx_event_loop_stats_n; i++) {
+        st = &ngx_event_loop_stats[i];
+
+        if (st->pid == 0) {
+            continue;
+        }
+
+        b->last = ngx_sprintf(b->last,
+                              "worker %ui pid %P iterations %uL events %uL "
+                              "max_busy %uLus\n",
+                              i, st->pid, st->iterations, st->events,
+                              st->max_busy);
+
+        b->last = ngx_cpymem(b->last, " phases us:", sizeof(" phases us:") - 1);
+
+        for (k = 0; k < NGX_EVENT_LOOP_PHASES; k++) {
+            b->last = ngx_sprintf(b->last, " %s:%uL", phases[k],
+                                  st->phase[k]);
+        }
+
+        b->last = ngx_cpymem(b->last, "\n busy us:", sizeof("\n busy us:") - 1);
+
+        for (k = 0; k < NGX_EVENT_LOOP_BUSY_BUCKETS - 1; k++) {
+            b->last = ngx_sprintf(b->last, " <%uL:%uL",
+                                  (uint64_t) NGX_EVENT_LOOP_BUSY_MIN << k,
+                                  st->busy[k]);
+        }
+
+        b->last = ngx_sprintf(b->last, " inf:%uL\n batch:", st->busy[k]);
+
+        for (k = 0; k < NGX_EVENT_LOOP_BATCH_BUCKETS - 1; k++) {
+            b->last = ngx_sprintf(b->last, " %ui:%uL",
+                                  k ? (ngx_uint_t) 1 << (k - 1) : 0,
+                                  st->batch[k]);
+        }
+
+        b->last = ngx_sprintf(b->last, " %ui+:%uL\n",
+                              (ngx_uint_t) 1 << (k - 1), st->batch[k]);
+
+        b->last = ngx_sprintf(b->last, " slow: %uL last: %p %Mms at %T\n",
+                              st->slow, (void *) st->slow_handler,
+                              st->slow_time, st->slow_sec);
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = b->last - b->pos;
+
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    if (b->last == b->pos) {
+        r->header_only = 1;
+    }
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
+/*
+ * 各共享内存区slab分配器的页及各大小类的使用情况，
+ * 碎片率为不在最大连续空闲页块中的空闲页所占的比例
+ */
+
+static ngx_int_t
+ngx_http_stub_status_zones_handler(ngx_http_request_t *r)
+{
+    size_t                 size;
+    ngx_int_t              rc;
+    ngx_buf_t             *b;
+    ngx_uint_t             i, k, reqs, fails;
+    ngx_chain_t            out;
+    ngx_shm_zone_t        *shm_zone;
+    ngx_slab_pool_t       *sp;
+    ngx_slab_stat_t       *slots;
+    ngx_list_part_t       *part;
+    ngx_slab_pool_stat_t   stat;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    r->headers_out.content_type_len = sizeof("text/plain") - 1;
+    ngx_str_set(&r->headers_out.content_type, "text/plain");
+    r->headers_out.content_type_lowcase = NULL;
+
+    slots = ngx_palloc(r->pool, ngx_pagesize_shift * sizeof(ngx_slab_stat_t));
+    if (slots == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    size = 0;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        size += sizeof("zone \"\" size  pages  free  runs  max_run  "
+                       "fragmentation %  fails  of  reqs\n")
+                + shm_zone[i].shm.name.len + NGX_SIZE_T_LEN
+                + 8 * NGX_INT_T_LEN
+                + ngx_pagesize_shift
+                  * (sizeof(" size  total  used  cached  reqs  hits  fails  "
+                            "occupancy %\n")
+                     + 8 * NGX_INT_T_LEN);
+    }
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    out.buf = b;
+    out.next = NULL;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        sp = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        ngx_slab_get_stat(sp, &stat, slots);
+
+        reqs = 0;
+        fails = 0;
+
+        for (k = 0; k < stat.nslots; k++) {
+            reqs += slots[k].reqs + slots[k].hits;
+            fails += slots[k].fails;
+        }
+
+        b->last = ngx_sprintf(b->last,
+                              "zone \"%V\" size %uz pages %ui free %ui "
+                              "runs %ui max_run %ui fragmentation %ui%% "
+                              "fails %ui of %ui reqs\n",
+                              &shm_zone[i].shm.name, shm_zone[i].shm.size,
+                              stat.pages, stat.free, stat.runs, stat.max_run,
+                              stat.free ? (stat.free - stat.max_run) * 100
+                                          / stat.free
+                                        : 0,
+                              fails, reqs);
+
+        for (k = 0; k < stat.nslots; k++) {
+
+            if (slots[k].total == 0 && slots[k].reqs == 0) {
+                continue;
+            }
+
+            b->last = ngx_sprintf(b->last,
+                                  " size %ui total %ui used %ui cached %ui "
+                                  "reqs %ui hits %ui fails %ui "
+                                  "occupancy %ui%%\n",
+                                  (ngx_uint_t) 1 << (k + sp->min_shift),
+                                  slots[k].total, slots[k].used,
+                                  slots[k].cached, slots[k].reqs,
+                                  slots[k].hits, slots[k].fails,
+                                  slots[k].total ? slots[k].used * 100
+                                                   / slots[k].total
+                                                 : 0);
+        }
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = b->last - b->pos;
+
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    if (b->last == b->pos) {
+        r->header_only = 1;
+    }
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
 static ngx_int_t
 ngx_http_stub_status_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
@@ -195,6 +493,195 @@ ngx_http_stub_status_variable(ngx_http_request_t *r,
 }
 
 
+static ngx_int_t
+ngx_http_stub_status_zone_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    ngx_str_t  *name = (ngx_str_t *) data;
+
+    u_char                *p;
+    ngx_str_t              zone;
+    ngx_uint_t             i, n, value;
+    ngx_shm_zone_t        *shm_zone;
+    ngx_slab_pool_t       *sp;
+    ngx_slab_stat_t       *slots;
+    ngx_slab_pool_stat_t   stat;
+
+    static ngx_str_t  prefixes[] = {
+        ngx_string("slab_free_"),
+        ngx_string("slab_used_"),
+        ngx_string("slab_fragmentation_"),
+        ngx_string("slab_fails_")
+    };
+
+    for (n = 0; n < sizeof(prefixes) / sizeof(ngx_str_t); n++) {
+        if (name->len > prefixes[n].len
+            && ngx_strncmp(name->data, prefixes[n].data, prefixes[n].len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (n == sizeof(prefixes) / sizeof(ngx_str_t)) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    zone.len = name->len - prefixes[n].len;
+    zone.data = name->data + prefixes[n].len;
+
+    shm_zone = ngx_http_stub_status_find_zone(&zone);
+
+    if (shm_zone == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    sp = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    slots = NULL;
+
+    if (n == 3) {
+        slots = ngx_palloc(r->pool, ngx_slab_nslots(sp)
+                                    * sizeof(ngx_slab_stat_t));
+        if (slots == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_slab_get_stat(sp, &stat, slots);
+
+    switch (n) {
+    case 0:
+        value = stat.free;
+        break;
+
+    case 1:
+        value = stat.pages - stat.free;
+        break;
+
+    case 2:
+        value = stat.free ? (stat.free - stat.max_run) * 100 / stat.free : 0;
+        break;
+
+    default: /* 3 */
+        value = 0;
+
+        for (i = 0; i < stat.nslots; i++) {
+            value += slots[i].fails;
+        }
+
+        break;
+    }
+
+    p = ngx_pnalloc(r->pool, NGX_INT_T_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->len = ngx_sprintf(p, "%ui", value) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+/* 处理请求的worker进程的内存池块缓存统计及内存占用峰值，字节 */
+
+static ngx_int_t
+ngx_http_stub_status_pool_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char         *p;
+    size_t          value;
+#if !(NGX_WIN32)
+    struct rusage   ru;
+#endif
+
+    p = ngx_pnalloc(r->pool, NGX_SIZE_T_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    switch (data) {
+    case 0:
+        value = ngx_pool_cache_stat.hits;
+        break;
+
+    case 1:
+        value = ngx_pool_cache_stat.misses;
+        break;
+
+    case 2:
+        value = ngx_pool_cache_stat.size;
+        break;
+
+    case 3:
+        value = ngx_pool_cache_stat.peak;
+        break;
+
+    default: /* 4 */
+
+#if !(NGX_WIN32)
+        if (getrusage(RUSAGE_SELF, &ru) == 0) {
+            /* kilobytes on Linux, bytes on Darwin */
+#if (NGX_DARWIN)
+            value = ru.ru_maxrss;
+#else
+            value = (size_t) ru.ru_maxrss * 1024;
+#endif
+            break;
+        }
+#endif
+
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    v->len = ngx_sprintf(p, "%uz", value) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_shm_zone_t *
+ngx_http_stub_status_find_zone(ngx_str_t *name)
+{
+    ngx_uint_t        i;
+    ngx_shm_zone_t   *shm_zone;
+    ngx_list_part_t  *part;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                return NULL;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (name->len == shm_zone[i].shm.name.len
+            && ngx_strncmp(name->data, shm_zone[i].shm.name.data, name->len)
+               == 0)
+        {
+            return &shm_zone[i];
+        }
+    }
+}
+
+
 static ngx_int_t
 ngx_http_stub_status_add_variables(ngx_conf_t *cf)
 {
@@ -217,10 +704,35 @@ ngx_http_stub_status_add_variables(ngx_conf_t *cf)
 static char *
 ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
+    ngx_str_t                 *value;
+    ngx_event_conf_t          *ecf;
     ngx_http_core_loc_conf_t  *clcf;
 
     clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
     clcf->handler = ngx_http_stub_status_handler;
 
+    value = cf->args->elts;
+
+    if (cf->args->nelts == 2 && ngx_strcmp(value[1].data, "loop") == 0) {
+
+        if (ngx_get_conf(cf->cycle->conf_ctx, ngx_events_module) == NULL) {
+            return "requires \"event_loop_stats\" in \"events\" "
+                   "section defined before";
+        }
+
+        ecf = ngx_event_get_conf(cf->cycle->conf_ctx, ngx_event_core_module);
+
+        if (ecf->loop_stats == NULL) {
+            return "requires \"event_loop_stats\"";
+        }
+
+        clcf->handler = ngx_http_stub_status_loop_handler;
+
+    } else if (cf->args->nelts == 2
+               && ngx_strcmp(value[1].data, "zones") == 0)
+    {
+        clcf->handler = ngx_http_stub_status_zones_handler;
+    }
+
     return NGX_CONF_OK;
 }
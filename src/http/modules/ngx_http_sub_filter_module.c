@@ -264,6 +264,7 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
     ctx->last_out = &ctx->out;
 
     r->filter_need_in_memory = 1;
+    r->filter_identity = 0;
 
     if (r == r->main) {
         ngx_http_clear_content_length(r);
@@ -0,0 +1,2196 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * 多个请求的HTTP/2流共享少量到上游的连接（会话）：
+ * 每个流对上游模块表现为一个虚拟连接，它的收发函数在会话的
+ * 真实连接上复用；会话处理连接级的帧（SETTINGS、PING、GOAWAY、
+ * 连接窗口），并把流的帧按原样交给对应的虚拟连接
+ */
+
+
+#define NGX_HTTP_MULTIPLEX_CHUNK_SIZE         NGX_HTTP_V2_DEFAULT_FRAME_SIZE
+#define NGX_HTTP_MULTIPLEX_BUFFER_SIZE                                        \
+    (NGX_HTTP_V2_FRAME_HEADER_SIZE + 2 * NGX_HTTP_V2_DEFAULT_FRAME_SIZE)
+
+/* 输出队列超过该长度时，已开始的流暂停发送 */
+#define NGX_HTTP_MULTIPLEX_OUTPUT_SIZE        (4 * NGX_HTTP_V2_DEFAULT_FRAME_SIZE)
+
+/* 流标识接近上限时不再在会话上创建新流 */
+#define NGX_HTTP_MULTIPLEX_MAX_STREAM_ID      0x7fffff00
+
+#define NGX_HTTP_MULTIPLEX_HEADER_TABLE_SIZE  0x1
+#define NGX_HTTP_MULTIPLEX_ENABLE_PUSH        0x2
+#define NGX_HTTP_MULTIPLEX_MAX_STREAMS        0x3
+#define NGX_HTTP_MULTIPLEX_INIT_WINDOW_SIZE   0x4
+
+#define NGX_HTTP_MULTIPLEX_FLOW_CTRL_FAILED   0x3
+#define NGX_HTTP_MULTIPLEX_CANCEL             0x8
+
+
+typedef struct ngx_http_upstream_multiplex_session_s
+    ngx_http_upstream_multiplex_session_t;
+
+
+typedef struct {
+    ngx_uint_t                         max_sessions;
+    ngx_uint_t                         streams;
+    size_t                             window;
+    ngx_msec_t                         timeout;
+
+    ngx_uint_t                         nsessions;
+    ngx_queue_t                        sessions;
+    ngx_queue_t                        free;
+
+    ngx_http_upstream_init_pt          original_init_upstream;
+    ngx_http_upstream_init_peer_pt     original_init_peer;
+
+} ngx_http_upstream_multiplex_srv_conf_t;
+
+
+typedef struct {
+    /* 虚拟连接及其事件，必须是第一个成员 */
+    ngx_connection_t                   connection;
+    ngx_event_t                        read;
+    ngx_event_t                        write;
+
+    ngx_queue_t                        queue;
+    ngx_http_upstream_multiplex_session_t  *session;
+
+    ngx_uint_t                         id;
+
+    /* 收到的本流的帧，保持线上格式 */
+    ngx_chain_t                       *in;
+    ngx_chain_t                       *last_in;
+    size_t                             buffered;
+    size_t                             recv_window;
+
+    unsigned                           remote_closed:1;
+    unsigned                           reset:1;
+    unsigned                           eof:1;
+    unsigned                           blocked:1;
+    unsigned                           queued:1;
+
+} ngx_http_upstream_multiplex_stream_t;
+
+
+struct ngx_http_upstream_multiplex_session_s {
+    ngx_http_upstream_multiplex_conn_t       h2;
+
+    ngx_queue_t                        queue;
+    ngx_http_upstream_multiplex_srv_conf_t  *conf;
+
+    ngx_peer_connection_t              peer;
+    ngx_pool_t                        *pool;
+
+    /* 只有上游配置、地址和TLS名称都相同的请求共享会话 */
+    ngx_http_upstream_conf_t          *upstream;
+    ngx_sockaddr_t                     sockaddr;
+    ngx_str_t                          name;
+    ngx_str_t                          ssl_name;
+
+    ngx_queue_t                        streams;
+    ngx_uint_t                         nstreams;
+    ngx_uint_t                         max_streams;
+
+    ngx_buf_t                         *buffer;
+
+    ngx_chain_t                       *out;
+    ngx_chain_t                       *last_out;
+    size_t                             out_size;
+
+    ngx_chain_t                       *free;
+
+    unsigned                           ssl:1;
+    unsigned                           ready:1;
+    unsigned                           goaway:1;
+};
+
+
+typedef struct {
+    ngx_http_upstream_multiplex_srv_conf_t  *conf;
+
+    ngx_http_request_t                *request;
+
+    void                              *data;
+
+    ngx_event_get_peer_pt              original_get_peer;
+    ngx_event_free_peer_pt             original_free_peer;
+
+} ngx_http_upstream_multiplex_peer_data_t;
+
+
+#define ngx_http_upstream_multiplex_stream(c)                                 \
+    ((ngx_http_upstream_multiplex_stream_t *)                                 \
+        ((u_char *) (c) - offsetof(ngx_http_upstream_multiplex_stream_t,      \
+                                   connection)))
+
+
+static ngx_int_t ngx_http_upstream_init_multiplex_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_upstream_get_multiplex_peer(
+    ngx_peer_connection_t *pc, void *data);
+static void ngx_http_upstream_free_multiplex_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state);
+
+static ngx_http_upstream_multiplex_session_t *
+    ngx_http_upstream_multiplex_create_session(
+    ngx_http_upstream_multiplex_srv_conf_t *mcf, ngx_peer_connection_t *pc,
+    ngx_http_upstream_t *u, ngx_str_t *ssl_name);
+static void ngx_http_upstream_multiplex_connect_handler(ngx_event_t *ev);
+#if (NGX_HTTP_SSL)
+static ngx_int_t ngx_http_upstream_multiplex_ssl_name(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_str_t *name);
+static void ngx_http_upstream_multiplex_ssl_handshake(ngx_connection_t *c);
+#endif
+static void ngx_http_upstream_multiplex_session_ready(
+    ngx_http_upstream_multiplex_session_t *s);
+static void ngx_http_upstream_multiplex_read_handler(ngx_event_t *rev);
+static void ngx_http_upstream_multiplex_write_handler(ngx_event_t *wev);
+static ngx_int_t ngx_http_upstream_multiplex_flush(
+    ngx_http_upstream_multiplex_session_t *s);
+static ngx_int_t ngx_http_upstream_multiplex_process(
+    ngx_http_upstream_multiplex_session_t *s);
+static ngx_int_t ngx_http_upstream_multiplex_frame(
+    ngx_http_upstream_multiplex_session_t *s, u_char *pos, size_t size);
+static ngx_int_t ngx_http_upstream_multiplex_settings(
+    ngx_http_upstream_multiplex_session_t *s, u_char *p, size_t size);
+static void ngx_http_upstream_multiplex_goaway(
+    ngx_http_upstream_multiplex_session_t *s, ngx_uint_t last);
+static ngx_int_t ngx_http_upstream_multiplex_send_frame(
+    ngx_http_upstream_multiplex_session_t *s, ngx_uint_t type,
+    ngx_uint_t flags, ngx_uint_t sid, u_char *payload, size_t size);
+static ngx_int_t ngx_http_upstream_multiplex_send_window_update(
+    ngx_http_upstream_multiplex_session_t *s, ngx_uint_t sid, size_t window);
+static ngx_int_t ngx_http_upstream_multiplex_copy(
+    ngx_http_upstream_multiplex_session_t *s, ngx_chain_t **chain,
+    ngx_chain_t **last, u_char *p, size_t size);
+static void ngx_http_upstream_multiplex_free_chain(
+    ngx_http_upstream_multiplex_session_t *s, ngx_chain_t *cl);
+static void ngx_http_upstream_multiplex_close_session(
+    ngx_http_upstream_multiplex_session_t *s);
+
+static ngx_http_upstream_multiplex_stream_t *
+    ngx_http_upstream_multiplex_create_stream(
+    ngx_http_upstream_multiplex_session_t *s, ngx_log_t *log);
+static void ngx_http_upstream_multiplex_close_stream(
+    ngx_http_upstream_multiplex_srv_conf_t *mcf,
+    ngx_http_upstream_multiplex_stream_t *stream, ngx_uint_t cancel);
+static void ngx_http_upstream_multiplex_wake_stream(
+    ngx_http_upstream_multiplex_stream_t *stream);
+static ssize_t ngx_http_upstream_multiplex_recv(ngx_connection_t *c,
+    u_char *buf, size_t size);
+static ssize_t ngx_http_upstream_multiplex_recv_chain(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+static ssize_t ngx_http_upstream_multiplex_send(ngx_connection_t *c,
+    u_char *buf, size_t size);
+static ngx_chain_t *ngx_http_upstream_multiplex_send_chain(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+static void ngx_http_upstream_multiplex_dummy_handler(ngx_event_t *ev);
+
+static void *ngx_http_upstream_multiplex_create_conf(ngx_conf_t *cf);
+static char *ngx_http_upstream_multiplex(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+static ngx_command_t  ngx_http_upstream_multiplex_commands[] = {
+
+    { ngx_string("multiplex"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_http_upstream_multiplex,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("multiplex_streams"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_multiplex_srv_conf_t, streams),
+      NULL },
+
+    { ngx_string("multiplex_window"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_multiplex_srv_conf_t, window),
+      NULL },
+
+    { ngx_string("multiplex_timeout"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_multiplex_srv_conf_t, timeout),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_upstream_multiplex_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    NULL,                                  /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_upstream_multiplex_create_conf, /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_upstream_multiplex_module = {
+    NGX_MODULE_V1,
+    &ngx_http_upstream_multiplex_module_ctx, /* module context */
+    ngx_http_upstream_multiplex_commands,    /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_http_upstream_init_multiplex(ngx_conf_t *cf,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_http_upstream_multiplex_srv_conf_t  *mcf;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cf->log, 0,
+                   "init multiplex");
+
+    mcf = ngx_http_conf_upstream_srv_conf(us,
+                                          ngx_http_upstream_multiplex_module);
+
+    ngx_conf_init_uint_value(mcf->streams, 100);
+    ngx_conf_init_size_value(mcf->window, 256 * 1024);
+    ngx_conf_init_msec_value(mcf->timeout, 60000);
+
+    if (mcf->streams == 0) {
+        mcf->streams = 1;
+    }
+
+    if (mcf->window > NGX_HTTP_V2_MAX_WINDOW) {
+        mcf->window = NGX_HTTP_V2_MAX_WINDOW;
+    }
+
+    if (mcf->original_init_upstream(cf, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    mcf->original_init_peer = us->peer.init;
+
+    us->peer.init = ngx_http_upstream_init_multiplex_peer;
+
+    ngx_queue_init(&mcf->sessions);
+    ngx_queue_init(&mcf->free);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_init_multiplex_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_http_upstream_multiplex_peer_data_t  *mp;
+    ngx_http_upstream_multiplex_srv_conf_t   *mcf;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "init multiplex peer");
+
+    mcf = ngx_http_conf_upstream_srv_conf(us,
+                                          ngx_http_upstream_multiplex_module);
+
+    mp = ngx_palloc(r->pool, sizeof(ngx_http_upstream_multiplex_peer_data_t));
+    if (mp == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (mcf->original_init_peer(r, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    mp->conf = mcf;
+    mp->request = r;
+    mp->data = r->upstream->peer.data;
+    mp->original_get_peer = r->upstream->peer.get;
+    mp->original_free_peer = r->upstream->peer.free;
+
+    r->upstream->peer.data = mp;
+    r->upstream->peer.get = ngx_http_upstream_get_multiplex_peer;
+    r->upstream->peer.free = ngx_http_upstream_free_multiplex_peer;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_get_multiplex_peer(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_upstream_multiplex_peer_data_t  *mp = data;
+
+    ngx_int_t                               rc;
+    ngx_str_t                               ssl_name;
+    ngx_queue_t                            *q;
+    ngx_http_upstream_t                    *u;
+    ngx_http_upstream_multiplex_stream_t   *stream;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "get multiplex peer");
+
+    /* ask balancer */
+
+    rc = mp->original_get_peer(pc, mp->data);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    u = mp->request->upstream;
+
+    /* 只有支持多路复用的请求（grpc_pass及HTTP/2的proxy_pass）才使用共享会话 */
+
+    if (!u->multiplex || pc->local || ngx_terminate || ngx_exiting) {
+        return NGX_OK;
+    }
+
+    ngx_str_null(&ssl_name);
+
+#if (NGX_HTTP_SSL)
+
+    if (u->ssl) {
+
+        /* 按请求变化的客户端证书不能用于共享的连接 */
+
+        if (u->conf->ssl_certificate
+            && u->conf->ssl_certificate->value.len
+            && (u->conf->ssl_certificate->lengths
+                || u->conf->ssl_certificate_key->lengths))
+        {
+            return NGX_OK;
+        }
+
+        if (ngx_http_upstream_multiplex_ssl_name(mp->request, u, &ssl_name)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+#endif
+
+    /* search for a session with a free stream slot */
+
+    for (q = ngx_queue_head(&mp->conf->sessions);
+         q != ngx_queue_sentinel(&mp->conf->sessions);
+         q = ngx_queue_next(q))
+    {
+        s = ngx_queue_data(q, ngx_http_upstream_multiplex_session_t, queue);
+
+        if (s->upstream != u->conf
+            || s->ssl != u->ssl
+            || s->goaway
+            || s->nstreams >= s->max_streams
+            || s->ssl_name.len != ssl_name.len
+            || ngx_memn2cmp((u_char *) &s->sockaddr, (u_char *) pc->sockaddr,
+                            s->peer.socklen, pc->socklen)
+               != 0)
+        {
+            continue;
+        }
+
+        if (ssl_name.len
+            && ngx_strncmp(s->ssl_name.data, ssl_name.data, ssl_name.len) != 0)
+        {
+            continue;
+        }
+
+        goto found;
+    }
+
+    if (mp->conf->nsessions >= mp->conf->max_sessions) {
+
+        /* all sessions are busy, use a dedicated connection */
+
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                       "multiplex sessions are busy");
+
+        return NGX_OK;
+    }
+
+    s = ngx_http_upstream_multiplex_create_session(mp->conf, pc, u, &ssl_name);
+
+    if (s == NULL) {
+        return NGX_OK;
+    }
+
+found:
+
+    stream = ngx_http_upstream_multiplex_create_stream(s, pc->log);
+    if (stream == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "get multiplex peer: using session %p, streams %ui of %ui",
+                   s, s->nstreams, s->max_streams);
+
+    pc->connection = &stream->connection;
+
+    /*
+     * only streams of an established session do not count as a new try,
+     * much like cached keepalive connections
+     */
+
+    pc->cached = s->ready;
+
+    return NGX_DONE;
+}
+
+
+static void
+ngx_http_upstream_free_multiplex_peer(ngx_peer_connection_t *pc, void *data,
+    ngx_uint_t state)
+{
+    ngx_http_upstream_multiplex_peer_data_t  *mp = data;
+
+    ngx_http_upstream_t                   *u;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "free multiplex peer");
+
+    if (pc->connection
+        && pc->connection->recv == ngx_http_upstream_multiplex_recv)
+    {
+        u = mp->request->upstream;
+        stream = ngx_http_upstream_multiplex_stream(pc->connection);
+
+        ngx_http_upstream_multiplex_close_stream(mp->conf, stream,
+                                                 !u->request_body_sent);
+
+        pc->connection = NULL;
+    }
+
+    mp->original_free_peer(pc, mp->data, state);
+}
+
+
+ngx_int_t
+ngx_http_upstream_multiplex_open_stream(ngx_connection_t *c,
+    ngx_http_upstream_multiplex_conn_t **h2, ngx_uint_t *id)
+{
+    ngx_http_upstream_multiplex_stream_t   *stream;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    if (c->recv != ngx_http_upstream_multiplex_recv) {
+        return NGX_DECLINED;
+    }
+
+    stream = ngx_http_upstream_multiplex_stream(c);
+    s = stream->session;
+
+    if (s == NULL || stream->eof) {
+        return NGX_ERROR;
+    }
+
+    if (stream->id == 0) {
+        s->h2.last_stream_id = s->h2.last_stream_id
+                               ? s->h2.last_stream_id + 2 : 1;
+
+        stream->id = s->h2.last_stream_id;
+
+        if (stream->id >= NGX_HTTP_MULTIPLEX_MAX_STREAM_ID) {
+            /* drain the session, new streams will use another one */
+            s->goaway = 1;
+        }
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex stream %ui opened on session %p", stream->id, s);
+
+    *h2 = &s->h2;
+    *id = stream->id;
+
+    return NGX_OK;
+}
+
+
+static ngx_http_upstream_multiplex_session_t *
+ngx_http_upstream_multiplex_create_session(
+    ngx_http_upstream_multiplex_srv_conf_t *mcf, ngx_peer_connection_t *pc,
+    ngx_http_upstream_t *u, ngx_str_t *ssl_name)
+{
+    u_char                                 *p;
+    ngx_int_t                               rc;
+    ngx_pool_t                             *pool;
+    ngx_connection_t                       *c;
+    ngx_http_upstream_multiplex_session_t  *s;
+    u_char                                  settings[18];
+
+    static const u_char  preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    pool = ngx_create_pool(1024, ngx_cycle->log);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    s = ngx_pcalloc(pool, sizeof(ngx_http_upstream_multiplex_session_t));
+    if (s == NULL) {
+        goto failed;
+    }
+
+    s->pool = pool;
+    s->conf = mcf;
+    s->upstream = u->conf;
+    s->ssl = u->ssl;
+
+    if (ssl_name->len) {
+        s->ssl_name.data = ngx_pnalloc(pool, ssl_name->len + 1);
+        if (s->ssl_name.data == NULL) {
+            goto failed;
+        }
+
+        (void) ngx_cpystrn(s->ssl_name.data, ssl_name->data, ssl_name->len + 1);
+        s->ssl_name.len = ssl_name->len;
+    }
+
+    s->name.data = ngx_pstrdup(pool, pc->name);
+    if (s->name.data == NULL) {
+        goto failed;
+    }
+
+    s->name.len = pc->name->len;
+
+    ngx_memcpy(&s->sockaddr, pc->sockaddr, pc->socklen);
+
+    s->peer.sockaddr = &s->sockaddr.sockaddr;
+    s->peer.socklen = pc->socklen;
+    s->peer.name = &s->name;
+    s->peer.get = ngx_event_get_peer;
+    s->peer.log = ngx_cycle->log;
+    s->peer.log_error = NGX_ERROR_ERR;
+    s->peer.rcvbuf = pc->rcvbuf;
+    s->peer.so_keepalive = pc->so_keepalive;
+
+    s->h2.init_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+    s->h2.send_window = NGX_HTTP_V2_DEFAULT_WINDOW;
+    s->h2.recv_window = NGX_HTTP_V2_MAX_WINDOW;
+
+    s->max_streams = mcf->streams;
+
+    ngx_queue_init(&s->streams);
+
+    s->buffer = ngx_create_temp_buf(pool, NGX_HTTP_MULTIPLEX_BUFFER_SIZE);
+    if (s->buffer == NULL) {
+        goto failed;
+    }
+
+    /*
+     * connection preface: the dynamic table is disabled, so header blocks
+     * of different streams never depend on each other
+     */
+
+    if (ngx_http_upstream_multiplex_copy(s, &s->out, &s->last_out,
+                                         (u_char *) preface,
+                                         sizeof(preface) - 1)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    s->out_size = sizeof(preface) - 1;
+
+    p = settings;
+
+    p = ngx_http_v2_write_uint16(p, NGX_HTTP_MULTIPLEX_HEADER_TABLE_SIZE);
+    p = ngx_http_v2_write_uint32(p, 0);
+
+    p = ngx_http_v2_write_uint16(p, NGX_HTTP_MULTIPLEX_ENABLE_PUSH);
+    p = ngx_http_v2_write_uint32(p, 0);
+
+    p = ngx_http_v2_write_uint16(p, NGX_HTTP_MULTIPLEX_INIT_WINDOW_SIZE);
+    p = ngx_http_v2_write_uint32(p, mcf->window);
+
+    if (ngx_http_upstream_multiplex_send_frame(s, NGX_HTTP_V2_SETTINGS_FRAME,
+                                               0, 0, settings, p - settings)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    if (ngx_http_upstream_multiplex_send_window_update(s, 0,
+                            NGX_HTTP_V2_MAX_WINDOW - NGX_HTTP_V2_DEFAULT_WINDOW)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    rc = ngx_event_connect_peer(&s->peer);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "multiplex session %p connect: %i", s, rc);
+
+    if (rc == NGX_ERROR || rc == NGX_BUSY || rc == NGX_DECLINED) {
+        if (s->peer.connection) {
+            ngx_close_connection(s->peer.connection);
+        }
+
+        goto failed;
+    }
+
+    c = s->peer.connection;
+
+    c->data = s;
+    c->pool = pool;
+
+    c->read->handler = ngx_http_upstream_multiplex_connect_handler;
+    c->write->handler = ngx_http_upstream_multiplex_connect_handler;
+
+#if (NGX_HTTP_SSL)
+
+    /*
+     * the SSL object is created before the connection is established,
+     * so streams never see a session without c->ssl and do not try
+     * to start a handshake on their own
+     */
+
+    if (s->ssl) {
+        if (ngx_ssl_create_connection(u->conf->ssl, c,
+                                      NGX_SSL_BUFFER|NGX_SSL_CLIENT)
+            != NGX_OK)
+        {
+            ngx_close_connection(c);
+            goto failed;
+        }
+
+        c->sendfile = 0;
+    }
+
+#endif
+
+    ngx_add_timer(c->write, u->conf->connect_timeout);
+
+    if (rc == NGX_OK) {
+        ngx_post_event(c->write, &ngx_posted_events);
+    }
+
+    ngx_queue_insert_head(&mcf->sessions, &s->queue);
+    mcf->nsessions++;
+
+    return s;
+
+failed:
+
+    ngx_destroy_pool(pool);
+
+    return NULL;
+}
+
+
+static void
+ngx_http_upstream_multiplex_connect_handler(ngx_event_t *ev)
+{
+    int                                     err;
+    socklen_t                               len;
+    ngx_connection_t                       *c;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    c = ev->data;
+    s = c->data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex session %p connect handler", s);
+
+    if (ev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, c->log, NGX_ETIMEDOUT,
+                      "upstream timed out while connecting to "
+                      "multiplexed upstream %V", &s->name);
+        goto failed;
+    }
+
+    if (!ev->write) {
+        return;
+    }
+
+    err = 0;
+    len = sizeof(int);
+
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (void *) &err, &len) == -1) {
+        err = ngx_socket_errno;
+    }
+
+    if (err) {
+        (void) ngx_connection_error(c, err,
+                                    "connect() to multiplexed upstream failed");
+        goto failed;
+    }
+
+#if (NGX_HTTP_SSL)
+
+    if (s->ssl) {
+        ngx_int_t  rc;
+
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+
+        /* as per RFC 6066, literal IPv4 and IPv6 addresses are not permitted */
+
+        if (s->upstream->ssl_server_name
+            && s->ssl_name.len
+            && *s->ssl_name.data != '['
+            && ngx_inet_addr(s->ssl_name.data, s->ssl_name.len) == INADDR_NONE
+            && SSL_set_tlsext_host_name(c->ssl->connection,
+                                        (char *) s->ssl_name.data)
+               == 0)
+        {
+            ngx_ssl_error(NGX_LOG_ERR, c->log, 0,
+                          "SSL_set_tlsext_host_name(\"%s\") failed",
+                          s->ssl_name.data);
+            goto failed;
+        }
+
+#endif
+
+        rc = ngx_ssl_handshake(c);
+
+        if (rc == NGX_AGAIN) {
+            c->ssl->handler = ngx_http_upstream_multiplex_ssl_handshake;
+            return;
+        }
+
+        ngx_http_upstream_multiplex_ssl_handshake(c);
+        return;
+    }
+
+#endif
+
+    ngx_http_upstream_multiplex_session_ready(s);
+    return;
+
+failed:
+
+    ngx_http_upstream_multiplex_close_session(s);
+}
+
+
+#if (NGX_HTTP_SSL)
+
+static ngx_int_t
+ngx_http_upstream_multiplex_ssl_name(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_str_t *name)
+{
+    u_char  *p, *last;
+
+    if (u->conf->ssl_name) {
+        if (ngx_http_complex_value(r, u->conf->ssl_name, name) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+    } else {
+        *name = u->ssl_name;
+    }
+
+    if (name->len == 0) {
+        return NGX_OK;
+    }
+
+    /* strip the port as ngx_http_upstream_ssl_name() does */
+
+    p = name->data;
+    last = name->data + name->len;
+
+    if (*p == '[') {
+        p = ngx_strlchr(p, last, ']');
+
+        if (p == NULL) {
+            p = name->data;
+        }
+    }
+
+    p = ngx_strlchr(p, last, ':');
+
+    if (p != NULL) {
+        name->len = p - name->data;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_multiplex_ssl_handshake(ngx_connection_t *c)
+{
+    long                                    rc;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    s = c->data;
+
+    if (!c->ssl->handshaked) {
+        goto failed;
+    }
+
+    if (s->upstream->ssl_verify) {
+        rc = SSL_get_verify_result(c->ssl->connection);
+
+        if (rc != X509_V_OK) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream SSL certificate verify error: (%l:%s)",
+                          rc, X509_verify_cert_error_string(rc));
+            goto failed;
+        }
+
+        if (ngx_ssl_check_host(c, &s->ssl_name) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream SSL certificate does not match \"%V\"",
+                          &s->ssl_name);
+            goto failed;
+        }
+    }
+
+    ngx_http_upstream_multiplex_session_ready(s);
+    return;
+
+failed:
+
+    ngx_http_upstream_multiplex_close_session(s);
+}
+
+#endif
+
+
+static void
+ngx_http_upstream_multiplex_session_ready(
+    ngx_http_upstream_multiplex_session_t *s)
+{
+    ngx_connection_t  *c;
+
+    c = s->peer.connection;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex session %p ready", s);
+
+    s->ready = 1;
+
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+
+    if (ngx_tcp_nodelay(c) != NGX_OK) {
+        ngx_http_upstream_multiplex_close_session(s);
+        return;
+    }
+
+    c->read->handler = ngx_http_upstream_multiplex_read_handler;
+    c->write->handler = ngx_http_upstream_multiplex_write_handler;
+
+    if (ngx_http_upstream_multiplex_flush(s) != NGX_OK) {
+        ngx_http_upstream_multiplex_close_session(s);
+        return;
+    }
+
+    if (s->nstreams == 0) {
+        c->idle = 1;
+        ngx_add_timer(c->read, s->conf->timeout);
+    }
+
+    /* the handshake may have left data in the SSL buffers */
+
+    ngx_post_event(c->read, &ngx_posted_events);
+}
+
+
+static void
+ngx_http_upstream_multiplex_read_handler(ngx_event_t *rev)
+{
+    ssize_t                                 n;
+    ngx_buf_t                              *b;
+    ngx_int_t                               rc;
+    ngx_connection_t                       *c;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    c = rev->data;
+    s = c->data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex session %p read handler", s);
+
+    if (rev->timedout || c->close) {
+        /* idle timeout or graceful shutdown, there are no streams */
+        ngx_http_upstream_multiplex_close_session(s);
+        return;
+    }
+
+    b = s->buffer;
+
+    for ( ;; ) {
+
+        n = c->recv(c, b->last, b->end - b->last);
+
+        if (n == NGX_AGAIN) {
+            break;
+        }
+
+        if (n == 0 || n == NGX_ERROR) {
+            ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                          "multiplexed upstream %V closed connection%s",
+                          &s->name, n ? " with error" : "");
+
+            ngx_http_upstream_multiplex_close_session(s);
+            return;
+        }
+
+        b->last += n;
+
+        rc = ngx_http_upstream_multiplex_process(s);
+
+        if (rc == NGX_DONE) {
+            /* the session was closed */
+            return;
+        }
+
+        if (rc != NGX_OK) {
+            ngx_http_upstream_multiplex_close_session(s);
+            return;
+        }
+    }
+
+    if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+        ngx_http_upstream_multiplex_close_session(s);
+        return;
+    }
+
+    /* control frames: acknowledgements and window updates */
+
+    if (ngx_http_upstream_multiplex_flush(s) != NGX_OK) {
+        ngx_http_upstream_multiplex_close_session(s);
+    }
+}
+
+
+static void
+ngx_http_upstream_multiplex_write_handler(ngx_event_t *wev)
+{
+    ngx_connection_t                       *c;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    c = wev->data;
+    s = c->data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex session %p write handler", s);
+
+    if (ngx_http_upstream_multiplex_flush(s) != NGX_OK) {
+        ngx_http_upstream_multiplex_close_session(s);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_flush(ngx_http_upstream_multiplex_session_t *s)
+{
+    size_t                                 size;
+    ngx_queue_t                           *q;
+    ngx_chain_t                           *cl;
+    ngx_connection_t                      *c;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    c = s->peer.connection;
+
+    if (!s->ready) {
+        return NGX_OK;
+    }
+
+    if (s->out || c->buffered) {
+        cl = c->send_chain(c, s->out, 0);
+
+        if (cl == NGX_CHAIN_ERROR) {
+            c->error = 1;
+            return NGX_ERROR;
+        }
+
+        /* return the sent chunks */
+
+        while (s->out && s->out->buf->pos == s->out->buf->last) {
+            cl = s->out;
+            s->out = cl->next;
+
+            cl->next = NULL;
+            ngx_http_upstream_multiplex_free_chain(s, cl);
+        }
+
+        size = 0;
+
+        for (cl = s->out; cl; cl = cl->next) {
+            size += cl->buf->last - cl->buf->pos;
+        }
+
+        s->out_size = size;
+
+        if (s->out == NULL) {
+            s->last_out = NULL;
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "multiplex session %p output: %uz", s, s->out_size);
+    }
+
+    if (ngx_handle_write_event(c->write, 0) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (s->out_size >= NGX_HTTP_MULTIPLEX_OUTPUT_SIZE) {
+        return NGX_OK;
+    }
+
+    /* resume streams which were stopped by a long output queue */
+
+    for (q = ngx_queue_head(&s->streams);
+         q != ngx_queue_sentinel(&s->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_upstream_multiplex_stream_t, queue);
+
+        if (stream->blocked) {
+            stream->blocked = 0;
+            stream->write.ready = 1;
+            ngx_post_event(&stream->write, &ngx_posted_events);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_process(ngx_http_upstream_multiplex_session_t *s)
+{
+    u_char     *p;
+    size_t      size, rest;
+    ngx_buf_t  *b;
+    ngx_int_t   rc;
+
+    b = s->buffer;
+    p = b->pos;
+
+    for ( ;; ) {
+        rest = b->last - p;
+
+        if (rest < NGX_HTTP_V2_FRAME_HEADER_SIZE) {
+            break;
+        }
+
+        size = (p[0] << 16) + (p[1] << 8) + p[2];
+
+        if (size > NGX_HTTP_V2_DEFAULT_FRAME_SIZE) {
+            ngx_log_error(NGX_LOG_ERR, s->peer.connection->log, 0,
+                          "multiplexed upstream %V sent too large "
+                          "http2 frame: %uz", &s->name, size);
+            return NGX_ERROR;
+        }
+
+        if (rest < NGX_HTTP_V2_FRAME_HEADER_SIZE + size) {
+            break;
+        }
+
+        rc = ngx_http_upstream_multiplex_frame(s, p, size);
+
+        if (rc != NGX_OK) {
+            return rc;
+        }
+
+        p += NGX_HTTP_V2_FRAME_HEADER_SIZE + size;
+    }
+
+    rest = b->last - p;
+
+    if (p != b->start) {
+        ngx_memmove(b->start, p, rest);
+    }
+
+    b->pos = b->start;
+    b->last = b->start + rest;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_frame(ngx_http_upstream_multiplex_session_t *s,
+    u_char *pos, size_t size)
+{
+    u_char                                *p, payload[4];
+    size_t                                 window;
+    ngx_uint_t                             type, flags, sid, last;
+    ngx_queue_t                           *q;
+    ngx_connection_t                      *c;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    c = s->peer.connection;
+
+    type = pos[3];
+    flags = pos[4];
+    sid = ngx_http_v2_parse_sid(&pos[5]);
+
+    p = pos + NGX_HTTP_V2_FRAME_HEADER_SIZE;
+
+    ngx_log_debug4(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex frame type:%ui f:%ui l:%uz sid:%ui",
+                   type, flags, size, sid);
+
+    if (sid == 0) {
+
+        switch (type) {
+
+        case NGX_HTTP_V2_SETTINGS_FRAME:
+
+            if (flags & NGX_HTTP_V2_ACK_FLAG) {
+                return NGX_OK;
+            }
+
+            return ngx_http_upstream_multiplex_settings(s, p, size);
+
+        case NGX_HTTP_V2_PING_FRAME:
+
+            if (size != 8) {
+                goto invalid;
+            }
+
+            if (flags & NGX_HTTP_V2_ACK_FLAG) {
+                return NGX_OK;
+            }
+
+            return ngx_http_upstream_multiplex_send_frame(s,
+                                                   NGX_HTTP_V2_PING_FRAME,
+                                                   NGX_HTTP_V2_ACK_FLAG, 0,
+                                                   p, 8);
+
+        case NGX_HTTP_V2_GOAWAY_FRAME:
+
+            if (size < 8) {
+                goto invalid;
+            }
+
+            last = ngx_http_v2_parse_sid(p);
+
+            ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                          "multiplexed upstream %V sent goaway with "
+                          "error %uD, last stream %ui",
+                          &s->name, ngx_http_v2_parse_uint32(&p[4]), last);
+
+            ngx_http_upstream_multiplex_goaway(s, last);
+
+            if (s->nstreams == 0) {
+                ngx_http_upstream_multiplex_close_session(s);
+                return NGX_DONE;
+            }
+
+            return NGX_OK;
+
+        case NGX_HTTP_V2_WINDOW_UPDATE_FRAME:
+
+            if (size != 4) {
+                goto invalid;
+            }
+
+            window = ngx_http_v2_parse_window(p);
+
+            if (window == 0
+                || window > NGX_HTTP_V2_MAX_WINDOW - s->h2.send_window)
+            {
+                goto invalid;
+            }
+
+            s->h2.send_window += window;
+
+            /* streams blocked by the connection window check it again */
+
+            for (q = ngx_queue_head(&s->streams);
+                 q != ngx_queue_sentinel(&s->streams);
+                 q = ngx_queue_next(q))
+            {
+                stream = ngx_queue_data(q,
+                                   ngx_http_upstream_multiplex_stream_t, queue);
+
+                if (stream->id && !stream->blocked) {
+                    stream->write.ready = 1;
+                    ngx_post_event(&stream->write, &ngx_posted_events);
+                }
+            }
+
+            return NGX_OK;
+
+        case NGX_HTTP_V2_DATA_FRAME:
+        case NGX_HTTP_V2_HEADERS_FRAME:
+        case NGX_HTTP_V2_PRIORITY_FRAME:
+        case NGX_HTTP_V2_RST_STREAM_FRAME:
+        case NGX_HTTP_V2_PUSH_PROMISE_FRAME:
+        case NGX_HTTP_V2_CONTINUATION_FRAME:
+            goto invalid;
+
+        default:
+            return NGX_OK;
+        }
+    }
+
+    if (type == NGX_HTTP_V2_PUSH_PROMISE_FRAME) {
+        goto invalid;
+    }
+
+    if (type == NGX_HTTP_V2_DATA_FRAME) {
+
+        if (size > s->h2.recv_window) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "multiplexed upstream %V violated connection "
+                          "flow control, received %uz data frame with "
+                          "window %uz", &s->name, size, s->h2.recv_window);
+            return NGX_ERROR;
+        }
+
+        s->h2.recv_window -= size;
+
+        if (s->h2.recv_window < NGX_HTTP_V2_MAX_WINDOW / 4) {
+            if (ngx_http_upstream_multiplex_send_window_update(s, 0,
+                                   NGX_HTTP_V2_MAX_WINDOW - s->h2.recv_window)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+            s->h2.recv_window = NGX_HTTP_V2_MAX_WINDOW;
+        }
+    }
+
+    stream = NULL;
+
+    for (q = ngx_queue_head(&s->streams);
+         q != ngx_queue_sentinel(&s->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_upstream_multiplex_stream_t, queue);
+
+        if (stream->id == sid) {
+            break;
+        }
+
+        stream = NULL;
+    }
+
+    if (stream == NULL || stream->eof) {
+        /* frames of closed or refused streams are ignored */
+        return NGX_OK;
+    }
+
+    switch (type) {
+
+    case NGX_HTTP_V2_DATA_FRAME:
+
+        if (size > stream->recv_window) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "multiplexed upstream %V violated stream %ui "
+                          "flow control, received %uz data frame with "
+                          "window %uz",
+                          &s->name, sid, size, stream->recv_window);
+
+            (void) ngx_http_v2_write_uint32(payload,
+                                        NGX_HTTP_MULTIPLEX_FLOW_CTRL_FAILED);
+
+            if (ngx_http_upstream_multiplex_send_frame(s,
+                                          NGX_HTTP_V2_RST_STREAM_FRAME, 0, sid,
+                                          payload, 4)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+            ngx_http_upstream_multiplex_free_chain(s, stream->in);
+            stream->in = NULL;
+            stream->last_in = NULL;
+
+            stream->reset = 1;
+            stream->eof = 1;
+
+            ngx_http_upstream_multiplex_wake_stream(stream);
+
+            return NGX_OK;
+        }
+
+        stream->recv_window -= size;
+
+        /* fall through */
+
+    case NGX_HTTP_V2_HEADERS_FRAME:
+
+        if (flags & NGX_HTTP_V2_END_STREAM_FLAG) {
+            stream->remote_closed = 1;
+        }
+
+        break;
+
+    case NGX_HTTP_V2_RST_STREAM_FRAME:
+        stream->reset = 1;
+        break;
+
+    case NGX_HTTP_V2_PRIORITY_FRAME:
+        return NGX_OK;
+    }
+
+    if (ngx_http_upstream_multiplex_copy(s, &stream->in, &stream->last_in, pos,
+                                         NGX_HTTP_V2_FRAME_HEADER_SIZE + size)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    stream->buffered += NGX_HTTP_V2_FRAME_HEADER_SIZE + size;
+
+    stream->read.ready = 1;
+    ngx_post_event(&stream->read, &ngx_posted_events);
+
+    return NGX_OK;
+
+invalid:
+
+    ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                  "multiplexed upstream %V sent invalid http2 frame "
+                  "type:%ui l:%uz sid:%ui", &s->name, type, size, sid);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_settings(ngx_http_upstream_multiplex_session_t *s,
+    u_char *p, size_t size)
+{
+    u_char                                 frame[NGX_HTTP_V2_FRAME_HEADER_SIZE
+                                                 + 4];
+    size_t                                 window;
+    ngx_uint_t                             id, value;
+    ngx_queue_t                           *q;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    if (size % 6) {
+        ngx_log_error(NGX_LOG_ERR, s->peer.connection->log, 0,
+                      "multiplexed upstream %V sent settings frame "
+                      "with invalid length %uz", &s->name, size);
+        return NGX_ERROR;
+    }
+
+    for ( /* void */ ; size; size -= 6, p += 6) {
+        id = ngx_http_v2_parse_uint16(p);
+        value = ngx_http_v2_parse_uint32(&p[2]);
+
+        switch (id) {
+
+        case NGX_HTTP_MULTIPLEX_MAX_STREAMS:
+            s->max_streams = ngx_min(value, s->conf->streams);
+            break;
+
+        case NGX_HTTP_MULTIPLEX_INIT_WINDOW_SIZE:
+
+            if (value > NGX_HTTP_V2_MAX_WINDOW) {
+                ngx_log_error(NGX_LOG_ERR, s->peer.connection->log, 0,
+                              "multiplexed upstream %V sent settings frame "
+                              "with too large initial window size: %ui",
+                              &s->name, value);
+                return NGX_ERROR;
+            }
+
+            if (value <= s->h2.init_window) {
+
+                /*
+                 * windows of the streams already sent are not reduced,
+                 * the change only applies to new streams
+                 */
+
+                s->h2.init_window = value;
+                break;
+            }
+
+            /*
+             * the increase is delivered to the open streams as
+             * a window update frame of their own
+             */
+
+            window = value - s->h2.init_window;
+            s->h2.init_window = value;
+
+            for (q = ngx_queue_head(&s->streams);
+                 q != ngx_queue_sentinel(&s->streams);
+                 q = ngx_queue_next(q))
+            {
+                stream = ngx_queue_data(q,
+                                   ngx_http_upstream_multiplex_stream_t, queue);
+
+                if (stream->id == 0 || stream->eof) {
+                    continue;
+                }
+
+                frame[0] = 0;
+                frame[1] = 0;
+                frame[2] = 4;
+                frame[3] = NGX_HTTP_V2_WINDOW_UPDATE_FRAME;
+                frame[4] = 0;
+
+                (void) ngx_http_v2_write_uint32(&frame[5], stream->id);
+                (void) ngx_http_v2_write_uint32(&frame[9], window);
+
+                if (ngx_http_upstream_multiplex_copy(s, &stream->in,
+                                                     &stream->last_in,
+                                                     frame, sizeof(frame))
+                    != NGX_OK)
+                {
+                    return NGX_ERROR;
+                }
+
+                stream->buffered += sizeof(frame);
+
+                stream->read.ready = 1;
+                ngx_post_event(&stream->read, &ngx_posted_events);
+            }
+
+            break;
+        }
+    }
+
+    return ngx_http_upstream_multiplex_send_frame(s, NGX_HTTP_V2_SETTINGS_FRAME,
+                                                  NGX_HTTP_V2_ACK_FLAG, 0,
+                                                  NULL, 0);
+}
+
+
+static void
+ngx_http_upstream_multiplex_goaway(ngx_http_upstream_multiplex_session_t *s,
+    ngx_uint_t last)
+{
+    ngx_queue_t                           *q;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    s->goaway = 1;
+
+    /*
+     * streams above the last processed one are refused: they are closed
+     * without a response, so the request can be passed to the next upstream
+     */
+
+    for (q = ngx_queue_head(&s->streams);
+         q != ngx_queue_sentinel(&s->streams);
+         q = ngx_queue_next(q))
+    {
+        stream = ngx_queue_data(q, ngx_http_upstream_multiplex_stream_t, queue);
+
+        if (stream->eof || (stream->id && stream->id <= last)) {
+            continue;
+        }
+
+        ngx_http_upstream_multiplex_free_chain(s, stream->in);
+        stream->in = NULL;
+        stream->last_in = NULL;
+
+        stream->reset = 1;
+        stream->eof = 1;
+
+        ngx_http_upstream_multiplex_wake_stream(stream);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_send_frame(ngx_http_upstream_multiplex_session_t *s,
+    ngx_uint_t type, ngx_uint_t flags, ngx_uint_t sid, u_char *payload,
+    size_t size)
+{
+    u_char  header[NGX_HTTP_V2_FRAME_HEADER_SIZE];
+
+    header[0] = (u_char) (size >> 16);
+    header[1] = (u_char) (size >> 8);
+    header[2] = (u_char) size;
+    header[3] = (u_char) type;
+    header[4] = (u_char) flags;
+
+    (void) ngx_http_v2_write_sid(&header[5], sid);
+
+    if (ngx_http_upstream_multiplex_copy(s, &s->out, &s->last_out,
+                                         header, sizeof(header))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (size
+        && ngx_http_upstream_multiplex_copy(s, &s->out, &s->last_out,
+                                            payload, size)
+           != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    s->out_size += sizeof(header) + size;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_multiplex_send_window_update(
+    ngx_http_upstream_multiplex_session_t *s, ngx_uint_t sid, size_t window)
+{
+    u_char  payload[4];
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "multiplex send window update sid:%ui %uz", sid, window);
+
+    (void) ngx_http_v2_write_uint32(payload, window);
+
+    return ngx_http_upstream_multiplex_send_frame(s,
+                                                  NGX_HTTP_V2_WINDOW_UPDATE_FRAME,
+                                                  0, sid, payload, 4);
+}
+
+
+/*
+ * 把数据追加到由固定大小的块组成的链中，块在会话内复用
+ */
+
+static ngx_int_t
+ngx_http_upstream_multiplex_copy(ngx_http_upstream_multiplex_session_t *s,
+    ngx_chain_t **chain, ngx_chain_t **last, u_char *p, size_t size)
+{
+    size_t        n;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    cl = *last;
+
+    while (size) {
+
+        if (cl == NULL || cl->buf->last == cl->buf->end) {
+
+            if (s->free) {
+                cl = s->free;
+                s->free = cl->next;
+
+            } else {
+                b = ngx_create_temp_buf(s->pool,
+                                        NGX_HTTP_MULTIPLEX_CHUNK_SIZE);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+
+                cl = ngx_alloc_chain_link(s->pool);
+                if (cl == NULL) {
+                    return NGX_ERROR;
+                }
+
+                /* output is not delayed in the SSL buffer */
+                b->flush = 1;
+
+                cl->buf = b;
+            }
+
+            cl->next = NULL;
+
+            if (*last) {
+                (*last)->next = cl;
+
+            } else {
+                *chain = cl;
+            }
+
+            *last = cl;
+        }
+
+        b = cl->buf;
+
+        n = ngx_min(size, (size_t) (b->end - b->last));
+
+        b->last = ngx_cpymem(b->last, p, n);
+
+        p += n;
+        size -= n;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_multiplex_free_chain(ngx_http_upstream_multiplex_session_t *s,
+    ngx_chain_t *cl)
+{
+    ngx_chain_t  *ln;
+
+    while (cl) {
+        ln = cl->next;
+
+        cl->buf->pos = cl->buf->start;
+        cl->buf->last = cl->buf->start;
+
+        cl->next = s->free;
+        s->free = cl;
+
+        cl = ln;
+    }
+}
+
+
+static void
+ngx_http_upstream_multiplex_close_session(
+    ngx_http_upstream_multiplex_session_t *s)
+{
+    ngx_queue_t                           *q;
+    ngx_connection_t                      *c;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "close multiplex session %p", s);
+
+    ngx_queue_remove(&s->queue);
+    s->conf->nsessions--;
+
+    /* the streams see the connection closed */
+
+    while (!ngx_queue_empty(&s->streams)) {
+        q = ngx_queue_head(&s->streams);
+        ngx_queue_remove(q);
+
+        stream = ngx_queue_data(q, ngx_http_upstream_multiplex_stream_t, queue);
+
+        stream->session = NULL;
+        stream->in = NULL;
+        stream->last_in = NULL;
+        stream->eof = 1;
+
+        ngx_http_upstream_multiplex_wake_stream(stream);
+    }
+
+    c = s->peer.connection;
+
+#if (NGX_HTTP_SSL)
+
+    if (c->ssl) {
+        c->ssl->no_wait_shutdown = 1;
+        c->ssl->no_send_shutdown = 1;
+
+        (void) ngx_ssl_shutdown(c);
+    }
+
+#endif
+
+    ngx_destroy_pool(c->pool);
+    ngx_close_connection(c);
+}
+
+
+static ngx_http_upstream_multiplex_stream_t *
+ngx_http_upstream_multiplex_create_stream(
+    ngx_http_upstream_multiplex_session_t *s, ngx_log_t *log)
+{
+    ngx_queue_t                           *q;
+    ngx_event_t                           *rev, *wev;
+    ngx_connection_t                      *c, *sc;
+    ngx_http_upstream_multiplex_stream_t  *stream;
+
+    if (!ngx_queue_empty(&s->conf->free)) {
+        q = ngx_queue_head(&s->conf->free);
+        ngx_queue_remove(q);
+
+        stream = ngx_queue_data(q, ngx_http_upstream_multiplex_stream_t, queue);
+
+    } else {
+        stream = ngx_palloc(ngx_cycle->pool,
+                            sizeof(ngx_http_upstream_multiplex_stream_t));
+        if (stream == NULL) {
+            return NULL;
+        }
+    }
+
+    ngx_memzero(stream, sizeof(ngx_http_upstream_multiplex_stream_t));
+
+    sc = s->peer.connection;
+
+    stream->session = s;
+    stream->recv_window = s->conf->window;
+
+    /*
+     * the virtual connection uses the socket and SSL connection of
+     * the session only to look like an established connection,
+     * all input and output goes through the session
+     */
+
+    c = &stream->connection;
+    rev = &stream->read;
+    wev = &stream->write;
+
+    c->read = rev;
+    c->write = wev;
+
+    c->fd = sc->fd;
+    c->type = SOCK_STREAM;
+
+    c->recv = ngx_http_upstream_multiplex_recv;
+    c->send = ngx_http_upstream_multiplex_send;
+    c->recv_chain = ngx_http_upstream_multiplex_recv_chain;
+    c->send_chain = ngx_http_upstream_multiplex_send_chain;
+
+    c->log = log;
+    c->log_error = NGX_ERROR_ERR;
+
+    c->sockaddr = sc->sockaddr;
+    c->socklen = sc->socklen;
+    c->addr_text = sc->addr_text;
+
+#if (NGX_HTTP_SSL)
+    c->ssl = sc->ssl;
+#endif
+
+    c->tcp_nodelay = NGX_TCP_NODELAY_DISABLED;
+    c->tcp_nopush = NGX_TCP_NOPUSH_DISABLED;
+
+    c->start_time = ngx_current_msec;
+    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+
+    rev->data = c;
+    rev->log = log;
+    rev->handler = ngx_http_upstream_multiplex_dummy_handler;
+    rev->active = 1;
+
+    wev->data = c;
+    wev->log = log;
+    wev->handler = ngx_http_upstream_multiplex_dummy_handler;
+    wev->write = 1;
+    wev->active = 1;
+    wev->ready = 1;
+
+    ngx_queue_insert_tail(&s->streams, &stream->queue);
+    s->nstreams++;
+
+    if (sc->idle) {
+        sc->idle = 0;
+
+        if (sc->read->timer_set) {
+            ngx_del_timer(sc->read);
+        }
+    }
+
+    return stream;
+}
+
+
+static void
+ngx_http_upstream_multiplex_close_stream(
+    ngx_http_upstream_multiplex_srv_conf_t *mcf,
+    ngx_http_upstream_multiplex_stream_t *stream, ngx_uint_t cancel)
+{
+    u_char                                  payload[4];
+    ngx_connection_t                       *c, *sc;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    c = &stream->connection;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "close multiplex stream %ui, cancel:%ui",
+                   stream->id, cancel);
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+
+    if (c->read->posted) {
+        ngx_delete_posted_event(c->read);
+    }
+
+    if (c->write->posted) {
+        ngx_delete_posted_event(c->write);
+    }
+
+    if (c->pool) {
+        ngx_destroy_pool(c->pool);
+        c->pool = NULL;
+    }
+
+    s = stream->session;
+
+    if (s == NULL) {
+        goto free;
+    }
+
+    if (stream->id && !stream->reset && (cancel || !stream->remote_closed)) {
+
+        (void) ngx_http_v2_write_uint32(payload, NGX_HTTP_MULTIPLEX_CANCEL);
+
+        if (ngx_http_upstream_multiplex_send_frame(s,
+                                                   NGX_HTTP_V2_RST_STREAM_FRAME,
+                                                   0, stream->id, payload, 4)
+            != NGX_OK)
+        {
+            s->goaway = 1;
+        }
+    }
+
+    ngx_http_upstream_multiplex_free_chain(s, stream->in);
+
+    ngx_queue_remove(&stream->queue);
+    s->nstreams--;
+
+    sc = s->peer.connection;
+
+    if (s->nstreams == 0) {
+
+        if (s->goaway || ngx_terminate || ngx_exiting) {
+            ngx_http_upstream_multiplex_close_session(s);
+            goto free;
+        }
+
+        if (s->ready) {
+            sc->idle = 1;
+            ngx_add_timer(sc->read, mcf->timeout);
+        }
+    }
+
+    if (s->out) {
+        ngx_post_event(sc->write, &ngx_posted_events);
+    }
+
+free:
+
+    stream->session = NULL;
+
+    ngx_queue_insert_head(&mcf->free, &stream->queue);
+}
+
+
+static void
+ngx_http_upstream_multiplex_wake_stream(
+    ngx_http_upstream_multiplex_stream_t *stream)
+{
+    stream->read.ready = 1;
+    stream->write.ready = 1;
+
+    ngx_post_event(&stream->read, &ngx_posted_events);
+    ngx_post_event(&stream->write, &ngx_posted_events);
+}
+
+
+static ssize_t
+ngx_http_upstream_multiplex_recv(ngx_connection_t *c, u_char *buf,
+    size_t size)
+{
+    u_char                                 *p;
+    size_t                                  n, window;
+    ngx_buf_t                              *b;
+    ngx_chain_t                            *cl;
+    ngx_http_upstream_multiplex_stream_t   *stream;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    stream = ngx_http_upstream_multiplex_stream(c);
+    s = stream->session;
+
+    p = buf;
+
+    while (stream->in && size) {
+        b = stream->in->buf;
+
+        n = ngx_min(size, (size_t) (b->last - b->pos));
+
+        p = ngx_cpymem(p, b->pos, n);
+
+        b->pos += n;
+        size -= n;
+
+        if (b->pos == b->last) {
+            cl = stream->in;
+            stream->in = cl->next;
+
+            if (stream->in == NULL) {
+                stream->last_in = NULL;
+            }
+
+            cl->next = NULL;
+            ngx_http_upstream_multiplex_free_chain(s, cl);
+        }
+    }
+
+    n = p - buf;
+
+    if (n) {
+        stream->buffered -= n;
+
+        /*
+         * the stream window is restored as the data is consumed,
+         * so a slow client only holds a window worth of data
+         */
+
+        window = s->conf->window;
+
+        if (!stream->remote_closed
+            && stream->recv_window + stream->buffered <= window / 2)
+        {
+            if (ngx_http_upstream_multiplex_send_window_update(s, stream->id,
+                                window - stream->buffered - stream->recv_window)
+                != NGX_OK)
+            {
+                c->read->error = 1;
+                return NGX_ERROR;
+            }
+
+            stream->recv_window = window - stream->buffered;
+
+            ngx_post_event(s->peer.connection->write, &ngx_posted_events);
+        }
+
+        if (stream->in == NULL && !stream->eof) {
+            c->read->ready = 0;
+        }
+
+        return n;
+    }
+
+    if (stream->eof) {
+        c->read->eof = 1;
+        return 0;
+    }
+
+    c->read->ready = 0;
+
+    return NGX_AGAIN;
+}
+
+
+static ssize_t
+ngx_http_upstream_multiplex_recv_chain(ngx_connection_t *c, ngx_chain_t *in,
+    off_t limit)
+{
+    size_t    size;
+    ssize_t   n, total;
+
+    total = 0;
+
+    for ( /* void */ ; in; in = in->next) {
+
+        size = in->buf->end - in->buf->last;
+
+        if (limit && (off_t) size > limit - total) {
+            size = (size_t) (limit - total);
+        }
+
+        n = ngx_http_upstream_multiplex_recv(c, in->buf->last, size);
+
+        if (n <= 0) {
+            return total ? total : n;
+        }
+
+        total += n;
+
+        if ((size_t) n < size || (limit && total >= limit)) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+
+static ssize_t
+ngx_http_upstream_multiplex_send(ngx_connection_t *c, u_char *buf,
+    size_t size)
+{
+    ngx_buf_t     b;
+    ngx_chain_t   cl, *rc;
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    b.pos = buf;
+    b.last = buf + size;
+    b.temporary = 1;
+
+    cl.buf = &b;
+    cl.next = NULL;
+
+    rc = ngx_http_upstream_multiplex_send_chain(c, &cl, 0);
+
+    if (rc == NGX_CHAIN_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (rc == &cl) {
+        return NGX_AGAIN;
+    }
+
+    return size;
+}
+
+
+/*
+ * 流的输出整体复制到会话的输出队列中，保证帧不会被其他流的帧截断；
+ * 第一次发送（请求头）总是被接受，以保证流标识按顺序出现在连接上
+ */
+
+static ngx_chain_t *
+ngx_http_upstream_multiplex_send_chain(ngx_connection_t *c, ngx_chain_t *in,
+    off_t limit)
+{
+    off_t                                   sent;
+    size_t                                  size;
+    ngx_buf_t                              *b;
+    ngx_chain_t                            *cl;
+    ngx_http_upstream_multiplex_stream_t   *stream;
+    ngx_http_upstream_multiplex_session_t  *s;
+
+    stream = ngx_http_upstream_multiplex_stream(c);
+    s = stream->session;
+
+    if (s == NULL || stream->eof) {
+        c->write->error = 1;
+        return NGX_CHAIN_ERROR;
+    }
+
+    if (stream->queued && s->out_size >= NGX_HTTP_MULTIPLEX_OUTPUT_SIZE) {
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "multiplex stream %ui blocked, output: %uz",
+                       stream->id, s->out_size);
+
+        stream->blocked = 1;
+        c->write->ready = 0;
+
+        return in;
+    }
+
+    sent = 0;
+
+    for (cl = in; cl; cl = cl->next) {
+        b = cl->buf;
+
+        if (ngx_buf_special(b)) {
+            continue;
+        }
+
+        if (!ngx_buf_in_memory(b)) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                          "file buffer in multiplexed upstream output");
+            return NGX_CHAIN_ERROR;
+        }
+
+        size = b->last - b->pos;
+
+        if (ngx_http_upstream_multiplex_copy(s, &s->out, &s->last_out,
+                                             b->pos, size)
+            != NGX_OK)
+        {
+            return NGX_CHAIN_ERROR;
+        }
+
+        sent += size;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "multiplex stream %ui queued %O", stream->id, sent);
+
+    s->out_size += sent;
+    stream->queued = 1;
+
+    c->sent += sent;
+
+    ngx_post_event(s->peer.connection->write, &ngx_posted_events);
+
+    return ngx_chain_update_sent(in, sent);
+}
+
+
+static void
+ngx_http_upstream_multiplex_dummy_handler(ngx_event_t *ev)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "multiplex dummy handler");
+}
+
+
+static void *
+ngx_http_upstream_multiplex_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_upstream_multiplex_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool,
+                       sizeof(ngx_http_upstream_multiplex_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->original_init_upstream = NULL;
+     *     conf->original_init_peer = NULL;
+     *     conf->max_sessions = 0;
+     *     conf->nsessions = 0;
+     */
+
+    conf->streams = NGX_CONF_UNSET_UINT;
+    conf->window = NGX_CONF_UNSET_SIZE;
+    conf->timeout = NGX_CONF_UNSET_MSEC;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_upstream_multiplex(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_upstream_srv_conf_t            *uscf;
+    ngx_http_upstream_multiplex_srv_conf_t  *mcf = conf;
+
+    ngx_int_t    n;
+    ngx_str_t   *value;
+
+    if (mcf->max_sessions) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    n = ngx_atoi(value[1].data, value[1].len);
+
+    if (n == NGX_ERROR || n == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\" in \"%V\" directive",
+                           &value[1], &cmd->name);
+        return NGX_CONF_ERROR;
+    }
+
+    mcf->max_sessions = n;
+
+    /* init upstream handler */
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    mcf->original_init_upstream = uscf->peer.init_upstream
+                                  ? uscf->peer.init_upstream
+                                  : ngx_http_upstream_init_round_robin;
+
+    uscf->peer.init_upstream = ngx_http_upstream_init_multiplex;
+
+    return NGX_CONF_OK;
+}
@@ -0,0 +1,33 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HTTP_UPSTREAM_MULTIPLEX_H_INCLUDED_
+#define _NGX_HTTP_UPSTREAM_MULTIPLEX_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * 多路复用的HTTP/2上游连接的连接级状态，由连接上的所有流共享：
+ * 发送方向的流量控制由使用者检查并扣减，连接级控制帧由本模块处理
+ */
+typedef struct {
+    size_t                      init_window;    /* 对端的初始流窗口 */
+    size_t                      send_window;    /* 连接的发送窗口 */
+    size_t                      recv_window;    /* 连接的接收窗口 */
+    ngx_uint_t                  last_stream_id;
+} ngx_http_upstream_multiplex_conn_t;
+
+
+ngx_int_t ngx_http_upstream_multiplex_open_stream(ngx_connection_t *c,
+    ngx_http_upstream_multiplex_conn_t **h2, ngx_uint_t *id);
+
+
+#endif /* _NGX_HTTP_UPSTREAM_MULTIPLEX_H_INCLUDED_ */
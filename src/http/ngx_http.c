@@ -43,11 +43,9 @@ static ngx_int_t ngx_http_cmp_locations(const ngx_queue_t *one,
     const ngx_queue_t *two);
 static ngx_int_t ngx_http_join_exact_locations(ngx_conf_t *cf,
     ngx_queue_t *locations);
-static void ngx_http_create_locations_list(ngx_queue_t *locations,
-    ngx_queue_t *q);
-static ngx_http_location_tree_node_t *
-    ngx_http_create_locations_tree(ngx_conf_t *cf, ngx_queue_t *locations,
-    size_t prefix);
+static ngx_int_t ngx_http_create_locations_trie(ngx_conf_t *cf,
+    ngx_http_location_trie_t *node, ngx_http_location_queue_t **lqs,
+    ngx_uint_t n, size_t depth);
 
 static ngx_int_t ngx_http_optimize_servers(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf, ngx_array_t *ports);
@@ -56,6 +54,10 @@ static ngx_int_t ngx_http_server_names(ngx_conf_t *cf,
 static ngx_int_t ngx_http_cmp_conf_addrs(const void *one, const void *two);
 static int ngx_libc_cdecl ngx_http_cmp_dns_wildcards(const void *one,
     const void *two);
+#if (NGX_PCRE)
+static ngx_int_t ngx_http_create_regex_set(ngx_conf_t *cf,
+    ngx_str_t *literals, ngx_uint_t n, ngx_regex_set_t **set);
+#endif
 
 static ngx_int_t ngx_http_init_listening(ngx_conf_t *cf,
     ngx_http_conf_port_t *port);
@@ -355,231 +357,6 @@ failed:
     return rv;
 }
 
-{
-    char                        *rv;
-    ngx_uint_t                   mi, m, s;
-    ngx_conf_t                   pcf;
-    ngx_http_module_t           *module;
-    ngx_http_conf_ctx_t         *ctx;
-    ngx_http_core_loc_conf_t    *clcf;
-    ngx_http_core_srv_conf_t   **cscfp;
-    ngx_http_core_main_conf_t   *cmcf;
-
-    if (*(ngx_http_conf_ctx_t **) conf) {
-        return "is duplicate";
-    }
-
-    /* the main http context */
-
-    ctx = ngx_pcalloc(cf->pool, sizeof(ngx_http_conf_ctx_t));
-    if (ctx == NULL) {
-        return NGX_CONF_ERROR;
-    }
-
-    *(ngx_http_conf_ctx_t **) conf = ctx;
-
-
-    /* count the number of the http modules and set up their indices */
-
-    ngx_http_max_module = ngx_count_modules(cf->cycle, NGX_HTTP_MODULE);
-
-
-    /* the http main_conf context, it is the same in the all http contexts */
-
-    ctx->main_conf = ngx_pcalloc(cf->pool,
-                                 sizeof(void *) * ngx_http_max_module);
-    if (ctx->main_conf == NULL) {
-        return NGX_CONF_ERROR;
-    }
-
-
-    /*
-     * the http null srv_conf context, it is used to merge
-     * the server{}s' srv_conf's
-     */
-
-    ctx->srv_conf = ngx_pcalloc(cf->pool, sizeof(void *) * ngx_http_max_module);
-    if (ctx->srv_conf == NULL) {
-        return NGX_CONF_ERROR;
-    }
-
-
-    /*
-     * the http null loc_conf context, it is used to merge
-     * the server{}s' loc_conf's
-     */
-
-    ctx->loc_conf = ngx_pcalloc(cf->pool, sizeof(void *) * ngx_http_max_module);
-    if (ctx->loc_conf == NULL) {
-        return NGX_CONF_ERROR;
-    }
-
-
-    /*
-     * create the main_conf's, the null srv_conf's, and the null loc_conf's
-     * of the all http modules
-     */
-
-    for (m = 0; cf->cycle->modules[m]; m++) {
-        if (cf->cycle->modules[m]->type != NGX_HTTP_MODULE) {
-            continue;
-        }
-
-        module = cf->cycle->modules[m]->ctx;
-        mi = cf->cycle->modules[m]->ctx_index;
-
-        if (module->create_main_conf) {
-            ctx->main_conf[mi] = module->create_main_conf(cf);
-            if (ctx->main_conf[mi] == NULL) {
-                return NGX_CONF_ERROR;
-            }
-        }
-
-        if (module->create_srv_conf) {
-            ctx->srv_conf[mi] = module->create_srv_conf(cf);
-            if (ctx->srv_conf[mi] == NULL) {
-                return NGX_CONF_ERROR;
-            }
-        }
-
-        if (module->create_loc_conf) {
-            ctx->loc_conf[mi] = module->create_loc_conf(cf);
-            if (ctx->loc_conf[mi] == NULL) {
-                return NGX_CONF_ERROR;
-            }
-        }
-    }
-
-    pcf = *cf;
-    cf->ctx = ctx;
-
-    for (m = 0; cf->cycle->modules[m]; m++) {
-        if (cf->cycle->modules[m]->type != NGX_HTTP_MODULE) {
-            continue;
-        }
-
-        module = cf->cycle->modules[m]->ctx;
-
-        if (module->preconfiguration) {
-            if (module->preconfiguration(cf) != NGX_OK) {
-                return NGX_CONF_ERROR;
-            }
-        }
-    }
-
-    /* parse inside the http{} block */
-
-    cf->module_type = NGX_HTTP_MODULE;
-    cf->cmd_type = NGX_HTTP_MAIN_CONF;
-    rv = ngx_conf_parse(cf, NULL);
-
-    if (rv != NGX_CONF_OK) {
-        goto failed;
-    }
-
-    /*
-     * init http{} main_conf's, merge the server{}s' srv_conf's
-     * and its location{}s' loc_conf's
-     */
-
-    cmcf = ctx->main_conf[ngx_http_core_module.ctx_index];
-    cscfp = cmcf->servers.elts;
-
-    for (m = 0; cf->cycle->modules[m]; m++) {
-        if (cf->cycle->modules[m]->type != NGX_HTTP_MODULE) {
-            continue;
-        }
-
-        module = cf->cycle->modules[m]->ctx;
-        mi = cf->cycle->modules[m]->ctx_index;
-
-        /* init http{} main_conf's */
-
-        if (module->init_main_conf) {
-            rv = module->init_main_conf(cf, ctx->main_conf[mi]);
-            if (rv != NGX_CONF_OK) {
-                goto failed;
-            }
-        }
-
-        rv = ngx_http_merge_servers(cf, cmcf, module, mi);
-        if (rv != NGX_CONF_OK) {
-            goto failed;
-        }
-    }
-
-
-    /* create location trees */
-
-    for (s = 0; s < cmcf->servers.nelts; s++) {
-
-        clcf = cscfp[s]->ctx->loc_conf[ngx_http_core_module.ctx_index];
-
-        if (ngx_http_init_locations(cf, cscfp[s], clcf) != NGX_OK) {
-            return NGX_CONF_ERROR;
-        }
-
-        if (ngx_http_init_static_location_trees(cf, clcf) != NGX_OK) {
-            return NGX_CONF_ERROR;
-        }
-    }
-
-
-    if (ngx_http_init_phases(cf, cmcf) != NGX_OK) {
-        return NGX_CONF_ERROR;
-    }
-
-    if (ngx_http_init_headers_in_hash(cf, cmcf) != NGX_OK) {
-        return NGX_CONF_ERROR;
-    }
-
-
-    for (m = 0; cf->cycle->modules[m]; m++) {
-        if (cf->cycle->modules[m]->type != NGX_HTTP_MODULE) {
-            continue;
-        }
-
-        module = cf->cycle->modules[m]->ctx;
-
-        if (module->postconfiguration) {
-            if (module->postconfiguration(cf) != NGX_OK) {
-                return NGX_CONF_ERROR;
-            }
-        }
-    }
-
-    if (ngx_http_variables_init_vars(cf) != NGX_OK) {
-        return NGX_CONF_ERROR;
-    }
-
-    /*
-     * http{}'s cf->ctx was needed while the configuration merging
-     * and in postconfiguration process
-     */
-
-    *cf = pcf;
-
-
-    if (ngx_http_init_phase_handlers(cf, cmcf) != NGX_OK) {
-        return NGX_CONF_ERROR;
-    }
-
-
-    /* optimize the lists of ports, addresses and server names */
-
-    if (ngx_http_optimize_servers(cf, cmcf, cmcf->ports) != NGX_OK) {
-        return NGX_CONF_ERROR;
-    }
-
-    return NGX_CONF_OK;
-
-failed:
-
-    *cf = pcf;
-
-    return rv;
-}
-
 
 /*
 整体功能：初始化NGINX HTTP核心模块的各个处理阶段的处理函数数组。
@@ -695,6 +472,21 @@ ngx_http_init_headers_in_hash(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
         return NGX_ERROR;
     }
 
+    /*
+     * the known headers are looked up for every request header line,
+     * the perfect hash needs a single comparison and rejects most of
+     * unknown headers by the key; headers_in_hash is still used
+     * if no layout is found
+     */
+
+    if (ngx_hash_perfect_init(&cmcf->headers_in_perfect_hash,
+                              &cmcf->headers_in_hash, headers_in.elts,
+                              headers_in.nelts, 1024, cf->pool)
+        == NGX_ERROR)
+    {
+        return NGX_ERROR;
+    }
+
     return NGX_OK;
 }
 
@@ -926,6 +718,7 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
     ngx_http_core_loc_conf_t   **clcfp;
 #if (NGX_PCRE)
     ngx_uint_t                   r;
+    ngx_str_t                   *literals;
     ngx_queue_t                 *regex;
 #endif
 
@@ -1024,18 +817,33 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 
         pclcf->regex_locations = clcfp;
 
+        literals = ngx_palloc(cf->temp_pool, r * sizeof(ngx_str_t));
+        if (literals == NULL) {
+            return NGX_ERROR;
+        }
+
+        r = 0;
+
         for (q = regex;
              q != ngx_queue_sentinel(locations);
              q = ngx_queue_next(q))
         {
             lq = (ngx_http_location_queue_t *) q;
 
+            literals[r++] = lq->exact->regex->literal;
+
             *(clcfp++) = lq->exact;
         }
 
         *clcfp = NULL;
 
         ngx_queue_split(locations, regex, &tail);
+
+        if (ngx_http_create_regex_set(cf, literals, r, &pclcf->regex_set)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
     }
 
 #endif
@@ -1048,9 +856,10 @@ static ngx_int_t
 ngx_http_init_static_location_trees(ngx_conf_t *cf,
     ngx_http_core_loc_conf_t *pclcf)
 {
+    ngx_uint_t                  n;
     ngx_queue_t                *q, *locations;
     ngx_http_core_loc_conf_t   *clcf;
-    ngx_http_location_queue_t  *lq;
+    ngx_http_location_queue_t  *lq, **lqs;
 
     locations = pclcf->locations;
 
@@ -1079,14 +888,37 @@ ngx_http_init_static_location_trees(ngx_conf_t *cf,
         return NGX_ERROR;
     }
 
-    ngx_http_create_locations_list(locations, ngx_queue_head(locations));
+    n = 0;
+
+    for (q = ngx_queue_head(locations);
+         q != ngx_queue_sentinel(locations);
+         q = ngx_queue_next(q))
+    {
+        n++;
+    }
+
+    lqs = ngx_palloc(cf->temp_pool, n * sizeof(ngx_http_location_queue_t *));
+    if (lqs == NULL) {
+        return NGX_ERROR;
+    }
+
+    n = 0;
+
+    for (q = ngx_queue_head(locations);
+         q != ngx_queue_sentinel(locations);
+         q = ngx_queue_next(q))
+    {
+        lqs[n++] = (ngx_http_location_queue_t *) q;
+    }
 
-    pclcf->static_locations = ngx_http_create_locations_tree(cf, locations, 0);
+    pclcf->static_locations = ngx_pcalloc(cf->pool,
+                                          sizeof(ngx_http_location_trie_t));
     if (pclcf->static_locations == NULL) {
         return NGX_ERROR;
     }
 
-    return NGX_OK;
+    return ngx_http_create_locations_trie(cf, pclcf->static_locations,
+                                          lqs, n, 0);
 }
 
 
@@ -1129,8 +961,6 @@ ngx_http_add_location(ngx_conf_t *cf, ngx_queue_t **locations,
     lq->file_name = cf->conf_file->file.name.data;
     lq->line = cf->conf_file->line;
 
-    ngx_queue_init(&lq->list);
-
     ngx_queue_insert_tail(*locations, &lq->queue);
 
     if (ngx_http_escape_location_name(cf, clcf) != NGX_OK) {
@@ -1286,140 +1116,117 @@ ngx_http_join_exact_locations(ngx_conf_t *cf, ngx_queue_t *locations)
 }
 
 
-static void
-ngx_http_create_locations_list(ngx_queue_t *locations, ngx_queue_t *q)
-{
-    u_char                     *name;
-    size_t                      len;
-    ngx_queue_t                *x, tail;
-    ngx_http_location_queue_t  *lq, *lx;
-
-    if (q == ngx_queue_last(locations)) {
-        return;
-    }
-
-    lq = (ngx_http_location_queue_t *) q;
-
-    if (lq->inclusive == NULL) {
-        ngx_http_create_locations_list(locations, ngx_queue_next(q));
-        return;
-    }
+/*
+ * the locations are sorted by ngx_filename_cmp(), so the names sharing
+ * a prefix are adjacent: a node takes the common prefix of the range,
+ * the location equal to it, if any, and a child for each next byte
+ */
 
-    len = lq->name->len;
-    name = lq->name->data;
+static ngx_int_t
+ngx_http_create_locations_trie(ngx_conf_t *cf, ngx_http_location_trie_t *node,
+    ngx_http_location_queue_t **lqs, ngx_uint_t n, size_t depth)
+{
+    u_char                     c, *keys;
+    size_t                     len;
+    ngx_str_t                 *first, *last;
+    ngx_uint_t                 i, j, k, nchildren;
+    ngx_http_location_queue_t  *lq;
 
-    for (x = ngx_queue_next(q);
-         x != ngx_queue_sentinel(locations);
-         x = ngx_queue_next(x))
-    {
-        lx = (ngx_http_location_queue_t *) x;
+    first = lqs[0]->name;
+    last = lqs[n - 1]->name;
 
-        if (len > lx->name->len
-            || ngx_filename_cmp(name, lx->name->data, len) != 0)
+    for (len = depth; len < first->len && len < last->len; len++) {
+        if (ngx_http_location_char(first->data[len])
+            != ngx_http_location_char(last->data[len]))
         {
             break;
         }
     }
 
-    q = ngx_queue_next(q);
+    node->len = (u_short) (len - depth);
 
-    if (q == x) {
-        ngx_http_create_locations_list(locations, x);
-        return;
+    node->name = ngx_pnalloc(cf->pool, node->len);
+    if (node->name == NULL) {
+        return NGX_ERROR;
     }
 
-    ngx_queue_split(locations, q, &tail);
-    ngx_queue_add(&lq->list, &tail);
-
-    if (x == ngx_queue_sentinel(locations)) {
-        ngx_http_create_locations_list(&lq->list, ngx_queue_head(&lq->list));
-        return;
+    for (i = 0; i < node->len; i++) {
+        node->name[i] = ngx_http_location_char(first->data[depth + i]);
     }
 
-    ngx_queue_split(&lq->list, x, &tail);
-    ngx_queue_add(locations, &tail);
-
-    ngx_http_create_locations_list(&lq->list, ngx_queue_head(&lq->list));
-
-    ngx_http_create_locations_list(locations, x);
-}
-
-
-/*
- * to keep cache locality for left leaf nodes, allocate nodes in following
- * order: node, left subtree, right subtree, inclusive subtree
- */
-
-static ngx_http_location_tree_node_t *
-ngx_http_create_locations_tree(ngx_conf_t *cf, ngx_queue_t *locations,
-    size_t prefix)
-{
-    size_t                          len;
-    ngx_queue_t                    *q, tail;
-    ngx_http_location_queue_t      *lq;
-    ngx_http_location_tree_node_t  *node;
+    if (first->len == len) {
+        lq = lqs[0];
 
-    q = ngx_queue_middle(locations);
+        node->exact = lq->exact;
+        node->inclusive = lq->inclusive;
 
-    lq = (ngx_http_location_queue_t *) q;
-    len = lq->name->len - prefix;
+        node->auto_redirect = (u_char)
+                              ((lq->exact && lq->exact->auto_redirect)
+                               || (lq->inclusive
+                                   && lq->inclusive->auto_redirect));
 
-    node = ngx_palloc(cf->pool,
-                      offsetof(ngx_http_location_tree_node_t, name) + len);
-    if (node == NULL) {
-        return NULL;
+        lqs++;
+        n--;
     }
 
-    node->left = NULL;
-    node->right = NULL;
-    node->tree = NULL;
-    node->exact = lq->exact;
-    node->inclusive = lq->inclusive;
+    if (n == 0) {
+        return NGX_OK;
+    }
 
-    node->auto_redirect = (u_char) ((lq->exact && lq->exact->auto_redirect)
-                           || (lq->inclusive && lq->inclusive->auto_redirect));
+    nchildren = 1;
 
-    node->len = (u_short) len;
-    ngx_memcpy(node->name, &lq->name->data[prefix], len);
+    for (i = 1; i < n; i++) {
+        if (ngx_http_location_char(lqs[i]->name->data[len])
+            != ngx_http_location_char(lqs[i - 1]->name->data[len]))
+        {
+            nchildren++;
+        }
+    }
 
-    ngx_queue_split(locations, q, &tail);
+    node->nchildren = (u_short) nchildren;
 
-    if (ngx_queue_empty(locations)) {
-        /*
-         * ngx_queue_split() insures that if left part is empty,
-         * then right one is empty too
-         */
-        goto inclusive;
+    node->children = ngx_pcalloc(cf->pool,
+                                 nchildren * sizeof(ngx_http_location_trie_t));
+    if (node->children == NULL) {
+        return NGX_ERROR;
     }
 
-    node->left = ngx_http_create_locations_tree(cf, locations, prefix);
-    if (node->left == NULL) {
-        return NULL;
+    node->keys = ngx_pcalloc(cf->pool,
+                             (nchildren > NGX_HTTP_LOCATION_TRIE_SCAN)
+                             ? 256 : nchildren);
+    if (node->keys == NULL) {
+        return NGX_ERROR;
     }
 
-    ngx_queue_remove(q);
+    keys = node->keys;
 
-    if (ngx_queue_empty(&tail)) {
-        goto inclusive;
-    }
+    for (i = 0, k = 0; i < n; i = j, k++) {
 
-    node->right = ngx_http_create_locations_tree(cf, &tail, prefix);
-    if (node->right == NULL) {
-        return NULL;
-    }
+        c = ngx_http_location_char(lqs[i]->name->data[len]);
 
-inclusive:
+        for (j = i + 1; j < n; j++) {
+            if (ngx_http_location_char(lqs[j]->name->data[len]) != c) {
+                break;
+            }
+        }
 
-    if (ngx_queue_empty(&lq->list)) {
-        return node;
-    }
+        if (nchildren > NGX_HTTP_LOCATION_TRIE_SCAN) {
+            /* names do not contain zero bytes, so there are at most 255 */
+            keys[c] = (u_char) (k + 1);
 
-    node->tree = ngx_http_create_locations_tree(cf, &lq->list, prefix + len);
-    if (node->tree == NULL) {
-        return NULL;
+        } else {
+            keys[k] = c;
+        }
+
+        if (ngx_http_create_locations_trie(cf, &node->children[k], &lqs[i],
+                                           j - i, len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
     }
 
-    return node;
+    return NGX_OK;
 }
 
 
@@ -1672,6 +1479,7 @@ ngx_http_add_address(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 #if (NGX_PCRE)
     addr->nregex = 0;
     addr->regex = NULL;
+    addr->regex_set = NULL;
 #endif
     addr->default_server = cscf;
     addr->servers.elts = NULL;
@@ -1778,49 +1586,6 @@ ngx_http_optimize_servers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
     return NGX_OK;
 }
 
-{
-    ngx_uint_t             p, a;
-    ngx_http_conf_port_t  *port;
-    ngx_http_conf_addr_t  *addr;
-
-    if (ports == NULL) {
-        return NGX_OK;
-    }
-
-    port = ports->elts;
-    for (p = 0; p < ports->nelts; p++) {
-
-        ngx_sort(port[p].addrs.elts, (size_t) port[p].addrs.nelts,
-                 sizeof(ngx_http_conf_addr_t), ngx_http_cmp_conf_addrs);
-
-        /*
-         * check whether all name-based servers have the same
-         * configuration as a default server for given address:port
-         */
-
-        addr = port[p].addrs.elts;
-        for (a = 0; a < port[p].addrs.nelts; a++) {
-
-            if (addr[a].servers.nelts > 1
-#if (NGX_PCRE)
-                || addr[a].default_server->captures
-#endif
-               )
-            {
-                if (ngx_http_server_names(cf, cmcf, &addr[a]) != NGX_OK) {
-                    return NGX_ERROR;
-                }
-            }
-        }
-
-        if (ngx_http_init_listening(cf, &port[p]) != NGX_OK) {
-            return NGX_ERROR;
-        }
-    }
-
-    return NGX_OK;
-}
-
 
 static ngx_int_t
 ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
@@ -1833,6 +1598,7 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
     ngx_http_server_name_t     *name;
     ngx_http_core_srv_conf_t  **cscfp;
 #if (NGX_PCRE)
+    ngx_str_t                  *literals;
     ngx_uint_t                  regex, i;
 
     regex = 0;
@@ -1953,6 +1719,11 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
         return NGX_ERROR;
     }
 
+    literals = ngx_palloc(cf->temp_pool, regex * sizeof(ngx_str_t));
+    if (literals == NULL) {
+        return NGX_ERROR;
+    }
+
     i = 0;
 
     for (s = 0; s < addr->servers.nelts; s++) {
@@ -1961,11 +1732,18 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
 
         for (n = 0; n < cscfp[s]->server_names.nelts; n++) {
             if (name[n].regex) {
+                literals[i] = name[n].regex->literal;
                 addr->regex[i++] = name[n];
             }
         }
     }
 
+    if (ngx_http_create_regex_set(cf, literals, regex, &addr->regex_set)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
 #endif
 
     return NGX_OK;
@@ -2024,6 +1802,44 @@ ngx_http_cmp_dns_wildcards(const void *one, const void *two)
 }
 
 
+#if (NGX_PCRE)
+
+/*
+ * regexes are tested in order until one matches; with enough of them
+ * having a required literal, one scan of the subject over all literals
+ * tells which regexes are worth testing at all
+ */
+
+static ngx_int_t
+ngx_http_create_regex_set(ngx_conf_t *cf, ngx_str_t *literals, ngx_uint_t n,
+    ngx_regex_set_t **set)
+{
+    ngx_uint_t  i, k;
+
+    k = 0;
+
+    for (i = 0; i < n; i++) {
+        if (literals[i].len) {
+            k++;
+        }
+    }
+
+    if (k < NGX_REGEX_SET_MIN) {
+        *set = NULL;
+        return NGX_OK;
+    }
+
+    *set = ngx_regex_set_create(cf->pool, literals, n);
+    if (*set == NULL) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 /*
  * ngx_http_init_listening - 初始化监听器，根据端口信息创建listening结构体。
  *
@@ -2106,76 +1922,6 @@ ngx_http_init_listening(ngx_conf_t *cf, ngx_http_conf_port_t *port)
     return NGX_OK;
 }
 
-{
-    ngx_uint_t                 i, last, bind_wildcard;
-    ngx_listening_t           *ls;
-    ngx_http_port_t           *hport;
-    ngx_http_conf_addr_t      *addr;
-
-    addr = port->addrs.elts;
-    last = port->addrs.nelts;
-
-    /*
-     * If there is a binding to an "*:port" then we need to bind() to
-     * the "*:port" only and ignore other implicit bindings.  The bindings
-     * have been already sorted: explicit bindings are on the start, then
-     * implicit bindings go, and wildcard binding is in the end.
-     */
-
-    if (addr[last - 1].opt.wildcard) {
-        addr[last - 1].opt.bind = 1;
-        bind_wildcard = 1;
-
-    } else {
-        bind_wildcard = 0;
-    }
-
-    i = 0;
-
-    while (i < last) {
-
-        if (bind_wildcard && !addr[i].opt.bind) {
-            i++;
-            continue;
-        }
-
-        ls = ngx_http_add_listening(cf, &addr[i]);
-        if (ls == NULL) {
-            return NGX_ERROR;
-        }
-
-        hport = ngx_pcalloc(cf->pool, sizeof(ngx_http_port_t));
-        if (hport == NULL) {
-            return NGX_ERROR;
-        }
-
-        ls->servers = hport;
-
-        hport->naddrs = i + 1;
-
-        switch (ls->sockaddr->sa_family) {
-
-#if (NGX_HAVE_INET6)
-        case AF_INET6:
-            if (ngx_http_add_addrs6(cf, hport, addr) != NGX_OK) {
-                return NGX_ERROR;
-            }
-            break;
-#endif
-        default: /* AF_INET */
-            if (ngx_http_add_addrs(cf, hport, addr) != NGX_OK) {
-                return NGX_ERROR;
-            }
-            break;
-        }
-
-        addr++;
-        last--;
-    }
-
-    return NGX_OK;
-}
-
 
 /*
  * ngx_http_add_listening - 添加一个监听器，创建ngx_listening_t结构体。
@@ -2257,78 +2003,9 @@ ngx_http_add_listening(ngx_conf_t *cf, ngx_http_conf_addr_t *addr)
     ls->fastopen = addr->opt.fastopen;
 #endif
 
-#if (NGX_HAVE_REUSEPORT)
-    ls->reuseport = addr->opt.reuseport;
-#endif
-
-    return ls;
-}
-
-{
-    ngx_listening_t           *ls;
-    ngx_http_core_loc_conf_t  *clcf;
-    ngx_http_core_srv_conf_t  *cscf;
-
-    ls = ngx_create_listening(cf, addr->opt.sockaddr, addr->opt.socklen);
-    if (ls == NULL) {
-        return NULL;
-    }
-
-    ls->addr_ntop = 1;
-
-    ls->handler = ngx_http_init_connection;
-
-    cscf = addr->default_server;
-    ls->pool_size = cscf->connection_pool_size;
-
-    clcf = cscf->ctx->loc_conf[ngx_http_core_module.ctx_index];
-
-    ls->logp = clcf->error_log;
-    ls->log.data = &ls->addr_text;
-    ls->log.handler = ngx_accept_log_error;
-
-#if (NGX_WIN32)
-    {
-    ngx_iocp_conf_t  *iocpcf = NULL;
-
-    if (ngx_get_conf(cf->cycle->conf_ctx, ngx_events_module)) {
-        iocpcf = ngx_event_get_conf(cf->cycle->conf_ctx, ngx_iocp_module);
-    }
-    if (iocpcf && iocpcf->acceptex_read) {
-        ls->post_accept_buffer_size = cscf->client_header_buffer_size;
-    }
-    }
-#endif
-
-    ls->backlog = addr->opt.backlog;
-    ls->rcvbuf = addr->opt.rcvbuf;
-    ls->sndbuf = addr->opt.sndbuf;
-
-    ls->keepalive = addr->opt.so_keepalive;
-#if (NGX_HAVE_KEEPALIVE_TUNABLE)
-    ls->keepidle = addr->opt.tcp_keepidle;
-    ls->keepintvl = addr->opt.tcp_keepintvl;
-    ls->keepcnt = addr->opt.tcp_keepcnt;
-#endif
-
-#if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
-    ls->accept_filter = addr->opt.accept_filter;
-#endif
-
-#if (NGX_HAVE_DEFERRED_ACCEPT && defined TCP_DEFER_ACCEPT)
-    ls->deferred_accept = addr->opt.deferred_accept;
-#endif
-
-#if (NGX_HAVE_INET6)
-    ls->ipv6only = addr->opt.ipv6only;
-#endif
-
-#if (NGX_HAVE_SETFIB)
-    ls->setfib = addr->opt.setfib;
-#endif
-
-#if (NGX_HAVE_TCP_FASTOPEN)
-    ls->fastopen = addr->opt.fastopen;
+#if (NGX_HAVE_BUSY_POLL)
+    ls->busy_poll = addr->opt.busy_poll;
+    ls->prefer_busy_poll = addr->opt.prefer_busy_poll;
 #endif
 
 #if (NGX_HAVE_REUSEPORT)
@@ -2395,6 +2072,7 @@ ngx_http_add_addrs(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+        vn->regex_set = addr[i].regex_set;
 #endif
     }
 
@@ -2460,6 +2138,7 @@ ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+        vn->regex_set = addr[i].regex_set;
 #endif
     }
 
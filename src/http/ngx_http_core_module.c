@@ -26,7 +26,7 @@ static void ngx_http_core_auth_delay_handler(ngx_http_request_t *r);
 
 static ngx_int_t ngx_http_core_find_location(ngx_http_request_t *r);
 static ngx_int_t ngx_http_core_find_static_location(ngx_http_request_t *r,
-    ngx_http_location_tree_node_t *node);
+    ngx_http_location_trie_t *node);
 
 static ngx_int_t ngx_http_core_preconfiguration(ngx_conf_t *cf);
 static ngx_int_t ngx_http_core_postconfiguration(ngx_conf_t *cf);
@@ -62,6 +62,8 @@ static char *ngx_http_core_set_aio(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_http_core_directio(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_http_core_sendzerocopy(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_http_core_error_page(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_http_core_open_file_cache(ngx_conf_t *cf, ngx_command_t *cmd,
@@ -444,6 +446,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_loc_conf_t, directio_alignment),
       NULL },
 
+    { ngx_string("sendzerocopy"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_core_sendzerocopy,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
     { ngx_string("tcp_nopush"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
       ngx_conf_set_flag_slot,
@@ -1420,6 +1429,29 @@ ngx_http_update_location_config(ngx_http_request_t *r)
         r->connection->tcp_nopush = NGX_TCP_NOPUSH_DISABLED;
     }
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    /*
+     * MSG_ZEROCOPY 只用于直接通过 ngx_linux_sendfile_chain() 发送的连接，
+     * 关闭时已交给内核的数据仍需等待完成通知，因此状态在连接上保留
+     */
+
+    if (r == r->main
+        && r->connection->send_chain == ngx_linux_sendfile_chain)
+    {
+        if (clcf->sendzerocopy && r->connection->zerocopy == NULL) {
+            r->connection->zerocopy = ngx_pcalloc(r->connection->pool,
+                                                 sizeof(ngx_linux_zerocopy_t));
+        }
+
+        if (r->connection->zerocopy) {
+            r->connection->zerocopy->threshold = clcf->sendzerocopy;
+            r->connection->zerocopy->timeout = clcf->send_timeout;
+        }
+    }
+
+#endif
+
     if (clcf->handler) {
         r->content_handler = clcf->handler;
     }
@@ -1474,8 +1506,19 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 
     if (noregex == 0 && pclcf->regex_locations) {
 
+        if (pclcf->regex_set) {
+            ngx_regex_set_match(pclcf->regex_set, &r->uri);
+        }
+
         for (clcfp = pclcf->regex_locations; *clcfp; clcfp++) {
 
+            if (pclcf->regex_set
+                && !ngx_regex_set_test(pclcf->regex_set,
+                                       clcfp - pclcf->regex_locations))
+            {
+                continue;
+            }
+
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "test location: ~ \"%V\"", &(*clcfp)->name);
 
@@ -1513,81 +1556,96 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 
 static ngx_int_t
 ngx_http_core_find_static_location(ngx_http_request_t *r,
-    ngx_http_location_tree_node_t *node)
+    ngx_http_location_trie_t *node)
 {
-    u_char     *uri;
-    size_t      len, n;
-    ngx_int_t   rc, rv;
+    u_char      c, *uri;
+    size_t      len;
+    ngx_int_t   rv;
+    ngx_uint_t  i;
 
     len = r->uri.len;
     uri = r->uri.data;
 
     rv = NGX_DECLINED;
 
-    for ( ;; ) {
-
-        if (node == NULL) {
-            return rv;
-        }
+    while (node) {
 
         ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                        "test location: \"%*s\"",
                        (size_t) node->len, node->name);
 
-        n = (len <= (size_t) node->len) ? len : node->len;
+        if (len < (size_t) node->len) {
 
-        rc = ngx_filename_cmp(uri, node->name, n);
+            if (len + 1 == (size_t) node->len
+                && node->auto_redirect
+                && ngx_http_location_cmp(uri, node->name, len) == 0)
+            {
+                r->loc_conf = (node->exact) ? node->exact->loc_conf:
+                                              node->inclusive->loc_conf;
+                return NGX_DONE;
+            }
 
-        if (rc != 0) {
-            node = (rc < 0) ? node->left : node->right;
+            return rv;
+        }
 
-            continue;
+        if (ngx_http_location_cmp(uri, node->name, node->len) != 0) {
+            return rv;
         }
 
-        if (len > (size_t) node->len) {
+        uri += node->len;
+        len -= node->len;
 
-            if (node->inclusive) {
+        if (len == 0) {
+
+            if (node->exact) {
+                r->loc_conf = node->exact->loc_conf;
+                return NGX_OK;
+            }
 
+            if (node->inclusive) {
                 r->loc_conf = node->inclusive->loc_conf;
-                rv = NGX_AGAIN;
+                return NGX_AGAIN;
+            }
 
-                node = node->tree;
-                uri += n;
-                len -= n;
+            /* a location with the trailing slash may still redirect */
 
-                continue;
-            }
+            c = '/';
 
-            /* exact only */
+        } else {
 
-            node = node->right;
+            if (node->inclusive) {
+                r->loc_conf = node->inclusive->loc_conf;
+                rv = NGX_AGAIN;
+            }
 
-            continue;
+            c = ngx_http_location_char(*uri);
         }
 
-        if (len == (size_t) node->len) {
+        if (node->nchildren > NGX_HTTP_LOCATION_TRIE_SCAN) {
+            i = node->keys[c];
 
-            if (node->exact) {
-                r->loc_conf = node->exact->loc_conf;
-                return NGX_OK;
-
-            } else {
-                r->loc_conf = node->inclusive->loc_conf;
-                return NGX_AGAIN;
+            if (i == 0) {
+                return rv;
             }
-        }
 
-        /* len < node->len */
+            node = &node->children[i - 1];
+            continue;
+        }
 
-        if (len + 1 == (size_t) node->len && node->auto_redirect) {
+        for (i = 0; i < node->nchildren; i++) {
+            if (node->keys[i] == c) {
+                break;
+            }
+        }
 
-            r->loc_conf = (node->exact) ? node->exact->loc_conf:
-                                          node->inclusive->loc_conf;
-            rv = NGX_DONE;
+        if (i == node->nchildren) {
+            return rv;
         }
 
-        node = node->left;
+        node = &node->children[i];
     }
+
+    return rv;
 }
 
 
@@ -3054,6 +3112,9 @@ ngx_http_core_server(ngx_conf_t *cf, ngx_command_t *cmd, void *dummy)
 #endif
 #if (NGX_HAVE_TCP_FASTOPEN)
         lsopt.fastopen = -1;
+#endif
+#if (NGX_HAVE_BUSY_POLL)
+        lsopt.busy_poll = -1;
 #endif
         lsopt.wildcard = 1;
 
@@ -3637,6 +3698,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
     clcf->read_ahead = NGX_CONF_UNSET_SIZE;
     clcf->directio = NGX_CONF_UNSET;
     clcf->directio_alignment = NGX_CONF_UNSET;
+    clcf->sendzerocopy = NGX_CONF_UNSET_SIZE;
     clcf->tcp_nopush = NGX_CONF_UNSET;
     clcf->tcp_nodelay = NGX_CONF_UNSET;
     clcf->send_timeout = NGX_CONF_UNSET_MSEC;
@@ -3867,6 +3929,7 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               NGX_OPEN_FILE_DIRECTIO_OFF);
     ngx_conf_merge_off_value(conf->directio_alignment, prev->directio_alignment,
                               512);
+    ngx_conf_merge_size_value(conf->sendzerocopy, prev->sendzerocopy, 0);
     ngx_conf_merge_value(conf->tcp_nopush, prev->tcp_nopush, 0);
     ngx_conf_merge_value(conf->tcp_nodelay, prev->tcp_nodelay, 1);
 
@@ -4036,6 +4099,9 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 #if (NGX_HAVE_TCP_FASTOPEN)
     lsopt.fastopen = -1;
 #endif
+#if (NGX_HAVE_BUSY_POLL)
+    lsopt.busy_poll = -1;
+#endif
 #if (NGX_HAVE_INET6)
     lsopt.ipv6only = 1;
 #endif
@@ -4087,6 +4153,38 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         }
 #endif
 
+        if (ngx_strncmp(value[n].data, "busy_poll=", 10) == 0) {
+#if (NGX_HAVE_BUSY_POLL)
+            lsopt.busy_poll = ngx_atoi(value[n].data + 10, value[n].len - 10);
+            lsopt.set = 1;
+            lsopt.bind = 1;
+
+            if (lsopt.busy_poll == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid busy_poll \"%V\"", &value[n]);
+                return NGX_CONF_ERROR;
+            }
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "busy_poll is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
+        if (ngx_strcmp(value[n].data, "prefer_busy_poll") == 0) {
+#if (NGX_HAVE_BUSY_POLL && defined SO_PREFER_BUSY_POLL)
+            lsopt.prefer_busy_poll = 1;
+            lsopt.set = 1;
+            lsopt.bind = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "prefer_busy_poll is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strncmp(value[n].data, "backlog=", 8) == 0) {
             lsopt.backlog = ngx_atoi(value[n].data + 8, value[n].len - 8);
             lsopt.set = 1;
@@ -4801,6 +4899,45 @@ ngx_http_core_directio(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_http_core_sendzerocopy(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_core_loc_conf_t *clcf = conf;
+
+    ngx_str_t  *value;
+
+    if (clcf->sendzerocopy != NGX_CONF_UNSET_SIZE) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        clcf->sendzerocopy = 0;
+        return NGX_CONF_OK;
+    }
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    clcf->sendzerocopy = ngx_parse_size(&value[1]);
+    if (clcf->sendzerocopy == (size_t) NGX_ERROR
+        || clcf->sendzerocopy == 0)
+    {
+        return "invalid value";
+    }
+
+    return NGX_CONF_OK;
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "\"sendzerocopy\" is unsupported on this platform");
+    return NGX_CONF_ERROR;
+
+#endif
+}
+
+
 static char *
 ngx_http_core_error_page(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
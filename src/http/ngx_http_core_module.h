@@ -60,7 +60,7 @@ typedef struct ngx_thread_pool_s  ngx_thread_pool_t;
 #define NGX_HTTP_SERVER_TOKENS_BUILD    2
 
 
-typedef struct ngx_http_location_tree_node_s  ngx_http_location_tree_node_t;
+typedef struct ngx_http_location_trie_s  ngx_http_location_trie_t;
 typedef struct ngx_http_core_loc_conf_s  ngx_http_core_loc_conf_t;
 
 
@@ -92,6 +92,10 @@ typedef struct {
 #if (NGX_HAVE_TCP_FASTOPEN)
     int                        fastopen;
 #endif
+#if (NGX_HAVE_BUSY_POLL)
+    int                        busy_poll;
+    unsigned                   prefer_busy_poll:1;
+#endif
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
     int                        tcp_keepidle;
     int                        tcp_keepintvl;
@@ -165,6 +169,7 @@ typedef struct {
     ngx_http_phase_engine_t    phase_engine;
 
     ngx_hash_t                 headers_in_hash;
+    ngx_hash_perfect_t         headers_in_perfect_hash;
 
     ngx_hash_t                 variables_hash;
 
@@ -236,6 +241,9 @@ typedef struct {
 
     ngx_uint_t                 nregex;
     ngx_http_server_name_t    *regex;
+#if (NGX_PCRE)
+    ngx_regex_set_t           *regex_set;
+#endif
 } ngx_http_virtual_names_t;
 
 
@@ -295,6 +303,7 @@ typedef struct {
 #if (NGX_PCRE)
     ngx_uint_t                 nregex;
     ngx_http_server_name_t    *regex;
+    ngx_regex_set_t           *regex_set;
 #endif
 
     /* the default server configuration for this address:port */
@@ -332,9 +341,10 @@ struct ngx_http_core_loc_conf_s {
     unsigned      gzip_disable_degradation:2;
 #endif
 
-    ngx_http_location_tree_node_t   *static_locations;
+    ngx_http_location_trie_t        *static_locations;
 #if (NGX_PCRE)
     ngx_http_core_loc_conf_t       **regex_locations;
+    ngx_regex_set_t                 *regex_set;
 #endif
 
     /* pointer to the modules' loc_conf */
@@ -365,6 +375,7 @@ struct ngx_http_core_loc_conf_s {
     size_t        send_lowat;              /* send_lowat */
     size_t        postpone_output;         /* postpone_output */
     size_t        sendfile_max_chunk;      /* sendfile_max_chunk */
+    size_t        sendzerocopy;            /* sendzerocopy */
     size_t        read_ahead;              /* read_ahead */
     size_t        subrequest_output_buffer_size;
                                            /* subrequest_output_buffer_size */
@@ -465,21 +476,40 @@ typedef struct {
     ngx_str_t                       *name;
     u_char                          *file_name;
     ngx_uint_t                       line;
-    ngx_queue_t                      list;
 } ngx_http_location_queue_t;
 
 
-struct ngx_http_location_tree_node_s {
-    ngx_http_location_tree_node_t   *left;
-    ngx_http_location_tree_node_t   *right;
-    ngx_http_location_tree_node_t   *tree;
+/*
+ * a radix trie of the static locations: each node holds the next part
+ * of the location names, the children start with distinct bytes
+ */
+
+#define NGX_HTTP_LOCATION_TRIE_SCAN  16
+
+#if (NGX_HAVE_CASELESS_FILESYSTEM)
+#define ngx_http_location_char(c)    ngx_tolower(c)
+#define ngx_http_location_cmp(s1, s2, n)  ngx_strncasecmp(s1, s2, n)
+#else
+#define ngx_http_location_char(c)    (c)
+#define ngx_http_location_cmp(s1, s2, n)  ngx_memcmp(s1, s2, n)
+#endif
 
+struct ngx_http_location_trie_s {
     ngx_http_core_loc_conf_t        *exact;
     ngx_http_core_loc_conf_t        *inclusive;
 
+    ngx_http_location_trie_t        *children;
+
+    /*
+     * first bytes of the children, or for more than
+     * NGX_HTTP_LOCATION_TRIE_SCAN children a map of bytes to child number + 1
+     */
+    u_char                          *keys;
+
+    u_char                          *name;
     u_short                          len;
+    u_short                          nchildren;
     u_char                           auto_redirect;
-    u_char                           name[1];
 };
 
 
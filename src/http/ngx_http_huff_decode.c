@@ -18,8 +18,17 @@ typedef struct {
 } ngx_http_huff_decode_code_t;
 
 
+typedef struct {
+    u_char  sym;
+    u_char  len;
+} ngx_http_huff_decode_fast_t;
+
+
 static ngx_inline ngx_int_t ngx_http_huff_decode_bits(u_char *state,
     u_char *ending, ngx_uint_t bits, u_char **dst);
+static void ngx_http_huff_decode_init(void);
+static u_char *ngx_http_huff_decode_fast(u_char **src, u_char *end,
+    u_char *dst, ngx_uint_t *half);
 
 
 static ngx_http_huff_decode_code_t  ngx_http_huff_decode_codes[256][16] =
@@ -2639,11 +2648,72 @@ static ngx_http_huff_decode_code_t  ngx_http_huff_decode_codes[256][16] =
 };
 
 
+/*
+ * code lengths of the canonical HPACK code (RFC 7541, Appendix B),
+ * the last one is EOS; the codes themselves are assigned in the order
+ * of length and symbol
+ */
+
+static u_char  ngx_http_huff_code_len[257] =
+{
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+     6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+     5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+    13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+     7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+    15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+     6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+
+/*
+ * the fast path looks up the next NGX_HTTP_HUFF_DECODE_BITS bits,
+ * longer codes are decoded from the first code of each length
+ */
+
+#define NGX_HTTP_HUFF_DECODE_BITS  10
+#define NGX_HTTP_HUFF_EOS          256
+
+#if (NGX_HAVE_LITTLE_ENDIAN && NGX_HAVE_NONALIGNED && NGX_HAVE_GCC_BSWAP64)
+
+#define ngx_http_huff_decode_load(p)                                          \
+    __builtin_bswap64(*(uint64_t *) (p))
+
+#else
+
+#define ngx_http_huff_decode_load(p)                                          \
+    ((uint64_t) (p)[0] << 56 | (uint64_t) (p)[1] << 48                        \
+     | (uint64_t) (p)[2] << 40 | (uint64_t) (p)[3] << 32                      \
+     | (uint64_t) (p)[4] << 24 | (uint64_t) (p)[5] << 16                      \
+     | (uint64_t) (p)[6] << 8 | (uint64_t) (p)[7])
+
+#endif
+
+static ngx_uint_t                   ngx_http_huff_decode_ready;
+static ngx_http_huff_decode_fast_t
+                    ngx_http_huff_decode_fast_codes[1 << NGX_HTTP_HUFF_DECODE_BITS];
+static uint32_t                     ngx_http_huff_decode_first[31];
+static uint32_t                     ngx_http_huff_decode_count[31];
+static u_short                      ngx_http_huff_decode_offset[31];
+static u_short                      ngx_http_huff_decode_syms[257];
+
+
 ngx_int_t
 ngx_http_huff_decode(u_char *state, u_char *src, size_t len, u_char **dst,
     ngx_uint_t last, ngx_log_t *log)
 {
-    u_char  *end, ch, ending;
+    u_char      *end, ch, ending;
+    ngx_uint_t   half;
 
     ch = 0;
     ending = 1;
@@ -2651,10 +2721,34 @@ ngx_http_huff_decode(u_char *state, u_char *src, size_t len, u_char **dst,
     end = src + len;
 
     while (src != end) {
+
+        half = 0;
+
+        /*
+         * the bulk of a string is decoded several bits at a time
+         * while at a code boundary, the state machine continues from
+         * the last code boundary which is also a nibble boundary
+         */
+
+        if (*state == 0 && end - src >= 8) {
+
+            if (!ngx_http_huff_decode_ready) {
+                ngx_http_huff_decode_init();
+            }
+
+            *dst = ngx_http_huff_decode_fast(&src, end, *dst, &half);
+            ending = 1;
+
+            if (src == end) {
+                break;
+            }
+        }
+
         ch = *src++;
 
-        if (ngx_http_huff_decode_bits(state, &ending, ch >> 4, dst)
-            != NGX_OK)
+        if (!half
+            && ngx_http_huff_decode_bits(state, &ending, ch >> 4, dst)
+               != NGX_OK)
         {
             ngx_log_debug2(NGX_LOG_DEBUG_HTTP, log, 0,
                            "http2 huffman decoding error at state %d: "
@@ -2712,3 +2806,145 @@ ngx_http_huff_decode_bits(u_char *state, u_char *ending, ngx_uint_t bits,
 
     return NGX_OK;
 }
+
+
+static void
+ngx_http_huff_decode_init(void)
+{
+    uint32_t    code;
+    ngx_uint_t  i, n, len, pos[31];
+
+    for (i = 0; i < 257; i++) {
+        ngx_http_huff_decode_count[ngx_http_huff_code_len[i]]++;
+    }
+
+    code = 0;
+    n = 0;
+
+    for (len = 1; len <= 30; len++) {
+        ngx_http_huff_decode_first[len] = code;
+        ngx_http_huff_decode_offset[len] = (u_short) n;
+        pos[len] = n;
+
+        n += ngx_http_huff_decode_count[len];
+        code = (code + ngx_http_huff_decode_count[len]) << 1;
+    }
+
+    for (i = 0; i < 257; i++) {
+        len = ngx_http_huff_code_len[i];
+        n = pos[len]++;
+
+        ngx_http_huff_decode_syms[n] = (u_short) i;
+
+        if (len > NGX_HTTP_HUFF_DECODE_BITS) {
+            continue;
+        }
+
+        /* all entries starting with the code */
+
+        code = ngx_http_huff_decode_first[len]
+               + (n - ngx_http_huff_decode_offset[len]);
+
+        code <<= NGX_HTTP_HUFF_DECODE_BITS - len;
+
+        for (n = 0; n < (1U << (NGX_HTTP_HUFF_DECODE_BITS - len)); n++) {
+            ngx_http_huff_decode_fast_codes[code + n].sym = (u_char) i;
+            ngx_http_huff_decode_fast_codes[code + n].len = (u_char) len;
+        }
+    }
+
+    ngx_http_huff_decode_ready = 1;
+}
+
+
+/*
+ * decodes codes while at least 30 bits are available, and returns
+ * the output and the input position as of the last code that ended
+ * at a nibble boundary; EOS is left to the state machine to report
+ */
+
+static u_char *
+ngx_http_huff_decode_fast(u_char **src, u_char *end, u_char *dst,
+    ngx_uint_t *half)
+{
+    u_char                       *p, *mark_dst;
+    uint32_t                      code;
+    uint64_t                      bits;
+    ngx_uint_t                    nbits, used, mark, len, sym;
+    ngx_http_huff_decode_fast_t  *fast;
+
+    p = *src;
+    bits = 0;
+    nbits = 0;
+    used = 0;
+    mark = 0;
+    mark_dst = dst;
+
+    for ( ;; ) {
+
+        if (end - p >= 8) {
+            bits |= ngx_http_huff_decode_load(p) >> nbits;
+            p += (63 - nbits) >> 3;
+            nbits |= 56;
+
+        } else {
+            while (nbits <= 56 && p != end) {
+                bits |= (uint64_t) *p++ << (56 - nbits);
+                nbits += 8;
+            }
+
+            if (nbits < 30) {
+                break;
+            }
+        }
+
+        do {
+            fast = &ngx_http_huff_decode_fast_codes[bits
+                                         >> (64 - NGX_HTTP_HUFF_DECODE_BITS)];
+
+            if (fast->len) {
+                sym = fast->sym;
+                len = fast->len;
+
+            } else {
+                for (len = NGX_HTTP_HUFF_DECODE_BITS + 1; len < 30; len++) {
+                    code = (uint32_t) (bits >> (64 - len));
+
+                    if (code - ngx_http_huff_decode_first[len]
+                        < ngx_http_huff_decode_count[len])
+                    {
+                        break;
+                    }
+                }
+
+                code = (uint32_t) (bits >> (64 - len));
+
+                sym = ngx_http_huff_decode_syms[ngx_http_huff_decode_offset[len]
+                                       + code - ngx_http_huff_decode_first[len]];
+
+                if (sym == NGX_HTTP_HUFF_EOS) {
+                    goto done;
+                }
+            }
+
+            *dst++ = (u_char) sym;
+
+            bits <<= len;
+            nbits -= len;
+            used += len;
+
+            if ((used & 3) == 0) {
+                mark = used;
+                mark_dst = dst;
+            }
+
+        } while (nbits >= 30);
+    }
+
+done:
+
+    *src += mark / 8;
+    *half = (mark & 4) ? 1 : 0;
+
+    return mark_dst;
+}
@@ -9,6 +9,10 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#if (NGX_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
 
 static uint32_t  usual[] = {
     0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
@@ -98,6 +102,107 @@ static uint32_t  usual[] = {
 #endif
 
 
+#if (NGX_HAVE_SSE2)
+
+/*
+ * 向量化的快速路径：一次检查16个字节，
+ * 跳过状态机中不改变任何状态的字节，返回第一个需要状态机处理的字节；
+ * 不足一个向量的剩余字节仍由状态机逐个处理，因此解析结果与逐字节解析相同
+ */
+
+#define NGX_HTTP_PARSE_SCAN_PATH    0   /* sw_check_uri: "usual"以外的字节 */
+#define NGX_HTTP_PARSE_SCAN_ARGS    1   /* sw_uri: 控制字符, ' ', '#' */
+#define NGX_HTTP_PARSE_SCAN_NAME    2   /* sw_name: [0-9A-Za-z-]以外的字节 */
+#define NGX_HTTP_PARSE_SCAN_VALUE   3   /* sw_value: ' ', CR, LF, '\0' */
+#define NGX_HTTP_PARSE_SCAN_LINE    4   /* 行尾: CR, LF */
+
+
+static ngx_inline u_char *
+ngx_http_parse_scan(u_char *p, u_char *last, ngx_uint_t set)
+{
+    uint32_t  m;
+    __m128i   v, t;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        switch (set) {
+
+        case NGX_HTTP_PARSE_SCAN_PATH:
+        case NGX_HTTP_PARSE_SCAN_ARGS:
+
+            t = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(-1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8(0x21)));
+
+            t = _mm_or_si128(t, _mm_or_si128(
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('#')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f))));
+
+            if (set == NGX_HTTP_PARSE_SCAN_PATH) {
+                t = _mm_or_si128(t, _mm_or_si128(
+                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))),
+                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('/')))));
+
+                t = _mm_or_si128(t, _mm_cmpeq_epi8(v, _mm_set1_epi8('?')));
+#if (NGX_WIN32)
+                t = _mm_or_si128(t, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+#endif
+            }
+
+            m = _mm_movemask_epi8(t);
+            break;
+
+        case NGX_HTTP_PARSE_SCAN_NAME:
+
+            t = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+            t = _mm_and_si128(_mm_cmpgt_epi8(t, _mm_set1_epi8('a' - 1)),
+                              _mm_cmplt_epi8(t, _mm_set1_epi8('z' + 1)));
+
+            t = _mm_or_si128(t, _mm_and_si128(
+                    _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+
+            t = _mm_or_si128(t, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+
+            m = ~_mm_movemask_epi8(t) & 0xffff;
+            break;
+
+        case NGX_HTTP_PARSE_SCAN_LINE:
+
+            t = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(CR)),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8(LF)));
+
+            m = _mm_movemask_epi8(t);
+            break;
+
+        default: /* NGX_HTTP_PARSE_SCAN_VALUE */
+
+            t = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(CR))),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(LF)),
+                                 _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+
+            m = _mm_movemask_epi8(t);
+            break;
+        }
+
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 16;
+    }
+
+    return p;
+}
+
+#endif
+
+
 /* gcc, icc, msvc and others compile these switches as an jump table */
 
 ngx_int_t
@@ -541,6 +646,10 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         case sw_check_uri:
 
             if (usual[ch >> 5] & (1U << (ch & 0x1f))) {
+#if (NGX_HAVE_SSE2)
+                p = ngx_http_parse_scan(p + 1, b->last,
+                                        NGX_HTTP_PARSE_SCAN_PATH) - 1;
+#endif
                 break;
             }
 
@@ -605,6 +714,10 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         case sw_uri:
 
             if (usual[ch >> 5] & (1U << (ch & 0x1f))) {
+#if (NGX_HAVE_SSE2)
+                p = ngx_http_parse_scan(p + 1, b->last,
+                                        NGX_HTTP_PARSE_SCAN_ARGS) - 1;
+#endif
                 break;
             }
 
@@ -821,6 +934,9 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
 {
     u_char      c, ch, *p;
     ngx_uint_t  hash, i;
+#if (NGX_HAVE_SSE2)
+    u_char     *last;
+#endif
     enum {
         sw_start = 0,
         sw_name,
@@ -915,6 +1031,22 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
                 hash = ngx_hash(hash, c);
                 r->lowcase_header[i++] = c;
                 i &= (NGX_HTTP_LC_HEADER_LEN - 1);
+
+#if (NGX_HAVE_SSE2)
+                last = ngx_http_parse_scan(p + 1, b->last,
+                                           NGX_HTTP_PARSE_SCAN_NAME);
+
+                /* "0-9", "-" and letters are lowercased by the 0x20 bit */
+
+                while (++p < last) {
+                    c = *p | 0x20;
+                    hash = ngx_hash(hash, c);
+                    r->lowcase_header[i++] = c;
+                    i &= (NGX_HTTP_LC_HEADER_LEN - 1);
+                }
+
+                p--;
+#endif
                 break;
             }
 
@@ -1012,6 +1144,12 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
             case '\0':
                 r->header_end = p;
                 return NGX_HTTP_PARSE_INVALID_HEADER;
+#if (NGX_HAVE_SSE2)
+            default:
+                p = ngx_http_parse_scan(p + 1, b->last,
+                                        NGX_HTTP_PARSE_SCAN_VALUE) - 1;
+                break;
+#endif
             }
             break;
 
@@ -2260,6 +2398,12 @@ ngx_http_parse_chunked(ngx_http_request_t *r, ngx_buf_t *b,
                 break;
             case LF:
                 state = sw_chunk_data;
+                break;
+#if (NGX_HAVE_SSE2)
+            default:
+                pos = ngx_http_parse_scan(pos + 1, b->last,
+                                          NGX_HTTP_PARSE_SCAN_LINE) - 1;
+#endif
             }
             break;
 
@@ -2301,6 +2445,12 @@ ngx_http_parse_chunked(ngx_http_request_t *r, ngx_buf_t *b,
                 break;
             case LF:
                 state = sw_trailer;
+                break;
+#if (NGX_HAVE_SSE2)
+            default:
+                pos = ngx_http_parse_scan(pos + 1, b->last,
+                                          NGX_HTTP_PARSE_SCAN_LINE) - 1;
+#endif
             }
             break;
 
@@ -2336,6 +2486,12 @@ ngx_http_parse_chunked(ngx_http_request_t *r, ngx_buf_t *b,
                 break;
             case LF:
                 state = sw_trailer;
+                break;
+#if (NGX_HAVE_SSE2)
+            default:
+                pos = ngx_http_parse_scan(pos + 1, b->last,
+                                          NGX_HTTP_PARSE_SCAN_LINE) - 1;
+#endif
             }
             break;
 
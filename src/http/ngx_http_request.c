@@ -11,7 +11,8 @@
 
 
 static void ngx_http_wait_request_handler(ngx_event_t *ev);
-static ngx_http_request_t *ngx_http_alloc_request(ngx_connection_t *c);
+static ngx_http_request_t *ngx_http_alloc_request(ngx_connection_t *c,
+    ngx_pool_t *pool);
 static void ngx_http_process_request_line(ngx_event_t *rev);
 static void ngx_http_process_request_headers(ngx_event_t *rev);
 static ssize_t ngx_http_read_request_header(ngx_http_request_t *r);
@@ -532,12 +533,24 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
 
 ngx_http_request_t *
 ngx_http_create_request(ngx_connection_t *c)
+{
+    return ngx_http_create_request_in_pool(c, NULL);
+}
+
+
+/*
+ * pool不为NULL时请求分配在调用者提供的内存池中（如HTTP/2复用的内存池），
+ * 失败时该内存池被销毁
+ */
+
+ngx_http_request_t *
+ngx_http_create_request_in_pool(ngx_connection_t *c, ngx_pool_t *pool)
 {
     ngx_http_request_t        *r;
     ngx_http_log_ctx_t        *ctx;
     ngx_http_core_loc_conf_t  *clcf;
 
-    r = ngx_http_alloc_request(c);
+    r = ngx_http_alloc_request(c, pool);
     if (r == NULL) {
         return NULL;
     }
@@ -563,9 +576,8 @@ ngx_http_create_request(ngx_connection_t *c)
 
 
 static ngx_http_request_t *
-ngx_http_alloc_request(ngx_connection_t *c)
+ngx_http_alloc_request(ngx_connection_t *c, ngx_pool_t *pool)
 {
-    ngx_pool_t                 *pool;
     ngx_time_t                 *tp;
     ngx_http_request_t         *r;
     ngx_http_connection_t      *hc;
@@ -576,9 +588,11 @@ ngx_http_alloc_request(ngx_connection_t *c)
 
     cscf = ngx_http_get_module_srv_conf(hc->conf_ctx, ngx_http_core_module);
 
-    pool = ngx_create_pool(cscf->request_pool_size, c->log);
     if (pool == NULL) {
-        return NULL;
+        pool = ngx_create_pool(cscf->request_pool_size, c->log);
+        if (pool == NULL) {
+            return NULL;
+        }
     }
 
     r = ngx_pcalloc(pool, sizeof(ngx_http_request_t));
@@ -1019,7 +1033,7 @@ ngx_http_ssl_certificate(ngx_ssl_conn_t *ssl_conn, void *arg)
         return 0;
     }
 
-    r = ngx_http_alloc_request(c);
+    r = ngx_http_alloc_request(c, NULL);
     if (r == NULL) {
         return 0;
     }
@@ -1513,8 +1527,8 @@ ngx_http_process_request_headers(ngx_event_t *rev)
                 ngx_strlow(h->lowcase_key, h->key.data, h->key.len);
             }
 
-            hh = ngx_hash_find(&cmcf->headers_in_hash, h->hash,
-                               h->lowcase_key, h->key.len);
+            hh = ngx_hash_find_perfect(&cmcf->headers_in_perfect_hash,
+                                       h->hash, h->lowcase_key, h->key.len);
 
             if (hh && hh->handler(r, h, hh->offset) != NGX_OK) {
                 break;
@@ -2350,6 +2364,10 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 
         sn = virtual_names->regex;
 
+        if (virtual_names->regex_set) {
+            ngx_regex_set_match(virtual_names->regex_set, host);
+        }
+
 #if (NGX_HTTP_SSL && defined SSL_CTRL_SET_TLSEXT_HOSTNAME)
 
         if (r == NULL) {
@@ -2357,6 +2375,12 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 
             for (i = 0; i < virtual_names->nregex; i++) {
 
+                if (virtual_names->regex_set
+                    && !ngx_regex_set_test(virtual_names->regex_set, i))
+                {
+                    continue;
+                }
+
                 n = ngx_regex_exec(sn[i].regex->regex, host, NULL, 0);
 
                 if (n == NGX_REGEX_NO_MATCHED) {
@@ -2386,6 +2410,12 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 
         for (i = 0; i < virtual_names->nregex; i++) {
 
+            if (virtual_names->regex_set
+                && !ngx_regex_set_test(virtual_names->regex_set, i))
+            {
+                continue;
+            }
+
             n = ngx_http_regex_exec(r, sn[i].regex, host);
 
             if (n == NGX_DECLINED) {
@@ -3776,6 +3806,23 @@ ngx_http_free_request(ngx_http_request_t *r, ngx_int_t rc)
     pool = r->pool;
     r->pool = NULL;
 
+#if (NGX_HTTP_V2)
+    if (r->stream) {
+        /* the pool is reset and cached by the HTTP/2 connection */
+        ngx_http_v2_put_pool(r->stream->connection, pool);
+        return;
+    }
+#endif
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+    if (r->connection->zerocopy
+        && ngx_linux_zerocopy_hold(r->connection, pool) == NGX_OK)
+    {
+        /* the buffers are still referenced by the kernel */
+        return;
+    }
+#endif
+
     ngx_destroy_pool(pool);
 }
 
@@ -3823,6 +3870,12 @@ ngx_http_close_connection(ngx_connection_t *c)
 
     c->destroyed = 1;
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+    if (c->zerocopy && ngx_linux_zerocopy_linger(c) == NGX_OK) {
+        return;
+    }
+#endif
+
     pool = c->pool;
 
     ngx_close_connection(c);
@@ -77,6 +77,12 @@ static void
 static void
     ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
     ngx_uint_t do_write);
+#if (NGX_HAVE_SPLICE)
+static ngx_linux_splice_t *ngx_http_upstream_splice_pipe(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_splice_body(ngx_http_request_t *r,
+    ngx_http_upstream_t *u, ngx_linux_splice_t *sp, ngx_uint_t do_write);
+#endif
 #if (NGX_THREADS)
 static ngx_int_t ngx_http_upstream_thread_handler(ngx_thread_task_t *task,
     ngx_file_t *file);
@@ -2999,6 +3005,9 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u)
     ngx_connection_t          *c;
     ngx_http_core_loc_conf_t  *clcf;
 
+    /* the body filters which change or need to see the body reset it */
+    r->filter_identity = 1;
+
     rc = ngx_http_send_header(r);
 
     if (rc == NGX_ERROR || rc > NGX_OK || r->post_action) {
@@ -3674,6 +3683,9 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
     ngx_connection_t          *downstream, *upstream;
     ngx_http_upstream_t       *u;
     ngx_http_core_loc_conf_t  *clcf;
+#if (NGX_HAVE_SPLICE)
+    ngx_linux_splice_t        *sp;
+#endif
 
     u = r->upstream;
     downstream = r->connection;
@@ -3683,8 +3695,22 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
 
     do_write = do_write || u->length == 0;
 
+#if (NGX_HAVE_SPLICE)
+    sp = ngx_http_upstream_splice_pipe(r, u);
+#endif
+
     for ( ;; ) {
 
+#if (NGX_HAVE_SPLICE)
+        if (sp) {
+            if (ngx_http_upstream_splice_body(r, u, sp, do_write) == NGX_DONE) {
+                return;
+            }
+
+            break;
+        }
+#endif
+
         if (do_write) {
 
             if (u->out_bufs || u->busy_bufs || downstream->buffered) {
@@ -3795,6 +3821,168 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+/*
+ * 当响应体不经修改地转发给客户端时（没有 SSL、HTTP/2，没有需要
+ * 读取数据的过滤模块，不限速，也不需要 chunked 编码），数据经内核
+ * 管道从上游连接直接移到客户端连接；已读入 u->buffer 的数据先按普通
+ * 方式发送
+ */
+
+static ngx_linux_splice_t *
+ngx_http_upstream_splice_pipe(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    ngx_connection_t  *c;
+
+    if (u->splice) {
+        return u->splice;
+    }
+
+    if (!u->conf->splice || !u->spliceable) {
+        return NULL;
+    }
+
+    c = r->connection;
+
+    if (r != r->main
+        || c->send_chain != ngx_linux_sendfile_chain
+        || !r->filter_identity
+        || r->preserve_body
+        || r->limit_rate
+        || r->chunked
+        || r->allow_ranges
+        || r->filter_need_in_memory
+        || r->main_filter_need_in_memory
+        || r->postponed)
+    {
+        return NULL;
+    }
+
+    /* io_uring may read from the socket on its own */
+
+    if (ngx_event_flags & NGX_USE_IO_URING_EVENT) {
+        return NULL;
+    }
+
+#if (NGX_HTTP_SSL)
+    if (u->peer.connection->ssl) {
+        return NULL;
+    }
+#endif
+
+    if (u->out_bufs
+        || u->busy_bufs
+        || c->buffered
+        || u->buffer.pos != u->buffer.last)
+    {
+        return NULL;
+    }
+
+    u->splice = ngx_linux_splice_create(r->pool, u->conf->buffer_size,
+                                        c->log);
+
+    if (u->splice == NULL) {
+        u->spliceable = 0;
+        return NULL;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream splice body");
+
+    return u->splice;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_splice_body(ngx_http_request_t *r, ngx_http_upstream_t *u,
+    ngx_linux_splice_t *sp, ngx_uint_t do_write)
+{
+    size_t             size;
+    ssize_t            n;
+    ngx_connection_t  *downstream, *upstream;
+
+    downstream = r->connection;
+    upstream = u->peer.connection;
+
+    for ( ;; ) {
+
+        if (do_write) {
+
+            if (sp->size
+                && ngx_linux_splice_send(downstream, sp) == NGX_ERROR)
+            {
+                ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
+                return NGX_DONE;
+            }
+
+            if (sp->size == 0) {
+
+                if (u->length == 0
+                    || (upstream->read->eof && u->length == -1))
+                {
+                    ngx_http_upstream_finalize_request(r, u, 0);
+                    return NGX_DONE;
+                }
+
+                if (upstream->read->eof) {
+                    ngx_log_error(NGX_LOG_ERR, upstream->log, 0,
+                                  "upstream prematurely closed connection");
+
+                    ngx_http_upstream_finalize_request(r, u,
+                                                       NGX_HTTP_BAD_GATEWAY);
+                    return NGX_DONE;
+                }
+
+                if (upstream->read->error || u->error) {
+                    ngx_http_upstream_finalize_request(r, u,
+                                                       NGX_HTTP_BAD_GATEWAY);
+                    return NGX_DONE;
+                }
+            }
+        }
+
+        size = sp->capacity - sp->size;
+
+        if (u->length != -1 && (off_t) size > u->length) {
+            size = (size_t) u->length;
+        }
+
+        if (size && upstream->read->ready) {
+
+            n = ngx_linux_splice_recv(upstream, sp, size);
+
+            if (n == NGX_AGAIN) {
+                break;
+            }
+
+            if (n > 0) {
+                u->state->bytes_received += n;
+                u->state->response_length += n;
+
+                if (u->length != -1) {
+                    u->length -= n;
+
+                    if (u->length == 0) {
+                        u->keepalive = !u->headers_in.connection_close;
+                    }
+                }
+            }
+
+            do_write = 1;
+
+            continue;
+        }
+
+        break;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 ngx_int_t
 ngx_http_upstream_non_buffered_filter_init(void *data)
 {
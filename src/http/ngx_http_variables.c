@@ -2501,8 +2501,16 @@ ngx_http_map_find(ngx_http_request_t *r, ngx_http_map_t *map, ngx_str_t *match)
 
         reg = map->regex;
 
+        if (map->regex_set) {
+            ngx_regex_set_match(map->regex_set, match);
+        }
+
         for (i = 0; i < map->nregex; i++) {
 
+            if (map->regex_set && !ngx_regex_set_test(map->regex_set, i)) {
+                continue;
+            }
+
             n = ngx_http_regex_exec(r, reg[i].regex, match);
 
             if (n == NGX_OK) {
@@ -2564,6 +2572,10 @@ ngx_http_regex_compile(ngx_conf_t *cf, ngx_regex_compile_t *rc)
     re->ncaptures = rc->captures;
     re->name = rc->pattern;
 
+    if (ngx_regex_literal(cf->pool, &rc->pattern, &re->literal) != NGX_OK) {
+        return NULL;
+    }
+
     cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
     cmcf->ncaptures = ngx_max(cmcf->ncaptures, re->ncaptures);
 
@@ -76,6 +76,7 @@ typedef struct {
     ngx_http_regex_variable_t    *variables;
     ngx_uint_t                    nvariables;
     ngx_str_t                     name;
+    ngx_str_t                     literal;
 } ngx_http_regex_t;
 
 
@@ -98,6 +99,7 @@ typedef struct {
 #if (NGX_PCRE)
     ngx_http_map_regex_t         *regex;
     ngx_uint_t                    nregex;
+    ngx_regex_set_t              *regex_set;
 #endif
 } ngx_http_map_t;
 
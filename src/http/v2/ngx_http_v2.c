@@ -42,6 +42,7 @@ typedef struct {
 #define NGX_HTTP_V2_PING_SIZE                    8
 #define NGX_HTTP_V2_GOAWAY_SIZE                  8
 #define NGX_HTTP_V2_WINDOW_UPDATE_SIZE           4
+#define NGX_HTTP_V2_PRIORITY_UPDATE_SIZE         4   /* minimum */
 
 #define NGX_HTTP_V2_SETTINGS_PARAM_SIZE          6
 
@@ -56,6 +57,18 @@ typedef struct {
 
 #define NGX_HTTP_V2_ROOT                         (void *) -1
 
+/* 内存池超过该块数时不再缓存复用 */
+#define NGX_HTTP_V2_POOL_CACHE_BLOCKS            4
+
+/* 每个流使用请求内存池和请求头内存池两个内存池 */
+#define NGX_HTTP_V2_STREAM_POOLS                 2
+
+/* 连接空闲超过该时间（毫秒）后才释放连接的内存池及其中缓存的对象 */
+#define NGX_HTTP_V2_IDLE_FREE_TIMEOUT            1000
+
+/* 用于估计带宽时延积的PING帧的不透明数据 */
+#define NGX_HTTP_V2_BDP_PING                     "nginxbdp"
+
 
 static void ngx_http_v2_read_handler(ngx_event_t *rev);
 static void ngx_http_v2_write_handler(ngx_event_t *wev);
@@ -95,6 +108,8 @@ static u_char *ngx_http_v2_handle_continuation(ngx_http_v2_connection_t *h2c,
     u_char *pos, u_char *end, ngx_http_v2_handler_pt handler);
 static u_char *ngx_http_v2_state_priority(ngx_http_v2_connection_t *h2c,
     u_char *pos, u_char *end);
+static u_char *ngx_http_v2_state_priority_update(
+    ngx_http_v2_connection_t *h2c, u_char *pos, u_char *end);
 static u_char *ngx_http_v2_state_rst_stream(ngx_http_v2_connection_t *h2c,
     u_char *pos, u_char *end);
 static u_char *ngx_http_v2_state_settings(ngx_http_v2_connection_t *h2c,
@@ -141,6 +156,9 @@ static ngx_int_t ngx_http_v2_settings_frame_handler(
     ngx_http_v2_connection_t *h2c, ngx_http_v2_out_frame_t *frame);
 static ngx_int_t ngx_http_v2_send_window_update(ngx_http_v2_connection_t *h2c,
     ngx_uint_t sid, size_t window);
+static ngx_int_t ngx_http_v2_bdp_data(ngx_http_v2_connection_t *h2c,
+    size_t size);
+static void ngx_http_v2_bdp_ack(ngx_http_v2_connection_t *h2c);
 static ngx_int_t ngx_http_v2_send_rst_stream(ngx_http_v2_connection_t *h2c,
     ngx_uint_t sid, ngx_uint_t status);
 static ngx_int_t ngx_http_v2_send_goaway(ngx_http_v2_connection_t *h2c,
@@ -170,12 +188,17 @@ static ngx_int_t ngx_http_v2_construct_request_line(ngx_http_request_t *r);
 static ngx_int_t ngx_http_v2_cookie(ngx_http_request_t *r,
     ngx_http_v2_header_t *header);
 static ngx_int_t ngx_http_v2_construct_cookie_header(ngx_http_request_t *r);
+static void ngx_http_v2_parse_priority(ngx_http_v2_node_t *node, u_char *p,
+    u_char *end);
 static void ngx_http_v2_run_request(ngx_http_request_t *r);
 static void ngx_http_v2_run_request_handler(ngx_event_t *ev);
 static ngx_int_t ngx_http_v2_process_request_body(ngx_http_request_t *r,
     u_char *pos, size_t size, ngx_uint_t last, ngx_uint_t flush);
 static ngx_int_t ngx_http_v2_filter_request_body(ngx_http_request_t *r);
 static void ngx_http_v2_read_client_request_body_handler(ngx_http_request_t *r);
+static size_t ngx_http_v2_body_window_extra(ngx_http_request_t *r,
+    size_t size);
+static void ngx_http_v2_resize_request_body_buffer(ngx_http_request_t *r);
 
 static ngx_int_t ngx_http_v2_terminate_stream(ngx_http_v2_connection_t *h2c,
     ngx_http_v2_stream_t *stream, ngx_uint_t status);
@@ -183,6 +206,7 @@ static void ngx_http_v2_close_stream_handler(ngx_event_t *ev);
 static void ngx_http_v2_retry_close_stream_handler(ngx_event_t *ev);
 static void ngx_http_v2_handle_connection_handler(ngx_event_t *rev);
 static void ngx_http_v2_idle_handler(ngx_event_t *rev);
+static void ngx_http_v2_idle_free_handler(ngx_event_t *wev);
 static void ngx_http_v2_finalize_connection(ngx_http_v2_connection_t *h2c,
     ngx_uint_t status);
 
@@ -192,9 +216,14 @@ static void ngx_http_v2_set_dependency(ngx_http_v2_connection_t *h2c,
     ngx_http_v2_node_t *node, ngx_uint_t depend, ngx_uint_t exclusive);
 static void ngx_http_v2_node_children_update(ngx_http_v2_node_t *node);
 
+static void ngx_http_v2_free_pool(ngx_http_v2_connection_t *h2c);
+static void ngx_http_v2_free_pools(ngx_http_v2_connection_t *h2c);
 static void ngx_http_v2_pool_cleanup(void *data);
 
 
+ngx_http_v2_reuse_stat_t  ngx_http_v2_reuse_stat;
+
+
 static ngx_http_v2_handler_pt ngx_http_v2_frame_states[] = {
     ngx_http_v2_state_data,               /* NGX_HTTP_V2_DATA_FRAME */
     ngx_http_v2_state_headers,            /* NGX_HTTP_V2_HEADERS_FRAME */
@@ -279,6 +308,17 @@ ngx_http_v2_init(ngx_event_t *rev)
     h2c->concurrent_pushes = h2scf->concurrent_pushes;
     h2c->priority_limit = ngx_max(h2scf->concurrent_streams, 100);
 
+    h2c->bdp.window = h2scf->preread_size;
+
+    /* the client's table is of the default size until it is changed */
+
+    h2c->hpack_enc.max = h2scf->hpack_table_size;
+    h2c->hpack_enc.size = ngx_min(h2c->hpack_enc.max, NGX_HTTP_V2_TABLE_SIZE);
+
+    if (h2c->hpack_enc.size < NGX_HTTP_V2_TABLE_SIZE) {
+        ngx_http_v2_hpack_table_resize(h2c, h2c->hpack_enc.size);
+    }
+
     h2c->pool = ngx_create_pool(h2scf->pool_size, h2c->connection->log);
     if (h2c->pool == NULL) {
         ngx_http_close_connection(c);
@@ -592,6 +632,12 @@ ngx_http_v2_send_output_queue(ngx_http_v2_connection_t *h2c)
             break;
         }
 
+        if (out->stream && !out->blocked
+            && (ngx_int_t) (out->finish - h2c->vtime) > 0)
+        {
+            h2c->vtime = out->finish;
+        }
+
         ngx_log_debug4(NGX_LOG_DEBUG_HTTP, c->log, 0,
                        "http2 frame sent: %p sid:%ui bl:%d len:%uz",
                        out, out->stream ? out->stream->node->id : 0,
@@ -636,6 +682,7 @@ ngx_http_v2_handle_connection(ngx_http_v2_connection_t *h2c)
 {
     ngx_int_t                  rc;
     ngx_connection_t          *c;
+    ngx_http_v2_srv_conf_t    *h2scf;
     ngx_http_core_loc_conf_t  *clcf;
 
     if (h2c->last_out || h2c->processing || h2c->pushing) {
@@ -686,13 +733,6 @@ ngx_http_v2_handle_connection(ngx_http_v2_connection_t *h2c)
         return;
     }
 
-    ngx_destroy_pool(h2c->pool);
-
-    h2c->pool = NULL;
-    h2c->free_frames = NULL;
-    h2c->frames = 0;
-    h2c->free_fake_connections = NULL;
-
 #if (NGX_HTTP_SSL)
     if (c->ssl) {
         ngx_ssl_free_buffer(c);
@@ -707,6 +747,22 @@ ngx_http_v2_handle_connection(ngx_http_v2_connection_t *h2c)
     if (c->write->timer_set) {
         ngx_del_timer(c->write);
     }
+
+    h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                         ngx_http_v2_module);
+
+    if (h2scf->pool_cache == 0) {
+        ngx_http_v2_free_pool(h2c);
+        return;
+    }
+
+    /*
+     * 连接的内存池及其中缓存的帧、伪连接和流的内存池在空闲一段时间后
+     * 才释放，短暂空闲后到来的流可以继续复用，见ngx_http_v2_idle_free_handler()
+     */
+
+    c->write->handler = ngx_http_v2_idle_free_handler;
+    ngx_add_timer(c->write, NGX_HTTP_V2_IDLE_FREE_TIMEOUT);
 }
 
 
@@ -938,6 +994,10 @@ ngx_http_v2_state_head(ngx_http_v2_connection_t *h2c, u_char *pos, u_char *end)
                    "http2 frame type:%ui f:%Xd l:%uz sid:%ui",
                    type, h2c->state.flags, h2c->state.length, h2c->state.sid);
 
+    if (type == NGX_HTTP_V2_PRIORITY_UPDATE_FRAME) {
+        return ngx_http_v2_state_priority_update(h2c, pos, end);
+    }
+
     if (type >= NGX_HTTP_V2_FRAME_STATES) {
         ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
                       "client sent frame with unknown type %ui", type);
@@ -1066,6 +1126,18 @@ ngx_http_v2_state_data(ngx_http_v2_connection_t *h2c, u_char *pos, u_char *end)
         stream->recv_window = NGX_HTTP_V2_MAX_WINDOW;
     }
 
+    if (!stream->no_flow_control) {
+
+        if (stream->recv_window == 0) {
+            h2c->bdp.stalls++;
+        }
+
+        if (ngx_http_v2_bdp_data(h2c, size) == NGX_ERROR) {
+            return ngx_http_v2_connection_error(h2c,
+                                                NGX_HTTP_V2_INTERNAL_ERROR);
+        }
+    }
+
     if (stream->in_closed) {
         ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
                       "client sent DATA frame for half-closed stream %ui",
@@ -1299,7 +1371,7 @@ ngx_http_v2_state_headers(ngx_http_v2_connection_t *h2c, u_char *pos,
 
     h2c->last_sid = h2c->state.sid;
 
-    h2c->state.pool = ngx_create_pool(1024, h2c->connection->log);
+    h2c->state.pool = ngx_http_v2_get_pool(h2c, 1024, h2c->connection->log);
     if (h2c->state.pool == NULL) {
         return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_INTERNAL_ERROR);
     }
@@ -1738,6 +1810,7 @@ ngx_http_v2_state_process_header(ngx_http_v2_connection_t *h2c, u_char *pos,
     ngx_http_core_main_conf_t  *cmcf;
 
     static ngx_str_t cookie = ngx_string("cookie");
+    static ngx_str_t priority = ngx_string("priority");
 
     header = &h2c->state.header;
 
@@ -1863,12 +1936,22 @@ ngx_http_v2_state_process_header(ngx_http_v2_connection_t *h2c, u_char *pos,
 
         cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
 
-        hh = ngx_hash_find(&cmcf->headers_in_hash, h->hash,
-                           h->lowcase_key, h->key.len);
+        hh = ngx_hash_find_perfect(&cmcf->headers_in_perfect_hash, h->hash,
+                                   h->lowcase_key, h->key.len);
 
         if (hh && hh->handler(r, h, hh->offset) != NGX_OK) {
             goto error;
         }
+
+        /* a PRIORITY_UPDATE frame received before takes precedence */
+
+        if (h->key.len == priority.len
+            && ngx_memcmp(h->key.data, priority.data, priority.len) == 0
+            && !h2c->state.stream->node->extensible)
+        {
+            ngx_http_v2_parse_priority(h2c->state.stream->node, h->value.data,
+                                       h->value.data + h->value.len);
+        }
     }
 
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -1915,7 +1998,7 @@ ngx_http_v2_state_header_complete(ngx_http_v2_connection_t *h2c, u_char *pos,
     }
 
     if (!h2c->state.keep_pool) {
-        ngx_destroy_pool(h2c->state.pool);
+        ngx_http_v2_put_pool(h2c, h2c->state.pool);
     }
 
     h2c->state.pool = NULL;
@@ -2071,6 +2154,104 @@ ngx_http_v2_state_priority(ngx_http_v2_connection_t *h2c, u_char *pos,
 }
 
 
+/*
+ * RFC 9218的PRIORITY_UPDATE帧，可以在请求之前到达，因此优先级保存在节点中；
+ * 状态缓冲区放不下的帧只有完整读入时才处理
+ */
+
+static u_char *
+ngx_http_v2_state_priority_update(ngx_http_v2_connection_t *h2c, u_char *pos,
+    u_char *end)
+{
+    size_t               size;
+    ngx_uint_t           sid;
+    ngx_http_v2_node_t  *node;
+
+    size = h2c->state.length;
+
+    if (size < NGX_HTTP_V2_PRIORITY_UPDATE_SIZE) {
+        ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
+                      "client sent PRIORITY_UPDATE frame "
+                      "with incorrect length %uz", size);
+
+        return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_SIZE_ERROR);
+    }
+
+    if (h2c->state.sid != 0) {
+        ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
+                      "client sent PRIORITY_UPDATE frame "
+                      "with incorrect identifier");
+
+        return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_PROTOCOL_ERROR);
+    }
+
+    if ((size_t) (end - pos) < size) {
+
+        if (size <= NGX_HTTP_V2_STATE_BUFFER_SIZE) {
+            return ngx_http_v2_state_save(h2c, pos, end,
+                                          ngx_http_v2_state_priority_update);
+        }
+
+        ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
+                      "client sent too long PRIORITY_UPDATE frame");
+
+        return ngx_http_v2_state_skip(h2c, pos, end);
+    }
+
+    if (--h2c->priority_limit == 0) {
+        ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
+                      "client sent too many PRIORITY_UPDATE frames");
+
+        return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_ENHANCE_YOUR_CALM);
+    }
+
+    sid = ngx_http_v2_parse_sid(pos);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 PRIORITY_UPDATE frame sid:%ui \"%*s\"",
+                   sid, size - NGX_HTTP_V2_PRIORITY_UPDATE_SIZE,
+                   pos + NGX_HTTP_V2_PRIORITY_UPDATE_SIZE);
+
+    if (sid == 0) {
+        ngx_log_error(NGX_LOG_INFO, h2c->connection->log, 0,
+                      "client sent PRIORITY_UPDATE frame "
+                      "for incorrect stream");
+
+        return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_PROTOCOL_ERROR);
+    }
+
+    if (sid % 2 == 0) {
+        /* pushed responses are not reprioritized */
+        pos += size;
+        return ngx_http_v2_state_complete(h2c, pos, end);
+    }
+
+    node = ngx_http_v2_get_node_by_id(h2c, sid, 1);
+
+    if (node == NULL) {
+        return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_INTERNAL_ERROR);
+    }
+
+    if (node->parent == NULL) {
+        /* a new node for a stream not yet opened */
+
+        node->weight = NGX_HTTP_V2_DEFAULT_WEIGHT;
+
+        h2c->closed_nodes++;
+        ngx_queue_insert_tail(&h2c->closed, &node->reuse);
+
+        ngx_http_v2_set_dependency(h2c, node, 0, 0);
+    }
+
+    ngx_http_v2_parse_priority(node, pos + NGX_HTTP_V2_PRIORITY_UPDATE_SIZE,
+                               pos + size);
+
+    pos += size;
+
+    return ngx_http_v2_state_complete(h2c, pos, end);
+}
+
+
 static u_char *
 ngx_http_v2_state_rst_stream(ngx_http_v2_connection_t *h2c, u_char *pos,
     u_char *end)
@@ -2279,7 +2460,7 @@ ngx_http_v2_state_settings_params(ngx_http_v2_connection_t *h2c, u_char *pos,
 
         case NGX_HTTP_V2_HEADER_TABLE_SIZE_SETTING:
 
-            h2c->table_update = 1;
+            ngx_http_v2_hpack_table_resize(h2c, value);
             break;
 
         default:
@@ -2351,6 +2532,14 @@ ngx_http_v2_state_ping(ngx_http_v2_connection_t *h2c, u_char *pos, u_char *end)
     }
 
     if (h2c->state.flags & NGX_HTTP_V2_ACK_FLAG) {
+
+        if (h2c->bdp.ping
+            && ngx_strncmp(pos, NGX_HTTP_V2_BDP_PING, NGX_HTTP_V2_PING_SIZE)
+               == 0)
+        {
+            ngx_http_v2_bdp_ack(h2c);
+        }
+
         return ngx_http_v2_state_skip(h2c, pos, end);
     }
 
@@ -2747,7 +2936,7 @@ ngx_http_v2_push_stream(ngx_http_v2_stream_t *parent, ngx_str_t *path)
 
     h2c = parent->connection;
 
-    pool = ngx_create_pool(1024, h2c->connection->log);
+    pool = ngx_http_v2_get_pool(h2c, 1024, h2c->connection->log);
     if (pool == NULL) {
         goto rst_stream;
     }
@@ -2755,7 +2944,7 @@ ngx_http_v2_push_stream(ngx_http_v2_stream_t *parent, ngx_str_t *path)
     node = ngx_http_v2_get_node_by_id(h2c, h2c->last_push, 1);
 
     if (node == NULL) {
-        ngx_destroy_pool(pool);
+        ngx_http_v2_put_pool(h2c, pool);
         goto rst_stream;
     }
 
@@ -2773,7 +2962,7 @@ ngx_http_v2_push_stream(ngx_http_v2_stream_t *parent, ngx_str_t *path)
             h2c->closed_nodes++;
         }
 
-        ngx_destroy_pool(pool);
+        ngx_http_v2_put_pool(h2c, pool);
         goto rst_stream;
     }
 
@@ -3005,6 +3194,98 @@ ngx_http_v2_send_window_update(ngx_http_v2_connection_t *h2c, ngx_uint_t sid,
 }
 
 
+/*
+ * 估计带宽时延积：收到受流量控制的DATA帧时若没有未确认的PING则发送一个，
+ * 在收到确认前累计DATA字节数，该字节数即一个往返时间内对端能够发送的数据量
+ */
+
+static ngx_int_t
+ngx_http_v2_bdp_data(ngx_http_v2_connection_t *h2c, size_t size)
+{
+    ngx_buf_t                *buf;
+    ngx_http_v2_srv_conf_t   *h2scf;
+    ngx_http_v2_out_frame_t  *frame;
+
+    if (h2c->bdp.ping) {
+        h2c->bdp.bytes += size;
+        return NGX_OK;
+    }
+
+    h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                         ngx_http_v2_module);
+
+    if (h2scf->body_window_max == 0) {
+        return NGX_OK;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 send PING frame for bdp");
+
+    frame = ngx_http_v2_get_frame(h2c, NGX_HTTP_V2_PING_SIZE,
+                                  NGX_HTTP_V2_PING_FRAME,
+                                  NGX_HTTP_V2_NO_FLAG, 0);
+    if (frame == NULL) {
+        return NGX_ERROR;
+    }
+
+    buf = frame->first->buf;
+
+    buf->last = ngx_cpymem(buf->last, NGX_HTTP_V2_BDP_PING,
+                           NGX_HTTP_V2_PING_SIZE);
+
+    ngx_http_v2_queue_blocked_frame(h2c, frame);
+
+    h2c->bdp.ping = 1;
+    h2c->bdp.bytes = size;
+    h2c->bdp.sent = ngx_event_usec();
+
+    return NGX_OK;
+}
+
+
+/*
+ * 收到PING确认：一个往返时间内收到的数据接近估计的窗口时，说明发送方
+ * 受窗口限制，窗口加倍；远小于估计的窗口时减半，但不小于初始窗口
+ */
+
+static void
+ngx_http_v2_bdp_ack(ngx_http_v2_connection_t *h2c)
+{
+    size_t                   sample, window, max;
+    ngx_http_v2_bdp_t       *bdp;
+    ngx_http_v2_srv_conf_t  *h2scf;
+
+    h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                         ngx_http_v2_module);
+
+    bdp = &h2c->bdp;
+
+    bdp->ping = 0;
+    bdp->rtt = ngx_event_usec() - bdp->sent;
+
+    sample = bdp->bytes;
+    bdp->bytes = 0;
+
+    max = ngx_min(h2scf->body_window_max, NGX_HTTP_V2_MAX_WINDOW / 2);
+    max = ngx_max(max, h2scf->preread_size);
+
+    window = bdp->window;
+
+    if (sample >= window / 3 * 2) {
+        window = ngx_min(sample * 2, max);
+
+    } else if (sample < window / 4) {
+        window = ngx_max(window / 2, h2scf->preread_size);
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 bdp sample:%uz rtt:%uLus window:%uz -> %uz",
+                   sample, bdp->rtt, bdp->window, window);
+
+    bdp->window = window;
+}
+
+
 static ngx_int_t
 ngx_http_v2_send_rst_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t sid,
     ngx_uint_t status)
@@ -3160,6 +3441,7 @@ static ngx_http_v2_stream_t *
 ngx_http_v2_create_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t push)
 {
     ngx_log_t                 *log;
+    ngx_pool_t                *pool;
     ngx_event_t               *rev, *wev;
     ngx_connection_t          *fc;
     ngx_http_log_ctx_t        *ctx;
@@ -3178,6 +3460,8 @@ ngx_http_v2_create_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t push)
         log = fc->log;
         ctx = log->data;
 
+        ngx_http_v2_reuse_stat.conn_hits++;
+
     } else {
         fc = ngx_palloc(h2c->pool, sizeof(ngx_connection_t));
         if (fc == NULL) {
@@ -3207,6 +3491,8 @@ ngx_http_v2_create_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t push)
         ctx->connection = fc;
         ctx->request = NULL;
         ctx->current_request = NULL;
+
+        ngx_http_v2_reuse_stat.conn_misses++;
     }
 
     ngx_memcpy(log, h2c->connection->log, sizeof(ngx_log_t));
@@ -3242,7 +3528,15 @@ ngx_http_v2_create_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t push)
     fc->sndlowat = 1;
     fc->tcp_nodelay = NGX_TCP_NODELAY_DISABLED;
 
-    r = ngx_http_create_request(fc);
+    cscf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                        ngx_http_core_module);
+
+    pool = ngx_http_v2_get_pool(h2c, cscf->request_pool_size, log);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    r = ngx_http_create_request_in_pool(fc, pool);
     if (r == NULL) {
         return NULL;
     }
@@ -3255,8 +3549,6 @@ ngx_http_v2_create_stream(ngx_http_v2_connection_t *h2c, ngx_uint_t push)
     fc->data = r;
     h2c->connection->requests++;
 
-    cscf = ngx_http_get_module_srv_conf(r, ngx_http_core_module);
-
     r->header_in = ngx_create_temp_buf(r->pool,
                                        cscf->client_header_buffer_size);
     if (r->header_in == NULL) {
@@ -3743,8 +4035,9 @@ ngx_http_v2_parse_header(ngx_http_request_t *r,
 
         cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
 
-        header->hh = ngx_hash_find(&cmcf->headers_in_hash, header->hash,
-                                   h->lowcase_key, h->key.len);
+        header->hh = ngx_hash_find_perfect(&cmcf->headers_in_perfect_hash,
+                                           header->hash, h->lowcase_key,
+                                           h->key.len);
         if (header->hh == NULL) {
             return NGX_ERROR;
         }
@@ -3919,8 +4212,8 @@ ngx_http_v2_construct_cookie_header(ngx_http_request_t *r)
 
     cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
 
-    hh = ngx_hash_find(&cmcf->headers_in_hash, h->hash,
-                       h->lowcase_key, h->key.len);
+    hh = ngx_hash_find_perfect(&cmcf->headers_in_perfect_hash, h->hash,
+                               h->lowcase_key, h->key.len);
 
     if (hh == NULL) {
         ngx_http_v2_close_stream(r->stream, NGX_HTTP_INTERNAL_SERVER_ERROR);
@@ -3939,6 +4232,95 @@ ngx_http_v2_construct_cookie_header(ngx_http_request_t *r)
 }
 
 
+/*
+ * 解析RFC 9218的Priority字段值，即结构化字段的字典：
+ * "u"为0-7的整数，"i"为布尔值，忽略其他成员、参数以及无效的值
+ */
+
+static void
+ngx_http_v2_parse_priority(ngx_http_v2_node_t *node, u_char *p, u_char *end)
+{
+    u_char      *key, *value, *last;
+    ngx_int_t    n;
+    ngx_uint_t   urgency, incremental, quoted;
+
+    urgency = NGX_HTTP_V2_DEFAULT_URGENCY;
+    incremental = 0;
+
+    while (p < end) {
+
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+
+        key = p;
+
+        while (p < end && *p != '=' && *p != ';' && *p != ',') {
+            p++;
+        }
+
+        for (last = p; last > key && last[-1] == ' '; last--) { /* void */ }
+
+        value = NULL;
+
+        if (p < end && *p == '=') {
+            value = ++p;
+
+            while (p < end && *p != ';' && *p != ',') {
+                p++;
+            }
+        }
+
+        /* the parameters may contain quoted strings */
+
+        quoted = 0;
+
+        while (p < end && (quoted || *p != ',')) {
+
+            if (*p == '\\' && quoted && p + 1 < end) {
+                p++;
+
+            } else if (*p == '"') {
+                quoted = !quoted;
+            }
+
+            p++;
+        }
+
+        if (last - key == 1 && key[0] == 'u' && value) {
+            for (last = value; last < end && *last >= '0' && *last <= '9';
+                 last++)
+            { /* void */ }
+
+            n = ngx_atoi(value, last - value);
+
+            if (n != NGX_ERROR && n <= NGX_HTTP_V2_MAX_URGENCY) {
+                urgency = n;
+            }
+
+        } else if (last - key == 1 && key[0] == 'i') {
+
+            if (value == NULL) {
+                incremental = 1;
+
+            } else if (end - value >= 2 && value[0] == '?'
+                       && (value[1] == '0' || value[1] == '1'))
+            {
+                incremental = value[1] - '0';
+            }
+        }
+
+        if (p < end) {
+            p++;  /* "," */
+        }
+    }
+
+    node->urgency = urgency;
+    node->incremental = incremental;
+    node->extensible = 1;
+}
+
+
 static void
 ngx_http_v2_run_request(ngx_http_request_t *r)
 {
@@ -4062,6 +4444,14 @@ ngx_http_v2_read_request_body(ngx_http_request_t *r)
         if (len > NGX_HTTP_V2_MAX_WINDOW) {
             len = NGX_HTTP_V2_MAX_WINDOW;
         }
+
+        /* the window estimated from the connection's round trips */
+
+        size = ngx_http_v2_body_window_extra(r, (size_t) len);
+
+        len += size;
+        stream->window_extra = size;
+        stream->connection->bdp.used += size;
     }
 
     rb->buf = ngx_create_temp_buf(r->pool, (size_t) len);
@@ -4440,6 +4830,8 @@ ngx_http_v2_read_client_request_body_handler(ngx_http_request_t *r)
     buf->pos = buf->start;
     buf->last = buf->start;
 
+    ngx_http_v2_resize_request_body_buffer(r);
+
     window = buf->end - buf->start;
 
     if (h2c->state.stream == stream) {
@@ -4535,6 +4927,8 @@ ngx_http_v2_read_unbuffered_request_body(ngx_http_request_t *r)
     buf->pos = buf->start;
     buf->last = buf->start;
 
+    ngx_http_v2_resize_request_body_buffer(r);
+
     window = buf->end - buf->start;
     h2c = stream->connection;
 
@@ -4572,6 +4966,108 @@ ngx_http_v2_read_unbuffered_request_body(ngx_http_request_t *r)
 }
 
 
+/*
+ * 请求体缓冲区即流的接收窗口，按连接估计的窗口可以增加的字节数，
+ * 受连接上所有流增加部分的总和以及请求体剩余长度的限制
+ */
+
+static size_t
+ngx_http_v2_body_window_extra(ngx_http_request_t *r, size_t size)
+{
+    off_t                      rest;
+    size_t                     extra;
+    ngx_http_v2_srv_conf_t    *h2scf;
+    ngx_http_v2_connection_t  *h2c;
+
+    h2c = r->stream->connection;
+    h2scf = ngx_http_get_module_srv_conf(r, ngx_http_v2_module);
+
+    if (h2c->bdp.window <= size || h2c->bdp.used >= h2scf->body_window_max) {
+        return 0;
+    }
+
+    extra = ngx_min(h2c->bdp.window - size,
+                    h2scf->body_window_max - h2c->bdp.used);
+
+    if (r->headers_in.content_length_n >= 0) {
+        rest = r->headers_in.content_length_n - r->request_body->received + 1;
+
+        if (rest <= (off_t) size) {
+            return 0;
+        }
+
+        if (rest - (off_t) size < (off_t) extra) {
+            extra = (size_t) (rest - (off_t) size);
+        }
+    }
+
+    return extra;
+}
+
+
+/*
+ * 缓冲区为空时按新的窗口估计重新分配：估计增大时扩大，减小时缩小并把
+ * 差额还给连接，但不小于已经通告给对端的窗口
+ */
+
+static void
+ngx_http_v2_resize_request_body_buffer(ngx_http_request_t *r)
+{
+    u_char                    *p;
+    size_t                     size, base, len, min;
+    ngx_buf_t                 *buf;
+    ngx_http_v2_stream_t      *stream;
+    ngx_http_v2_connection_t  *h2c;
+
+    stream = r->stream;
+    h2c = stream->connection;
+    buf = r->request_body->buf;
+
+    size = buf->end - buf->start;
+    base = size - stream->window_extra;
+
+    /* 流自身增加的部分不计入连接的限制 */
+
+    h2c->bdp.used -= stream->window_extra;
+
+    len = base + ngx_http_v2_body_window_extra(r, base);
+
+    min = stream->recv_window;
+
+    if (h2c->state.stream == stream) {
+        min += h2c->state.length;
+    }
+
+    if (len < min) {
+        len = min;
+    }
+
+    if ((len > size ? len - size : size - len) < ngx_pagesize) {
+        h2c->bdp.used += stream->window_extra;
+        return;
+    }
+
+    p = ngx_palloc(r->pool, len);
+    if (p == NULL) {
+        h2c->bdp.used += stream->window_extra;
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http2 request body buffer %uz -> %uz", size, len);
+
+    ngx_pfree(r->pool, buf->start);
+
+    buf->start = p;
+    buf->pos = p;
+    buf->last = p;
+    buf->end = p + len;
+
+    stream->window_extra = len - base;
+    h2c->bdp.used += stream->window_extra;
+}
+
+
 static ngx_int_t
 ngx_http_v2_terminate_stream(ngx_http_v2_connection_t *h2c,
     ngx_http_v2_stream_t *stream, ngx_uint_t status)
@@ -4629,6 +5125,9 @@ ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc)
         return;
     }
 
+    h2c->bdp.used -= stream->window_extra;
+    stream->window_extra = 0;
+
     if (!stream->rst_sent && !h2c->connection->error) {
 
         if (!stream->out_closed) {
@@ -4674,7 +5173,7 @@ ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc)
     ngx_http_free_request(stream->request, rc);
 
     if (pool != h2c->state.pool) {
-        ngx_destroy_pool(pool);
+        ngx_http_v2_put_pool(h2c, pool);
 
     } else {
         /* pool will be destroyed when the complete header is parsed */
@@ -4722,6 +5221,141 @@ ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc)
 }
 
 
+/*
+ * 流的请求内存池和请求头内存池在连接内缓存复用，
+ * 选择能容纳size的最小的缓存内存池，没有时新建
+ */
+
+ngx_pool_t *
+ngx_http_v2_get_pool(ngx_http_v2_connection_t *h2c, size_t size,
+    ngx_log_t *log)
+{
+    size_t       psize, best;
+    ngx_uint_t   i, n;
+    ngx_pool_t  *pool;
+
+    n = h2c->nfree_pools;
+    best = 0;
+
+    for (i = 0; i < h2c->nfree_pools; i++) {
+        pool = h2c->free_pools[i];
+        psize = pool->d.end - (u_char *) pool;
+
+        if (psize >= size && (best == 0 || psize < best)) {
+            best = psize;
+            n = i;
+        }
+    }
+
+    if (n == h2c->nfree_pools) {
+        ngx_http_v2_reuse_stat.pool_misses++;
+        return ngx_create_pool(size, log);
+    }
+
+    pool = h2c->free_pools[n];
+    h2c->free_pools[n] = h2c->free_pools[--h2c->nfree_pools];
+
+    pool->log = log;
+
+    ngx_http_v2_reuse_stat.pool_hits++;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 reuse pool %p, cached %ui", pool, h2c->nfree_pools);
+
+    return pool;
+}
+
+
+/*
+ * 与ngx_destroy_pool()一样先调用清理函数，再重置后放入连接的缓存；
+ * 缓存最多保存http2_pool_cache个流的内存池，缓存已满或内存池的块数
+ * 过多时直接销毁，缓存与连接的内存池一起在连接空闲一段时间后释放
+ */
+
+void
+ngx_http_v2_put_pool(ngx_http_v2_connection_t *h2c, ngx_pool_t *pool)
+{
+    ngx_uint_t               n;
+    ngx_pool_t              *p;
+    ngx_pool_cleanup_t      *c;
+    ngx_http_v2_srv_conf_t  *h2scf;
+
+    h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                         ngx_http_v2_module);
+
+    if (h2c->nfree_pools >= NGX_HTTP_V2_STREAM_POOLS * h2scf->pool_cache
+        || h2c->pool == NULL
+        || h2c->connection->error)
+    {
+        goto destroy;
+    }
+
+    n = 0;
+
+    for (p = pool; p; p = p->d.next) {
+        if (++n > NGX_HTTP_V2_POOL_CACHE_BLOCKS) {
+            goto destroy;
+        }
+    }
+
+    if (h2c->free_pools == NULL) {
+        h2c->free_pools = ngx_palloc(h2c->pool, NGX_HTTP_V2_STREAM_POOLS
+                                                * h2scf->pool_cache
+                                                * sizeof(ngx_pool_t *));
+        if (h2c->free_pools == NULL) {
+            goto destroy;
+        }
+    }
+
+    for (c = pool->cleanup; c; c = c->next) {
+        if (c->handler) {
+            ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
+                           "run cleanup: %p", c);
+            c->handler(c->data);
+        }
+    }
+
+    pool->cleanup = NULL;
+    pool->log = h2c->connection->log;
+
+    ngx_reset_pool(pool);
+
+    h2c->free_pools[h2c->nfree_pools++] = pool;
+
+    return;
+
+destroy:
+
+    ngx_http_v2_reuse_stat.pool_drops++;
+
+    ngx_destroy_pool(pool);
+}
+
+
+static void
+ngx_http_v2_free_pool(ngx_http_v2_connection_t *h2c)
+{
+    ngx_http_v2_free_pools(h2c);
+    ngx_destroy_pool(h2c->pool);
+
+    h2c->pool = NULL;
+    h2c->free_frames = NULL;
+    h2c->frames = 0;
+    h2c->free_fake_connections = NULL;
+}
+
+
+static void
+ngx_http_v2_free_pools(ngx_http_v2_connection_t *h2c)
+{
+    while (h2c->nfree_pools) {
+        ngx_destroy_pool(h2c->free_pools[--h2c->nfree_pools]);
+    }
+
+    h2c->free_pools = NULL;
+}
+
+
 static void
 ngx_http_v2_close_stream_handler(ngx_event_t *ev)
 {
@@ -4847,13 +5481,19 @@ ngx_http_v2_idle_handler(ngx_event_t *rev)
     c->destroyed = 0;
     ngx_reusable_connection(c, 0);
 
-    h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
-                                         ngx_http_v2_module);
+    if (c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
 
-    h2c->pool = ngx_create_pool(h2scf->pool_size, h2c->connection->log);
     if (h2c->pool == NULL) {
-        ngx_http_v2_finalize_connection(h2c, NGX_HTTP_V2_INTERNAL_ERROR);
-        return;
+        h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
+                                             ngx_http_v2_module);
+
+        h2c->pool = ngx_create_pool(h2scf->pool_size, h2c->connection->log);
+        if (h2c->pool == NULL) {
+            ngx_http_v2_finalize_connection(h2c, NGX_HTTP_V2_INTERNAL_ERROR);
+            return;
+        }
     }
 
     c->write->handler = ngx_http_v2_write_handler;
@@ -4863,6 +5503,27 @@ ngx_http_v2_idle_handler(ngx_event_t *rev)
 }
 
 
+static void
+ngx_http_v2_idle_free_handler(ngx_event_t *wev)
+{
+    ngx_connection_t  *c;
+
+    if (!wev->timedout) {
+        return;
+    }
+
+    wev->timedout = 0;
+
+    c = wev->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http2 idle free handler");
+
+    c->write->handler = ngx_http_empty_handler;
+
+    ngx_http_v2_free_pool(c->data);
+}
+
+
 static void
 ngx_http_v2_finalize_connection(ngx_http_v2_connection_t *h2c,
     ngx_uint_t status)
@@ -5134,6 +5795,7 @@ ngx_http_v2_pool_cleanup(void *data)
     }
 
     if (h2c->pool) {
+        ngx_http_v2_free_pools(h2c);
         ngx_destroy_pool(h2c->pool);
     }
 }
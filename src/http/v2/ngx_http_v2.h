@@ -24,6 +24,10 @@
 #define NGX_HTTP_V2_MAX_FIELD                                                 \
     (127 + (1 << (NGX_HTTP_V2_INT_OCTETS - 1) * 7) - 1)
 
+#define NGX_HTTP_V2_TABLE_SIZE           4096
+#define NGX_HTTP_V2_DYNAMIC_INDEX        62
+#define NGX_HTTP_V2_MAX_TABLE_SIZE       65536
+
 #define NGX_HTTP_V2_STREAM_ID_SIZE       4
 
 #define NGX_HTTP_V2_FRAME_HEADER_SIZE    9
@@ -39,6 +43,7 @@
 #define NGX_HTTP_V2_GOAWAY_FRAME         0x7
 #define NGX_HTTP_V2_WINDOW_UPDATE_FRAME  0x8
 #define NGX_HTTP_V2_CONTINUATION_FRAME   0x9
+#define NGX_HTTP_V2_PRIORITY_UPDATE_FRAME  0x10   /* RFC 9218 */
 
 /* frame flags */
 #define NGX_HTTP_V2_NO_FLAG              0x00
@@ -52,6 +57,11 @@
 #define NGX_HTTP_V2_DEFAULT_WINDOW       65535
 
 #define NGX_HTTP_V2_DEFAULT_WEIGHT       16
+#define NGX_HTTP_V2_MAX_WEIGHT           256
+
+/* RFC 9218 extensible priorities */
+#define NGX_HTTP_V2_DEFAULT_URGENCY      3
+#define NGX_HTTP_V2_MAX_URGENCY          7
 
 
 typedef struct ngx_http_v2_connection_s   ngx_http_v2_connection_t;
@@ -114,6 +124,65 @@ typedef struct {
 } ngx_http_v2_hpack_t;
 
 
+typedef struct {
+    ngx_uint_t                       hash;
+    ngx_uint_t                       name_hash;
+    ngx_str_t                        name;
+    ngx_str_t                        value;
+} ngx_http_v2_hpack_entry_t;
+
+
+/*
+ * the encoder side of the dynamic table, it mirrors the table of the
+ * client's decoder; name and value of an entry are kept contiguous
+ * in a ring of twice the maximum table size, so the live entries never
+ * overlap even if the space at the end of the ring is skipped
+ */
+
+typedef struct {
+    ngx_http_v2_hpack_entry_t       *entries;
+
+    ngx_uint_t                       added;
+    ngx_uint_t                       deleted;
+    ngx_uint_t                       allocated;
+
+    size_t                           size;
+    size_t                           used;
+    size_t                           max;
+
+    size_t                           update;    /* pending size update */
+    size_t                           lowest;
+
+    u_char                          *storage;
+    u_char                          *pos;
+} ngx_http_v2_hpack_enc_t;
+
+
+/*
+ * 请求体接收窗口的自动调整：以一次PING往返期间收到的DATA字节数
+ * 估计带宽时延积，据此确定受流量控制的请求体的缓冲区即接收窗口大小
+ */
+typedef struct {
+    size_t                           window;    /* 估计的流接收窗口 */
+    size_t                           bytes;     /* PING发出后收到的字节数 */
+    size_t                           used;      /* 超出默认大小的缓冲区总和 */
+    uint64_t                         sent;      /* PING发出的时间，微秒 */
+    uint64_t                         rtt;       /* 最近的往返时间，微秒 */
+    ngx_uint_t                       stalls;    /* 流接收窗口耗尽的次数 */
+    unsigned                         ping:1;    /* 等待PING的确认 */
+} ngx_http_v2_bdp_t;
+
+
+/* 每个worker进程的流对象复用统计 */
+typedef struct {
+    ngx_uint_t                       pool_hits;     /* 复用缓存的内存池 */
+    ngx_uint_t                       pool_misses;   /* 新建内存池 */
+    ngx_uint_t                       pool_drops;    /* 未放入缓存而销毁 */
+    ngx_uint_t                       conn_hits;     /* 复用的伪连接 */
+    ngx_uint_t                       conn_misses;   /* 新分配的伪连接 */
+} ngx_http_v2_reuse_stat_t;
+
+
 struct ngx_http_v2_connection_s {
     ngx_connection_t                *connection;
     ngx_http_connection_t           *http_connection;
@@ -140,16 +209,25 @@ struct ngx_http_v2_connection_s {
     ngx_http_v2_state_t              state;
 
     ngx_http_v2_hpack_t              hpack;
+    ngx_http_v2_hpack_enc_t          hpack_enc;
+
+    ngx_http_v2_bdp_t                bdp;
 
     ngx_pool_t                      *pool;
 
     ngx_http_v2_out_frame_t         *free_frames;
     ngx_connection_t                *free_fake_connections;
 
+    ngx_pool_t                     **free_pools;
+    ngx_uint_t                       nfree_pools;
+
     ngx_http_v2_node_t             **streams_index;
 
     ngx_http_v2_out_frame_t         *last_out;
 
+    /* 加权公平队列的虚拟时间，即最近发送的数据帧的虚拟完成时间 */
+    ngx_uint_t                       vtime;
+
     ngx_queue_t                      dependencies;
     ngx_queue_t                      closed;
 
@@ -178,6 +256,11 @@ struct ngx_http_v2_node_s {
     ngx_uint_t                       weight;
     double                           rel_weight;
     ngx_http_v2_stream_t            *stream;
+
+    /* 客户端通过priority请求头或PRIORITY_UPDATE帧设置的优先级 */
+    unsigned                         urgency:3;
+    unsigned                         incremental:1;
+    unsigned                         extensible:1;
 };
 
 
@@ -197,8 +280,14 @@ struct ngx_http_v2_stream_s {
 
     ngx_buf_t                       *preread;
 
+    /* 请求体缓冲区按带宽时延积增加的部分 */
+    size_t                           window_extra;
+
     ngx_uint_t                       frames;
 
+    /* 最近排队的数据帧的虚拟完成时间 */
+    ngx_uint_t                       finish;
+
     ngx_http_v2_out_frame_t         *free_frames;
     ngx_chain_t                     *free_frame_headers;
     ngx_chain_t                     *free_bufs;
@@ -230,28 +319,92 @@ struct ngx_http_v2_out_frame_s {
     ngx_http_v2_stream_t            *stream;
     size_t                           length;
 
+    ngx_uint_t                       finish;
+
     unsigned                         blocked:1;
     unsigned                         fin:1;
 };
 
 
+/*
+ * 数据帧的发送顺序：先按RFC 9218的urgency，同一urgency中非增量的响应
+ * 按流标识符依次整体发送，其余的流按RFC 7540依赖树的层级，
+ * 同一层级按权重进行加权公平排队（按虚拟完成时间）
+ */
+
+static ngx_inline ngx_uint_t
+ngx_http_v2_frame_precedes(ngx_http_v2_out_frame_t *a,
+    ngx_http_v2_out_frame_t *b)
+{
+    ngx_uint_t           ua, ub, sa, sb, ra, rb;
+    ngx_http_v2_node_t  *na, *nb;
+
+    na = a->stream->node;
+    nb = b->stream->node;
+
+    ua = na->extensible ? na->urgency : NGX_HTTP_V2_DEFAULT_URGENCY;
+    ub = nb->extensible ? nb->urgency : NGX_HTTP_V2_DEFAULT_URGENCY;
+
+    if (ua != ub) {
+        return ua < ub;
+    }
+
+    sa = na->extensible && !na->incremental;
+    sb = nb->extensible && !nb->incremental;
+
+    if (sa != sb) {
+        return sa;
+    }
+
+    if (sa) {
+        return na->id < nb->id;
+    }
+
+    ra = na->extensible ? 0 : na->rank;
+    rb = nb->extensible ? 0 : nb->rank;
+
+    if (ra != rb) {
+        return ra < rb;
+    }
+
+    return (ngx_int_t) (a->finish - b->finish) <= 0;
+}
+
+
 static ngx_inline void
 ngx_http_v2_queue_frame(ngx_http_v2_connection_t *h2c,
     ngx_http_v2_out_frame_t *frame)
 {
+    ngx_uint_t                 weight;
+    ngx_http_v2_node_t        *node;
+    ngx_http_v2_stream_t      *stream;
     ngx_http_v2_out_frame_t  **out;
 
+    stream = frame->stream;
+    node = stream->node;
+
+    weight = node->extensible ? NGX_HTTP_V2_DEFAULT_WEIGHT : node->weight;
+
+    if ((ngx_int_t) (stream->finish - h2c->vtime) < 0) {
+        stream->finish = h2c->vtime;
+    }
+
+    stream->finish += (frame->length + NGX_HTTP_V2_FRAME_HEADER_SIZE)
+                      * NGX_HTTP_V2_MAX_WEIGHT / weight;
+
+    frame->finish = stream->finish;
+
+    /* the queue is in reverse order, the frames of a stream keep their order */
+
     for (out = &h2c->last_out; *out; out = &(*out)->next) {
 
-        if ((*out)->blocked || (*out)->stream == NULL) {
+        if ((*out)->blocked || (*out)->stream == NULL
+            || (*out)->stream == stream)
+        {
             break;
         }
 
-        if ((*out)->stream->node->rank < frame->stream->node->rank
-            || ((*out)->stream->node->rank == frame->stream->node->rank
-                && (*out)->stream->node->rel_weight
-                   >= frame->stream->node->rel_weight))
-        {
+        if (ngx_http_v2_frame_precedes(*out, frame)) {
             break;
         }
     }
@@ -300,6 +453,10 @@ void ngx_http_v2_close_stream(ngx_http_v2_stream_t *stream, ngx_int_t rc);
 
 ngx_int_t ngx_http_v2_send_output_queue(ngx_http_v2_connection_t *h2c);
 
+ngx_pool_t *ngx_http_v2_get_pool(ngx_http_v2_connection_t *h2c, size_t size,
+    ngx_log_t *log);
+void ngx_http_v2_put_pool(ngx_http_v2_connection_t *h2c, ngx_pool_t *pool);
+
 
 ngx_str_t *ngx_http_v2_get_static_name(ngx_uint_t index);
 ngx_str_t *ngx_http_v2_get_static_value(ngx_uint_t index);
@@ -376,6 +533,13 @@ ngx_int_t ngx_http_v2_table_size(ngx_http_v2_connection_t *h2c, size_t size);
 #define NGX_HTTP_V2_ENCODE_RAW            0
 #define NGX_HTTP_V2_ENCODE_HUFF           0x80
 
+#define NGX_HTTP_V2_HPACK_LITERAL         0
+#define NGX_HTTP_V2_HPACK_INDEX           1
+#define NGX_HTTP_V2_HPACK_NEVER           2
+
+/* the upper bound of a pending dynamic table size update */
+#define NGX_HTTP_V2_TABLE_UPDATE_SIZE     (2 * NGX_HTTP_V2_INT_OCTETS)
+
 #define NGX_HTTP_V2_AUTHORITY_INDEX       1
 
 #define NGX_HTTP_V2_METHOD_INDEX          2
@@ -411,6 +575,17 @@ ngx_int_t ngx_http_v2_table_size(ngx_http_v2_connection_t *h2c, size_t size);
 
 u_char *ngx_http_v2_string_encode(u_char *dst, u_char *src, size_t len,
     u_char *tmp, ngx_uint_t lower);
+u_char *ngx_http_v2_hpack_encode(ngx_http_v2_connection_t *h2c, u_char *pos,
+    ngx_uint_t index, ngx_str_t *name, u_char *value, size_t len,
+    ngx_uint_t mode, u_char *tmp);
+u_char *ngx_http_v2_hpack_table_update(ngx_http_v2_connection_t *h2c,
+    u_char *pos);
+void ngx_http_v2_hpack_table_resize(ngx_http_v2_connection_t *h2c,
+    size_t size);
+void ngx_http_v2_hpack_table_clear(ngx_http_v2_connection_t *h2c);
+
+
+extern ngx_http_v2_reuse_stat_t  ngx_http_v2_reuse_stat;
 
 
 #endif /* _NGX_HTTP_V2_H_INCLUDED_ */
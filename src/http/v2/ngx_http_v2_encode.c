@@ -12,6 +12,9 @@
 
 static u_char *ngx_http_v2_write_int(u_char *pos, ngx_uint_t prefix,
     ngx_uint_t value);
+static ngx_int_t ngx_http_v2_hpack_alloc(ngx_http_v2_connection_t *h2c);
+static void ngx_http_v2_hpack_evict(ngx_http_v2_hpack_enc_t *enc,
+    size_t size);
 
 
 u_char *
@@ -40,6 +43,265 @@ ngx_http_v2_string_encode(u_char *dst, u_char *src, size_t len, u_char *tmp,
 }
 
 
+u_char *
+ngx_http_v2_hpack_encode(ngx_http_v2_connection_t *h2c, u_char *pos,
+    ngx_uint_t index, ngx_str_t *name, u_char *value, size_t len,
+    ngx_uint_t mode, u_char *tmp)
+{
+    size_t                      size;
+    ngx_uint_t                  n, hash, name_hash, found;
+    ngx_http_v2_hpack_enc_t    *enc;
+    ngx_http_v2_hpack_entry_t  *entry;
+
+    if (index) {
+        name = ngx_http_v2_get_static_name(index);
+    }
+
+    enc = &h2c->hpack_enc;
+
+    /* the size of an entry is the sum of its name, value and 32 octets */
+
+    size = 32 + name->len + len;
+
+    if (mode != NGX_HTTP_V2_HPACK_INDEX || size > enc->size) {
+        goto literal;
+    }
+
+    name_hash = ngx_hash_key_lc(name->data, name->len);
+    hash = ngx_hash(name_hash, ngx_hash_key(value, len));
+
+    found = 0;
+
+    for (n = enc->added; n != enc->deleted; n--) {
+        entry = &enc->entries[(n - 1) % enc->allocated];
+
+        if (entry->name_hash != name_hash
+            || entry->name.len != name->len
+            || ngx_strncasecmp(entry->name.data, name->data, name->len) != 0)
+        {
+            continue;
+        }
+
+        if (entry->hash == hash
+            && entry->value.len == len
+            && ngx_memcmp(entry->value.data, value, len) == 0)
+        {
+            n = enc->added - n + NGX_HTTP_V2_DYNAMIC_INDEX;
+
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                           "http2 hpack index: %ui", n);
+
+            *pos = 128;
+            return ngx_http_v2_write_int(pos, ngx_http_v2_prefix(7), n);
+        }
+
+        if (found == 0) {
+            found = enc->added - n + NGX_HTTP_V2_DYNAMIC_INDEX;
+        }
+    }
+
+    if (ngx_http_v2_hpack_alloc(h2c) != NGX_OK) {
+        goto literal;
+    }
+
+    /* literal with incremental indexing */
+
+    if (index == 0) {
+        index = found;
+    }
+
+    if (index) {
+        *pos = 64;
+        pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(6), index);
+
+    } else {
+        *pos++ = 64;
+        pos = ngx_http_v2_write_name(pos, name->data, name->len, tmp);
+    }
+
+    pos = ngx_http_v2_write_value(pos, value, len, tmp);
+
+    ngx_http_v2_hpack_evict(enc, enc->size - size);
+
+    if (enc->pos + name->len + len > enc->storage + 2 * enc->max) {
+        enc->pos = enc->storage;
+    }
+
+    entry = &enc->entries[enc->added++ % enc->allocated];
+
+    entry->hash = hash;
+    entry->name_hash = name_hash;
+
+    entry->name.len = name->len;
+    entry->name.data = enc->pos;
+    ngx_strlow(enc->pos, name->data, name->len);
+    enc->pos += name->len;
+
+    entry->value.len = len;
+    entry->value.data = enc->pos;
+    enc->pos = ngx_cpymem(enc->pos, value, len);
+
+    enc->used += size;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 hpack add: \"%V\" size:%uz",
+                   &entry->name, enc->used);
+
+    return pos;
+
+literal:
+
+    *pos = (mode == NGX_HTTP_V2_HPACK_NEVER) ? 16 : 0;
+
+    if (index) {
+        pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(4), index);
+
+    } else {
+        pos++;
+        pos = ngx_http_v2_write_name(pos, name->data, name->len, tmp);
+    }
+
+    return ngx_http_v2_write_value(pos, value, len, tmp);
+}
+
+
+u_char *
+ngx_http_v2_hpack_table_update(ngx_http_v2_connection_t *h2c, u_char *pos)
+{
+    ngx_http_v2_hpack_enc_t  *enc;
+
+    enc = &h2c->hpack_enc;
+
+    /* the smallest size since the last update is signalled first */
+
+    if (enc->lowest < enc->update) {
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                       "http2 table size update: %uz", enc->lowest);
+
+        *pos = 32;
+        pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(5), enc->lowest);
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 table size update: %uz", enc->update);
+
+    *pos = 32;
+    pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(5), enc->update);
+
+    ngx_http_v2_hpack_evict(enc, enc->lowest);
+
+    enc->size = enc->update;
+    h2c->table_update = 0;
+
+    return pos;
+}
+
+
+void
+ngx_http_v2_hpack_table_resize(ngx_http_v2_connection_t *h2c, size_t size)
+{
+    ngx_http_v2_hpack_enc_t  *enc;
+
+    enc = &h2c->hpack_enc;
+
+    size = ngx_min(size, enc->max);
+
+    if (!h2c->table_update || size < enc->lowest) {
+        enc->lowest = size;
+    }
+
+    enc->update = size;
+    h2c->table_update = 1;
+}
+
+
+/*
+ * called if a header block was encoded but is not going to be sent:
+ * the next block starts with emptying the client's table
+ */
+
+void
+ngx_http_v2_hpack_table_clear(ngx_http_v2_connection_t *h2c)
+{
+    ngx_http_v2_hpack_enc_t  *enc;
+
+    enc = &h2c->hpack_enc;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 hpack table clear");
+
+    if (!h2c->table_update) {
+        enc->update = enc->size;
+    }
+
+    enc->lowest = 0;
+    h2c->table_update = 1;
+
+    enc->deleted = enc->added;
+    enc->used = 0;
+    enc->pos = enc->storage;
+}
+
+
+static ngx_int_t
+ngx_http_v2_hpack_alloc(ngx_http_v2_connection_t *h2c)
+{
+    ngx_uint_t                  i, n;
+    ngx_http_v2_hpack_enc_t    *enc;
+    ngx_http_v2_hpack_entry_t  *entries;
+
+    enc = &h2c->hpack_enc;
+
+    if (enc->storage == NULL) {
+        enc->storage = ngx_pnalloc(h2c->connection->pool, 2 * enc->max);
+        if (enc->storage == NULL) {
+            return NGX_ERROR;
+        }
+
+        enc->pos = enc->storage;
+    }
+
+    if (enc->added - enc->deleted < enc->allocated) {
+        return NGX_OK;
+    }
+
+    n = enc->allocated ? 2 * enc->allocated : 16;
+
+    entries = ngx_palloc(h2c->connection->pool,
+                         n * sizeof(ngx_http_v2_hpack_entry_t));
+    if (entries == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; enc->deleted + i != enc->added; i++) {
+        entries[i] = enc->entries[(enc->deleted + i) % enc->allocated];
+    }
+
+    if (enc->entries) {
+        (void) ngx_pfree(h2c->connection->pool, enc->entries);
+    }
+
+    enc->entries = entries;
+    enc->allocated = n;
+    enc->added = i;
+    enc->deleted = 0;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_v2_hpack_evict(ngx_http_v2_hpack_enc_t *enc, size_t size)
+{
+    ngx_http_v2_hpack_entry_t  *entry;
+
+    while (enc->used > size) {
+        entry = &enc->entries[enc->deleted++ % enc->allocated];
+        enc->used -= 32 + entry->name.len + entry->value.len;
+    }
+}
+
+
 static u_char *
 ngx_http_v2_write_int(u_char *pos, ngx_uint_t prefix, ngx_uint_t value)
 {
@@ -15,6 +15,10 @@ static ngx_int_t ngx_http_v2_add_variables(ngx_conf_t *cf);
 
 static ngx_int_t ngx_http_v2_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_v2_bdp_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_v2_reuse_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
 
 static ngx_int_t ngx_http_v2_module_init(ngx_cycle_t *cycle);
 
@@ -28,6 +32,8 @@ static char *ngx_http_v2_merge_loc_conf(ngx_conf_t *cf, void *parent,
     void *child);
 
 static char *ngx_http_v2_push(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_http_v2_hpack_index(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 
 static char *ngx_http_v2_recv_buffer_size(ngx_conf_t *cf, void *post,
     void *data);
@@ -36,6 +42,8 @@ static char *ngx_http_v2_preread_size(ngx_conf_t *cf, void *post, void *data);
 static char *ngx_http_v2_streams_index_mask(ngx_conf_t *cf, void *post,
     void *data);
 static char *ngx_http_v2_chunk_size(ngx_conf_t *cf, void *post, void *data);
+static char *ngx_http_v2_hpack_table_size(ngx_conf_t *cf, void *post,
+    void *data);
 static char *ngx_http_v2_obsolete(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
@@ -71,6 +79,25 @@ static ngx_conf_post_t  ngx_http_v2_streams_index_mask_post =
     { ngx_http_v2_streams_index_mask };
 static ngx_conf_post_t  ngx_http_v2_chunk_size_post =
     { ngx_http_v2_chunk_size };
+static ngx_conf_post_t  ngx_http_v2_hpack_table_size_post =
+    { ngx_http_v2_hpack_table_size };
+
+
+/* response headers indexed in the dynamic table unless configured otherwise */
+
+static ngx_str_t  ngx_http_v2_hpack_index_default[] = {
+    ngx_string("server"),
+    ngx_string("content-type"),
+    ngx_string("content-encoding"),
+    ngx_string("cache-control"),
+    ngx_string("vary"),
+    ngx_string("accept-ranges"),
+    ngx_string("access-control-allow-origin"),
+    ngx_string("strict-transport-security"),
+    ngx_string("x-content-type-options"),
+    ngx_string("x-frame-options"),
+    ngx_null_string
+};
 
 
 static ngx_command_t  ngx_http_v2_commands[] = {
@@ -138,6 +165,27 @@ static ngx_command_t  ngx_http_v2_commands[] = {
       offsetof(ngx_http_v2_srv_conf_t, streams_index_mask),
       &ngx_http_v2_streams_index_mask_post },
 
+    { ngx_string("http2_hpack_table_size"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_v2_srv_conf_t, hpack_table_size),
+      &ngx_http_v2_hpack_table_size_post },
+
+    { ngx_string("http2_body_window_max"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_v2_srv_conf_t, body_window_max),
+      NULL },
+
+    { ngx_string("http2_pool_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_v2_srv_conf_t, pool_cache),
+      NULL },
+
     { ngx_string("http2_recv_timeout"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
       ngx_http_v2_obsolete,
@@ -173,6 +221,13 @@ static ngx_command_t  ngx_http_v2_commands[] = {
       0,
       NULL },
 
+    { ngx_string("http2_hpack_index"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_v2_hpack_index,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -213,6 +268,35 @@ static ngx_http_variable_t  ngx_http_v2_vars[] = {
     { ngx_string("http2"), NULL,
       ngx_http_v2_variable, 0, 0, 0 },
 
+    { ngx_string("http2_pool_hits"), NULL, ngx_http_v2_reuse_variable,
+      offsetof(ngx_http_v2_reuse_stat_t, pool_hits),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_pool_misses"), NULL, ngx_http_v2_reuse_variable,
+      offsetof(ngx_http_v2_reuse_stat_t, pool_misses),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_pool_drops"), NULL, ngx_http_v2_reuse_variable,
+      offsetof(ngx_http_v2_reuse_stat_t, pool_drops),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_conn_hits"), NULL, ngx_http_v2_reuse_variable,
+      offsetof(ngx_http_v2_reuse_stat_t, conn_hits),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_conn_misses"), NULL, ngx_http_v2_reuse_variable,
+      offsetof(ngx_http_v2_reuse_stat_t, conn_misses),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_window_stalls"), NULL, ngx_http_v2_bdp_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_bdp"), NULL, ngx_http_v2_bdp_variable,
+      1, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("http2_rtt"), NULL, ngx_http_v2_bdp_variable,
+      2, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
       ngx_http_null_variable
 };
 
@@ -270,6 +354,77 @@ ngx_http_v2_variable(ngx_http_request_t *r,
 }
 
 
+/* 处理请求的worker进程中HTTP/2流对象的复用计数 */
+
+/* 当前连接的接收窗口统计：窗口耗尽次数、估计的窗口大小、往返时间（微秒） */
+
+static ngx_int_t
+ngx_http_v2_bdp_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char              *p;
+    ngx_http_v2_bdp_t   *bdp;
+
+    if (r->stream == NULL) {
+        *v = ngx_http_variable_null_value;
+        return NGX_OK;
+    }
+
+    p = ngx_pnalloc(r->pool, NGX_INT64_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    bdp = &r->stream->connection->bdp;
+
+    switch (data) {
+
+    case 0:
+        v->len = ngx_sprintf(p, "%ui", bdp->stalls) - p;
+        break;
+
+    case 1:
+        v->len = ngx_sprintf(p, "%uz", bdp->window) - p;
+        break;
+
+    default: /* 2 */
+        v->len = ngx_sprintf(p, "%uL", bdp->rtt) - p;
+        break;
+    }
+
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_v2_reuse_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char      *p;
+    ngx_uint_t   value;
+
+    p = ngx_pnalloc(r->pool, NGX_INT_T_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    value = *(ngx_uint_t *) ((u_char *) &ngx_http_v2_reuse_stat + data);
+
+    v->len = ngx_sprintf(p, "%ui", value) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_v2_module_init(ngx_cycle_t *cycle)
 {
@@ -323,6 +478,10 @@ ngx_http_v2_create_srv_conf(ngx_conf_t *cf)
 
     h2scf->streams_index_mask = NGX_CONF_UNSET_UINT;
 
+    h2scf->hpack_table_size = NGX_CONF_UNSET_SIZE;
+    h2scf->pool_cache = NGX_CONF_UNSET_UINT;
+    h2scf->body_window_max = NGX_CONF_UNSET_SIZE;
+
     return h2scf;
 }
 
@@ -345,6 +504,14 @@ ngx_http_v2_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_uint_value(conf->streams_index_mask,
                               prev->streams_index_mask, 32 - 1);
 
+    ngx_conf_merge_size_value(conf->hpack_table_size, prev->hpack_table_size,
+                              NGX_HTTP_V2_TABLE_SIZE);
+
+    ngx_conf_merge_uint_value(conf->pool_cache, prev->pool_cache, 16);
+
+    ngx_conf_merge_size_value(conf->body_window_max, prev->body_window_max,
+                              1024 * 1024);
+
     return NGX_CONF_OK;
 }
 
@@ -370,6 +537,8 @@ ngx_http_v2_create_loc_conf(ngx_conf_t *cf)
     h2lcf->push_preload = NGX_CONF_UNSET;
     h2lcf->push = NGX_CONF_UNSET;
 
+    h2lcf->hpack_index = NGX_CONF_UNSET_PTR;
+
     return h2lcf;
 }
 
@@ -380,6 +549,8 @@ ngx_http_v2_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_http_v2_loc_conf_t *prev = parent;
     ngx_http_v2_loc_conf_t *conf = child;
 
+    ngx_str_t  *name, *value;
+
     ngx_conf_merge_size_value(conf->chunk_size, prev->chunk_size, 8 * 1024);
 
     ngx_conf_merge_value(conf->push, prev->push, 1);
@@ -390,6 +561,25 @@ ngx_http_v2_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_value(conf->push_preload, prev->push_preload, 0);
 
+    ngx_conf_merge_ptr_value(conf->hpack_index, prev->hpack_index,
+                             NGX_CONF_UNSET_PTR);
+
+    if (conf->hpack_index == NGX_CONF_UNSET_PTR) {
+        conf->hpack_index = ngx_array_create(cf->pool, 10, sizeof(ngx_str_t));
+        if (conf->hpack_index == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        for (name = ngx_http_v2_hpack_index_default; name->len; name++) {
+            value = ngx_array_push(conf->hpack_index);
+            if (value == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            *value = *name;
+        }
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -452,6 +642,63 @@ ngx_http_v2_push(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_http_v2_hpack_index(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_v2_loc_conf_t *h2lcf = conf;
+
+    ngx_str_t   *value, *name;
+    ngx_uint_t   i;
+
+    if (h2lcf->hpack_index != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            return "\"off\" parameter cannot be used with header names";
+        }
+
+        h2lcf->hpack_index = NULL;
+        return NGX_CONF_OK;
+    }
+
+    h2lcf->hpack_index = ngx_array_create(cf->pool, cf->args->nelts - 1,
+                                          sizeof(ngx_str_t));
+    if (h2lcf->hpack_index == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        /* cookies are never put in the table, see RFC 7541, Section 7.1.3 */
+
+        if ((value[i].len == sizeof("cookie") - 1
+             && ngx_strcasecmp(value[i].data, (u_char *) "cookie") == 0)
+            || (value[i].len == sizeof("set-cookie") - 1
+                && ngx_strcasecmp(value[i].data, (u_char *) "set-cookie") == 0))
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "header \"%V\" cannot be indexed", &value[i]);
+            return NGX_CONF_ERROR;
+        }
+
+        name = ngx_array_push(h2lcf->hpack_index);
+        if (name == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        *name = value[i];
+        ngx_strlow(name->data, name->data, name->len);
+    }
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_http_v2_recv_buffer_size(ngx_conf_t *cf, void *post, void *data)
 {
@@ -546,6 +793,23 @@ ngx_http_v2_chunk_size(ngx_conf_t *cf, void *post, void *data)
 }
 
 
+static char *
+ngx_http_v2_hpack_table_size(ngx_conf_t *cf, void *post, void *data)
+{
+    size_t *sp = data;
+
+    if (*sp > NGX_HTTP_V2_MAX_TABLE_SIZE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "the maximum hpack table size is %uz",
+                           (size_t) NGX_HTTP_V2_MAX_TABLE_SIZE);
+
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_http_v2_obsolete(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -26,6 +26,9 @@ typedef struct {
     ngx_uint_t                      concurrent_pushes;
     size_t                          preread_size;
     ngx_uint_t                      streams_index_mask;
+    size_t                          hpack_table_size;
+    ngx_uint_t                      pool_cache;
+    size_t                          body_window_max;
 } ngx_http_v2_srv_conf_t;
 
 
@@ -36,6 +39,8 @@ typedef struct {
 
     ngx_flag_t                      push;
     ngx_array_t                    *pushes;
+
+    ngx_array_t                    *hpack_index;   /* of ngx_str_t */
 } ngx_http_v2_loc_conf_t;
 
 
@@ -13,4 +13,81 @@ ngx_chain_t *ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in,
     off_t limit);
 
 
+#if (NGX_HAVE_SPLICE)
+
+/*
+ * 用于 splice() 转发的内核管道，数据从一个套接字移入管道，
+ * 再从管道移到另一个套接字，不经过用户空间
+ */
+typedef struct {
+    ngx_fd_t              fd[2];
+    size_t                size;       // 管道中尚未发出的数据
+    size_t                capacity;   // 管道容量
+} ngx_linux_splice_t;
+
+
+ngx_linux_splice_t *ngx_linux_splice_create(ngx_pool_t *pool, size_t size,
+    ngx_log_t *log);
+ssize_t ngx_linux_splice_recv(ngx_connection_t *c, ngx_linux_splice_t *sp,
+    size_t size);
+ssize_t ngx_linux_splice_send(ngx_connection_t *c, ngx_linux_splice_t *sp);
+
+#endif
+
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+#define NGX_LINUX_ZEROCOPY_SENDS        64
+#define NGX_LINUX_ZEROCOPY_BUFFER_SIZE  1024
+
+/*
+ * 一次 send 调用交给内核的数据。MSG_ZEROCOPY 发送的数据在收到
+ * 完成通知之前仍被内核引用，对应的缓冲区不能被释放或复用
+ */
+typedef struct {
+    size_t                size;
+    uint32_t              seq;        // MSG_ZEROCOPY 发送的通知序号
+    unsigned              zerocopy:1;
+    unsigned              done:1;     // 数据已不再被内核引用
+} ngx_linux_zerocopy_send_t;
+
+
+/*
+ * 请求结束时仍被内核引用的内存池，在数据全部完成之前不能销毁
+ */
+typedef struct ngx_linux_zerocopy_hold_s  ngx_linux_zerocopy_hold_t;
+
+struct ngx_linux_zerocopy_hold_s {
+    ngx_pool_t                 *pool;
+    ngx_linux_zerocopy_hold_t  *next;
+};
+
+
+struct ngx_linux_zerocopy_s {
+    size_t                threshold;  // 达到该长度的内存数据才使用 MSG_ZEROCOPY，0 为关闭
+    off_t                 unacked;    // 已交给内核但缓冲区尚未释放的字节数
+    uint32_t              seq;        // 下一个 MSG_ZEROCOPY 发送的通知序号
+
+    ngx_uint_t            head;
+    ngx_uint_t            nelts;
+    ngx_linux_zerocopy_send_t  sends[NGX_LINUX_ZEROCOPY_SENDS];
+
+    ngx_linux_zerocopy_hold_t  *held;  // 等待完成通知的内存池
+    ngx_linux_zerocopy_hold_t  *free;
+
+    ngx_msec_t            timeout;    // 关闭连接时等待完成通知的最长时间
+
+    unsigned              enabled:1;  // 套接字已设置 SO_ZEROCOPY
+    unsigned              disabled:1; // 内核不支持或回退为复制，不再使用 MSG_ZEROCOPY
+    unsigned              reset:1;    // 关闭时发送 RST，内核丢弃发送队列
+};
+
+
+void ngx_linux_zerocopy_complete(ngx_connection_t *c);
+ngx_int_t ngx_linux_zerocopy_hold(ngx_connection_t *c, ngx_pool_t *pool);
+ngx_int_t ngx_linux_zerocopy_linger(ngx_connection_t *c);
+
+#endif
+
+
 #endif /* _NGX_LINUX_H_INCLUDED_ */
@@ -25,6 +25,17 @@ static ssize_t ngx_linux_sendfile_thread(ngx_connection_t *c, ngx_buf_t *file,
 static void ngx_linux_sendfile_thread_handler(void *data, ngx_log_t *log);
 #endif
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+static ngx_chain_t *ngx_linux_zerocopy_chain(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+static ssize_t ngx_linux_zerocopy_send(ngx_connection_t *c, ngx_iovec_t *vec);
+static ngx_chain_t *ngx_linux_zerocopy_release(ngx_connection_t *c,
+    ngx_chain_t *in);
+static void ngx_linux_zerocopy_destroy_held(ngx_linux_zerocopy_t *zc);
+static void ngx_linux_zerocopy_linger_handler(ngx_event_t *ev);
+static void ngx_linux_zerocopy_reset(ngx_connection_t *c);
+#endif
+
 
 /*
  * On Linux up to 2.4.21 sendfile() (syscall #187) works with 32-bit
@@ -60,6 +71,14 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
     ngx_iovec_t    header;
     struct iovec   headers[NGX_IOVS_PREALLOCATE];
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    if (c->zerocopy && (c->zerocopy->threshold || c->zerocopy->unacked)) {
+        return ngx_linux_zerocopy_chain(c, in, limit);
+    }
+
+#endif
+
     wev = c->write;
 
     if (!wev->ready) {
@@ -433,3 +452,582 @@ again:
 }
 
 #endif /* NGX_THREADS */
+
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+/*
+ * MSG_ZEROCOPY 发送时内核直接引用用户缓冲区的页面，在收到错误队列上的
+ * 完成通知之前这些数据不能被修改，因此已交给内核的数据不从链表中移除：
+ * 缓冲区的 pos/file_pos 只在通知到达后才前移，在此之前链表返回非 NULL，
+ * 调用者会保持 NGX_HTTP_WRITE_BUFFERED 并且不会复用这些缓冲区。
+ *
+ * 普通 writev()/sendfile() 发送的数据没有这个限制，但为了保持顺序，
+ * 它们也要等到前面的 MSG_ZEROCOPY 数据完成之后才一起释放。
+ */
+
+static ngx_chain_t *
+ngx_linux_zerocopy_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
+{
+    off_t                       send, skip, size, unacked;
+    size_t                      sent;
+    ssize_t                     n;
+    ngx_buf_t                  *b, file;
+    ngx_uint_t                  zerocopy;
+    ngx_event_t                *wev;
+    ngx_chain_t                *cl;
+    ngx_iovec_t                 vec;
+    struct iovec                iovs[NGX_IOVS_PREALLOCATE];
+    ngx_linux_zerocopy_t       *zc;
+    ngx_linux_zerocopy_send_t  *zs;
+#if (NGX_THREADS)
+    ngx_file_t                  sync;
+#endif
+
+    zc = c->zerocopy;
+    wev = c->write;
+
+    in = ngx_linux_zerocopy_release(c, in);
+
+    if (!wev->ready) {
+        return in;
+    }
+
+    if (limit == 0 || limit > (off_t) (NGX_SENDFILE_MAXSIZE - ngx_pagesize)) {
+        limit = NGX_SENDFILE_MAXSIZE - ngx_pagesize;
+    }
+
+    send = 0;
+
+    vec.iovs = iovs;
+    vec.nalloc = NGX_IOVS_PREALLOCATE;
+
+    for ( ;; ) {
+
+        /* skip the data which is already in the kernel */
+
+        skip = zc->unacked;
+
+        for (cl = in; cl; cl = cl->next) {
+
+            if (ngx_buf_special(cl->buf)) {
+                continue;
+            }
+
+            size = ngx_buf_size(cl->buf);
+
+            if (skip < size) {
+                break;
+            }
+
+            skip -= size;
+        }
+
+        if (cl == NULL || zc->nelts == NGX_LINUX_ZEROCOPY_SENDS) {
+
+            if (zc->unacked == 0) {
+                return in;
+            }
+
+            /* check for the completions which are not reported yet */
+
+            unacked = zc->unacked;
+
+            ngx_linux_zerocopy_complete(c);
+
+            in = ngx_linux_zerocopy_release(c, in);
+
+            if (zc->unacked != unacked) {
+                continue;
+            }
+
+            /* the completions will be reported with EPOLLERR */
+
+            wev->ready = 0;
+            return in;
+        }
+
+        b = cl->buf;
+
+        if (b->in_file) {
+            size = b->file_last - b->file_pos - skip;
+
+            if (size > limit - send) {
+                size = limit - send;
+            }
+
+            file = *b;
+            file.file_pos += skip;
+
+#if (NGX_THREADS)
+            /* the shifted buf cannot outlive this call */
+            sync = *b->file;
+            sync.thread_handler = NULL;
+            file.file = &sync;
+#endif
+
+            n = ngx_linux_sendfile(c, &file, (size_t) size);
+            zerocopy = 0;
+
+        } else {
+            b->pos += (size_t) skip;
+
+            cl = ngx_output_chain_to_iovec(&vec, cl, (size_t) (limit - send),
+                                           c->log);
+
+            b->pos -= (size_t) skip;
+
+            if (cl == NGX_CHAIN_ERROR) {
+                return NGX_CHAIN_ERROR;
+            }
+
+            zerocopy = (zc->threshold
+                        && !zc->disabled
+                        && vec.size >= zc->threshold);
+
+            n = NGX_DECLINED;
+
+            if (zerocopy) {
+                n = ngx_linux_zerocopy_send(c, &vec);
+            }
+
+            if (n == NGX_DECLINED) {
+                zerocopy = 0;
+                n = ngx_writev(c, &vec);
+            }
+        }
+
+        if (n == NGX_ERROR) {
+            return NGX_CHAIN_ERROR;
+        }
+
+        sent = (n == NGX_AGAIN) ? 0 : n;
+
+        if (sent) {
+            zs = &zc->sends[(zc->head + zc->nelts - 1)
+                            % NGX_LINUX_ZEROCOPY_SENDS];
+
+            if (!zerocopy && zc->nelts && zs->done) {
+                zs->size += sent;
+
+            } else {
+                zs = &zc->sends[(zc->head + zc->nelts)
+                                % NGX_LINUX_ZEROCOPY_SENDS];
+                zc->nelts++;
+
+                zs->size = sent;
+                zs->zerocopy = zerocopy;
+                zs->done = !zerocopy;
+
+                if (zerocopy) {
+                    zs->seq = zc->seq++;
+                }
+            }
+
+            zc->unacked += sent;
+            c->sent += sent;
+            send += sent;
+        }
+
+        in = ngx_linux_zerocopy_release(c, in);
+
+        if (n == NGX_AGAIN) {
+            wev->ready = 0;
+            return in;
+        }
+
+        if (send >= limit || in == NULL) {
+            return in;
+        }
+    }
+}
+
+
+static ssize_t
+ngx_linux_zerocopy_send(ngx_connection_t *c, ngx_iovec_t *vec)
+{
+    int                    val;
+    ssize_t                n;
+    ngx_err_t              err;
+    struct msghdr          msg;
+    ngx_linux_zerocopy_t  *zc;
+
+    zc = c->zerocopy;
+
+    if (!zc->enabled) {
+        val = 1;
+
+        if (setsockopt(c->fd, SOL_SOCKET, SO_ZEROCOPY,
+                       (const void *) &val, sizeof(int))
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_INFO, c->log, ngx_socket_errno,
+                          "setsockopt(SO_ZEROCOPY) failed, ignored");
+
+            zc->disabled = 1;
+            return NGX_DECLINED;
+        }
+
+        zc->enabled = 1;
+    }
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+
+    msg.msg_iov = vec->iovs;
+    msg.msg_iovlen = vec->count;
+
+eintr:
+
+    n = sendmsg(c->fd, &msg, MSG_ZEROCOPY);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmsg zerocopy: %z of %uz #%uD", n, vec->size, zc->seq);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() was interrupted");
+            goto eintr;
+
+        case ENOBUFS:
+            /* the optmem limit for the notifications is reached */
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg(MSG_ZEROCOPY) is not possible");
+            return NGX_DECLINED;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    return n;
+}
+
+
+/*
+ * 读取错误队列中的 MSG_ZEROCOPY 完成通知，由事件模块在套接字上
+ * 报告 EPOLLERR 时调用，此后的写事件处理会释放相应的缓冲区
+ */
+
+void
+ngx_linux_zerocopy_complete(ngx_connection_t *c)
+{
+    uint32_t                    lo, hi;
+    ngx_err_t                   err;
+    ngx_uint_t                  i;
+    struct msghdr               msg;
+    struct cmsghdr             *cmsg;
+    ngx_linux_zerocopy_t       *zc;
+    struct sock_extended_err   *ee;
+    ngx_linux_zerocopy_send_t  *zs;
+
+    union {
+        struct cmsghdr          cm;
+        u_char                  buf[CMSG_SPACE(sizeof(struct sock_extended_err)
+                                            + sizeof(struct sockaddr_in6))];
+    } control;
+
+    zc = c->zerocopy;
+
+    for ( ;; ) {
+        ngx_memzero(&msg, sizeof(struct msghdr));
+
+        msg.msg_control = &control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE) == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EINTR) {
+                continue;
+            }
+
+            if (err != NGX_EAGAIN) {
+                ngx_log_error(NGX_LOG_ALERT, c->log, err,
+                              "recvmsg(MSG_ERRQUEUE) failed");
+            }
+
+            return;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (!(cmsg->cmsg_level == IPPROTO_IP
+                  && cmsg->cmsg_type == IP_RECVERR)
+                && !(cmsg->cmsg_level == IPPROTO_IPV6
+                     && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+
+            ee = (struct sock_extended_err *) CMSG_DATA(cmsg);
+
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0) {
+                continue;
+            }
+
+            lo = ee->ee_info;
+            hi = ee->ee_data;
+
+            ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "zerocopy completed: #%uD-%uD, code:%d",
+                           lo, hi, ee->ee_code);
+
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                /* the kernel had to copy the data anyway, e.g. on loopback */
+                zc->disabled = 1;
+            }
+
+            for (i = 0; i < zc->nelts; i++) {
+                zs = &zc->sends[(zc->head + i) % NGX_LINUX_ZEROCOPY_SENDS];
+
+                if (zs->zerocopy
+                    && (uint32_t) (zs->seq - lo) <= (uint32_t) (hi - lo))
+                {
+                    zs->done = 1;
+                }
+            }
+        }
+    }
+}
+
+
+static ngx_chain_t *
+ngx_linux_zerocopy_release(ngx_connection_t *c, ngx_chain_t *in)
+{
+    off_t                       size;
+    ngx_linux_zerocopy_t       *zc;
+    ngx_linux_zerocopy_send_t  *zs;
+
+    zc = c->zerocopy;
+    size = 0;
+
+    while (zc->nelts) {
+        zs = &zc->sends[zc->head];
+
+        if (!zs->done) {
+            break;
+        }
+
+        size += zs->size;
+
+        zc->head = (zc->head + 1) % NGX_LINUX_ZEROCOPY_SENDS;
+        zc->nelts--;
+    }
+
+    if (size == 0) {
+        return in;
+    }
+
+    zc->unacked -= size;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "zerocopy released: %O, unacked: %O", size, zc->unacked);
+
+    if (zc->nelts == 0) {
+        ngx_linux_zerocopy_destroy_held(zc);
+    }
+
+    return ngx_chain_update_sent(in, size);
+}
+
+
+/*
+ * 请求结束时如果还有数据未收到完成通知，请求的内存池（其中的缓冲区
+ * 仍被内核引用）挂到连接上，等全部通知到达后再销毁，避免内存被复用
+ */
+
+ngx_int_t
+ngx_linux_zerocopy_hold(ngx_connection_t *c, ngx_pool_t *pool)
+{
+    ngx_linux_zerocopy_t       *zc;
+    ngx_linux_zerocopy_hold_t  *hold;
+
+    zc = c->zerocopy;
+
+    ngx_linux_zerocopy_complete(c);
+
+    (void) ngx_linux_zerocopy_release(c, NULL);
+
+    if (zc->nelts == 0 || zc->reset) {
+        return NGX_DECLINED;
+    }
+
+    hold = zc->free;
+
+    if (hold) {
+        zc->free = hold->next;
+
+    } else {
+        hold = ngx_palloc(c->pool, sizeof(ngx_linux_zerocopy_hold_t));
+        if (hold == NULL) {
+            ngx_linux_zerocopy_reset(c);
+            return NGX_DECLINED;
+        }
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "zerocopy hold pool:%p, unacked: %O", pool, zc->unacked);
+
+    hold->pool = pool;
+    hold->next = zc->held;
+    zc->held = hold;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_linux_zerocopy_destroy_held(ngx_linux_zerocopy_t *zc)
+{
+    ngx_linux_zerocopy_hold_t  *hold;
+
+    while (zc->held) {
+        hold = zc->held;
+        zc->held = hold->next;
+
+        ngx_destroy_pool(hold->pool);
+
+        hold->next = zc->free;
+        zc->free = hold;
+    }
+}
+
+
+/*
+ * 关闭连接前等待所有 MSG_ZEROCOPY 数据的完成通知：close() 之后内核
+ * 仍会继续发送并引用这些页面，而通知已无法读取。
+ * 返回 NGX_OK 时连接由 ngx_linux_zerocopy_linger_handler() 负责关闭，
+ * 超时则以 RST 关闭连接，让内核丢弃发送队列
+ */
+
+ngx_int_t
+ngx_linux_zerocopy_linger(ngx_connection_t *c)
+{
+    ngx_event_t           *rev, *wev;
+    ngx_linux_zerocopy_t  *zc;
+
+    zc = c->zerocopy;
+
+    ngx_linux_zerocopy_complete(c);
+
+    (void) ngx_linux_zerocopy_release(c, NULL);
+
+    if (zc->nelts == 0 || zc->reset) {
+        ngx_linux_zerocopy_destroy_held(zc);
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "zerocopy linger, unacked: %O", zc->unacked);
+
+    c->log->action = "waiting for zerocopy completion";
+
+    ngx_reusable_connection(c, 0);
+
+    rev = c->read;
+    wev = c->write;
+
+    rev->handler = ngx_linux_zerocopy_linger_handler;
+    wev->handler = ngx_linux_zerocopy_linger_handler;
+
+    if (wev->timer_set) {
+        ngx_del_timer(wev);
+    }
+
+    ngx_add_timer(rev, zc->timeout);
+
+    if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+        ngx_linux_zerocopy_reset(c);
+        ngx_linux_zerocopy_destroy_held(zc);
+        return NGX_DECLINED;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_linux_zerocopy_linger_handler(ngx_event_t *ev)
+{
+    ssize_t                n;
+    ngx_pool_t            *pool;
+    ngx_event_t           *rev;
+    ngx_connection_t      *c;
+    ngx_linux_zerocopy_t  *zc;
+    u_char                 buffer[NGX_LINUX_ZEROCOPY_BUFFER_SIZE];
+
+    c = ev->data;
+    zc = c->zerocopy;
+    rev = c->read;
+
+    if (rev->timedout || c->close) {
+        ngx_log_error(NGX_LOG_INFO, c->log, NGX_ETIMEDOUT,
+                      "zerocopy completion timed out, unacked: %O",
+                      zc->unacked);
+
+        ngx_linux_zerocopy_reset(c);
+        goto close;
+    }
+
+    /* the client data are not needed anymore */
+
+    while (rev->ready && !rev->eof && !rev->error) {
+        n = c->recv(c, buffer, sizeof(buffer));
+
+        if (n == NGX_AGAIN || n == NGX_ERROR || n == 0) {
+            break;
+        }
+    }
+
+    ngx_linux_zerocopy_complete(c);
+
+    (void) ngx_linux_zerocopy_release(c, NULL);
+
+    if (zc->nelts) {
+        return;
+    }
+
+close:
+
+    ngx_linux_zerocopy_destroy_held(zc);
+
+    pool = c->pool;
+
+    ngx_close_connection(c);
+
+    ngx_destroy_pool(pool);
+}
+
+
+static void
+ngx_linux_zerocopy_reset(ngx_connection_t *c)
+{
+    struct linger  linger;
+
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+
+    if (setsockopt(c->fd, SOL_SOCKET, SO_LINGER,
+                   (const void *) &linger, sizeof(struct linger)) == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, c->log, ngx_socket_errno,
+                      "setsockopt(SO_LINGER) failed");
+    }
+
+    c->zerocopy->reset = 1;
+}
+
+#endif /* NGX_HAVE_MSG_ZEROCOPY */
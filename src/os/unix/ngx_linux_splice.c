@@ -0,0 +1,198 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+static void ngx_linux_splice_cleanup(void *data);
+
+
+ngx_linux_splice_t *
+ngx_linux_splice_create(ngx_pool_t *pool, size_t size, ngx_log_t *log)
+{
+    int                  n;
+    ngx_pool_cleanup_t  *cln;
+    ngx_linux_splice_t  *sp;
+
+    cln = ngx_pool_cleanup_add(pool, sizeof(ngx_linux_splice_t));
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    sp = cln->data;
+
+    if (pipe2(sp->fd, O_NONBLOCK|O_CLOEXEC) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "pipe2() failed");
+        return NULL;
+    }
+
+    cln->handler = ngx_linux_splice_cleanup;
+
+    /*
+     * the pipe capacity is rounded up to a power of 2 pages,
+     * and may be limited by /proc/sys/fs/pipe-max-size
+     */
+
+    if (size > (size_t) ngx_pagesize
+        && fcntl(sp->fd[1], F_SETPIPE_SZ, (int) size) == -1)
+    {
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, ngx_errno,
+                       "fcntl(F_SETPIPE_SZ, %uz) failed", size);
+    }
+
+    n = fcntl(sp->fd[1], F_GETPIPE_SZ);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "fcntl(F_GETPIPE_SZ) failed");
+        return NULL;
+    }
+
+    sp->size = 0;
+    sp->capacity = n;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0, "splice pipe: %d:%d %uz",
+                   sp->fd[0], sp->fd[1], sp->capacity);
+
+    return sp;
+}
+
+
+static void
+ngx_linux_splice_cleanup(void *data)
+{
+    ngx_linux_splice_t  *sp = data;
+
+    (void) close(sp->fd[0]);
+    (void) close(sp->fd[1]);
+}
+
+
+ssize_t
+ngx_linux_splice_recv(ngx_connection_t *c, ngx_linux_splice_t *sp,
+    size_t size)
+{
+    ssize_t       n;
+    ngx_err_t     err;
+    ngx_event_t  *rev;
+
+    rev = c->read;
+
+    if (size > sp->capacity - sp->size) {
+        size = sp->capacity - sp->size;
+    }
+
+    for ( ;; ) {
+        n = splice(c->fd, NULL, sp->fd[1], NULL, size,
+                   SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "splice recv: fd:%d %z of %uz", c->fd, n, size);
+
+        if (n > 0) {
+            sp->size += n;
+            return n;
+        }
+
+        if (n == 0) {
+            rev->ready = 0;
+            rev->eof = 1;
+            return 0;
+        }
+
+        err = ngx_socket_errno;
+
+        if (err == NGX_EINTR) {
+            continue;
+        }
+
+        if (err == NGX_EAGAIN) {
+
+            /*
+             * a pipe buffer is used for each socket buffer fragment,
+             * so a non-empty pipe may be out of buffers even if there
+             * is room for the data; the socket state is unknown then
+             */
+
+            if (sp->size == 0) {
+                rev->ready = 0;
+            }
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "splice() not ready");
+            return NGX_AGAIN;
+        }
+
+        rev->error = 1;
+        ngx_connection_error(c, err, "splice() failed");
+        return NGX_ERROR;
+    }
+}
+
+
+ssize_t
+ngx_linux_splice_send(ngx_connection_t *c, ngx_linux_splice_t *sp)
+{
+    ssize_t       n, sent;
+    ngx_err_t     err;
+    ngx_event_t  *wev;
+
+    wev = c->write;
+
+    if (!wev->ready) {
+        return NGX_AGAIN;
+    }
+
+    sent = 0;
+
+    /* send till the pipe is empty or an explicit EAGAIN */
+
+    while (sp->size) {
+        n = splice(sp->fd[0], NULL, c->fd, NULL, sp->size,
+                   SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "splice send: fd:%d %z of %uz", c->fd, n, sp->size);
+
+        if (n > 0) {
+            sp->size -= n;
+            c->sent += n;
+            sent += n;
+            continue;
+        }
+
+        if (n == 0) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                          "splice() returned zero with %uz bytes in pipe",
+                          sp->size);
+            return NGX_ERROR;
+        }
+
+        err = ngx_socket_errno;
+
+        if (err == NGX_EINTR) {
+            continue;
+        }
+
+        if (err == NGX_EAGAIN) {
+            wev->ready = 0;
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "splice() not ready");
+
+            return sent ? sent : NGX_AGAIN;
+        }
+
+        wev->error = 1;
+        ngx_connection_error(c, err, "splice() failed");
+        return NGX_ERROR;
+    }
+
+    return sent;
+}
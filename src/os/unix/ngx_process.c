@@ -92,148 +92,6 @@ ngx_signal_t signals[] = {
  */
 ngx_pid_t ngx_spawn_process(ngx_cycle_t *cycle, ngx_spawn_proc_pt proc, void *data,
                             char *name, ngx_int_t respawn)
-{
-    u_long on;
-    ngx_pid_t pid;
-    ngx_int_t s;
-
-    // 根据 respawn 参数判断是否需要重新创建进程
-    if (respawn >= 0)
-    {
-        s = respawn;
-    }
-    else
-    {
-        // 寻找可用的 ngx_processes 数组下标
-        for (s = 0; s < ngx_last_process; s++)
-        {
-            if (ngx_processes[s].pid == -1)
-            {
-                break;
-            }
-        }
-
-        // 检查是否超过最大进程数量限制
-        if (s == NGX_MAX_PROCESSES)
-        {
-            ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
-                          "no more than %d processes can be spawned",
-                          NGX_MAX_PROCESSES);
-            return NGX_INVALID_PID;
-        }
-    }
-
-    // 如果不是 NGX_PROCESS_DETACHED，则创建通信通道
-    if (respawn != NGX_PROCESS_DETACHED)
-    {
-        if (socketpair(AF_UNIX, SOCK_STREAM, 0, ngx_processes[s].channel) == -1)
-        {
-            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
-                          "socketpair() failed while spawning \"%s\"", name);
-            return NGX_INVALID_PID;
-        }
-
-        // 设置通道为非阻塞
-        ngx_nonblocking(ngx_processes[s].channel[0]);
-        ngx_nonblocking(ngx_processes[s].channel[1]);
-
-        // 设置通道的 FIOASYNC、F_SETOWN 和 FD_CLOEXEC 属性
-        on = 1;
-        ioctl(ngx_processes[s].channel[0], FIOASYNC, &on);
-        fcntl(ngx_processes[s].channel[0], F_SETOWN, ngx_pid);
-        fcntl(ngx_processes[s].channel[0], F_SETFD, FD_CLOEXEC);
-        fcntl(ngx_processes[s].channel[1], F_SETFD, FD_CLOEXEC);
-
-        // 设置 ngx_channel 为通道的写端
-        ngx_channel = ngx_processes[s].channel[1];
-    }
-    else
-    {
-        // 对于 NGX_PROCESS_DETACHED，关闭通道
-        ngx_processes[s].channel[0] = -1;
-        ngx_processes[s].channel[1] = -1;
-    }
-
-    ngx_process_slot = s;
-
-    // 创建子进程
-    pid = fork();
-
-    switch (pid)
-    {
-
-    case -1:
-        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
-                      "fork() failed while spawning \"%s\"", name);
-        ngx_close_channel(ngx_processes[s].channel, cycle->log);
-        return NGX_INVALID_PID;
-
-    case 0:
-        // 子进程执行函数
-        ngx_parent = ngx_pid;
-        ngx_pid = ngx_getpid();
-        proc(cycle, data);
-        break;
-
-    default:
-        break;
-    }
-
-    ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "start %s %P", name, pid);
-
-    // 设置子进程相关信息
-    ngx_processes[s].pid = pid;
-    ngx_processes[s].exited = 0;
-
-    if (respawn >= 0)
-    {
-        return pid;
-    }
-
-    ngx_processes[s].proc = proc;
-    ngx_processes[s].data = data;
-    ngx_processes[s].name = name;
-    ngx_processes[s].exiting = 0;
-
-    // 根据 respawn 参数设置子进程的属性
-    switch (respawn)
-    {
-    case NGX_PROCESS_NORESPAWN:
-        ngx_processes[s].respawn = 0;
-        ngx_processes[s].just_spawn = 0;
-        ngx_processes[s].detached = 0;
-        break;
-    case NGX_PROCESS_JUST_SPAWN:
-        ngx_processes[s].respawn = 0;
-        ngx_processes[s].just_spawn = 1;
-        ngx_processes[s].detached = 0;
-        break;
-    case NGX_PROCESS_RESPAWN:
-        ngx_processes[s].respawn = 1;
-        ngx_processes[s].just_spawn = 0;
-        ngx_processes[s].detached = 0;
-        break;
-    case NGX_PROCESS_JUST_RESPAWN:
-        ngx_processes[s].respawn = 1;
-        ngx_processes[s].just_spawn = 1;
-        ngx_processes[s].detached = 0;
-        break;
-    case NGX_PROCESS_DETACHED:
-        ngx_processes[s].respawn = 0;
-        ngx_processes[s].just_spawn = 0;
-        ngx_processes[s].detached = 1;
-        break;
-    }
-
-    // 如果 s 到达 ngx_last_process，则增加 ngx_last_process
-    if (s == ngx_last_process)
-    {
-        ngx_last_process++;
-    }
-
-    return pid;
-}
-
 {
     u_long on;
     ngx_pid_t pid;
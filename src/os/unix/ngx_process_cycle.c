@@ -324,6 +324,62 @@ void ngx_master_process_cycle(ngx_cycle_t *cycle)
     }
 }
 
+void
+ngx_single_process_cycle(ngx_cycle_t *cycle)
+{
+    ngx_uint_t  i;
+
+    if (ngx_set_environment(cycle, NULL) == NULL) {
+        /* fatal */
+        exit(2);
+    }
+
+    for (i = 0; cycle->modules[i]; i++) {
+        if (cycle->modules[i]->init_process) {
+            if (cycle->modules[i]->init_process(cycle) == NGX_ERROR) {
+                /* fatal */
+                exit(2);
+            }
+        }
+    }
+
+    for ( ;; ) {
+        ngx_log_debug0(NGX_LOG_DEBUG_EVENT, cycle->log, 0, "worker cycle");
+
+        ngx_process_events_and_timers(cycle);
+
+        if (ngx_terminate || ngx_quit) {
+
+            for (i = 0; cycle->modules[i]; i++) {
+                if (cycle->modules[i]->exit_process) {
+                    cycle->modules[i]->exit_process(cycle);
+                }
+            }
+
+            ngx_master_process_exit(cycle);
+        }
+
+        if (ngx_reconfigure) {
+            ngx_reconfigure = 0;
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "reconfiguring");
+
+            cycle = ngx_init_cycle(cycle);
+            if (cycle == NULL) {
+                cycle = (ngx_cycle_t *) ngx_cycle;
+                continue;
+            }
+
+            ngx_cycle = cycle;
+        }
+
+        if (ngx_reopen) {
+            ngx_reopen = 0;
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "reopening logs");
+            ngx_reopen_files(cycle, (ngx_uid_t) -1);
+        }
+    }
+}
+
 /*
  * ngx_start_worker_processes - 启动工作进程
  *
@@ -967,6 +1023,19 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
     tp = ngx_timeofday();
     srandom(((unsigned)ngx_pid << 16) ^ tp->sec ^ tp->msec);
 
+    // 启用本进程的空闲内存池块缓存
+    ngx_pool_cache_init(ccf->pool_cache);
+
+    /*
+     * 为配置了magazine的共享内存区创建本进程的弹匣缓存；
+     * 缓存管理进程和加载进程直接exit(0)退出，不会归还缓存的块，因此不使用
+     */
+    if (worker >= 0 && ngx_slab_cache_init(cycle) != NGX_OK)
+    {
+        /* 致命错误 */
+        exit(2);
+    }
+
     // 遍历所有模块，调用init_process回调函数
     for (i = 0; cycle->modules[i]; i++)
     {
@@ -1035,6 +1104,9 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
         }
     }
 
+    // 将弹匣缓存中的块归还给共享内存区
+    ngx_slab_cache_flush();
+
     if (ngx_exiting)
     {
         c = cycle->connections;
@@ -11,10 +11,48 @@
 
 #if (NGX_HAVE_MAP_ANON)
 
+static size_t ngx_shm_length(ngx_shm_t *shm);
+static void ngx_shm_tune(ngx_shm_t *shm, size_t size);
+#if (NGX_HAVE_MAP_HUGETLB)
+static size_t ngx_shm_huge_page_size(ngx_log_t *log);
+#endif
+#if (NGX_HAVE_MBIND)
+static unsigned long ngx_shm_numa_nodes(ngx_log_t *log);
+#endif
+
+
 ngx_int_t
 ngx_shm_alloc(ngx_shm_t *shm)
 {
-    shm->addr = (u_char *) mmap(NULL, shm->size,
+    size_t  size;
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    if (shm->flags & NGX_SHM_HUGETLB) {
+        size = ngx_shm_length(shm);
+
+        shm->addr = (u_char *) mmap(NULL, size, PROT_READ|PROT_WRITE,
+                                    MAP_ANON|MAP_SHARED|MAP_HUGETLB, -1, 0);
+
+        if (shm->addr != MAP_FAILED) {
+            ngx_shm_tune(shm, size);
+            return NGX_OK;
+        }
+
+        /* usually no huge pages are reserved in vm.nr_hugepages */
+
+        ngx_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                      "mmap(MAP_HUGETLB, %uz) for \"%V\" failed, "
+                      "using transparent huge pages", size, &shm->name);
+
+        shm->flags = (shm->flags & ~NGX_SHM_HUGETLB) | NGX_SHM_THP;
+    }
+
+#endif
+
+    size = ngx_shm_length(shm);
+
+    shm->addr = (u_char *) mmap(NULL, size,
                                 PROT_READ|PROT_WRITE,
                                 MAP_ANON|MAP_SHARED, -1, 0);
 
@@ -24,6 +62,8 @@ ngx_shm_alloc(ngx_shm_t *shm)
         return NGX_ERROR;
     }
 
+    ngx_shm_tune(shm, size);
+
     return NGX_OK;
 }
 
@@ -31,12 +71,242 @@ ngx_shm_alloc(ngx_shm_t *shm)
 void
 ngx_shm_free(ngx_shm_t *shm)
 {
-    if (munmap((void *) shm->addr, shm->size) == -1) {
+    size_t  size;
+
+    size = ngx_shm_length(shm);
+
+    if (munmap((void *) shm->addr, size) == -1) {
         ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                      "munmap(%p, %uz) failed", shm->addr, shm->size);
+                      "munmap(%p, %uz) failed", shm->addr, size);
     }
 }
 
+
+/*
+ * hugetlb mappings are rounded up to the huge page size,
+ * shm->size is kept as is since it is compared on reload
+ */
+
+static size_t
+ngx_shm_length(ngx_shm_t *shm)
+{
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    if (shm->flags & NGX_SHM_HUGETLB) {
+        return ngx_align(shm->size, ngx_shm_huge_page_size(shm->log));
+    }
+
+#endif
+
+    return shm->size;
+}
+
+
+static void
+ngx_shm_tune(ngx_shm_t *shm, size_t size)
+{
+    u_char         *p;
+#if (NGX_HAVE_MBIND)
+    int             mode;
+    unsigned long   mask;
+#endif
+
+    if (shm->flags == 0) {
+        return;
+    }
+
+#if (NGX_HAVE_MADV_HUGEPAGE)
+
+    /*
+     * shared anonymous memory is backed by shmem, so this depends on
+     * /sys/kernel/mm/transparent_hugepage/shmem_enabled being "advise"
+     */
+
+    if ((shm->flags & NGX_SHM_THP)
+        && madvise(shm->addr, size, MADV_HUGEPAGE) == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
+                      "madvise(MADV_HUGEPAGE) for \"%V\" failed, ignored",
+                      &shm->name);
+    }
+
+#endif
+
+#if (NGX_HAVE_MBIND)
+
+    if (shm->flags & (NGX_SHM_INTERLEAVE|NGX_SHM_BIND)) {
+
+        if (shm->flags & NGX_SHM_INTERLEAVE) {
+            mode = MPOL_INTERLEAVE;
+            mask = ngx_shm_numa_nodes(shm->log);
+
+        } else {
+            mode = MPOL_BIND;
+            mask = 1UL << shm->node;
+        }
+
+        if (syscall(SYS_mbind, shm->addr, size, mode, &mask,
+                    8 * sizeof(unsigned long) + 1, 0)
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
+                          "mbind(%s) for \"%V\" failed, ignored",
+                          (mode == MPOL_BIND) ? "MPOL_BIND" : "MPOL_INTERLEAVE",
+                          &shm->name);
+        }
+    }
+
+#endif
+
+    /* fault the pages in now, after the memory policy is set */
+
+    if (shm->flags & NGX_SHM_PREFAULT) {
+
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(shm->addr, size, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+#endif
+
+        for (p = shm->addr; p < shm->addr + size; p += ngx_pagesize) {
+            *(volatile u_char *) p = 0;
+        }
+    }
+}
+
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+static size_t
+ngx_shm_huge_page_size(ngx_log_t *log)
+{
+    u_char     *p, *last;
+    ssize_t     n;
+    ngx_fd_t    fd;
+    ngx_int_t   kb;
+    u_char      buf[4096];
+
+    static size_t  size;
+
+    if (size) {
+        return size;
+    }
+
+    size = 2 * 1024 * 1024;
+
+    fd = ngx_open_file("/proc/meminfo", NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        return size;
+    }
+
+    n = read(fd, buf, sizeof(buf) - 1);
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"/proc/meminfo\" failed");
+    }
+
+    if (n <= 0) {
+        return size;
+    }
+
+    buf[n] = '\0';
+
+    p = (u_char *) ngx_strstr(buf, "Hugepagesize:");
+    if (p == NULL) {
+        return size;
+    }
+
+    for (p += sizeof("Hugepagesize:") - 1; *p == ' '; p++) { /* void */ }
+
+    for (last = p; *last >= '0' && *last <= '9'; last++) { /* void */ }
+
+    kb = ngx_atoi(p, last - p);
+
+    if (kb > 0) {
+        size = (size_t) kb * 1024;
+    }
+
+    return size;
+}
+
+#endif
+
+
+#if (NGX_HAVE_MBIND)
+
+/* parses /sys/devices/system/node/online, e.g. "0-1,3" */
+
+static unsigned long
+ngx_shm_numa_nodes(ngx_log_t *log)
+{
+    u_char          *p, *last;
+    ssize_t          n;
+    ngx_fd_t         fd;
+    ngx_int_t        from, to;
+    unsigned long    mask;
+    u_char           buf[256];
+
+    mask = 1;
+
+    fd = ngx_open_file("/sys/devices/system/node/online", NGX_FILE_RDONLY,
+                       NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        return mask;
+    }
+
+    n = read(fd, buf, sizeof(buf) - 1);
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"/sys/devices/system/node/online\" "
+                      "failed");
+    }
+
+    if (n <= 0) {
+        return mask;
+    }
+
+    mask = 0;
+    p = buf;
+    last = buf + n;
+
+    while (p < last) {
+        from = 0;
+
+        while (p < last && *p >= '0' && *p <= '9') {
+            from = from * 10 + (*p++ - '0');
+        }
+
+        to = from;
+
+        if (p < last && *p == '-') {
+            p++;
+            to = 0;
+
+            while (p < last && *p >= '0' && *p <= '9') {
+                to = to * 10 + (*p++ - '0');
+            }
+        }
+
+        while (from <= to && from < (ngx_int_t) (8 * sizeof(unsigned long))) {
+            mask |= 1UL << from++;
+        }
+
+        if (p < last && *p != ',') {
+            break;
+        }
+
+        p++;
+    }
+
+    return mask ? mask : 1;
+}
+
+#endif
+
 #elif (NGX_HAVE_MAP_DEVZERO)
 
 ngx_int_t
@@ -13,12 +13,21 @@
 #include <ngx_core.h>
 
 
+#define NGX_SHM_HUGETLB      0x01
+#define NGX_SHM_THP          0x02
+#define NGX_SHM_PREFAULT     0x04
+#define NGX_SHM_INTERLEAVE   0x08
+#define NGX_SHM_BIND         0x10
+
+
 typedef struct {
     u_char      *addr;
     size_t       size;
     ngx_str_t    name;
     ngx_log_t   *log;
     ngx_uint_t   exists;   /* unsigned  exists:1;  */
+    ngx_uint_t   flags;
+    ngx_uint_t   node;
 } ngx_shm_t;
 
 
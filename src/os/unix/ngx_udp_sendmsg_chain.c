@@ -10,19 +10,35 @@
 #include <ngx_event.h>
 
 
+/* the maximum UDP payload of a segmented send over IPv4 */
+#define NGX_UDP_GSO_MAX_SIZE  65507
+
+
 static ngx_chain_t *ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec,
     ngx_chain_t *in, ngx_log_t *log);
 static ssize_t ngx_sendmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec);
+static ssize_t ngx_sendmsg_batch(ngx_connection_t *c, ngx_iovec_t *vec,
+    ngx_uint_t nvec);
+#if (NGX_HAVE_UDP_SEGMENT)
+static ngx_uint_t ngx_udp_gso_count(ngx_iovec_t *vec, ngx_uint_t nvec);
+static ssize_t ngx_sendmsg_gso(ngx_connection_t *c, ngx_iovec_t *vec,
+    ngx_uint_t nvec);
+#endif
+#if (NGX_HAVE_MMSG)
+static ssize_t ngx_sendmmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec,
+    ngx_uint_t nvec);
+#endif
 
 
 ngx_chain_t *
 ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 {
     ssize_t        n;
-    off_t          send;
-    ngx_chain_t   *cl;
+    off_t          send, size;
+    ngx_uint_t     nvec, max, niovs;
+    ngx_chain_t   *cl, *next;
     ngx_event_t   *wev;
-    ngx_iovec_t    vec;
+    ngx_iovec_t    vec[NGX_UDP_BATCH_MAX];
     struct iovec   iovs[NGX_IOVS_PREALLOCATE];
 
     wev = c->write;
@@ -48,47 +64,95 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
         limit = NGX_MAX_SIZE_T_VALUE - ngx_pagesize;
     }
 
-    send = 0;
+    /* the number of datagrams to collect for a single system call */
+
+    max = 1;
+
+    if (c->listening) {
+#if (NGX_HAVE_MMSG)
+        if (c->listening->udp_batch > 1) {
+            max = c->listening->udp_batch;
+        }
+#endif
+
+#if (NGX_HAVE_UDP_SEGMENT)
+        if (c->listening->udp_gso) {
+            max = NGX_UDP_BATCH_MAX;
+        }
+#endif
+    }
 
-    vec.iovs = iovs;
-    vec.nalloc = NGX_IOVS_PREALLOCATE;
+    send = 0;
 
     for ( ;; ) {
 
-        /* create the iovec and coalesce the neighbouring bufs */
+        /*
+         * create the iovecs and coalesce the neighbouring bufs;
+         * the iovecs of the datagrams in a batch are contiguous
+         */
 
-        cl = ngx_udp_output_chain_to_iovec(&vec, in, c->log);
+        next = in;
+        niovs = 0;
+        size = 0;
 
-        if (cl == NGX_CHAIN_ERROR) {
-            return NGX_CHAIN_ERROR;
-        }
+        for (nvec = 0; nvec < max; /* void */) {
 
-        if (cl && cl->buf->in_file) {
-            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
-                          "file buf in sendmsg "
-                          "t:%d r:%d f:%d %p %p-%p %p %O-%O",
-                          cl->buf->temporary,
-                          cl->buf->recycled,
-                          cl->buf->in_file,
-                          cl->buf->start,
-                          cl->buf->pos,
-                          cl->buf->last,
-                          cl->buf->file,
-                          cl->buf->file_pos,
-                          cl->buf->file_last);
+            vec[nvec].iovs = &iovs[niovs];
+            vec[nvec].nalloc = NGX_IOVS_PREALLOCATE - niovs;
 
-            ngx_debug_point();
+            cl = ngx_udp_output_chain_to_iovec(&vec[nvec], next, c->log);
 
-            return NGX_CHAIN_ERROR;
+            if (cl == NGX_CHAIN_ERROR) {
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (cl && cl->buf->in_file) {
+                ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                              "file buf in sendmsg "
+                              "t:%d r:%d f:%d %p %p-%p %p %O-%O",
+                              cl->buf->temporary,
+                              cl->buf->recycled,
+                              cl->buf->in_file,
+                              cl->buf->start,
+                              cl->buf->pos,
+                              cl->buf->last,
+                              cl->buf->file,
+                              cl->buf->file_pos,
+                              cl->buf->file_last);
+
+                ngx_debug_point();
+
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (cl == next) {
+                break;
+            }
+
+            size += vec[nvec].size;
+            niovs += vec[nvec].count;
+            nvec++;
+
+            next = cl;
+
+            if (next == NULL
+                || send + size >= limit
+                || niovs == NGX_IOVS_PREALLOCATE)
+            {
+                break;
+            }
         }
 
-        if (cl == in) {
+        if (nvec == 0) {
             return in;
         }
 
-        send += vec.size;
+        if (nvec == 1) {
+            n = ngx_sendmsg_vec(c, &vec[0]);
 
-        n = ngx_sendmsg_vec(c, &vec);
+        } else {
+            n = ngx_sendmsg_batch(c, vec, nvec);
+        }
 
         if (n == NGX_ERROR) {
             return NGX_CHAIN_ERROR;
@@ -99,7 +163,14 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
             return in;
         }
 
+        /*
+         * only the datagrams sent are accounted; after a short batch
+         * the rest is sent again, and the next call either sends more,
+         * or reports NGX_AGAIN or the error which stopped the batch
+         */
+
         c->sent += n;
+        send += n;
 
         in = ngx_chain_update_sent(in, n);
 
@@ -166,6 +237,12 @@ ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec, ngx_chain_t *in, ngx_log_t *log)
 
         } else {
             if (n == vec->nalloc) {
+
+                if (vec->nalloc < NGX_IOVS_PREALLOCATE) {
+                    /* no room left in a batch, send the datagram later */
+                    return cl;
+                }
+
                 ngx_log_error(NGX_LOG_ALERT, log, 0,
                               "too many parts in a datagram");
                 return NGX_CHAIN_ERROR;
@@ -240,6 +317,266 @@ ngx_sendmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec)
 }
 
 
+static ssize_t
+ngx_sendmsg_batch(ngx_connection_t *c, ngx_iovec_t *vec, ngx_uint_t nvec)
+{
+#if (NGX_HAVE_UDP_SEGMENT)
+    ssize_t     n;
+    ngx_uint_t  nseg;
+
+    if (c->listening->udp_gso) {
+        nseg = ngx_udp_gso_count(vec, nvec);
+
+        if (nseg > 1) {
+            n = ngx_sendmsg_gso(c, vec, nseg);
+
+            if (n != NGX_DECLINED) {
+                return n;
+            }
+        }
+    }
+#endif
+
+#if (NGX_HAVE_MMSG)
+    if (c->listening->udp_batch > 1) {
+        return ngx_sendmmsg_vec(c, vec,
+                                ngx_min(nvec, c->listening->udp_batch));
+    }
+#endif
+
+    return ngx_sendmsg_vec(c, &vec[0]);
+}
+
+
+#if (NGX_HAVE_UDP_SEGMENT)
+
+static ngx_uint_t
+ngx_udp_gso_count(ngx_iovec_t *vec, ngx_uint_t nvec)
+{
+    size_t      total;
+    ngx_uint_t  i;
+
+    /*
+     * a segmented send consists of the datagrams of the same size,
+     * the last one may be shorter
+     */
+
+    total = 0;
+
+    for (i = 0; i < nvec; i++) {
+
+        if (vec[i].size == 0
+            || vec[i].size > vec[0].size
+            || total + vec[i].size > NGX_UDP_GSO_MAX_SIZE)
+        {
+            break;
+        }
+
+        total += vec[i].size;
+
+        if (vec[i].size < vec[0].size) {
+            return i + 1;
+        }
+    }
+
+    return i;
+}
+
+
+static ssize_t
+ngx_sendmsg_gso(ngx_connection_t *c, ngx_iovec_t *vec, ngx_uint_t nvec)
+{
+    size_t           clen;
+    ssize_t          n;
+    uint16_t        *segment;
+    ngx_err_t        err;
+    ngx_uint_t       i;
+    struct msghdr    msg;
+    struct cmsghdr  *cmsg;
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    u_char           msg_control[CMSG_SPACE(sizeof(uint16_t))
+                                 + CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#else
+    u_char           msg_control[CMSG_SPACE(sizeof(uint16_t))];
+#endif
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+
+    if (c->socklen) {
+        msg.msg_name = c->sockaddr;
+        msg.msg_namelen = c->socklen;
+    }
+
+    /* the iovecs of the datagrams are contiguous */
+
+    msg.msg_iov = vec[0].iovs;
+    msg.msg_iovlen = 0;
+
+    for (i = 0; i < nvec; i++) {
+        msg.msg_iovlen += vec[i].count;
+    }
+
+    msg.msg_control = msg_control;
+    msg.msg_controllen = sizeof(msg_control);
+    ngx_memzero(msg_control, sizeof(msg_control));
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+    segment = (uint16_t *) CMSG_DATA(cmsg);
+    *segment = (uint16_t) vec[0].size;
+
+    clen = CMSG_SPACE(sizeof(uint16_t));
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    if (c->listening && c->listening->wildcard && c->local_sockaddr) {
+        cmsg = CMSG_NXTHDR(&msg, cmsg);
+        clen += ngx_set_srcaddr_cmsg(cmsg, c->local_sockaddr);
+    }
+#endif
+
+    msg.msg_controllen = clen;
+
+eintr:
+
+    n = sendmsg(c->fd, &msg, 0);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() was interrupted");
+            goto eintr;
+
+        case NGX_EINVAL:
+        case EIO:
+
+            /*
+             * the segment does not fit into the path MTU,
+             * or the device cannot offload the checksum
+             */
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmsg() with UDP_SEGMENT failed");
+            return NGX_DECLINED;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmsg: %z, %ui segments of %uz", n, nvec, vec[0].size);
+
+    return n;
+}
+
+#endif
+
+
+#if (NGX_HAVE_MMSG)
+
+static ssize_t
+ngx_sendmmsg_vec(ngx_connection_t *c, ngx_iovec_t *vec, ngx_uint_t nvec)
+{
+    int              n;
+    ssize_t          sent;
+    ngx_err_t        err;
+    ngx_uint_t       i;
+    struct mmsghdr   msgs[NGX_UDP_BATCH_MAX];
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+    struct msghdr   *msg;
+    struct cmsghdr  *cmsg;
+    u_char           msg_control[NGX_UDP_BATCH_MAX]
+                                [CMSG_SPACE(sizeof(ngx_addrinfo_t))];
+#endif
+
+    for (i = 0; i < nvec; i++) {
+        ngx_memzero(&msgs[i], sizeof(struct mmsghdr));
+
+        if (c->socklen) {
+            msgs[i].msg_hdr.msg_name = c->sockaddr;
+            msgs[i].msg_hdr.msg_namelen = c->socklen;
+        }
+
+        msgs[i].msg_hdr.msg_iov = vec[i].iovs;
+        msgs[i].msg_hdr.msg_iovlen = vec[i].count;
+
+#if (NGX_HAVE_ADDRINFO_CMSG)
+        if (c->listening && c->listening->wildcard && c->local_sockaddr) {
+
+            msg = &msgs[i].msg_hdr;
+
+            msg->msg_control = msg_control[i];
+            msg->msg_controllen = sizeof(msg_control[i]);
+            ngx_memzero(msg_control[i], sizeof(msg_control[i]));
+
+            cmsg = CMSG_FIRSTHDR(msg);
+
+            msg->msg_controllen = ngx_set_srcaddr_cmsg(cmsg, c->local_sockaddr);
+        }
+#endif
+    }
+
+eintr:
+
+    n = sendmmsg(c->fd, msgs, nvec, 0);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() was interrupted");
+            goto eintr;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    /*
+     * a short count means the next datagram would block or fail,
+     * the error itself is only reported by the next call
+     */
+
+    sent = 0;
+
+    for (i = 0; i < (ngx_uint_t) n; i++) {
+        sent += msgs[i].msg_len;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmmsg: %d of %ui, %z bytes", n, nvec, sent);
+
+    return sent;
+}
+
+#endif
+
+
 #if (NGX_HAVE_ADDRINFO_CMSG)
 
 size_t
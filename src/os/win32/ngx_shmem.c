@@ -132,82 +132,6 @@ ngx_shm_alloc(ngx_shm_t *shm)
     return NGX_ERROR;
 }
 
-{
-    u_char         *name;
-    uint64_t        size;
-    static u_char  *base = (u_char *) NGX_SHMEM_BASE;
-
-    name = ngx_alloc(shm->name.len + 2 + NGX_INT32_LEN, shm->log);
-    if (name == NULL) {
-        return NGX_ERROR;
-    }
-
-    (void) ngx_sprintf(name, "%V_%s%Z", &shm->name, ngx_unique);
-
-    ngx_set_errno(0);
-
-    size = shm->size;
-
-    shm->handle = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
-                                    (u_long) (size >> 32),
-                                    (u_long) (size & 0xffffffff),
-                                    (char *) name);
-
-    if (shm->handle == NULL) {
-        ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                      "CreateFileMapping(%uz, %s) failed",
-                      shm->size, name);
-        ngx_free(name);
-
-        return NGX_ERROR;
-    }
-
-    ngx_free(name);
-
-    if (ngx_errno == ERROR_ALREADY_EXISTS) {
-        shm->exists = 1;
-    }
-
-    shm->addr = MapViewOfFileEx(shm->handle, FILE_MAP_WRITE, 0, 0, 0, base);
-
-    if (shm->addr != NULL) {
-        base += ngx_align(size, ngx_allocation_granularity);
-        return NGX_OK;
-    }
-
-    ngx_log_debug3(NGX_LOG_DEBUG_CORE, shm->log, ngx_errno,
-                   "MapViewOfFileEx(%uz, %p) of file mapping \"%V\" failed, "
-                   "retry without a base address",
-                   shm->size, base, &shm->name);
-
-    /*
-     * Order of shared memory zones may be different in the master process
-     * and worker processes after reconfiguration.  As a result, the above
-     * may fail due to a conflict with a previously created mapping remapped
-     * to a different address.  Additionally, there may be a conflict with
-     * some other uses of the memory.  In this case we retry without a base
-     * address to let the system assign the address itself.
-     */
-
-    shm->addr = MapViewOfFile(shm->handle, FILE_MAP_WRITE, 0, 0, 0);
-
-    if (shm->addr != NULL) {
-        return NGX_OK;
-    }
-
-    ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                  "MapViewOfFile(%uz) of file mapping \"%V\" failed",
-                  shm->size, &shm->name);
-
-    if (CloseHandle(shm->handle) == 0) {
-        ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                      "CloseHandle() of file mapping \"%V\" failed",
-                      &shm->name);
-    }
-
-    return NGX_ERROR;
-}
-
 
 ngx_int_t
 ngx_shm_remap(ngx_shm_t *shm, u_char *addr)
@@ -13,6 +13,13 @@
 #include <ngx_core.h>
 
 
+#define NGX_SHM_HUGETLB      0x01
+#define NGX_SHM_THP          0x02
+#define NGX_SHM_PREFAULT     0x04
+#define NGX_SHM_INTERLEAVE   0x08
+#define NGX_SHM_BIND         0x10
+
+
 typedef struct {
     u_char      *addr;
     size_t       size;
@@ -20,6 +27,8 @@ typedef struct {
     HANDLE       handle;
     ngx_log_t   *log;
     ngx_uint_t   exists;   /* unsigned  exists:1;  */
+    ngx_uint_t   flags;    /* not used */
+    ngx_uint_t   node;     /* not used */
 } ngx_shm_t;
 
 
@@ -514,6 +514,14 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports)
             ls->fastopen = addr[i].opt.fastopen;
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+            ls->busy_poll = addr[i].opt.busy_poll;
+            ls->prefer_busy_poll = addr[i].opt.prefer_busy_poll;
+#endif
+
+            ls->udp_batch = addr[i].opt.batch;
+            ls->udp_gso = addr[i].opt.gso;
+
 #if (NGX_HAVE_REUSEPORT)
             ls->reuseport = addr[i].opt.reuseport;
 #endif
@@ -57,6 +57,7 @@ typedef struct {
     unsigned                       reuseport:1;
     unsigned                       so_keepalive:2;
     unsigned                       proxy_protocol:1;
+    unsigned                       gso:1;
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
     int                            tcp_keepidle;
     int                            tcp_keepintvl;
@@ -68,6 +69,11 @@ typedef struct {
 #if (NGX_HAVE_TCP_FASTOPEN)
     int                            fastopen;
 #endif
+#if (NGX_HAVE_BUSY_POLL)
+    int                            busy_poll;
+    unsigned                       prefer_busy_poll:1;
+#endif
+    int                            batch;
     int                            type;
 } ngx_stream_listen_t;
 
@@ -280,7 +286,8 @@ typedef struct {
         NULL)
 
 
-#define NGX_STREAM_WRITE_BUFFERED  0x10
+#define NGX_STREAM_WRITE_BUFFERED   0x10
+#define NGX_STREAM_SPLICE_BUFFERED  0x20
 
 
 void ngx_stream_core_run_phases(ngx_stream_session_t *s);
@@ -306,6 +313,10 @@ typedef ngx_int_t (*ngx_stream_filter_pt)(ngx_stream_session_t *s,
     ngx_chain_t *chain, ngx_uint_t from_upstream);
 
 
+ngx_int_t ngx_stream_write_filter(ngx_stream_session_t *s, ngx_chain_t *in,
+    ngx_uint_t from_upstream);
+
+
 extern ngx_stream_filter_pt  ngx_stream_top_filter;
 
 
@@ -619,6 +619,10 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ls->fastopen = -1;
 #endif
 
+#if (NGX_HAVE_BUSY_POLL)
+    ls->busy_poll = -1;
+#endif
+
 #if (NGX_HAVE_INET6)
     ls->ipv6only = 1;
 #endif
@@ -654,6 +658,36 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         }
 #endif
 
+        if (ngx_strncmp(value[i].data, "busy_poll=", 10) == 0) {
+#if (NGX_HAVE_BUSY_POLL)
+            ls->busy_poll = ngx_atoi(value[i].data + 10, value[i].len - 10);
+            ls->bind = 1;
+
+            if (ls->busy_poll == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid busy_poll \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "busy_poll is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "prefer_busy_poll") == 0) {
+#if (NGX_HAVE_BUSY_POLL && defined SO_PREFER_BUSY_POLL)
+            ls->prefer_busy_poll = 1;
+            ls->bind = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "prefer_busy_poll is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "backlog=", 8) == 0) {
             ls->backlog = ngx_atoi(value[i].data + 8, value[i].len - 8);
             ls->bind = 1;
@@ -738,6 +772,36 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "batch=", 6) == 0) {
+#if (NGX_HAVE_MMSG)
+            ls->batch = ngx_atoi(value[i].data + 6, value[i].len - 6);
+
+            if (ls->batch == NGX_ERROR || ls->batch == 0
+                || ls->batch > NGX_UDP_BATCH_MAX)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid batch \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "batch is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "gso") == 0) {
+#if (NGX_HAVE_UDP_SEGMENT)
+            ls->gso = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "gso is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strcmp(value[i].data, "ssl") == 0) {
 #if (NGX_STREAM_SSL)
             ngx_stream_ssl_conf_t  *sslcf;
@@ -884,6 +948,15 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             return "\"fastopen\" parameter is incompatible with \"udp\"";
         }
 #endif
+
+    } else {
+        if (ls->batch) {
+            return "\"batch\" parameter requires \"udp\"";
+        }
+
+        if (ls->gso) {
+            return "\"gso\" parameter requires \"udp\"";
+        }
     }
 
     for (n = 0; n < u.naddrs; n++) {
@@ -32,6 +32,7 @@ typedef struct {
     ngx_flag_t                       next_upstream;
     ngx_flag_t                       proxy_protocol;
     ngx_flag_t                       half_close;
+    ngx_flag_t                       splice;
     ngx_stream_upstream_local_t     *local;
     ngx_flag_t                       socket_keepalive;
 
@@ -78,6 +79,10 @@ static void ngx_stream_proxy_process(ngx_stream_session_t *s,
     ngx_uint_t from_upstream, ngx_uint_t do_write);
 static ngx_int_t ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
     ngx_uint_t from_upstream);
+#if (NGX_HAVE_SPLICE)
+static ngx_linux_splice_t *ngx_stream_proxy_splice_pipe(
+    ngx_stream_session_t *s, ngx_uint_t from_upstream);
+#endif
 static void ngx_stream_proxy_next_upstream(ngx_stream_session_t *s);
 static void ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc);
 static u_char *ngx_stream_proxy_log_error(ngx_log_t *log, u_char *buf,
@@ -255,6 +260,13 @@ static ngx_command_t  ngx_stream_proxy_commands[] = {
       offsetof(ngx_stream_proxy_srv_conf_t, half_close),
       NULL },
 
+    { ngx_string("proxy_splice"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_proxy_srv_conf_t, splice),
+      NULL },
+
 #if (NGX_STREAM_SSL)
 
     { ngx_string("proxy_ssl"),
@@ -1601,6 +1613,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
     ngx_log_handler_pt            handler;
     ngx_stream_upstream_t        *u;
     ngx_stream_proxy_srv_conf_t  *pscf;
+#if (NGX_HAVE_SPLICE)
+    ngx_linux_splice_t           *sp;
+#endif
 
     u = s->upstream;
 
@@ -1649,31 +1664,54 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         send_action = "proxying and sending to upstream";
     }
 
+#if (NGX_HAVE_SPLICE)
+    sp = ngx_stream_proxy_splice_pipe(s, from_upstream);
+#endif
+
     for ( ;; ) {
 
-        if (do_write && dst) {
+#if (NGX_HAVE_SPLICE)
 
-            if (*out || *busy || dst->buffered) {
+        if (sp) {
+            if (do_write && sp->size) {
                 c->log->action = send_action;
 
-                rc = ngx_stream_top_filter(s, *out, from_upstream);
-
-                if (rc == NGX_ERROR) {
+                if (ngx_linux_splice_send(dst, sp) == NGX_ERROR) {
                     ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
                     return;
                 }
+            }
+
+            size = sp->capacity - sp->size;
 
-                ngx_chain_update_chains(c->pool, &u->free, busy, out,
+        } else
+
+#endif
+        {
+            if (do_write && dst) {
+
+                if (*out || *busy || dst->buffered) {
+                    c->log->action = send_action;
+
+                    rc = ngx_stream_top_filter(s, *out, from_upstream);
+
+                    if (rc == NGX_ERROR) {
+                        ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                        return;
+                    }
+
+                    ngx_chain_update_chains(c->pool, &u->free, busy, out,
                                       (ngx_buf_tag_t) &ngx_stream_proxy_module);
 
-                if (*busy == NULL) {
-                    b->pos = b->start;
-                    b->last = b->start;
+                    if (*busy == NULL) {
+                        b->pos = b->start;
+                        b->last = b->start;
+                    }
                 }
             }
-        }
 
-        size = b->end - b->last;
+            size = b->end - b->last;
+        }
 
         if (size && src->read->ready && !src->read->delayed) {
 
@@ -1695,7 +1733,15 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
             c->log->action = recv_action;
 
-            n = src->recv(src, b->last, size);
+#if (NGX_HAVE_SPLICE)
+            if (sp) {
+                n = ngx_linux_splice_recv(src, sp, size);
+
+            } else
+#endif
+            {
+                n = src->recv(src, b->last, size);
+            }
 
             if (n == NGX_AGAIN) {
                 break;
@@ -1723,6 +1769,16 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
                     }
                 }
 
+#if (NGX_HAVE_SPLICE)
+                if (sp) {
+                    (*packets)++;
+                    *received += n;
+                    do_write = 1;
+
+                    continue;
+                }
+#endif
+
                 for (ll = out; *ll; ll = &(*ll)->next) { /* void */ }
 
                 cl = ngx_chain_get_free_buf(c->pool, &u->free);
@@ -1756,6 +1812,17 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
     c->log->action = "proxying connection";
 
+#if (NGX_HAVE_SPLICE)
+    if (sp) {
+        if (sp->size) {
+            dst->buffered |= NGX_STREAM_SPLICE_BUFFERED;
+
+        } else {
+            dst->buffered &= ~NGX_STREAM_SPLICE_BUFFERED;
+        }
+    }
+#endif
+
     if (ngx_stream_proxy_test_finalize(s, from_upstream) == NGX_OK) {
         return;
     }
@@ -1889,6 +1956,93 @@ ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+/*
+ * 纯 TCP 转发时数据经内核管道直接在两个套接字之间移动；
+ * 使用 SSL、有其他 stream 过滤模块或用户空间缓冲区中
+ * 仍有数据（例如预读的数据、PROXY 协议头）时使用普通转发
+ */
+
+static ngx_linux_splice_t *
+ngx_stream_proxy_splice_pipe(ngx_stream_session_t *s, ngx_uint_t from_upstream)
+{
+    ngx_buf_t                    *b;
+    ngx_chain_t                  *out, *busy;
+    ngx_connection_t             *c, *pc, *dst;
+    ngx_linux_splice_t          **sp;
+    ngx_stream_upstream_t        *u;
+    ngx_stream_proxy_srv_conf_t  *pscf;
+
+    u = s->upstream;
+
+    sp = from_upstream ? &u->upstream_pipe : &u->downstream_pipe;
+
+    if (*sp) {
+        return *sp;
+    }
+
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    c = s->connection;
+
+    if (!pscf->splice
+        || u->splice_failed
+        || !u->connected
+        || c->type != SOCK_STREAM
+        || ngx_stream_top_filter != ngx_stream_write_filter)
+    {
+        return NULL;
+    }
+
+    /* io_uring may read from the socket on its own */
+
+    if (ngx_event_flags & NGX_USE_IO_URING_EVENT) {
+        return NULL;
+    }
+
+    pc = u->peer.connection;
+
+#if (NGX_SSL)
+    if (c->ssl || pc->ssl) {
+        return NULL;
+    }
+#endif
+
+    if (from_upstream) {
+        dst = c;
+        b = &u->upstream_buf;
+        out = u->downstream_out;
+        busy = u->downstream_busy;
+
+    } else {
+        dst = pc;
+        b = &u->downstream_buf;
+        out = u->upstream_out;
+        busy = u->upstream_busy;
+    }
+
+    if (out || busy || dst->buffered || b->pos != b->last) {
+        return NULL;
+    }
+
+    *sp = ngx_linux_splice_create(c->pool, pscf->buffer_size, c->log);
+
+    if (*sp == NULL) {
+        u->splice_failed = 1;
+        return NULL;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                   "stream proxy splice %s",
+                   from_upstream ? "from upstream" : "to upstream");
+
+    return *sp;
+}
+
+#endif
+
+
 static void
 ngx_stream_proxy_next_upstream(ngx_stream_session_t *s)
 {
@@ -2091,6 +2245,7 @@ ngx_stream_proxy_create_srv_conf(ngx_conf_t *cf)
     conf->local = NGX_CONF_UNSET_PTR;
     conf->socket_keepalive = NGX_CONF_UNSET;
     conf->half_close = NGX_CONF_UNSET;
+    conf->splice = NGX_CONF_UNSET;
 
 #if (NGX_STREAM_SSL)
     conf->ssl_enable = NGX_CONF_UNSET;
@@ -2151,6 +2306,8 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_value(conf->half_close, prev->half_close, 0);
 
+    ngx_conf_merge_value(conf->splice, prev->splice, 0);
+
 #if (NGX_STREAM_SSL)
 
     if (ngx_stream_proxy_merge_ssl(cf, conf, prev) != NGX_OK) {